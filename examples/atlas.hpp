@@ -0,0 +1,410 @@
+//
+// Texture Atlas Library
+//
+// Packs many small images into a few large pages, so they can be
+// drawn from one texture without rebinding. Rectangles are placed
+// with a skyline packer, which allocates incrementally at runtime in
+// time linear in the length of the skyline.
+//
+// Every image is surrounded by padding filled with copies of its
+// edge pixels, so bilinear filtering and the first mipmap levels do
+// not bleed in neighbouring images.
+//
+
+#pragma once
+
+// CUSTOM
+#include "images.hpp"
+
+// STANDARD
+#include <algorithm>
+#include <memory>
+#include <string.h>
+#include <vector>
+
+
+namespace Atlases
+{
+    typedef struct {
+        int x;
+        int y;
+        int width;
+        int height;
+    } _rect_t;
+
+
+    // --- PACKER --- //
+
+    class SkylinePacker
+    {
+    private:
+        // a horizontal segment of the top edge of the packed area
+        typedef struct {
+            int x;
+            int y;
+            int width;
+        } _segment_t;
+
+        int _width;
+        int _height;
+        long _used_area = 0;
+        std::vector<_segment_t> _skyline;
+
+        // the height a `width' wide rectangle would be placed at when
+        // its left edge is at segment `index', or -1 if it does not fit
+        int fitAt(size_t index, int width, int height)
+        {
+            int x = _skyline[index].x;
+            if(x + width > _width) {
+                return -1;
+            }
+            int y = 0;
+            for(size_t i = index; i < _skyline.size() && _skyline[i].x < x + width; i++) {
+                y = std::max(y, _skyline[i].y);
+            }
+            if(y + height > _height) {
+                return -1;
+            }
+            return y;
+        }
+
+        void place(size_t index, const _rect_t& rect)
+        {
+            _segment_t segment = {rect.x, rect.y + rect.height, rect.width};
+            _skyline.insert(_skyline.begin() + index, segment);
+
+            // cut off the segments now below the rectangle
+            int right = rect.x + rect.width;
+            size_t i = index + 1;
+            while(i < _skyline.size() && _skyline[i].x < right)
+            {
+                int overlap = right - _skyline[i].x;
+                if(overlap < _skyline[i].width)
+                {
+                    _skyline[i].x += overlap;
+                    _skyline[i].width -= overlap;
+                    break;
+                }
+                _skyline.erase(_skyline.begin() + i);
+            }
+
+            // merge neighbours at the same height
+            for(size_t j = (index > 0) ? index - 1 : 0; j + 1 < _skyline.size() && j <= index + 1; )
+            {
+                if(_skyline[j].y == _skyline[j + 1].y)
+                {
+                    _skyline[j].width += _skyline[j + 1].width;
+                    _skyline.erase(_skyline.begin() + j + 1);
+                }
+                else {
+                    j++;
+                }
+            }
+        }
+
+    public:
+        SkylinePacker(int width, int height)
+            : _width(width), _height(height)
+        {
+            Clear();
+        }
+
+        void Clear()
+        {
+            _skyline.clear();
+            _segment_t floor = {0, 0, _width};
+            _skyline.push_back(floor);
+            _used_area = 0;
+        }
+
+        // find room for a `width' by `height' rectangle, choosing the
+        // lowest top edge, then the narrowest segment (best fit).
+        // Returns false if it does not fit.
+        bool Insert(int width, int height, _rect_t& rect)
+        {
+            int best_top = _height + 1;
+            int best_width = _width + 1;
+            size_t best_index = 0;
+            for(size_t i = 0; i < _skyline.size(); i++)
+            {
+                int y = fitAt(i, width, height);
+                if(y < 0) {
+                    continue;
+                }
+                if(y + height < best_top ||
+                   (y + height == best_top && _skyline[i].width < best_width))
+                {
+                    best_top = y + height;
+                    best_width = _skyline[i].width;
+                    best_index = i;
+                    rect.x = _skyline[i].x;
+                    rect.y = y;
+                }
+            }
+            if(best_top > _height) {
+                return false;
+            }
+
+            rect.width = width;
+            rect.height = height;
+            place(best_index, rect);
+            _used_area += (long)width * height;
+            return true;
+        }
+
+        // fraction of the page covered by rectangles
+        double GetOccupancy()
+        {
+            return (double)_used_area / ((double)_width * _height);
+        }
+
+        long GetUsedArea()
+        {
+            return _used_area;
+        }
+
+        // height of the highest rectangle, i.e. the rows in use
+        int GetUsedHeight()
+        {
+            int height = 0;
+            for(const _segment_t& segment : _skyline) {
+                height = std::max(height, segment.y);
+            }
+            return height;
+        }
+
+        int GetWidth()
+        {
+            return _width;
+        }
+
+        int GetHeight()
+        {
+            return _height;
+        }
+    };
+
+
+    // --- ATLAS --- //
+
+    // where an image ended up, with texture coordinates of its corners
+    typedef struct {
+        int page;
+        _rect_t rect;  // the image, without padding, in pixels
+        float u0, v0, u1, v1;
+    } _atlas_entry_t;
+
+    typedef int _atlas_handle_t;
+
+    const _atlas_handle_t ATLAS_HANDLE_INVALID = -1;
+
+    // copy `image' into `page' at `rect', extruding its edge pixels
+    // `padding' pixels outwards
+    inline void blitExtruded(const Images::Image& image, Images::Image& page,
+                             const _rect_t& rect, int padding)
+    {
+        int channels = page.channels;
+        size_t row = Images::getRowSize(page);
+        for(int y = -padding; y < image.height + padding; y++)
+        {
+            int sy = std::min(std::max(y, 0), image.height - 1);
+            const unsigned char* src = &image.pixels[sy * Images::getRowSize(image)];
+            unsigned char* dst = &page.pixels[(rect.y + y) * row + rect.x * channels];
+
+            if(image.channels == channels) {
+                memcpy(dst, src, (size_t)image.width * channels);
+            }
+            else
+            {
+                // grey and RGB images are expanded, with opaque alpha
+                for(int x = 0; x < image.width; x++)
+                {
+                    for(int c = 0; c < channels; c++)
+                    {
+                        int sc = (image.channels == 1) ? 0 : std::min(c, image.channels - 1);
+                        dst[x * channels + c] = (c == 3 && image.channels < 4)
+                            ? 255 : src[x * image.channels + sc];
+                    }
+                }
+            }
+
+            unsigned char* left = dst;
+            unsigned char* right = dst + (size_t)(image.width - 1) * channels;
+            for(int x = 1; x <= padding; x++)
+            {
+                memcpy(left - x * channels, left, channels);
+                memcpy(right + x * channels, right, channels);
+            }
+        }
+    }
+
+    class Atlas
+    {
+    private:
+        typedef struct {
+            Images::Image image;
+            SkylinePacker packer;
+            _rect_t dirty;  // changed since the last `GetDirty'
+        } _page_t;
+
+        int _size;
+        int _channels;
+        int _padding;
+        int _alignment;
+        int _max_pages;
+        // by pointer, so that the images stay in place when pages are
+        // added, and `GetPage' references remain valid
+        std::vector<std::unique_ptr<_page_t>> _pages;
+        std::vector<_atlas_entry_t> _entries;
+
+        static int alignUp(int value, int alignment)
+        {
+            return (value + alignment - 1) / alignment * alignment;
+        }
+
+        static void addDirty(_rect_t& dirty, const _rect_t& rect)
+        {
+            if(dirty.width == 0)
+            {
+                dirty = rect;
+                return;
+            }
+            int x1 = std::max(dirty.x + dirty.width, rect.x + rect.width);
+            int y1 = std::max(dirty.y + dirty.height, rect.y + rect.height);
+            dirty.x = std::min(dirty.x, rect.x);
+            dirty.y = std::min(dirty.y, rect.y);
+            dirty.width = x1 - dirty.x;
+            dirty.height = y1 - dirty.y;
+        }
+
+        void addPage()
+        {
+            _pages.emplace_back(new _page_t{Images::Image(), SkylinePacker(_size, _size),
+                                            {0, 0, 0, 0}});
+            Images::Image& image = _pages.back()->image;
+            image.width = _size;
+            image.height = _size;
+            image.channels = _channels;
+            image.pixels.assign((size_t)_size * _size * _channels, 0);
+        }
+
+    public:
+        // pages of `size' by `size' pixels with 1, 3 or 4 channels.
+        // For clean mipmaps down to level n, use a `padding' and an
+        // `alignment' of 2^n pixels.
+        Atlas(int size, int channels = 4, int padding = 1, int alignment = 1,
+              int max_pages = 16)
+            : _size(size), _channels(channels), _padding(padding),
+              _alignment(std::max(alignment, 1)), _max_pages(max_pages)
+        {
+        }
+
+        // pack `image', adding a page if the others are full.
+        // Returns ATLAS_HANDLE_INVALID if it is larger than a page or
+        // all pages are in use.
+        _atlas_handle_t Add(const Images::Image& image)
+        {
+            int width = alignUp(image.width + 2 * _padding, _alignment);
+            int height = alignUp(image.height + 2 * _padding, _alignment);
+            if(image.width <= 0 || image.height <= 0 || width > _size || height > _size) {
+                return ATLAS_HANDLE_INVALID;
+            }
+
+            _rect_t rect;
+            size_t page = 0;
+            while(page < _pages.size() && !_pages[page]->packer.Insert(width, height, rect)) {
+                page++;
+            }
+            if(page == _pages.size())
+            {
+                if((int)_pages.size() == _max_pages) {
+                    return ATLAS_HANDLE_INVALID;
+                }
+                addPage();
+                _pages[page]->packer.Insert(width, height, rect);
+            }
+
+            _atlas_entry_t entry;
+            entry.page = page;
+            entry.rect.x = rect.x + _padding;
+            entry.rect.y = rect.y + _padding;
+            entry.rect.width = image.width;
+            entry.rect.height = image.height;
+            entry.u0 = (float)entry.rect.x / _size;
+            entry.v0 = (float)entry.rect.y / _size;
+            entry.u1 = (float)(entry.rect.x + image.width) / _size;
+            entry.v1 = (float)(entry.rect.y + image.height) / _size;
+
+            blitExtruded(image, _pages[page]->image, entry.rect, _padding);
+            addDirty(_pages[page]->dirty, rect);
+
+            _entries.push_back(entry);
+            return _entries.size() - 1;
+        }
+
+        const _atlas_entry_t& Get(_atlas_handle_t handle)
+        {
+            return _entries[handle];
+        }
+
+        // map texture coordinates in [0, 1] of the original image to
+        // coordinates in its page
+        void RemapUV(_atlas_handle_t handle, float& u, float& v)
+        {
+            const _atlas_entry_t& entry = _entries[handle];
+            u = entry.u0 + u * (entry.u1 - entry.u0);
+            v = entry.v0 + v * (entry.v1 - entry.v0);
+        }
+
+        // the bounds of everything added to `page' since the last call,
+        // to upload only that part. Returns false if nothing changed.
+        bool GetDirty(int page, _rect_t& rect)
+        {
+            rect = _pages[page]->dirty;
+            _pages[page]->dirty.width = 0;
+            _pages[page]->dirty.height = 0;
+            return rect.width > 0;
+        }
+
+        const Images::Image& GetPage(int page)
+        {
+            return _pages[page]->image;
+        }
+
+        // fraction of the pages covered by images, including padding
+        double GetOccupancy()
+        {
+            double sum = 0.0;
+            for(std::unique_ptr<_page_t>& page : _pages) {
+                sum += page->packer.GetOccupancy();
+            }
+            return _pages.empty() ? 0.0 : sum / _pages.size();
+        }
+
+        int GetPageCount()
+        {
+            return _pages.size();
+        }
+
+        int GetMaxPages()
+        {
+            return _max_pages;
+        }
+
+        int GetSize()
+        {
+            return _size;
+        }
+
+        int GetChannels()
+        {
+            return _channels;
+        }
+
+        size_t Size()
+        {
+            return _entries.size();
+        }
+    };
+
+} // namespace Atlases
@@ -0,0 +1,116 @@
+// Packing time and occupancy of the skyline packer for 10k
+// rectangles, inserted one at a time as at runtime, and sorted by
+// height first as an offline atlas builder would.
+
+#include "atlas.hpp"
+#include "benchmark.hpp"
+
+#include <algorithm>
+#include <random>
+#include <vector>
+
+const int RECTS = 10000;
+const int PAGE_SIZE = 2048;
+const int PADDING = 1;
+const int ITERATIONS = 20;
+
+typedef struct {
+    int width;
+    int height;
+} _size_t;
+
+// pack all `sizes' into as many pages as needed. Occupancy is
+// relative to the rows in use, so a half full last page counts as such.
+void pack(const std::vector<_size_t>& sizes, int& pages, double& occupancy)
+{
+    std::vector<Atlases::SkylinePacker> packers;
+    for(const _size_t& size : sizes)
+    {
+        Atlases::_rect_t rect;
+        int width = size.width + 2 * PADDING;
+        int height = size.height + 2 * PADDING;
+        size_t i = 0;
+        while(i < packers.size() && !packers[i].Insert(width, height, rect)) {
+            i++;
+        }
+        if(i == packers.size())
+        {
+            packers.push_back(Atlases::SkylinePacker(PAGE_SIZE, PAGE_SIZE));
+            packers.back().Insert(width, height, rect);
+        }
+    }
+
+    long used = 0;
+    long area = 0;
+    for(Atlases::SkylinePacker& packer : packers)
+    {
+        used += packer.GetUsedArea();
+        area += (long)packer.GetWidth() * packer.GetUsedHeight();
+    }
+    pages = packers.size();
+    occupancy = (double)used / area;
+}
+
+void run(const char* name, const std::vector<_size_t>& sizes)
+{
+    int pages = 0;
+    double occupancy = 0.0;
+    Benchmark::measure(name, ITERATIONS, sizes.size(), [&]() {
+        pack(sizes, pages, occupancy);
+    });
+    std::cout << "    " << pages << " pages, " << (int)(occupancy * 100.0 + 0.5)
+              << "% occupancy" << std::endl;
+}
+
+int main()
+{
+    std::cout << RECTS << " rectangles, " << PAGE_SIZE << "x" << PAGE_SIZE
+              << " pages, " << PADDING << " pixel padding" << std::endl;
+
+    std::mt19937 random(1);
+    std::vector<_size_t> uniform(RECTS);
+    for(_size_t& size : uniform) {
+        size = {8 + (int)(random() % 57), 8 + (int)(random() % 57)};
+    }
+
+    // mostly small icons and glyphs, with a few large images
+    std::vector<_size_t> mixed(RECTS);
+    for(_size_t& size : mixed)
+    {
+        int scale = (random() % 20 == 0) ? 256 : 32;
+        size = {4 + (int)(random() % scale), 4 + (int)(random() % scale)};
+    }
+
+    auto byHeight = [](const _size_t& a, const _size_t& b) {
+        return a.height > b.height || (a.height == b.height && a.width > b.width);
+    };
+
+    run("uniform 8-64, incremental", uniform);
+    std::sort(uniform.begin(), uniform.end(), byHeight);
+    run("uniform 8-64, sorted", uniform);
+
+    run("mixed, incremental", mixed);
+    std::sort(mixed.begin(), mixed.end(), byHeight);
+    run("mixed, sorted", mixed);
+
+    // insertion with the copy and extrusion of the pixels
+    std::vector<Images::Image> images(256);
+    for(Images::Image& image : images)
+    {
+        image.width = 8 + random() % 57;
+        image.height = 8 + random() % 57;
+        image.channels = 4;
+        image.pixels.assign((size_t)image.width * image.height * 4, 128);
+    }
+    int pages = 0;
+    Benchmark::measure("atlas add with extrusion", ITERATIONS, RECTS, [&]() {
+        Atlases::Atlas atlas(PAGE_SIZE, 4, PADDING);
+        for(int i = 0; i < RECTS; i++) {
+            atlas.Add(images[i % images.size()]);
+        }
+        pages = atlas.GetPageCount();
+    });
+    std::cout << "    " << pages << " pages" << std::endl;
+
+    return 0;
+}
@@ -0,0 +1,136 @@
+// Frame capture cost: the same scene is rendered without capturing,
+// with a synchronous `glReadPixels' every frame, and with the
+// asynchronous capture of capture.hpp writing a Y4M video (or a PPM
+// sequence). The asynchronous capture should only add a small part of
+// the frame time, and the time it spends on the rendering thread is
+// reported on its own. On a software rasterizer the readback waits
+// for the rendering, so that time includes the rendering as well.
+// Usage: bench_capture [frames] [ppm]
+
+#include "windows.hpp"
+#include "buffers.hpp"
+#include "capture.hpp"
+#include "benchmark.hpp"
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <cstdlib>
+#include <random>
+#include <string.h>
+#include <vector>
+
+const int OBJECTS = 2000;
+
+struct Vertex {
+    glm::vec2 vertexPos;
+    glm::vec3 vertexCol;
+};
+typedef Buffers::VertexLayout<Vertex, &Vertex::vertexPos, &Vertex::vertexCol> VertexLayout;
+
+int main(int argc, char** argv)
+{
+    int frames = (argc > 1) ? atoi(argv[1]) : 120;
+    bool ppm = (argc > 2) && strcmp(argv[2], "ppm") == 0;
+
+    Windows::DefaultWindow window("Capture benchmark", 640, Windows::ASPECT_RATIO_16_9);
+    glfwSwapInterval(0);
+    int width = window.GetWidth();
+    int height = window.GetHeight();
+
+    Shaders::ShaderWrapper shader("shaderCommands", Shaders::SHADERS_VF);
+    Shaders::_uniform_handle_t transform = shader.GetUniformHandle("transform");
+    Shaders::_uniform_handle_t tint = shader.GetUniformHandle("tint");
+
+    Vertex vertexData[] = {
+        {{-1.0f, -1.0f},  {1.0f, 0.0f, 0.0f}},
+        {{1.0f, -1.0f},   {0.0f, 1.0f, 0.0f}},
+        {{0.0f, 1.0f},    {0.0f, 0.0f, 1.0f}}
+    };
+    Buffers::Mesh<VertexLayout> mesh(vertexData, 3);
+
+    std::mt19937 random(1);
+    std::uniform_real_distribution<float> uniform(-1.0f, 1.0f);
+    std::vector<glm::vec3> positions(OBJECTS);
+    for(glm::vec3& position : positions) {
+        position = glm::vec3(uniform(random), uniform(random), 0.0f);
+    }
+
+    float time = 0.0f;
+    auto render = [&]() {
+        glClear(GL_COLOR_BUFFER_BIT);
+        shader.Activate();
+        States::bindVertexArray(mesh.GetVertexArray());
+        for(int i = 0; i < OBJECTS; i++)
+        {
+            glm::mat4 model = glm::translate(glm::mat4(1.0f), positions[i]);
+            model = glm::rotate(model, time + i, glm::vec3(0.0f, 0.0f, 1.0f));
+            model = glm::scale(model, glm::vec3(0.05f));
+            shader.SetUniform(transform, &model);
+            shader.SetUniform(tint, glm::vec3(0.5f + 0.5f * sin(time + i), 1.0f, 1.0f));
+            glDrawArrays(GL_TRIANGLES, 0, 3);
+        }
+        time += 0.016f;
+    };
+
+    // at most two frames in flight, like a swap chain, so that every
+    // frame time includes its rendering, also when swapping does not
+    // wait for it, e.g. headless
+    GLsync fences[2] = {0, 0};
+    int frame = 0;
+    auto swap = [&]() {
+        window.SwapBuffers();
+        GLsync& fence = fences[frame++ % 2];
+        if(fence != 0)
+        {
+            glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000);
+            glDeleteSync(fence);
+        }
+        fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    };
+
+    std::cout << frames << " frames of " << width << "x" << height << ", "
+              << OBJECTS << " draws each" << std::endl;
+
+    double plain = Benchmark::measure("no capture, per frame", frames, 1, [&]() {
+        render();
+        swap();
+    }) / 1e6;
+    glFinish();
+
+    std::vector<unsigned char> pixels((size_t)width * height * 4);
+    double sync = Benchmark::measure("glReadPixels, per frame", frames, 1, [&]() {
+        render();
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, States::getState().GetDefaultFramebuffer());
+        glPixelStorei(GL_PACK_ALIGNMENT, 4);
+        glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, &pixels[0]);
+        swap();
+    }) / 1e6;
+    glFinish();
+
+    Captures::FrameCapture capture(ppm ? "capture_%05ld.ppm" : "capture.y4m",
+                                   ppm ? Captures::CAPTURE_PPM : Captures::CAPTURE_Y4M);
+    double async = Benchmark::measure("capture, per frame", frames, 1, [&]() {
+        render();
+        capture.Capture(width, height);
+        swap();
+    }) / 1e6;
+    glFinish();
+    Benchmark::Timer flush;
+    capture.Finish();
+    double flushed = flush.Seconds();
+
+    // `measure' runs one more frame to warm up
+    const Captures::_capture_stats_t& stats = capture.GetStats();
+    double in_capture = stats.seconds * 1e3 / (frames + 1);
+    std::cout << std::setprecision(1)
+              << "glReadPixels adds " << 100.0 * (sync - plain) / plain << "% to the frame time, "
+              << "the capture " << 100.0 * (async - plain) / plain << "%, of which "
+              << 100.0 * in_capture / plain << "% is spent in Capture" << std::endl;
+    std::cout << stats.captured << " frames captured, " << stats.dropped << " dropped, "
+              << stats.written << " written, " << std::setprecision(2) << flushed
+              << " s to write the rest after the last frame" << std::endl;
+
+    window.CloseWindow();
+
+    return 0;
+}
@@ -0,0 +1,142 @@
+// Frame preparation with command buffers: every object of a scene is
+// animated, culled and recorded as a transform, a tint and a draw, by
+// an increasing number of threads. Recording is timed on its own, to
+// show how it scales with cores, and the replay on the GL thread
+// separately.
+// Usage: bench_commands [objects]
+
+#include "windows.hpp"
+#include "buffers.hpp"
+#include "commands.hpp"
+#include "benchmark.hpp"
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <vector>
+
+const int MATERIALS = 4;
+const int FRAMES = 50;
+
+struct Vertex {
+    glm::vec2 vertexPos;
+    glm::vec3 vertexCol;
+};
+typedef Buffers::VertexLayout<Vertex, &Vertex::vertexPos, &Vertex::vertexCol> VertexLayout;
+
+typedef struct {
+    glm::vec3 position;
+    float angle;
+    float speed;
+    float radius;
+    glm::vec3 tint;
+    int material;
+} _object_t;
+
+int main(int argc, char** argv)
+{
+    long count = (argc > 1) ? atol(argv[1]) : 50000;
+
+    Windows::DefaultWindow window("Command buffer benchmark", 400, Windows::ASPECT_RATIO_1_1);
+    glfwSwapInterval(0);
+
+    // the same program several times, standing in for materials
+    std::vector<std::unique_ptr<Shaders::ShaderWrapper>> shaders;
+    std::vector<Shaders::_uniform_handle_t> transforms, tints;
+    for(int i = 0; i < MATERIALS; i++)
+    {
+        shaders.emplace_back(new Shaders::ShaderWrapper("shaderCommands", Shaders::SHADERS_VF));
+        transforms.push_back(shaders[i]->GetUniformHandle("transform"));
+        tints.push_back(shaders[i]->GetUniformHandle("tint"));
+    }
+
+    Vertex vertexData[] = {
+        {{-1.0f, -1.0f},  {1.0f, 0.0f, 0.0f}},
+        {{1.0f, -1.0f},   {0.0f, 1.0f, 0.0f}},
+        {{0.0f, 1.0f},    {0.0f, 0.0f, 1.0f}}
+    };
+    Buffers::Mesh<VertexLayout> mesh(vertexData, 3);
+    GLuint vertex_array = mesh.GetVertexArray();
+
+    std::mt19937 random(1);
+    std::uniform_real_distribution<float> uniform(-1.0f, 1.0f);
+    std::vector<_object_t> objects(count);
+    for(_object_t& object : objects)
+    {
+        object.position = glm::vec3(uniform(random), uniform(random), uniform(random));
+        object.angle = uniform(random) * 3.14159f;
+        object.speed = uniform(random);
+        object.radius = 0.002f + 0.01f * (uniform(random) + 1.0f);
+        object.tint = glm::vec3(uniform(random), uniform(random), 1.0f) * 0.5f + 0.5f;
+        object.material = random() % MATERIALS;
+    }
+
+    const glm::mat4 view_projection = glm::ortho(-1.0f, 1.0f, -1.0f, 1.0f, -1.0f, 1.0f);
+    float time = 0.0f;
+
+    // what a scene traversal would do per object before its draw
+    auto record = [&](Commands::CommandBuffer& buffer, size_t begin, size_t end) {
+        for(size_t i = begin; i < end; i++)
+        {
+            const _object_t& object = objects[i];
+            glm::vec3 position = object.position;
+            position.x += 0.1f * sin(time * object.speed + object.angle);
+            if(fabs(position.x) > 1.0f + object.radius) {
+                continue; // outside the view
+            }
+            glm::mat4 model = glm::translate(glm::mat4(1.0f), position);
+            model = glm::rotate(model, object.angle + time * object.speed,
+                                glm::vec3(0.0f, 0.0f, 1.0f));
+            model = glm::scale(model, glm::vec3(object.radius));
+            glm::mat4 transform = view_projection * model;
+
+            // front to back, and the 24 bits of depth from [-1, 1]
+            uint32_t depth = (uint32_t)((position.z + 1.0f) * 0.5f * 0xffffff);
+            uint64_t key = Commands::makeKey(0, object.material, 0, depth);
+            Shaders::ShaderWrapper& shader = *shaders[object.material];
+            buffer.SetUniform(key, shader, transforms[object.material], transform);
+            buffer.SetUniform(key, shader, tints[object.material], object.tint);
+            buffer.Draw(key, vertex_array, GL_TRIANGLES, 0, 3);
+        }
+    };
+
+    std::cout << count << " objects, " << MATERIALS << " materials, "
+              << Threads::getHardwareThreads() << " hardware threads" << std::endl;
+
+    double single = 0.0;
+    for(unsigned threads = 1; threads <= Threads::getHardwareThreads(); threads *= 2)
+    {
+        Commands::CommandQueue queue(threads);
+        std::string name = "record, " + std::to_string(threads) + " threads, per object";
+        double ns = Benchmark::measure(name.c_str(), FRAMES, count, [&]() {
+            time += 0.016f;
+            queue.Record(count, record);
+        });
+        if(threads == 1) {
+            single = ns;
+        }
+        std::cout << "    " << single / ns << "x speedup" << std::endl;
+    }
+
+    Commands::CommandQueue queue;
+    queue.Record(count, record);
+    Benchmark::measure("merge and replay, per object", FRAMES, count, [&]() {
+        glClear(GL_COLOR_BUFFER_BIT);
+        queue.Submit();
+        window.SwapBuffers();
+        glFinish();
+    });
+
+    const Commands::_command_stats_t& stats = queue.GetStats();
+    const States::_state_counters_t& calls = States::getState().GetFrameCounters();
+    std::cout << stats.commands << " commands, " << stats.draws << " draws, "
+              << stats.bytes / 1024 << " KiB recorded per frame" << std::endl;
+    std::cout << "state changes per frame: " << States::getTotal(calls.issued)
+              << " issued, " << States::getTotal(calls.elided) << " elided" << std::endl;
+
+    window.CloseWindow();
+
+    return 0;
+}
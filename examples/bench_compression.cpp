@@ -0,0 +1,83 @@
+// Speed and quality of the BC1/BC3 encoder on a 4096x4096 texture
+// with its full mipmap chain, for each quality preset. Quality is the
+// PSNR of the decoded top level against the original.
+
+#include "compression.hpp"
+#include "benchmark.hpp"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string>
+
+const int SIZE = 4096;
+const int ITERATIONS = 3;
+
+int main()
+{
+    Threads::ThreadPool pool;
+    std::cout << SIZE << "x" << SIZE << " source with mipmaps, "
+              << pool.Size() << " threads" << std::endl;
+
+    // smooth gradients with some noise and hard edges, like a photo
+    std::vector<unsigned char> rgba((size_t)SIZE * SIZE * 4);
+    srand(1);
+    for(int y = 0; y < SIZE; y++)
+    {
+        for(int x = 0; x < SIZE; x++)
+        {
+            unsigned char* p = &rgba[((size_t)y * SIZE + x) * 4];
+            int noise = rand() % 16;
+            int edge = ((x / 97 + y / 61) % 3) * 40;
+            p[0] = (unsigned char)(128 + 100 * sinf(x * 0.01f) + noise / 2);
+            p[1] = (unsigned char)std::min(255, (y * 255 / SIZE) / 2 + edge + noise);
+            p[2] = (unsigned char)(128 + 90 * cosf((x + y) * 0.004f));
+            p[3] = (unsigned char)(((x / 8 + y / 8) % 2) ? 255 : 64 + noise);
+        }
+    }
+
+    std::vector<Mipmaps::Level> levels = Mipmaps::generateMipmaps(
+        &rgba[0], SIZE, SIZE, Mipmaps::MIPMAP_RGBA8, Mipmaps::MIPMAP_FILTER_BOX, &pool);
+    long pixels = 0;
+    for(const Mipmaps::Level& level : levels) {
+        pixels += (long)level.width * level.height;
+    }
+
+    const char* formats[] = {"BC1", "BC3"};
+    const char* qualities[] = {"fast", "normal", "high"};
+
+    for(int f = 0; f < 2; f++)
+    {
+        Compression::_compression_format_t format = (Compression::_compression_format_t)f;
+        for(int q = 0; q < 3; q++)
+        {
+            Compression::_compression_quality_t quality = (Compression::_compression_quality_t)q;
+            std::string name = std::string(formats[f]) + " " + qualities[q] + " chain";
+
+            std::vector<Compression::Level> compressed;
+            Benchmark::measureRate(name.c_str(), ITERATIONS, pixels, "pixels", [&]() {
+                compressed = Compression::compressMipmaps(levels, format, quality, &pool);
+            });
+
+            Benchmark::Timer timer;
+            compressed = Compression::compressMipmaps(levels, format, quality, &pool);
+            double seconds = timer.Seconds();
+
+            std::vector<unsigned char> decoded;
+            Compression::decompressImage(&compressed[0].data[0], SIZE, SIZE, format,
+                                         decoded, &pool);
+            double psnr = Compression::computePSNR(&rgba[0], &decoded[0], SIZE, SIZE,
+                                                   (format == Compression::COMPRESSION_BC1) ? 3 : 4);
+            std::cout << "    " << seconds * 1000.0 << " ms per chain, PSNR "
+                      << psnr << " dB" << std::endl;
+        }
+    }
+
+    // single threaded, for the speedup of the pool
+    Benchmark::measureRate("BC1 normal top level, 1 thread", 1, (long)SIZE * SIZE, "pixels", [&]() {
+        std::vector<unsigned char> out;
+        Compression::compressImage(&rgba[0], SIZE, SIZE, Compression::COMPRESSION_BC1,
+                                   Compression::COMPRESSION_NORMAL, out);
+    });
+
+    return 0;
+}
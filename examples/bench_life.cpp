@@ -0,0 +1,53 @@
+// Game of Life: generations per second of the bit-packed engine per
+// thread count. The board size can be given as the first argument,
+// e.g. `./bench_life 65536' for a 65536x65536 board (1 GiB).
+
+#include "life.hpp"
+#include "benchmark.hpp"
+
+#include <iomanip>
+#include <stdlib.h>
+#include <string>
+
+const size_t DEFAULT_SIZE = 8192;
+const int GENERATIONS = 10;
+
+int main(int argc, char** argv)
+{
+    size_t size = (argc > 1) ? strtoul(argv[1], NULL, 10) : DEFAULT_SIZE;
+    if(size == 0) {
+        size = DEFAULT_SIZE;
+    }
+
+    Life::Board board(size, size);
+    double cells = (double)board.GetWidth() * board.GetHeight();
+
+    std::cout << board.GetWidth() << "x" << board.GetHeight() << " board, "
+              << GENERATIONS << " generations per measurement" << std::endl;
+    for(unsigned threads = 1; threads <= Threads::getHardwareThreads(); threads *= 2)
+    {
+        Threads::ThreadPool pool(threads > 1 ? threads - 1 : 1); // the caller works too
+        Threads::ThreadPool* p = threads > 1 ? &pool : NULL;
+        board.Randomize(1, 0.5, p);
+
+        board.Step(p); // warm up
+
+        Benchmark::Timer timer;
+        board.Step(p, GENERATIONS);
+        double seconds = timer.Seconds();
+
+        std::string name = std::to_string(threads) + " thread(s)";
+        std::cout << std::left << std::setw(40) << name << std::right
+                  << std::setw(10) << std::fixed << std::setprecision(2)
+                  << GENERATIONS / seconds << " generations/s"
+                  << std::setw(10) << GENERATIONS * cells / seconds / 1e9
+                  << " Gcells/s" << std::endl;
+    }
+
+    // a texture-ready view of the corner of the board
+    std::vector<unsigned char> pixels(256 * 256);
+    board.ExportR8(&pixels[0], 0, 0, 256, 256);
+    std::cout << board.CountAlive() << " cells alive" << std::endl;
+
+    return 0;
+}
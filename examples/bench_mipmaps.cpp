@@ -0,0 +1,49 @@
+// Throughput of CPU mipmap generation for each format and filter,
+// reported in source megapixels per second.
+
+#include "mipmaps.hpp"
+#include "benchmark.hpp"
+
+#include <stdlib.h>
+#include <string>
+
+const int SIZE = 2048;
+const int ITERATIONS = 5;
+
+int main()
+{
+    Threads::ThreadPool pool;
+    std::cout << SIZE << "x" << SIZE << " source, "
+              << pool.Size() << " threads" << std::endl;
+
+    std::vector<unsigned char> rgba8((size_t)SIZE * SIZE * 4);
+    std::vector<float> rgba32f(rgba8.size());
+    srand(1);
+    for(size_t i = 0; i < rgba8.size(); i++)
+    {
+        rgba8[i] = rand() % 256;
+        rgba32f[i] = rgba8[i] / 255.0f;
+    }
+
+    const char* formats[] = {"RGBA8", "SRGB8_ALPHA8", "RGBA32F"};
+    const char* filters[] = {"box", "kaiser", "lanczos"};
+
+    for(int f = 0; f < 3; f++)
+    {
+        Mipmaps::_mipmap_format_t format = (Mipmaps::_mipmap_format_t)f;
+        const void* pixels = (format == Mipmaps::MIPMAP_RGBA32F)
+            ? (const void*)&rgba32f[0] : (const void*)&rgba8[0];
+
+        for(int k = 0; k < 3; k++)
+        {
+            std::string name = std::string(formats[f]) + " " + filters[k];
+            Benchmark::measureRate(name.c_str(), ITERATIONS, (long)SIZE * SIZE,
+                                   "pixels", [&]() {
+                Mipmaps::generateMipmaps(pixels, SIZE, SIZE, format,
+                                         (Mipmaps::_mipmap_filter_t)k, &pool);
+            });
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,79 @@
+// Software rasterizer: renders the scenes of example1 and example2 to
+// PPM files, then measures a scene of many triangles per thread count.
+
+#include "rasterizer.hpp"
+#include "benchmark.hpp"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string>
+
+const int WIDTH = 800;
+const int HEIGHT = 600;
+const int TRIANGLES = 20000;
+const int FRAMES = 20;
+
+int main()
+{
+    // vertex data of example1.cpp and example2.cpp
+    float example1[] = {
+        -1.0f, -1.0f,  1.0f, 0.0f, 0.0f,
+        -1.0f, 1.0f,   0.0f, 1.0f, 0.0f,
+        1.0f, 1.0f,    0.0f, 0.0f, 1.0f
+    };
+    float example2[] = {
+        -0.5f, -0.5f,  1.0f, 0.0f, 0.0f,
+        -0.5f, 0.5f,   0.0f, 1.0f, 0.0f,
+        0.5f, 0.5f,    0.0f, 0.0f, 1.0f
+    };
+
+    Rasterizer::Framebuffer fb(WIDTH, HEIGHT);
+    Rasterizer::Renderer serial;
+
+    Rasterizer::Program shader1 = {Rasterizer::shader1Vertex, NULL, 3};
+    fb.Clear(0.0f, 0.0f, 0.0f, 1.0f);
+    serial.DrawArrays(fb, shader1, example1, 5, 0, 3);
+    fb.WritePPM("example1.ppm");
+
+    float timer = 1.0f;
+    Rasterizer::_shader2_uniforms_t uniforms = {{cosf(timer), sinf(timer)}};
+    Rasterizer::Program shader2 = {Rasterizer::shader2Vertex, &uniforms, 3};
+    fb.Clear(0.0f, 0.0f, 0.0f, 1.0f);
+    serial.DrawArrays(fb, shader2, example2, 5, 0, 3);
+    fb.WritePPM("example2.ppm");
+    std::cout << "wrote example1.ppm and example2.ppm" << std::endl;
+
+    // small random triangles in the layout of the examples
+    std::vector<float> vertices((size_t)TRIANGLES * 3 * 5);
+    srand(1);
+    for(int t = 0; t < TRIANGLES; t++)
+    {
+        float cx = rand() / (float)RAND_MAX * 2.0f - 1.0f;
+        float cy = rand() / (float)RAND_MAX * 2.0f - 1.0f;
+        for(int k = 0; k < 3; k++)
+        {
+            float* v = &vertices[(t * 3 + k) * 5];
+            v[0] = cx + (rand() / (float)RAND_MAX - 0.5f) * 0.2f;
+            v[1] = cy + (rand() / (float)RAND_MAX - 0.5f) * 0.2f;
+            v[2] = rand() / (float)RAND_MAX;
+            v[3] = rand() / (float)RAND_MAX;
+            v[4] = rand() / (float)RAND_MAX;
+        }
+    }
+
+    std::cout << TRIANGLES << " triangles at " << WIDTH << "x" << HEIGHT
+              << std::endl;
+    for(unsigned threads = 1; threads <= Threads::getHardwareThreads(); threads *= 2)
+    {
+        Threads::ThreadPool pool(threads > 1 ? threads - 1 : 1); // the caller works too
+        Rasterizer::Renderer renderer(threads > 1 ? &pool : NULL);
+
+        std::string name = std::to_string(threads) + " thread(s)";
+        Benchmark::measureRate(name.c_str(), FRAMES, TRIANGLES, "triangles", [&]() {
+            fb.Clear(0.0f, 0.0f, 0.0f, 1.0f);
+            renderer.DrawArrays(fb, shader1, &vertices[0], 5, 0, TRIANGLES * 3);
+        });
+    }
+
+    return 0;
+}
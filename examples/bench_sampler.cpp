@@ -0,0 +1,71 @@
+// Throughput of the CPU sampler for each filter and wrap mode,
+// comparing the reference path with the vectorized one.
+
+#include "sampler.hpp"
+#include "benchmark.hpp"
+
+#include <stdlib.h>
+#include <string>
+
+const int SIZE = 1024;
+const size_t SAMPLES = 1 << 20;
+const int ITERATIONS = 10;
+
+int main()
+{
+    std::vector<unsigned char> rgba8((size_t)SIZE * SIZE * 4);
+    srand(1);
+    for(size_t i = 0; i < rgba8.size(); i++) {
+        rgba8[i] = rand() % 256;
+    }
+    Sampler::Texture texture(
+        Mipmaps::generateMipmaps(&rgba8[0], SIZE, SIZE, Mipmaps::MIPMAP_RGBA8,
+                                 Mipmaps::MIPMAP_FILTER_BOX),
+        Mipmaps::MIPMAP_RGBA8);
+
+    // coordinates slightly outside [0,1] so wrapping is exercised
+    std::vector<float> u(SAMPLES), v(SAMPLES), lod(SAMPLES), out(SAMPLES * 4);
+    for(size_t i = 0; i < SAMPLES; i++)
+    {
+        u[i] = rand() / (float)RAND_MAX * 1.5f - 0.25f;
+        v[i] = rand() / (float)RAND_MAX * 1.5f - 0.25f;
+        lod[i] = rand() / (float)RAND_MAX * 6.0f - 1.0f;
+    }
+
+    std::cout << SIZE << "x" << SIZE << " texture, " << SAMPLES << " samples, "
+              << Sampler::getLaneCount() << " lanes" << std::endl;
+
+    const char* filters[] = {"nearest", "bilinear", "trilinear"};
+    const char* wraps[] = {"repeat", "clamp", "mirror"};
+    Sampler::_wrap_t wrap_modes[] = {Sampler::SAMPLER_REPEAT,
+                                     Sampler::SAMPLER_CLAMP_TO_EDGE,
+                                     Sampler::SAMPLER_MIRRORED_REPEAT};
+
+    for(int f = 0; f < 3; f++)
+    {
+        for(int w = 0; w < 3; w++)
+        {
+            Sampler::SamplerState state = Sampler::getDefaultState();
+            state.mag_filter = (f == 0) ? Sampler::SAMPLER_NEAREST : Sampler::SAMPLER_LINEAR;
+            state.min_filter = state.mag_filter;
+            state.mipmap = (f == 2) ? Sampler::SAMPLER_MIPMAP_LINEAR : Sampler::SAMPLER_MIPMAP_NONE;
+            state.wrap_s = wrap_modes[w];
+            state.wrap_t = wrap_modes[w];
+
+            std::string name = std::string(filters[f]) + " " + wraps[w];
+            Benchmark::measureRate((name + " reference").c_str(), ITERATIONS,
+                                   SAMPLES, "samples", [&]() {
+                for(size_t i = 0; i < SAMPLES; i++) {
+                    Sampler::sample(texture, state, u[i], v[i], lod[i], &out[i * 4]);
+                }
+            });
+            Benchmark::measureRate((name + " vectorized").c_str(), ITERATIONS,
+                                   SAMPLES, "samples", [&]() {
+                Sampler::sampleMany(texture, state, SAMPLES, &u[0], &v[0],
+                                    &lod[0], &out[0]);
+            });
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,106 @@
+// Stress test of the sprite batch: many small quads from several
+// texture arrays per frame, reporting draw calls and frame time.
+// Usage: bench_sprites [sprites]
+
+#include "windows.hpp"
+#include "sprites.hpp"
+#include "benchmark.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+const int TEXTURES = 8;       // texture arrays
+const int LAYERS = 4;         // images per texture array
+const int TEXTURE_SIZE = 32;
+const int FRAMES = 200;
+
+GLuint createTextureArray(int seed)
+{
+    std::vector<GLubyte> pixels(TEXTURE_SIZE * TEXTURE_SIZE * LAYERS * 4);
+    for(size_t i = 0; i < pixels.size(); i++) {
+        pixels[i] = (GLubyte)(i * 7 + seed * 31);
+    }
+
+    GLuint texture;
+    glGenTextures(1, &texture);
+    States::bindTexture(GL_TEXTURE_2D_ARRAY, texture);
+    glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_RGBA8, TEXTURE_SIZE, TEXTURE_SIZE, LAYERS,
+                 0, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    return texture;
+}
+
+int main(int argc, char** argv)
+{
+    long count = (argc > 1) ? atol(argv[1]) : 100000;
+
+    Windows::DefaultWindow window("Sprite benchmark", 800, Windows::ASPECT_RATIO_1_1);
+    glfwSwapInterval(0);
+    int width = window.GetWidth();
+    int height = window.GetHeight();
+
+    Shaders::ShaderWrapper shader("shaderSprites", Shaders::SHADERS_VF);
+    GLuint textures[TEXTURES];
+    for(int i = 0; i < TEXTURES; i++) {
+        textures[i] = createTextureArray(i);
+    }
+
+    typedef struct {
+        Sprites::_sprite_t sprite;
+        GLuint texture;
+    } _entry_t;
+
+    // textures in random order, as a scene would submit them
+    std::mt19937 random(1);
+    std::vector<_entry_t> entries(count);
+    for(_entry_t& entry : entries)
+    {
+        float x = random() % width;
+        float y = random() % height;
+        float size = 4 + random() % 12;
+        Buffers::rgba8 color = {255, (GLubyte)random(), (GLubyte)random(), 255};
+        entry.sprite = {glm::vec4(x, y, size, size), glm::vec4(0, 0, 1, 1),
+                        color, (GLuint)(random() % LAYERS)};
+        entry.texture = textures[random() % TEXTURES];
+    }
+
+    Sprites::SpriteBatch batch(count);
+    batch.SetShader(shader);
+
+    States::getState().SetBlend(true);
+    States::getState().BlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+
+    std::cout << count << " sprites, " << TEXTURES << " texture arrays of "
+              << LAYERS << " layers, " << FRAMES << " frames" << std::endl;
+
+    auto frame = [&]() {
+        glClear(GL_COLOR_BUFFER_BIT);
+        batch.Begin(width, height);
+        for(const _entry_t& entry : entries) {
+            batch.Add(entry.sprite, entry.texture);
+        }
+        batch.End();
+        window.SwapBuffers();
+        glFinish();
+    };
+
+    Benchmark::measure("unsorted submission, per sprite", FRAMES, count, frame);
+    Benchmark::measure("unsorted submission, per frame", FRAMES, 1, frame);
+    std::cout << "draw calls per frame: " << batch.GetDrawCalls()
+              << " for " << batch.GetSpriteCount() << " sprites" << std::endl;
+
+    // already in texture order, so the sort is skipped
+    std::stable_sort(entries.begin(), entries.end(),
+                     [](const _entry_t& a, const _entry_t& b) {
+                         return a.texture < b.texture;
+                     });
+    Benchmark::measure("sorted submission, per frame", FRAMES, 1, frame);
+    std::cout << "draw calls per frame: " << batch.GetDrawCalls() << std::endl;
+
+    window.CloseWindow();
+
+    return 0;
+}
@@ -0,0 +1,305 @@
+// Benchmark suite run by `make bench': uniform setting, shader compile
+// and link, file loading, texture upload and draw throughput, each
+// repeated after a warmup. The results are written as JSON, and can be
+// compared against the JSON of an earlier run, in which case the exit
+// status is 1 if any benchmark regressed, and 2 on errors.
+// Usage: bench_suite [--json file] [--compare baseline] [--threshold percent]
+//                    [--warmup n] [--repetitions n] [--filter text]
+
+#include "windows.hpp"
+#include "buffers.hpp"
+#include "fileIO.hpp"
+#include "images.hpp"
+#include "shaders.hpp"
+#include "benchmark.hpp"
+
+#include <chrono>
+#include <cstdlib>
+#include <cstdio>
+#include <random>
+#include <string.h>
+#include <vector>
+
+const int NUM_FLOATS = 64;          // uniforms of shaderUniforms
+const int UNIFORM_PASSES = 32;
+const int TEXTURE_SIZE = 1024;
+const int FILE_SIZE = 4 << 20;
+const int DRAWS = 2000;
+const int TRIANGLES = 100000;
+const int BATCH = 10;               // short operations per repetition
+
+const char* TEXT_FILE = "bench_suite.txt";
+const char* IMAGE_FILE = "bench_suite.ppm";
+
+struct Vertex {
+    glm::vec2 vertexPos;
+    glm::vec3 vertexCol;
+};
+typedef Buffers::VertexLayout<Vertex, &Vertex::vertexPos, &Vertex::vertexCol> VertexLayout;
+
+// compile and link without the program cache, or the driver's own, as
+// every call gets a source of its own, also across runs
+GLuint compileProgram(const std::string& vertex, const std::string& fragment, long variant)
+{
+    static long run = (long)std::chrono::system_clock::now().time_since_epoch().count();
+    std::string suffix = "\n// variant " + std::to_string(run) + "."
+                       + std::to_string(variant) + "\n";
+    std::string sources[2] = {vertex + suffix, fragment + suffix};
+    GLenum types[2] = {GL_VERTEX_SHADER, GL_FRAGMENT_SHADER};
+
+    GLuint program = glCreateProgram();
+    GLuint shaders[2];
+    for(int i = 0; i < 2; i++)
+    {
+        const char* source = sources[i].c_str();
+        shaders[i] = glCreateShader(types[i]);
+        glShaderSource(shaders[i], 1, &source, NULL);
+        glCompileShader(shaders[i]);
+        Shaders::checkCompileStatus(shaders[i]);
+        glAttachShader(program, shaders[i]);
+    }
+    glLinkProgram(program);
+    Shaders::checkLinkStatus(program);
+    for(GLuint shader : shaders) {
+        glDeleteShader(shader);
+    }
+    return program;
+}
+
+bool writeTestFiles()
+{
+    std::mt19937 random(1);
+    std::string text(FILE_SIZE, ' ');
+    for(char& c : text) {
+        c = "abcdefgh \n"[random() % 10];
+    }
+
+    std::vector<unsigned char> pixels((size_t)TEXTURE_SIZE * TEXTURE_SIZE * 3);
+    for(unsigned char& pixel : pixels) {
+        pixel = random() & 0xff;
+    }
+
+    FILE* file = fopen(TEXT_FILE, "wb");
+    FILE* image = fopen(IMAGE_FILE, "wb");
+    bool ok = file && image;
+    if(ok)
+    {
+        ok = fwrite(text.data(), 1, text.size(), file) == text.size();
+        fprintf(image, "P6\n%d %d\n255\n", TEXTURE_SIZE, TEXTURE_SIZE);
+        ok = ok && fwrite(&pixels[0], 1, pixels.size(), image) == pixels.size();
+    }
+    if(file) {
+        fclose(file);
+    }
+    if(image) {
+        fclose(image);
+    }
+    if(!ok) {
+        std::cerr << "Could not write the files to load" << std::endl;
+    }
+    return ok;
+}
+
+int main(int argc, char** argv)
+{
+    const char* json = "bench.json";
+    const char* baseline = NULL;
+    double threshold = 0.1;
+    int warmup = 3;
+    int repetitions = 10;
+    const char* filter = NULL;
+    for(int i = 1; i < argc; i += 2)
+    {
+        if(i + 1 == argc)
+        {
+            std::cerr << "Missing value for option '" << argv[i] << "'" << std::endl;
+            return 2;
+        }
+        if(strcmp(argv[i], "--json") == 0) {
+            json = argv[i + 1];
+        }
+        else if(strcmp(argv[i], "--compare") == 0) {
+            baseline = argv[i + 1];
+        }
+        else if(strcmp(argv[i], "--threshold") == 0) {
+            threshold = atof(argv[i + 1]) / 100.0;
+        }
+        else if(strcmp(argv[i], "--warmup") == 0) {
+            warmup = atoi(argv[i + 1]);
+        }
+        else if(strcmp(argv[i], "--repetitions") == 0) {
+            repetitions = atoi(argv[i + 1]);
+        }
+        else if(strcmp(argv[i], "--filter") == 0) {
+            filter = argv[i + 1];
+        }
+        else
+        {
+            std::cerr << "Unknown option '" << argv[i] << "'" << std::endl;
+            return 2;
+        }
+    }
+
+    Windows::DefaultWindow window("Benchmark suite", 400, Windows::ASPECT_RATIO_1_1);
+    std::cout << glGetString(GL_RENDERER) << ", " << glGetString(GL_VERSION) << std::endl;
+
+    Benchmark::Suite suite(warmup, repetitions);
+    if(filter) {
+        suite.SetFilter(filter);
+    }
+
+    // --- uniforms --- //
+
+    Shaders::ShaderWrapper uniforms("shaderUniforms", Shaders::SHADERS_VF);
+    Shaders::_uniform_handle_t handles[NUM_FLOATS];
+    for(int i = 0; i < NUM_FLOATS; i++)
+    {
+        char name[8];
+        snprintf(name, sizeof(name), "u%02d", i);
+        handles[i] = uniforms.GetUniformHandle(name);
+    }
+    uniforms.Activate();
+    suite.Run("uniforms: SetUniform(handle)", NUM_FLOATS * UNIFORM_PASSES, [&]() {
+        for(int p = 0; p < UNIFORM_PASSES; p++)
+            for(int i = 0; i < NUM_FLOATS; i++)
+                uniforms.SetUniform(handles[i], (float)p);
+        glFinish();
+    });
+
+    // --- shaders --- //
+
+    std::string vertex = FileIO::readFileContents("shaderCommands/vertex.shd");
+    std::string fragment = FileIO::readFileContents("shaderCommands/fragment.shd");
+    long variant = 0;
+    suite.Run("shaders: compile and link", 1, [&]() {
+        GLuint program = compileProgram(vertex, fragment, variant++);
+        States::getState().DeleteProgram(program);
+    });
+
+    GLint formats = 0;
+    if(GLEW_ARB_get_program_binary) {
+        glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+    }
+    if(formats > 0)
+    {
+        // what a program cache hit costs, without the file
+        GLuint program = compileProgram(vertex, fragment, variant++);
+        GLint length = 0;
+        glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+        std::vector<char> binary(length > 0 ? length : 1);
+        GLenum format = 0;
+        glGetProgramBinary(program, length, NULL, &format, &binary[0]);
+        States::getState().DeleteProgram(program);
+
+        suite.Run("shaders: load program binary", BATCH, [&]() {
+            for(int i = 0; i < BATCH; i++)
+            {
+                GLuint loaded = glCreateProgram();
+                glProgramBinary(loaded, format, &binary[0], length);
+                GLint linked = GL_FALSE;
+                glGetProgramiv(loaded, GL_LINK_STATUS, &linked);
+                glDeleteProgram(loaded);
+            }
+        });
+    }
+
+    // --- files --- //
+
+    if(writeTestFiles())
+    {
+        Memory::FrameArena& arena = Memory::getFrameArena();
+        suite.Run("files: read 4 MiB", BATCH, [&]() {
+            for(int i = 0; i < BATCH; i++)
+            {
+                FileIO::readFileContents(TEXT_FILE, arena);
+                arena.Reset();
+            }
+        });
+
+        Images::Image image;
+        suite.Run("files: decode 1024x1024 PPM", BATCH, [&]() {
+            for(int i = 0; i < BATCH; i++) {
+                Images::decodeImage(IMAGE_FILE, image);
+            }
+        });
+    }
+    remove(TEXT_FILE);
+    remove(IMAGE_FILE);
+
+    // --- textures --- //
+
+    std::vector<unsigned char> pixels((size_t)TEXTURE_SIZE * TEXTURE_SIZE * 4, 0x80);
+    GLuint texture;
+    glGenTextures(1, &texture);
+    States::bindTexture(GL_TEXTURE_2D, texture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, TEXTURE_SIZE, TEXTURE_SIZE, 0,
+                 GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    suite.Run("textures: upload 1024x1024 RGBA8", BATCH, [&]() {
+        States::bindTexture(GL_TEXTURE_2D, texture);
+        for(int i = 0; i < BATCH; i++)
+        {
+            glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, TEXTURE_SIZE, TEXTURE_SIZE,
+                            GL_RGBA, GL_UNSIGNED_BYTE, &pixels[0]);
+            glFinish();
+        }
+    });
+
+    suite.Run("textures: upload and mipmap 1024x1024", 1, [&]() {
+        States::bindTexture(GL_TEXTURE_2D, texture);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, TEXTURE_SIZE, TEXTURE_SIZE,
+                        GL_RGBA, GL_UNSIGNED_BYTE, &pixels[0]);
+        glGenerateMipmap(GL_TEXTURE_2D);
+        glFinish();
+    });
+    States::getState().DeleteTextures(1, &texture);
+
+    // --- draws --- //
+
+    Shaders::ShaderWrapper shader("shaderCommands", Shaders::SHADERS_VF);
+    Shaders::_uniform_handle_t transform = shader.GetUniformHandle("transform");
+    Shaders::_uniform_handle_t tint = shader.GetUniformHandle("tint");
+
+    std::mt19937 random(1);
+    std::uniform_real_distribution<float> uniform(-1.0f, 1.0f);
+    std::vector<Vertex> vertices(TRIANGLES * 3);
+    for(Vertex& vertex : vertices)
+    {
+        vertex.vertexPos = glm::vec2(uniform(random), uniform(random));
+        vertex.vertexCol = glm::vec3(uniform(random), uniform(random), 1.0f);
+    }
+    Buffers::Mesh<VertexLayout> mesh(&vertices[0], vertices.size());
+    const glm::mat4 model = glm::scale(glm::mat4(1.0f), glm::vec3(0.05f));
+
+    shader.Activate();
+    States::bindVertexArray(mesh.GetVertexArray());
+    suite.Run("draws: draw calls", DRAWS, [&]() {
+        glClear(GL_COLOR_BUFFER_BIT);
+        for(int i = 0; i < DRAWS; i++)
+        {
+            shader.SetUniform(transform, &model);
+            shader.SetUniform(tint, glm::vec3(1.0f, (float)i / DRAWS, 1.0f));
+            glDrawArrays(GL_TRIANGLES, 3 * (i % TRIANGLES), 3);
+        }
+        glFinish();
+    });
+
+    suite.Run("draws: triangles in one draw", TRIANGLES, [&]() {
+        glClear(GL_COLOR_BUFFER_BIT);
+        shader.SetUniform(transform, &model);
+        shader.SetUniform(tint, glm::vec3(1.0f));
+        glDrawArrays(GL_TRIANGLES, 0, TRIANGLES * 3);
+        glFinish();
+    });
+
+    window.CloseWindow();
+
+    if(!suite.WriteJSON(json)) {
+        return 2;
+    }
+    int regressions = baseline ? suite.Compare(baseline, threshold) : 0;
+    if(regressions < 0) {
+        return 2;
+    }
+    return (regressions > 0) ? 1 : 0;
+}
@@ -0,0 +1,57 @@
+// Cost of setting uniform variables, comparing a driver lookup per call
+// (what `ShaderWrapper' used to do) with the reflected uniform table.
+
+#include "windows.hpp"
+#include "shaders.hpp"
+#include "benchmark.hpp"
+
+#include <cstdio>
+
+const int NUM_FLOATS = 64;
+const int PASSES = 32; // NUM_FLOATS * PASSES uniforms set per frame
+const int FRAMES = 200;
+
+int main()
+{
+    Windows::DefaultWindow window("Uniform benchmark", 400, Windows::ASPECT_RATIO_1_1);
+
+    Shaders::ShaderWrapper shader("shaderUniforms", Shaders::SHADERS_VF);
+    shader.Activate();
+    GLuint program = shader.GetProgram();
+
+    char names[NUM_FLOATS][8];
+    Shaders::_uniform_handle_t handles[NUM_FLOATS];
+    for(int i = 0; i < NUM_FLOATS; i++)
+    {
+        snprintf(names[i], sizeof(names[i]), "u%02d", i);
+        handles[i] = shader.GetUniformHandle(names[i]);
+    }
+
+    const long ops = NUM_FLOATS * PASSES;
+    std::cout << ops << " uniforms per frame, " << FRAMES << " frames" << std::endl;
+
+    Benchmark::measure("glGetUniformLocation per call", FRAMES, ops, [&]() {
+        for(int p = 0; p < PASSES; p++)
+            for(int i = 0; i < NUM_FLOATS; i++)
+                glUniform1f(glGetUniformLocation(program, names[i]), (float)p);
+        glFinish();
+    });
+
+    Benchmark::measure("SetUniform(name) via table", FRAMES, ops, [&]() {
+        for(int p = 0; p < PASSES; p++)
+            for(int i = 0; i < NUM_FLOATS; i++)
+                shader.SetUniform(names[i], (float)p);
+        glFinish();
+    });
+
+    Benchmark::measure("SetUniform(handle)", FRAMES, ops, [&]() {
+        for(int p = 0; p < PASSES; p++)
+            for(int i = 0; i < NUM_FLOATS; i++)
+                shader.SetUniform(handles[i], (float)p);
+        glFinish();
+    });
+
+    window.CloseWindow();
+
+    return 0;
+}
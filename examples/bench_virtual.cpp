@@ -0,0 +1,155 @@
+// Virtual texture residency driven by simulated feedback: a camera
+// pans and zooms over a 16384x16384 texture, and the tiles it needs
+// arrive two frames after they were requested. Reports the time to
+// process a feedback buffer, how often the exact tile needed was
+// resident, and the traffic of the tile cache.
+// The tile streamer is measured reading from a real tile file.
+
+#include "virtualTexture.hpp"
+#include "benchmark.hpp"
+
+#include <math.h>
+#include <stdio.h>
+#include <deque>
+
+const int SIZE = 16384;
+const int TILE_SIZE = 128;
+const int BORDER = 4;
+const int SLOTS = 24 * 24;
+const int FEEDBACK_WIDTH = 160;
+const int FEEDBACK_HEIGHT = 90;
+const int FRAMES = 600;
+const int LATENCY = 2; // frames from request to upload
+
+// encode a feedback pixel like `vtFeedback' in shaderVirtual/
+uint32_t encodeFeedback(int level, int x, int y)
+{
+    unsigned char rgba[4] = {(unsigned char)(x & 255), (unsigned char)(y & 255),
+                             (unsigned char)((x >> 8) | ((y >> 8) << 4)), (unsigned char)level};
+    uint32_t pixel;
+    memcpy(&pixel, rgba, 4);
+    return pixel;
+}
+
+// what a camera looking at `width' by `height' texels of the texture
+// around (cx, cy) would write to the feedback buffer
+void simulateFeedback(const VirtualTextures::_layout_t& layout, double cx, double cy,
+                      double width, std::vector<uint32_t>& pixels)
+{
+    double height = width * FEEDBACK_HEIGHT / FEEDBACK_WIDTH;
+    // texels per screen pixel, with the screen 8 times the feedback
+    double footprint = width / (FEEDBACK_WIDTH * 8);
+    int level = std::min(std::max((int)floor(log2(footprint)), 0), layout.levels - 1);
+    int tile = TILE_SIZE << level;
+
+    for(int y = 0; y < FEEDBACK_HEIGHT; y++)
+    {
+        for(int x = 0; x < FEEDBACK_WIDTH; x++)
+        {
+            double u = cx + (x - FEEDBACK_WIDTH / 2) * width / FEEDBACK_WIDTH;
+            double v = cy + (y - FEEDBACK_HEIGHT / 2) * height / FEEDBACK_HEIGHT;
+            if(u < 0 || v < 0 || u >= SIZE || v >= SIZE) {
+                pixels[y * FEEDBACK_WIDTH + x] = 0xff000000u; // background
+                continue;
+            }
+            pixels[y * FEEDBACK_WIDTH + x] = encodeFeedback(level, (int)u / tile, (int)v / tile);
+        }
+    }
+}
+
+int main()
+{
+    VirtualTextures::_layout_t layout;
+    VirtualTextures::makeLayout(SIZE, SIZE, TILE_SIZE, BORDER, layout);
+    std::cout << SIZE << "x" << SIZE << " virtual texture, " << layout.levels << " levels, "
+              << SLOTS << " slots, " << FEEDBACK_WIDTH << "x" << FEEDBACK_HEIGHT
+              << " feedback" << std::endl;
+
+    VirtualTextures::Residency residency(layout, SLOTS);
+    std::vector<uint32_t> feedback(FEEDBACK_WIDTH * FEEDBACK_HEIGHT);
+    std::vector<VirtualTextures::_tile_id_t> requests;
+    std::deque<std::pair<long, VirtualTextures::_tile_id_t>> in_flight;
+
+    // the coarsest level is always resident
+    int coarsest = layout.levels - 1;
+    for(int y = 0; y < VirtualTextures::getTilesY(layout, coarsest); y++) {
+        for(int x = 0; x < VirtualTextures::getTilesX(layout, coarsest); x++) {
+            residency.Insert(VirtualTextures::makeTileId(coarsest, x, y), 0, true);
+        }
+    }
+
+    double process_seconds = 0.0;
+    long hits = 0, samples = 0;
+    for(long frame = 1; frame <= FRAMES; frame++)
+    {
+        // pan along a circle while zooming in and out
+        double t = frame / 120.0;
+        double cx = SIZE / 2 + SIZE / 3 * cos(t);
+        double cy = SIZE / 2 + SIZE / 3 * sin(t * 0.7);
+        double width = 2048.0 * pow(2.0, 2.5 * sin(t * 0.5));
+        simulateFeedback(layout, cx, cy, width, feedback);
+
+        Benchmark::Timer timer;
+        residency.ProcessFeedback(&feedback[0], feedback.size(), frame, requests, 64);
+        process_seconds += timer.Seconds();
+
+        for(VirtualTextures::_tile_id_t tile : requests) {
+            in_flight.push_back(std::make_pair(frame + LATENCY, tile));
+        }
+        while(!in_flight.empty() && in_flight.front().first <= frame)
+        {
+            if(residency.Insert(in_flight.front().second, frame) < 0) {
+                residency.Cancel(in_flight.front().second);
+            }
+            in_flight.pop_front();
+        }
+
+        for(uint32_t pixel : feedback)
+        {
+            VirtualTextures::_tile_id_t tile = VirtualTextures::decodeFeedback(pixel);
+            if(tile != VirtualTextures::VT_TILE_INVALID)
+            {
+                samples++;
+                hits += residency.GetPageTable().Find(tile) != VirtualTextures::VT_SLOT_NONE;
+            }
+        }
+        residency.GetPageTable().Build(24);
+    }
+
+    const VirtualTextures::_residency_stats_t& stats = residency.GetStats();
+    std::cout << "feedback processing: " << process_seconds / FRAMES * 1e6 << " us per frame, "
+              << process_seconds / FRAMES / feedback.size() * 1e9 << " ns per pixel" << std::endl;
+    std::cout << "exact tile resident for " << 100.0 * hits / samples << "% of samples" << std::endl;
+    std::cout << "tiles requested " << stats.requested << ", loaded " << stats.loaded
+              << ", evicted " << stats.evicted << ", rejected " << stats.rejected << std::endl;
+
+    // a smaller texture on disk, to measure the tile streamer
+    const int FILE_SIZE = 2048;
+    const char* path = "virtual.tiles";
+    std::vector<unsigned char> pixels((size_t)FILE_SIZE * FILE_SIZE * 4);
+    for(size_t i = 0; i < pixels.size(); i++) {
+        pixels[i] = (unsigned char)(i * 13 >> 4);
+    }
+    if(!VirtualTextures::writeTileFile(path, &pixels[0], FILE_SIZE, FILE_SIZE, TILE_SIZE, BORDER)) {
+        return 1;
+    }
+    VirtualTextures::TileFile file;
+    if(!file.Open(path)) {
+        return 1;
+    }
+    const VirtualTextures::_layout_t& file_layout = file.GetLayout();
+    int tiles = VirtualTextures::getTilesX(file_layout, 0) * VirtualTextures::getTilesY(file_layout, 0);
+    std::vector<VirtualTextures::_loaded_tile_t> loaded;
+
+    VirtualTextures::TileStreamer streamer(file);
+    Benchmark::measureRate("tile streaming, level 0", 5, (long)tiles, "tiles", [&]() {
+        for(int i = 0; i < tiles; i++) {
+            streamer.Request(VirtualTextures::makeTileId(0, i % 16, i / 16));
+        }
+        streamer.Wait();
+        streamer.Poll(loaded, tiles);
+    });
+    remove(path);
+
+    return 0;
+}
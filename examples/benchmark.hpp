@@ -0,0 +1,300 @@
+//
+// Benchmark Library
+//
+// Timing helpers shared by the benchmark programs, and a suite that
+// repeats each benchmark after a warmup, summarizes the repetitions,
+// and writes them as JSON, to compare later runs against.
+//
+
+#pragma once
+
+// STANDARD
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <iomanip>
+#include <stdlib.h>
+#include <string>
+#include <string.h>
+#include <vector>
+
+
+namespace Benchmark
+{
+    // wall-clock stopwatch, started on construction
+    class Timer
+    {
+    private:
+        std::chrono::steady_clock::time_point _start;
+
+    public:
+        Timer()
+        {
+            Reset();
+        }
+
+        void Reset()
+        {
+            _start = std::chrono::steady_clock::now();
+        }
+
+        double Seconds()
+        {
+            std::chrono::duration<double> elapsed =
+                std::chrono::steady_clock::now() - _start;
+            return elapsed.count();
+        }
+    };
+
+    // call `func' once to warm up, then `iterations' times while timing.
+    // Each call is expected to perform `operations' units of work, and
+    // the average time per operation is printed and returned (in ns).
+    template<typename Func>
+    double measure(const char* name, int iterations, long operations, Func func)
+    {
+        func();
+
+        Timer timer;
+        for(int i = 0; i < iterations; i++) {
+            func();
+        }
+        double seconds = timer.Seconds();
+        double ns = seconds * 1e9 / ((double)iterations * operations);
+
+        std::cout << std::left << std::setw(40) << name << std::right
+                  << std::fixed << std::setprecision(2) << std::setw(12) << ns
+                  << " ns/op" << std::endl;
+        return ns;
+    }
+
+    // same as `measure', but print the rate in millions of `unit'
+    // per second, e.g. megapixels per second. Returns the rate.
+    template<typename Func>
+    double measureRate(const char* name, int iterations, long operations,
+                       const char* unit, Func func)
+    {
+        func();
+
+        Timer timer;
+        for(int i = 0; i < iterations; i++) {
+            func();
+        }
+        double seconds = timer.Seconds();
+        double rate = (double)iterations * operations / seconds / 1e6;
+
+        std::cout << std::left << std::setw(40) << name << std::right
+                  << std::fixed << std::setprecision(2) << std::setw(12) << rate
+                  << " M" << unit << "/s" << std::endl;
+        return rate;
+    }
+
+
+    // --- SUITE --- //
+
+    // all times in ns per operation
+    typedef struct {
+        std::string name;
+        long operations;    // per repetition
+        int repetitions;
+        double median;
+        double mean;
+        double min;
+        double max;
+        double stddev;
+    } _result_t;
+
+    inline _result_t summarize(const char* name, long operations, std::vector<double>& samples)
+    {
+        _result_t result = {name, operations, (int)samples.size(), 0.0, 0.0, 0.0, 0.0, 0.0};
+        if(samples.empty()) {
+            return result;
+        }
+        std::sort(samples.begin(), samples.end());
+        size_t count = samples.size();
+        result.median = (count % 2) ? samples[count / 2]
+                                    : 0.5 * (samples[count / 2 - 1] + samples[count / 2]);
+        result.min = samples.front();
+        result.max = samples.back();
+        for(double sample : samples) {
+            result.mean += sample;
+        }
+        result.mean /= count;
+        for(double sample : samples) {
+            result.stddev += (sample - result.mean) * (sample - result.mean);
+        }
+        result.stddev = (count > 1) ? sqrt(result.stddev / (count - 1)) : 0.0;
+        return result;
+    }
+
+    // the number after `"key":' in `line', or 0
+    inline double findNumber(const std::string& line, const char* key)
+    {
+        std::string pattern = std::string("\"") + key + "\":";
+        size_t pos = line.find(pattern);
+        return (pos == std::string::npos) ? 0.0 : atof(line.c_str() + pos + pattern.size());
+    }
+
+    // results as written by `Suite::WriteJSON', one per line. Not a
+    // general JSON parser.
+    inline bool readResults(const char* path, std::vector<_result_t>& results)
+    {
+        std::ifstream in(path);
+        if(!in.is_open())
+        {
+            std::cerr << "Could not read file '" << path << "'." << std::endl;
+            return false;
+        }
+
+        std::string line;
+        while(std::getline(in, line))
+        {
+            size_t begin = line.find("\"name\": \"");
+            if(begin == std::string::npos) {
+                continue;
+            }
+            begin += strlen("\"name\": \"");
+            size_t end = line.find('"', begin);
+            if(end == std::string::npos) {
+                continue;
+            }
+
+            _result_t result;
+            result.name = line.substr(begin, end - begin);
+            result.operations = (long)findNumber(line, "operations");
+            result.repetitions = (int)findNumber(line, "repetitions");
+            result.median = findNumber(line, "median_ns");
+            result.mean = findNumber(line, "mean_ns");
+            result.min = findNumber(line, "min_ns");
+            result.max = findNumber(line, "max_ns");
+            result.stddev = findNumber(line, "stddev_ns");
+            results.push_back(result);
+        }
+        return true;
+    }
+
+    class Suite
+    {
+    private:
+        int _warmup;
+        int _repetitions;
+        std::string _filter;
+        std::vector<_result_t> _results;
+
+    public:
+        Suite(int warmup = 3, int repetitions = 10)
+            : _warmup(warmup), _repetitions(repetitions > 0 ? repetitions : 1)
+        {
+        }
+
+        // only run benchmarks with `filter' in their name
+        void SetFilter(const char* filter)
+        {
+            _filter = filter;
+        }
+
+        // call `func' `warmup' times, then time `repetitions' calls, each
+        // expected to perform `operations' units of work. The names must
+        // not contain quotes, and stay the same between runs to be
+        // compared. Returns false if filtered out.
+        template<typename Func>
+        bool Run(const char* name, long operations, Func func)
+        {
+            if(!_filter.empty() && strstr(name, _filter.c_str()) == NULL) {
+                return false;
+            }
+            for(int i = 0; i < _warmup; i++) {
+                func();
+            }
+
+            std::vector<double> samples;
+            samples.reserve(_repetitions);
+            for(int i = 0; i < _repetitions; i++)
+            {
+                Timer timer;
+                func();
+                samples.push_back(timer.Seconds() * 1e9 / operations);
+            }
+            _results.push_back(summarize(name, operations, samples));
+
+            const _result_t& result = _results.back();
+            double spread = (result.median > 0.0) ? 100.0 * result.stddev / result.median : 0.0;
+            std::cout << std::left << std::setw(40) << name << std::right
+                      << std::fixed << std::setprecision(2) << std::setw(14) << result.median
+                      << " ns/op  +-" << std::setprecision(1) << std::setw(5) << spread
+                      << "%  min " << std::setprecision(2) << result.min << std::endl;
+            return true;
+        }
+
+        const std::vector<_result_t>& GetResults()
+        {
+            return _results;
+        }
+
+        bool WriteJSON(const char* path)
+        {
+            std::ofstream out(path);
+            if(!out.is_open())
+            {
+                std::cerr << "Could not write file '" << path << "'." << std::endl;
+                return false;
+            }
+
+            out << "{\n  \"benchmarks\": [" << std::fixed << std::setprecision(3);
+            for(size_t i = 0; i < _results.size(); i++)
+            {
+                const _result_t& result = _results[i];
+                out << (i ? "," : "") << "\n    {\"name\": \"" << result.name
+                    << "\", \"operations\": " << result.operations
+                    << ", \"repetitions\": " << result.repetitions
+                    << ", \"median_ns\": " << result.median
+                    << ", \"mean_ns\": " << result.mean
+                    << ", \"min_ns\": " << result.min
+                    << ", \"max_ns\": " << result.max
+                    << ", \"stddev_ns\": " << result.stddev << "}";
+            }
+            out << "\n  ]\n}\n";
+            return true;
+        }
+
+        // compare the medians with those of `baseline'. A benchmark has
+        // regressed if its median is more than `threshold' (e.g. 0.1 for
+        // 10%) slower, and even its fastest repetition is slower than
+        // the baseline's median, so that noise alone rarely trips it.
+        // Returns the number of regressions, or -1 without a baseline.
+        int Compare(const char* baseline, double threshold)
+        {
+            std::vector<_result_t> previous;
+            if(!readResults(baseline, previous)) {
+                return -1;
+            }
+
+            int regressions = 0;
+            std::cout << "compared with '" << baseline << "':" << std::endl;
+            for(const _result_t& result : _results)
+            {
+                auto match = std::find_if(previous.begin(), previous.end(),
+                    [&](const _result_t& other) { return other.name == result.name; });
+                if(match == previous.end() || match->median <= 0.0)
+                {
+                    std::cout << std::left << std::setw(40) << result.name
+                              << std::right << std::setw(14) << "new" << std::endl;
+                    continue;
+                }
+
+                double change = result.median / match->median - 1.0;
+                bool regressed = change > threshold && result.min > match->median;
+                const char* verdict = regressed ? "REGRESSION"
+                                    : (change < -threshold ? "faster" : "");
+                regressions += regressed;
+                std::cout << std::left << std::setw(40) << result.name << std::right
+                          << std::fixed << std::setprecision(1) << std::setw(13)
+                          << std::showpos << 100.0 * change << std::noshowpos
+                          << "%  " << verdict << std::endl;
+            }
+            return regressions;
+        }
+    };
+
+} // namespace Benchmark
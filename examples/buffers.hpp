@@ -0,0 +1,599 @@
+//
+// Buffer Library
+//
+// Wrappers around OpenGL buffer objects: uniform blocks shared
+// between several shader programs, and vertex buffers whose
+// attribute layout is derived from a C++ struct.
+//
+
+#pragma once
+
+// GLEW
+#ifndef GLEW_STATIC
+#define GLEW_STATIC
+#endif
+#include <GL/glew.h>
+
+// GLM
+#include <glm/glm.hpp>
+
+// CUSTOM
+#include "shaders.hpp"
+#include "state.hpp"
+
+// STANDARD
+#include <string.h>
+#include <iostream>
+#include <vector>
+
+
+namespace Buffers
+{
+    // --- STD140 LAYOUT --- //
+
+    // base alignment and size of a type inside a std140 uniform block
+    template<typename T> struct std140 {};
+
+    template<> struct std140<float>        { static const size_t align = 4;  static const size_t size = 4;  };
+    template<> struct std140<int>          { static const size_t align = 4;  static const size_t size = 4;  };
+    template<> struct std140<unsigned int> { static const size_t align = 4;  static const size_t size = 4;  };
+    template<> struct std140<glm::vec2>    { static const size_t align = 8;  static const size_t size = 8;  };
+    template<> struct std140<glm::vec3>    { static const size_t align = 16; static const size_t size = 12; };
+    template<> struct std140<glm::vec4>    { static const size_t align = 16; static const size_t size = 16; };
+    template<> struct std140<glm::mat4>    { static const size_t align = 16; static const size_t size = 64; };
+
+    inline size_t alignUp(size_t offset, size_t align)
+    {
+        return (offset + align - 1) / align * align;
+    }
+
+    // wait until the GPU has passed `fence', then delete it
+    inline void waitSync(GLsync& fence)
+    {
+        if(!fence) {
+            return;
+        }
+        GLenum status = glClientWaitSync(fence, 0, 0);
+        while(status == GL_TIMEOUT_EXPIRED) {
+            status = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000);
+        }
+        glDeleteSync(fence);
+        fence = 0;
+    }
+
+    // computes member offsets of a uniform block in declaration order,
+    // e.g. for `uniform Camera { mat4 view; vec3 eye; float time; };'
+    //
+    //     Std140Layout layout;
+    //     size_t view = layout.Add<glm::mat4>();
+    //     size_t eye  = layout.Add<glm::vec3>();
+    //     size_t time = layout.Add<float>();
+    class Std140Layout
+    {
+    private:
+        size_t _size = 0;
+
+    public:
+        template<typename T>
+        size_t Add()
+        {
+            size_t offset = alignUp(_size, std140<T>::align);
+            _size = offset + std140<T>::size;
+            return offset;
+        }
+
+        // array elements are always padded to the size of a vec4
+        template<typename T>
+        size_t AddArray(size_t count)
+        {
+            size_t stride = alignUp(std140<T>::size, 16);
+            size_t offset = alignUp(_size, 16);
+            _size = offset + stride * count;
+            return offset;
+        }
+
+        // the block itself is padded to a multiple of a vec4
+        size_t Size() const
+        {
+            return alignUp(_size, 16);
+        }
+    };
+
+
+    // --- UNIFORM BLOCKS --- //
+
+    // how changes to a uniform block are transferred to the GPU
+    typedef enum {
+        UNIFORM_BLOCK_SUBDATA,    // single glBufferSubData of the dirty range
+        UNIFORM_BLOCK_PERSISTENT  // persistently mapped ring of block copies
+    } _uniform_block_mode_t;
+
+    // number of block copies in the persistent ring, i.e. the number
+    // of frames the GPU may lag behind before `Flush' has to wait
+    const int UNIFORM_BLOCK_RING_SIZE = 3;
+
+    // CPU-side mirror of a std140 uniform block. Setters only write to
+    // the mirror and extend the dirty byte range, `Flush' then uploads
+    // all changes at once. A block is bound to a fixed binding point,
+    // so any number of shader programs can share it.
+    class UniformBlock
+    {
+    private:
+        GLuint _buffer;
+        GLuint _binding;
+        _uniform_block_mode_t _mode;
+
+        std::vector<unsigned char> _data;
+        size_t _dirty_begin;
+        size_t _dirty_end;
+
+        // persistent ring only
+        unsigned char* _mapped = NULL;
+        size_t _stride = 0;
+        int _region = 0;
+        GLsync _fences[UNIFORM_BLOCK_RING_SIZE] = {};
+
+        void markDirty(size_t offset, size_t size)
+        {
+            if(offset < _dirty_begin) _dirty_begin = offset;
+            if(offset + size > _dirty_end) _dirty_end = offset + size;
+        }
+
+        void createPersistent()
+        {
+            GLint align = 256;
+            glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &align);
+            _stride = alignUp(_data.size(), align);
+
+            GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT |
+                               GL_MAP_COHERENT_BIT;
+            glBufferStorage(GL_UNIFORM_BUFFER, _stride * UNIFORM_BLOCK_RING_SIZE,
+                            NULL, flags);
+            _mapped = (unsigned char*)glMapBufferRange(
+                GL_UNIFORM_BUFFER, 0, _stride * UNIFORM_BLOCK_RING_SIZE, flags);
+
+            for(int i = 0; i < UNIFORM_BLOCK_RING_SIZE; i++) {
+                memcpy(_mapped + i * _stride, &_data[0], _data.size());
+            }
+            States::getState().BindBufferRange(GL_UNIFORM_BUFFER, _binding, _buffer, 0, _data.size());
+        }
+
+        void flushPersistent()
+        {
+            // fence the copy used until now, then move on to the
+            // oldest copy and wait until the GPU is done reading it
+            _fences[_region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+            _region = (_region + 1) % UNIFORM_BLOCK_RING_SIZE;
+
+            waitSync(_fences[_region]);
+
+            // the copy is several frames old, so all of it is written
+            memcpy(_mapped + _region * _stride, &_data[0], _data.size());
+            States::getState().BindBufferRange(GL_UNIFORM_BUFFER, _binding, _buffer,
+                              _region * _stride, _data.size());
+        }
+
+    public:
+        UniformBlock(GLuint binding, const Std140Layout& layout,
+                     _uniform_block_mode_t mode = UNIFORM_BLOCK_SUBDATA)
+            : _binding(binding), _mode(mode), _data(layout.Size(), 0)
+        {
+            _dirty_begin = _data.size();
+            _dirty_end = 0;
+
+            if(_mode == UNIFORM_BLOCK_PERSISTENT && !GLEW_ARB_buffer_storage)
+            {
+                std::cerr << "UniformBlock: persistent mapping is not supported,"
+                          << " falling back to glBufferSubData" << std::endl;
+                _mode = UNIFORM_BLOCK_SUBDATA;
+            }
+
+            glGenBuffers(1, &_buffer);
+            States::bindBuffer(GL_UNIFORM_BUFFER, _buffer);
+
+            if(_mode == UNIFORM_BLOCK_PERSISTENT) {
+                createPersistent();
+            }
+            else {
+                glBufferData(GL_UNIFORM_BUFFER, _data.size(), &_data[0],
+                             GL_DYNAMIC_DRAW);
+                States::getState().BindBufferBase(GL_UNIFORM_BUFFER, _binding, _buffer);
+            }
+        }
+
+        ~UniformBlock()
+        {
+            for(int i = 0; i < UNIFORM_BLOCK_RING_SIZE; i++) {
+                if(_fences[i]) glDeleteSync(_fences[i]);
+            }
+            if(_mapped)
+            {
+                States::bindBuffer(GL_UNIFORM_BUFFER, _buffer);
+                glUnmapBuffer(GL_UNIFORM_BUFFER);
+            }
+            States::getState().DeleteBuffers(1, &_buffer);
+        }
+
+        // connect the block named `name' in a shader program to this
+        // buffer. Should be done once per program, outside of the
+        // rendering loop.
+        void Attach(Shaders::ShaderWrapper& shader, const char* name)
+        {
+            GLuint program = shader.GetProgram();
+            GLuint index = glGetUniformBlockIndex(program, name);
+            if(index == GL_INVALID_INDEX)
+            {
+                std::cerr << "'" << name << "' is not an active uniform block"
+                          << std::endl;
+                return;
+            }
+
+            GLint size = 0;
+            glGetActiveUniformBlockiv(program, index,
+                                      GL_UNIFORM_BLOCK_DATA_SIZE, &size);
+            if((size_t)size > _data.size())
+            {
+                std::cerr << "Uniform block '" << name << "' is " << size
+                          << " bytes, but the layout only has "
+                          << _data.size() << " bytes" << std::endl;
+            }
+
+            glUniformBlockBinding(program, index, _binding);
+        }
+
+        // write a member at the offset returned by `Std140Layout::Add'.
+        // Nothing is marked dirty if the value did not change.
+        template<typename T>
+        void Set(size_t offset, const T& value)
+        {
+            const size_t size = std140<T>::size;
+            if(memcmp(&_data[offset], &value, size) != 0)
+            {
+                memcpy(&_data[offset], &value, size);
+                markDirty(offset, size);
+            }
+        }
+
+        // write element `index' of an array added with `AddArray'
+        template<typename T>
+        void SetElement(size_t offset, size_t index, const T& value)
+        {
+            Set(offset + index * alignUp(std140<T>::size, 16), value);
+        }
+
+        // upload everything written since the last flush. Should be
+        // called once per frame, before the first draw call.
+        void Flush()
+        {
+            if(_dirty_begin >= _dirty_end) {
+                return;
+            }
+
+            if(_mode == UNIFORM_BLOCK_PERSISTENT) {
+                flushPersistent();
+            }
+            else {
+                States::bindBuffer(GL_UNIFORM_BUFFER, _buffer);
+                glBufferSubData(GL_UNIFORM_BUFFER, _dirty_begin,
+                                _dirty_end - _dirty_begin, &_data[_dirty_begin]);
+            }
+
+            _dirty_begin = _data.size();
+            _dirty_end = 0;
+        }
+
+        GLuint GetBinding()
+        {
+            return _binding;
+        }
+
+        GLuint GetBuffer()
+        {
+            return _buffer;
+        }
+    };
+
+
+
+
+    // --- VERTEX LAYOUTS --- //
+
+    // a color with 8 bits per channel, normalized to [0, 1] in shaders
+    typedef struct {
+        GLubyte r, g, b, a;
+    } rgba8;
+
+    // format of a vertex attribute of type T
+    template<typename T> struct vertex_attribute {};
+
+    template<> struct vertex_attribute<float>        { static const GLint size = 1; static const GLenum type = GL_FLOAT;         static const bool normalized = false; static const bool integer = false; };
+    template<> struct vertex_attribute<glm::vec2>    { static const GLint size = 2; static const GLenum type = GL_FLOAT;         static const bool normalized = false; static const bool integer = false; };
+    template<> struct vertex_attribute<glm::vec3>    { static const GLint size = 3; static const GLenum type = GL_FLOAT;         static const bool normalized = false; static const bool integer = false; };
+    template<> struct vertex_attribute<glm::vec4>    { static const GLint size = 4; static const GLenum type = GL_FLOAT;         static const bool normalized = false; static const bool integer = false; };
+    template<> struct vertex_attribute<int>          { static const GLint size = 1; static const GLenum type = GL_INT;           static const bool normalized = false; static const bool integer = true;  };
+    template<> struct vertex_attribute<unsigned int> { static const GLint size = 1; static const GLenum type = GL_UNSIGNED_INT;  static const bool normalized = false; static const bool integer = true;  };
+    template<> struct vertex_attribute<rgba8>        { static const GLint size = 4; static const GLenum type = GL_UNSIGNED_BYTE; static const bool normalized = true;  static const bool integer = false; };
+
+    // byte offset of a data member, e.g. `&Vertex::position'
+    template<typename T, typename M>
+    size_t memberOffset(M T::* member)
+    {
+        alignas(T) static char storage[sizeof(T)];
+        const T* object = reinterpret_cast<const T*>(storage);
+        return reinterpret_cast<const char*>(&(object->*member)) - storage;
+    }
+
+    template<typename T, typename M>
+    void setAttribute(GLuint index, M T::* member, GLuint divisor, size_t base)
+    {
+        typedef vertex_attribute<M> attribute;
+        const GLvoid* offset = (const GLvoid*)(base + memberOffset(member));
+
+        if(attribute::integer) {
+            glVertexAttribIPointer(index, attribute::size, attribute::type,
+                                   sizeof(T), offset);
+        }
+        else {
+            glVertexAttribPointer(index, attribute::size, attribute::type,
+                                  attribute::normalized, sizeof(T), offset);
+        }
+        glEnableVertexAttribArray(index);
+        glVertexAttribDivisor(index, divisor);
+    }
+
+    // the attributes of a vertex struct, at locations 0, 1, 2, ... in
+    // the order of the members given, e.g. for
+    //
+    //     struct Vertex { glm::vec2 position; glm::vec3 color; };
+    //     typedef VertexLayout<Vertex, &Vertex::position, &Vertex::color> Layout;
+    //
+    // the shader declares `layout (location = 0) in vec2 position;' and
+    // `layout (location = 1) in vec3 color;'. Formats and the stride
+    // are known at compile time, and a member of a type without a
+    // `vertex_attribute' does not compile.
+    template<typename T, auto... Members>
+    struct VertexLayout
+    {
+        typedef T vertex_t;
+
+        static const GLsizei stride = sizeof(T);
+        static const GLuint count = sizeof...(Members);
+
+        // point the attributes of the bound vertex array object at the
+        // bound GL_ARRAY_BUFFER, from byte `base' on, starting at location
+        // `first'. With a `divisor' of 1 they advance per instance
+        // instead of per vertex.
+        static void Apply(GLuint first = 0, GLuint divisor = 0, size_t base = 0)
+        {
+            GLuint index = first;
+            (setAttribute(index++, Members, divisor, base), ...);
+        }
+    };
+
+
+    // --- MESHES --- //
+
+    // static geometry: a vertex array object with its own vertex
+    // buffer, and optionally an index buffer
+    template<typename Layout>
+    class Mesh
+    {
+    private:
+        typedef typename Layout::vertex_t vertex_t;
+
+        GLuint _vao;
+        GLuint _vbo;
+        GLuint _ebo = 0;
+        GLsizei _vertices;
+        GLsizei _indices = 0;
+
+    public:
+        Mesh(const vertex_t* vertices, size_t count, GLenum usage = GL_STATIC_DRAW)
+            : _vertices(count)
+        {
+            glGenVertexArrays(1, &_vao);
+            glGenBuffers(1, &_vbo);
+            States::bindVertexArray(_vao);
+            States::bindBuffer(GL_ARRAY_BUFFER, _vbo);
+            glBufferData(GL_ARRAY_BUFFER, count * sizeof(vertex_t), vertices, usage);
+            Layout::Apply();
+        }
+
+        ~Mesh()
+        {
+            if(_ebo) States::getState().DeleteBuffers(1, &_ebo);
+            States::getState().DeleteBuffers(1, &_vbo);
+            States::getState().DeleteVertexArrays(1, &_vao);
+        }
+
+        Mesh(const Mesh&) = delete;
+        Mesh& operator=(const Mesh&) = delete;
+
+        void SetIndices(const GLuint* indices, size_t count)
+        {
+            States::bindVertexArray(_vao);
+            if(!_ebo) glGenBuffers(1, &_ebo);
+            States::bindBuffer(GL_ELEMENT_ARRAY_BUFFER, _ebo);
+            glBufferData(GL_ELEMENT_ARRAY_BUFFER, count * sizeof(GLuint),
+                         indices, GL_STATIC_DRAW);
+            _indices = count;
+        }
+
+        void Draw(GLenum mode = GL_TRIANGLES)
+        {
+            States::bindVertexArray(_vao);
+            if(_indices) {
+                glDrawElements(mode, _indices, GL_UNSIGNED_INT, NULL);
+            }
+            else {
+                glDrawArrays(mode, 0, _vertices);
+            }
+        }
+
+        GLuint GetVertexArray()
+        {
+            return _vao;
+        }
+    };
+
+
+    // number of frames of vertex data in a stream, i.e. the number
+    // of frames the GPU may lag behind before `EndFrame' has to wait
+    const int VERTEX_STREAM_RING_SIZE = 3;
+
+    // geometry written anew every frame. The buffer holds one region
+    // per frame in flight, and a region is only written after the fence
+    // of the frame that last used it has passed, so writing never waits
+    // on the driver, and the buffer is never reallocated.
+    // With ARB_buffer_storage the buffer is mapped once, persistently;
+    // otherwise each region is written with an unsynchronized mapping.
+    template<typename Layout>
+    class VertexStream
+    {
+    private:
+        typedef typename Layout::vertex_t vertex_t;
+
+        GLuint _vao;
+        GLuint _vbo;
+        size_t _capacity;   // vertices per region
+        int _region = 0;
+        size_t _used = 0;   // vertices written to the current region
+        GLsync _fences[VERTEX_STREAM_RING_SIZE] = {};
+
+        vertex_t* _mapped = NULL;
+        std::vector<vertex_t> _staging; // without persistent mapping
+        size_t _staged = 0;             // first vertex not yet uploaded
+
+        // upload the vertices written since the last upload
+        void upload()
+        {
+            if(_mapped || _staged == _used) {
+                return;
+            }
+            size_t first = _region * _capacity + _staged;
+            size_t count = _used - _staged;
+
+            States::bindBuffer(GL_ARRAY_BUFFER, _vbo);
+            void* ptr = glMapBufferRange(GL_ARRAY_BUFFER, first * sizeof(vertex_t),
+                                         count * sizeof(vertex_t),
+                                         GL_MAP_WRITE_BIT | GL_MAP_UNSYNCHRONIZED_BIT |
+                                         GL_MAP_INVALIDATE_RANGE_BIT);
+            memcpy(ptr, &_staging[_staged], count * sizeof(vertex_t));
+            glUnmapBuffer(GL_ARRAY_BUFFER);
+            _staged = _used;
+        }
+
+    public:
+        // `capacity' is the number of vertices that can be written per
+        // frame. With `instanced', the layout advances per instance.
+        VertexStream(size_t capacity, bool instanced = false)
+            : _capacity(capacity)
+        {
+            glGenVertexArrays(1, &_vao);
+            glGenBuffers(1, &_vbo);
+            States::bindVertexArray(_vao);
+            States::bindBuffer(GL_ARRAY_BUFFER, _vbo);
+
+            GLsizeiptr size = _capacity * VERTEX_STREAM_RING_SIZE * sizeof(vertex_t);
+            if(GLEW_ARB_buffer_storage)
+            {
+                GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT |
+                                   GL_MAP_COHERENT_BIT;
+                glBufferStorage(GL_ARRAY_BUFFER, size, NULL, flags);
+                _mapped = (vertex_t*)glMapBufferRange(GL_ARRAY_BUFFER, 0, size, flags);
+            }
+            else
+            {
+                glBufferData(GL_ARRAY_BUFFER, size, NULL, GL_STREAM_DRAW);
+                _staging.resize(_capacity);
+            }
+            Layout::Apply(0, instanced ? 1 : 0);
+        }
+
+        ~VertexStream()
+        {
+            for(int i = 0; i < VERTEX_STREAM_RING_SIZE; i++) {
+                if(_fences[i]) glDeleteSync(_fences[i]);
+            }
+            if(_mapped)
+            {
+                States::bindBuffer(GL_ARRAY_BUFFER, _vbo);
+                glUnmapBuffer(GL_ARRAY_BUFFER);
+            }
+            States::getState().DeleteBuffers(1, &_vbo);
+            States::getState().DeleteVertexArrays(1, &_vao);
+        }
+
+        VertexStream(const VertexStream&) = delete;
+        VertexStream& operator=(const VertexStream&) = delete;
+
+        // room for `count' vertices in this frame, to be filled before
+        // the next `Draw'. `first' is set to the index to draw them
+        // from. Returns NULL if the frame is out of room.
+        vertex_t* Allocate(size_t count, GLint& first)
+        {
+            if(_used + count > _capacity) {
+                return NULL;
+            }
+            first = _region * _capacity + _used;
+            vertex_t* ptr = _mapped ? _mapped + first : &_staging[_used];
+            _used += count;
+            return ptr;
+        }
+
+        void Draw(GLenum mode, GLint first, GLsizei count)
+        {
+            upload();
+            States::bindVertexArray(_vao);
+            glDrawArrays(mode, first, count);
+        }
+
+        // like `Draw', but `count' vertices per instance of the layout,
+        // e.g. 4 for instanced quads with a triangle strip
+        void DrawInstanced(GLenum mode, GLsizei count, GLint first, GLsizei instances)
+        {
+            upload();
+            States::bindVertexArray(_vao);
+            if(GLEW_ARB_base_instance) {
+                glDrawArraysInstancedBaseInstance(mode, 0, count, instances, first);
+                return;
+            }
+
+            // OpenGL 3.3 has no base instance, so the attributes are
+            // pointed at the first instance instead
+            States::bindBuffer(GL_ARRAY_BUFFER, _vbo);
+            Layout::Apply(0, 1, first * sizeof(vertex_t));
+            glDrawArraysInstanced(mode, 0, count, instances);
+            Layout::Apply(0, 1);
+        }
+
+        // should be called once per frame after the last draw from the
+        // stream. Moves on to the next region, waiting for the GPU only
+        // if it is still using that region, several frames later.
+        void EndFrame()
+        {
+            upload();
+            _fences[_region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+            _region = (_region + 1) % VERTEX_STREAM_RING_SIZE;
+            waitSync(_fences[_region]);
+            _used = 0;
+            _staged = 0;
+        }
+
+        size_t GetCapacity()
+        {
+            return _capacity;
+        }
+
+        GLuint GetVertexArray()
+        {
+            return _vao;
+        }
+
+        GLuint GetBuffer()
+        {
+            return _vbo;
+        }
+    };
+
+} // namespace Buffers
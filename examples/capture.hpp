@@ -0,0 +1,491 @@
+//
+// Frame Capture
+//
+// Captures rendered frames to disk without stalling the rendering
+// loop. Every frame is read into one of a ring of pixel pack buffers,
+// and only used a few frames later, when its fence has signaled, so
+// the GPU never has to finish early. A writer thread converts and
+// writes the frames, either as a sequence of PPM images or as a Y4M
+// video, which e.g. ffmpeg and mpv read directly.
+//
+// When the writer or the GPU fall behind, frames are dropped and
+// counted instead of waited for.
+//
+
+#pragma once
+
+// GLEW
+#ifndef GLEW_STATIC
+#define GLEW_STATIC
+#endif
+#include <GL/glew.h>
+
+// CUSTOM
+#include "state.hpp"
+
+// STANDARD
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <iostream>
+#include <mutex>
+#include <stdio.h>
+#include <string>
+#include <string.h>
+#include <thread>
+#include <vector>
+
+
+namespace Captures
+{
+    typedef enum {
+        CAPTURE_PPM,    // `path' is a printf pattern for the frame number
+        CAPTURE_Y4M     // one file, 4:2:0
+    } _capture_format_t;
+
+    // frames between a readback and its use, i.e. pixel pack buffers.
+    // Each frame keeps its buffer until it is written, so this is also
+    // how far the writer may fall behind before frames are dropped.
+    const int CAPTURE_LATENCY = 3;
+
+    typedef struct {
+        long captured;      // handed to the writer
+        long dropped;       // while the GPU or the writer were behind
+        long written;
+        double seconds;     // spent in `Capture', on the rendering thread
+    } _capture_stats_t;
+
+
+    // --- CONVERSION --- //
+
+    // BT.601 with the limited range Y4M players expect. `rgba' is read
+    // bottom-up, as from `glReadPixels', and the planes are top-down.
+    inline void convertYUV420(const unsigned char* rgba, int width, int height,
+                              unsigned char* y_plane, unsigned char* u_plane,
+                              unsigned char* v_plane)
+    {
+        int chroma_width = (width + 1) / 2;
+        for(int y = 0; y < height; y++)
+        {
+            const unsigned char* row = rgba + (size_t)(height - 1 - y) * width * 4;
+            unsigned char* out = y_plane + (size_t)y * width;
+            for(int x = 0; x < width; x++)
+            {
+                int r = row[x * 4], g = row[x * 4 + 1], b = row[x * 4 + 2];
+                out[x] = (unsigned char)((66 * r + 129 * g + 25 * b + 128 + (16 << 8)) >> 8);
+            }
+        }
+
+        // chroma of the average of each 2x2 block
+        for(int cy = 0; cy < (height + 1) / 2; cy++)
+        {
+            int y0 = cy * 2;
+            int y1 = (y0 + 1 < height) ? y0 + 1 : y0;
+            const unsigned char* row0 = rgba + (size_t)(height - 1 - y0) * width * 4;
+            const unsigned char* row1 = rgba + (size_t)(height - 1 - y1) * width * 4;
+            for(int cx = 0; cx < chroma_width; cx++)
+            {
+                int x0 = cx * 2;
+                int x1 = (x0 + 1 < width) ? x0 + 1 : x0;
+                int r = row0[x0 * 4] + row0[x1 * 4] + row1[x0 * 4] + row1[x1 * 4];
+                int g = row0[x0 * 4 + 1] + row0[x1 * 4 + 1] + row1[x0 * 4 + 1] + row1[x1 * 4 + 1];
+                int b = row0[x0 * 4 + 2] + row0[x1 * 4 + 2] + row1[x0 * 4 + 2] + row1[x1 * 4 + 2];
+                size_t index = (size_t)cy * chroma_width + cx;
+                u_plane[index] = (unsigned char)((-38 * r - 74 * g + 112 * b + 512 + (128 << 10)) >> 10);
+                v_plane[index] = (unsigned char)((112 * r - 94 * g - 18 * b + 512 + (128 << 10)) >> 10);
+            }
+        }
+    }
+
+
+    // --- WRITER --- //
+
+    // writes frames on its own thread, in the order they were pushed
+    class FrameWriter
+    {
+    private:
+        typedef struct {
+            const unsigned char* pixels;   // RGBA, bottom-up
+            int width;
+            int height;
+            long frame;
+            std::atomic<bool>* busy;       // cleared once written
+        } _job_t;
+
+        std::string _path;
+        _capture_format_t _format;
+        int _fps;
+        FILE* _file = NULL;
+        int _width = 0;
+        int _height = 0;
+
+        std::vector<_job_t> _jobs;
+        size_t _head = 0;
+        size_t _count = 0;
+        bool _stop = false;
+        std::mutex _mutex;
+        std::condition_variable _job_available;
+        std::condition_variable _jobs_done;
+
+        std::atomic<long> _written;
+        std::vector<unsigned char> _buffer;
+        std::thread _thread;
+
+        bool writePPM(const _job_t& job)
+        {
+            char path[1024];
+            snprintf(path, sizeof(path), _path.c_str(), job.frame);
+            FILE* file = fopen(path, "wb");
+            if(file == NULL)
+            {
+                std::cerr << "FrameWriter: could not open '" << path << "'" << std::endl;
+                return false;
+            }
+            fprintf(file, "P6\n%d %d\n255\n", job.width, job.height);
+
+            _buffer.resize((size_t)job.width * job.height * 3);
+            unsigned char* out = &_buffer[0];
+            for(int y = job.height - 1; y >= 0; y--)
+            {
+                const unsigned char* row = job.pixels + (size_t)y * job.width * 4;
+                for(int x = 0; x < job.width; x++)
+                {
+                    *out++ = row[x * 4];
+                    *out++ = row[x * 4 + 1];
+                    *out++ = row[x * 4 + 2];
+                }
+            }
+            bool ok = fwrite(&_buffer[0], 1, _buffer.size(), file) == _buffer.size();
+            return (fclose(file) == 0) && ok;
+        }
+
+        bool writeY4M(const _job_t& job)
+        {
+            if(_file == NULL) {
+                return false;
+            }
+            if(_width == 0)
+            {
+                _width = job.width;
+                _height = job.height;
+                fprintf(_file, "YUV4MPEG2 W%d H%d F%d:1 Ip A1:1 C420jpeg\n",
+                        _width, _height, _fps);
+            }
+            if(job.width != _width || job.height != _height)
+            {
+                std::cerr << "FrameWriter: frame " << job.frame << " is " << job.width
+                          << "x" << job.height << ", the video " << _width << "x"
+                          << _height << std::endl;
+                return false;
+            }
+
+            size_t luma = (size_t)_width * _height;
+            size_t chroma = (size_t)((_width + 1) / 2) * ((_height + 1) / 2);
+            _buffer.resize(luma + 2 * chroma);
+            convertYUV420(job.pixels, _width, _height, &_buffer[0],
+                          &_buffer[luma], &_buffer[luma + chroma]);
+            fputs("FRAME\n", _file);
+            return fwrite(&_buffer[0], 1, _buffer.size(), _file) == _buffer.size();
+        }
+
+        void writerLoop()
+        {
+            for(;;)
+            {
+                _job_t job;
+                {
+                    std::unique_lock<std::mutex> lock(_mutex);
+                    _job_available.wait(lock, [this]() {
+                        return _stop || _count > 0;
+                    });
+                    if(_count == 0) {
+                        return; // stopping, and nothing left to write
+                    }
+                    job = _jobs[_head];
+                }
+
+                bool ok = (_format == CAPTURE_Y4M) ? writeY4M(job) : writePPM(job);
+                _written += ok;
+                job.busy->store(false, std::memory_order_release);
+
+                std::lock_guard<std::mutex> lock(_mutex);
+                _head = (_head + 1) % _jobs.size();
+                _count--;
+                if(_count == 0) {
+                    _jobs_done.notify_all();
+                }
+            }
+        }
+
+    public:
+        // at most `capacity' frames wait to be written
+        FrameWriter(const char* path, _capture_format_t format, int fps, size_t capacity)
+            : _path(path), _format(format), _fps(fps), _jobs(capacity > 0 ? capacity : 1),
+              _written(0)
+        {
+            // here rather than on the first frame, as replacing a long
+            // video can take a while
+            if(_format == CAPTURE_Y4M)
+            {
+                _file = fopen(path, "wb");
+                if(_file == NULL) {
+                    std::cerr << "FrameWriter: could not open '" << path << "'" << std::endl;
+                }
+            }
+            _thread = std::thread(&FrameWriter::writerLoop, this);
+        }
+
+        // writes all frames pushed before returning
+        ~FrameWriter()
+        {
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+                _stop = true;
+            }
+            _job_available.notify_all();
+            _thread.join();
+            if(_file != NULL) {
+                fclose(_file);
+            }
+        }
+
+        FrameWriter(const FrameWriter&) = delete;
+        FrameWriter& operator=(const FrameWriter&) = delete;
+
+        // `pixels' must stay valid until `busy' is cleared by the
+        // writer. Returns false, without taking the frame, if the
+        // writer is too far behind.
+        bool Push(const unsigned char* pixels, int width, int height, long frame,
+                  std::atomic<bool>* busy)
+        {
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+                if(_count == _jobs.size()) {
+                    return false;
+                }
+                busy->store(true, std::memory_order_relaxed);
+                _jobs[(_head + _count) % _jobs.size()] = {pixels, width, height, frame, busy};
+                _count++;
+            }
+            _job_available.notify_one();
+            return true;
+        }
+
+        // block until every pushed frame is written
+        void Wait()
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            _jobs_done.wait(lock, [this]() {
+                return _count == 0;
+            });
+        }
+
+        long GetWritten()
+        {
+            return _written;
+        }
+    };
+
+
+    // --- CAPTURE --- //
+
+    // reads back frames through a ring of `latency' pixel pack buffers.
+    // With ARB_buffer_storage they stay mapped, and the writer reads
+    // straight from them, otherwise each frame is copied out on the
+    // rendering thread once its transfer is done.
+    class FrameCapture
+    {
+    private:
+        typedef struct {
+            GLuint buffer;
+            GLsync fence;
+            unsigned char* mapped;         // persistently, or NULL
+            std::vector<unsigned char> copy;
+            std::atomic<bool> busy;        // being written
+            int width;
+            int height;
+            long frame;
+        } _slot_t;
+
+        std::vector<_slot_t> _slots;
+        size_t _next = 0;         // slot of the next readback
+        size_t _oldest = 0;       // slot of the oldest pending readback
+        size_t _pending = 0;
+        size_t _size = 0;         // bytes per buffer
+        bool _persistent;
+        long _frame = 0;
+
+        _capture_stats_t _stats = {0, 0, 0, 0.0};
+        FrameWriter _writer;
+
+        void resize(size_t size)
+        {
+            Finish();
+            for(_slot_t& slot : _slots)
+            {
+                States::bindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+                if(slot.mapped != NULL) {
+                    glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+                }
+                States::getState().DeleteBuffers(1, &slot.buffer);
+                glGenBuffers(1, &slot.buffer);
+                States::bindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+                slot.mapped = NULL;
+                if(_persistent)
+                {
+                    GLbitfield flags = GL_MAP_READ_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+                    glBufferStorage(GL_PIXEL_PACK_BUFFER, size, NULL, flags);
+                    slot.mapped = (unsigned char*)glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, size, flags);
+                }
+                else {
+                    glBufferData(GL_PIXEL_PACK_BUFFER, size, NULL, GL_STREAM_READ);
+                }
+            }
+            States::bindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+            _size = size;
+        }
+
+        // hand the oldest readback to the writer, if its transfer is
+        // done, or if `wait'
+        bool deliver(bool wait)
+        {
+            _slot_t& slot = _slots[_oldest];
+            GLenum status = glClientWaitSync(slot.fence, 0, 0);
+            while(wait && status == GL_TIMEOUT_EXPIRED) {
+                status = glClientWaitSync(slot.fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000);
+            }
+            if(status == GL_TIMEOUT_EXPIRED) {
+                return false;
+            }
+            glDeleteSync(slot.fence);
+            slot.fence = 0;
+
+            const unsigned char* pixels = slot.mapped;
+            if(pixels == NULL)
+            {
+                size_t size = (size_t)slot.width * slot.height * 4;
+                slot.copy.resize(size);
+                States::bindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+                const void* mapped = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, size, GL_MAP_READ_BIT);
+                if(mapped != NULL)
+                {
+                    memcpy(&slot.copy[0], mapped, size);
+                    glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+                }
+                States::bindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+                pixels = &slot.copy[0];
+            }
+
+            if(_writer.Push(pixels, slot.width, slot.height, slot.frame, &slot.busy)) {
+                _stats.captured++;
+            }
+            else {
+                _stats.dropped++;
+            }
+            _oldest = (_oldest + 1) % _slots.size();
+            _pending--;
+            return true;
+        }
+
+    public:
+        // `fps' is only stored in Y4M files
+        FrameCapture(const char* path, _capture_format_t format, int fps = 60,
+                     int latency = CAPTURE_LATENCY)
+            : _slots(latency > 0 ? latency : 1),
+              _writer(path, format, fps, _slots.size())
+        {
+            _persistent = GLEW_ARB_buffer_storage;
+            for(_slot_t& slot : _slots)
+            {
+                slot.buffer = 0;
+                slot.fence = 0;
+                slot.mapped = NULL;
+                slot.busy = false;
+            }
+        }
+
+        // writes the frames that are still in flight
+        ~FrameCapture()
+        {
+            Finish();
+            for(_slot_t& slot : _slots)
+            {
+                if(slot.mapped != NULL)
+                {
+                    States::bindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+                    glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+                }
+                States::getState().DeleteBuffers(1, &slot.buffer);
+            }
+        }
+
+        FrameCapture(const FrameCapture&) = delete;
+        FrameCapture& operator=(const FrameCapture&) = delete;
+
+        // start reading back the first color attachment of `framebuffer',
+        // or the back buffer if 0, after the frame is drawn and before
+        // the buffers are swapped. Returns false if the frame was dropped.
+        bool Capture(GLuint framebuffer, int width, int height)
+        {
+            auto start = std::chrono::steady_clock::now();
+            _frame++;
+
+            size_t size = (size_t)width * height * 4;
+            if(size > _size) {
+                resize(size);
+            }
+
+            // use what has arrived, oldest first, to keep the order
+            while(_pending > 0 && deliver(false)) {
+            }
+
+            bool captured = false;
+            _slot_t& slot = _slots[_next];
+            if(_pending == _slots.size() || slot.busy.load(std::memory_order_acquire)) {
+                _stats.dropped++;
+            }
+            else
+            {
+                States::bindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+                glBindFramebuffer(GL_READ_FRAMEBUFFER, framebuffer);
+                glReadBuffer(framebuffer == 0 ? GL_BACK : GL_COLOR_ATTACHMENT0);
+                glPixelStorei(GL_PACK_ALIGNMENT, 4);
+                glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+                States::bindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+                slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+                slot.width = width;
+                slot.height = height;
+                slot.frame = _frame;
+                _next = (_next + 1) % _slots.size();
+                _pending++;
+                captured = true;
+            }
+
+            std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+            _stats.seconds += elapsed.count();
+            return captured;
+        }
+
+        // the window's framebuffer, as bound by `UseDefaultFramebuffer'
+        bool Capture(int width, int height)
+        {
+            return Capture(States::getState().GetDefaultFramebuffer(), width, height);
+        }
+
+        // wait for all readbacks and until they are written
+        void Finish()
+        {
+            while(_pending > 0) {
+                deliver(true);
+            }
+            _writer.Wait();
+        }
+
+        const _capture_stats_t& GetStats()
+        {
+            _stats.written = _writer.GetWritten();
+            return _stats;
+        }
+    };
+
+} // namespace Captures
@@ -0,0 +1,452 @@
+//
+// Command Buffers
+//
+// Deferred rendering commands: worker threads record program, texture,
+// uniform and draw commands into their own command buffers, and the GL
+// thread replays them all at once in the order of their sort keys.
+//
+// Recording makes no GL calls, so scene traversal and the preparation
+// of draws can use every core. Commands with the same key are replayed
+// in the order they were recorded, so the commands of one draw are
+// usually recorded with the key of that draw.
+//
+
+#pragma once
+
+// GLEW
+#ifndef GLEW_STATIC
+#define GLEW_STATIC
+#endif
+#include <GL/glew.h>
+
+// CUSTOM
+#include "shaders.hpp"
+#include "state.hpp"
+#include "threads.hpp"
+
+// STANDARD
+#include <algorithm>
+#include <memory>
+#include <stdint.h>
+#include <string.h>
+#include <vector>
+
+
+namespace Commands
+{
+    typedef enum {
+        COMMAND_PROGRAM,
+        COMMAND_TEXTURE,
+        COMMAND_UNIFORM,
+        COMMAND_DRAW
+    } _command_type_t;
+
+    // the pass in the top 8 bits, so passes are replayed in order, then
+    // the program and texture to minimize state changes within a pass,
+    // and 24 bits of depth, e.g. front to back for opaque geometry
+    inline uint64_t makeKey(uint8_t pass, uint16_t program, uint16_t texture, uint32_t depth)
+    {
+        return ((uint64_t)pass << 56) | ((uint64_t)program << 40) |
+               ((uint64_t)texture << 24) | (depth & 0xffffff);
+    }
+
+    // --- COMMANDS --- //
+
+    // every command starts with this, and is padded to 8 bytes
+    typedef struct {
+        uint32_t type;
+        uint32_t size;
+    } _command_header_t;
+
+    typedef struct {
+        _command_header_t header;
+        Shaders::ShaderWrapper* shader;
+    } _program_command_t;
+
+    typedef struct {
+        _command_header_t header;
+        GLuint unit;
+        GLenum target;
+        GLuint texture;
+    } _texture_command_t;
+
+    // followed by the value, of the size of its type
+    typedef struct {
+        _command_header_t header;
+        Shaders::ShaderWrapper* shader;
+        Shaders::_uniform_handle_t handle;
+        Shaders::_uniform_t type;
+    } _uniform_command_t;
+
+    typedef struct {
+        _command_header_t header;
+        GLuint vertex_array;
+        GLenum mode;
+        GLint first;           // first vertex, or byte offset of the first index
+        GLsizei count;
+        GLsizei instances;
+        GLenum index_type;     // 0 to draw arrays
+    } _draw_command_t;
+
+    typedef struct {
+        uint64_t key;
+        uint32_t offset;       // of the command in the buffer
+    } _command_entry_t;
+
+    typedef struct {
+        long commands;
+        long draws;
+        long bytes;            // recorded, in all command buffers
+    } _command_stats_t;
+
+
+    // --- COMMAND BUFFERS --- //
+
+    // the commands of one thread, in a linear arena that keeps its
+    // memory from frame to frame. Not thread-safe, each thread records
+    // into its own buffer.
+    class CommandBuffer
+    {
+    private:
+        std::vector<unsigned char> _arena;
+        size_t _used = 0;
+        std::vector<_command_entry_t> _entries;
+        bool _sorted = true;
+
+        void* allocate(uint64_t key, _command_type_t type, size_t size)
+        {
+            size = (size + 7) & ~(size_t)7;
+            if(_used + size > _arena.size()) {
+                _arena.resize(std::max(_arena.size() * 2, _used + size));
+            }
+            _command_header_t* header = (_command_header_t*)&_arena[_used];
+            header->type = type;
+            header->size = size;
+            _entries.push_back({key, (uint32_t)_used});
+            _used += size;
+            _sorted = false;
+            return header;
+        }
+
+        template<typename T>
+        void recordUniform(uint64_t key, Shaders::ShaderWrapper& shader,
+                           Shaders::_uniform_handle_t handle,
+                           Shaders::_uniform_t type, const T& value)
+        {
+            _uniform_command_t* command = (_uniform_command_t*)
+                allocate(key, COMMAND_UNIFORM, sizeof(_uniform_command_t) + sizeof(T));
+            command->shader = &shader;
+            command->handle = handle;
+            command->type = type;
+            memcpy(command + 1, &value, sizeof(T));
+        }
+
+    public:
+        CommandBuffer(size_t bytes = 1 << 16)
+            : _arena(bytes)
+        {
+        }
+
+        // forget all commands, keeping the memory
+        void Reset()
+        {
+            _used = 0;
+            _entries.clear();
+            _sorted = true;
+        }
+
+        // sort the commands by key, keeping the order of equal keys.
+        // Called by the recording thread, so the GL thread only merges.
+        void Finish()
+        {
+            if(_sorted) {
+                return;
+            }
+            std::stable_sort(_entries.begin(), _entries.end(),
+                             [](const _command_entry_t& a, const _command_entry_t& b) {
+                                 return a.key < b.key;
+                             });
+            _sorted = true;
+        }
+
+        void UseProgram(uint64_t key, Shaders::ShaderWrapper& shader)
+        {
+            _program_command_t* command = (_program_command_t*)
+                allocate(key, COMMAND_PROGRAM, sizeof(_program_command_t));
+            command->shader = &shader;
+        }
+
+        void BindTexture(uint64_t key, GLuint unit, GLenum target, GLuint texture)
+        {
+            _texture_command_t* command = (_texture_command_t*)
+                allocate(key, COMMAND_TEXTURE, sizeof(_texture_command_t));
+            command->unit = unit;
+            command->target = target;
+            command->texture = texture;
+        }
+
+        // uniforms are set on `shader', which is made current on replay
+        void SetUniform(uint64_t key, Shaders::ShaderWrapper& shader,
+                        Shaders::_uniform_handle_t handle, const glm::mat4& mat)
+        {
+            recordUniform(key, shader, handle, Shaders::UNIFORM_MAT4, mat);
+        }
+
+        void SetUniform(uint64_t key, Shaders::ShaderWrapper& shader,
+                        Shaders::_uniform_handle_t handle, const glm::vec2& vec)
+        {
+            recordUniform(key, shader, handle, Shaders::UNIFORM_VEC2, vec);
+        }
+
+        void SetUniform(uint64_t key, Shaders::ShaderWrapper& shader,
+                        Shaders::_uniform_handle_t handle, const glm::vec3& vec)
+        {
+            recordUniform(key, shader, handle, Shaders::UNIFORM_VEC3, vec);
+        }
+
+        void SetUniform(uint64_t key, Shaders::ShaderWrapper& shader,
+                        Shaders::_uniform_handle_t handle, float f)
+        {
+            recordUniform(key, shader, handle, Shaders::UNIFORM_FLOAT, f);
+        }
+
+        void SetUniform(uint64_t key, Shaders::ShaderWrapper& shader,
+                        Shaders::_uniform_handle_t handle, int i)
+        {
+            recordUniform(key, shader, handle, Shaders::UNIFORM_INT, i);
+        }
+
+        void SetUniform(uint64_t key, Shaders::ShaderWrapper& shader,
+                        Shaders::_uniform_handle_t handle, unsigned int i)
+        {
+            recordUniform(key, shader, handle, Shaders::UNIFORM_UINT, i);
+        }
+
+        void Draw(uint64_t key, GLuint vertex_array, GLenum mode, GLint first,
+                  GLsizei count, GLsizei instances = 1)
+        {
+            _draw_command_t* command = (_draw_command_t*)
+                allocate(key, COMMAND_DRAW, sizeof(_draw_command_t));
+            *command = {command->header, vertex_array, mode, first, count, instances, 0};
+        }
+
+        // `offset' in bytes into the element buffer of the vertex array
+        void DrawElements(uint64_t key, GLuint vertex_array, GLenum mode, GLsizei count,
+                          GLenum index_type, GLint offset, GLsizei instances = 1)
+        {
+            _draw_command_t* command = (_draw_command_t*)
+                allocate(key, COMMAND_DRAW, sizeof(_draw_command_t));
+            *command = {command->header, vertex_array, mode, offset, count,
+                        instances, index_type};
+        }
+
+        const std::vector<_command_entry_t>& GetEntries()
+        {
+            return _entries;
+        }
+
+        const _command_header_t* GetCommand(const _command_entry_t& entry)
+        {
+            return (const _command_header_t*)&_arena[entry.offset];
+        }
+
+        size_t GetBytes()
+        {
+            return _used;
+        }
+    };
+
+    // execute one command on the GL thread
+    inline void execute(const _command_header_t* header)
+    {
+        switch(header->type)
+        {
+        case COMMAND_PROGRAM:
+        {
+            ((const _program_command_t*)header)->shader->Activate();
+            break;
+        }
+        case COMMAND_TEXTURE:
+        {
+            const _texture_command_t* command = (const _texture_command_t*)header;
+            States::bindTexture(command->unit, command->target, command->texture);
+            break;
+        }
+        case COMMAND_UNIFORM:
+        {
+            const _uniform_command_t* command = (const _uniform_command_t*)header;
+            Shaders::ShaderWrapper& shader = *command->shader;
+            const void* value = command + 1;
+            shader.Activate();
+            switch(command->type)
+            {
+            case Shaders::UNIFORM_MAT4:
+                shader.SetUniform(command->handle, (const glm::mat4*)value);
+                break;
+            case Shaders::UNIFORM_VEC2:
+                shader.SetUniform(command->handle, *(const glm::vec2*)value);
+                break;
+            case Shaders::UNIFORM_VEC3:
+                shader.SetUniform(command->handle, *(const glm::vec3*)value);
+                break;
+            case Shaders::UNIFORM_FLOAT:
+                shader.SetUniform(command->handle, *(const float*)value);
+                break;
+            case Shaders::UNIFORM_INT:
+                shader.SetUniform(command->handle, *(const int*)value);
+                break;
+            case Shaders::UNIFORM_UINT:
+                shader.SetUniform(command->handle, *(const unsigned int*)value);
+                break;
+            default:
+                break;
+            }
+            break;
+        }
+        case COMMAND_DRAW:
+        {
+            const _draw_command_t* command = (const _draw_command_t*)header;
+            States::bindVertexArray(command->vertex_array);
+            if(command->index_type != 0) {
+                glDrawElementsInstanced(command->mode, command->count, command->index_type,
+                                        (const void*)(intptr_t)command->first,
+                                        command->instances);
+            }
+            else if(command->instances == 1) {
+                glDrawArrays(command->mode, command->first, command->count);
+            }
+            else {
+                glDrawArraysInstanced(command->mode, command->first, command->count,
+                                      command->instances);
+            }
+            break;
+        }
+        default:
+            break;
+        }
+    }
+
+
+    // --- COMMAND QUEUE --- //
+
+    // one command buffer per recording thread, and the workers that
+    // record into them. `Record' splits the work between the threads,
+    // `Submit' replays the result on the GL thread.
+    class CommandQueue
+    {
+    private:
+        Threads::ThreadPool _pool;
+        std::vector<std::unique_ptr<CommandBuffer>> _buffers;
+        std::vector<size_t> _heads;
+        _command_stats_t _stats = {0, 0, 0};
+
+        static unsigned getRecordingThreads(unsigned threads)
+        {
+            return (threads == 0) ? Threads::getHardwareThreads() : threads;
+        }
+
+    public:
+        // 0 threads means one per hardware thread. The calling thread
+        // records as well, so the pool has one worker less.
+        CommandQueue(unsigned threads = 0)
+            : _pool(std::max(getRecordingThreads(threads), 2u) - 1)
+        {
+            for(unsigned i = 0; i < getRecordingThreads(threads); i++) {
+                _buffers.emplace_back(new CommandBuffer());
+            }
+        }
+
+        // call `func(buffer, begin, end)' for one consecutive chunk of
+        // [0, count) per command buffer, in parallel. Replaces the
+        // commands recorded before.
+        template<typename Func>
+        void Record(size_t count, Func func)
+        {
+            for(auto& buffer : _buffers) {
+                buffer->Reset();
+            }
+            size_t chunk = (count + _buffers.size() - 1) / _buffers.size();
+            Threads::parallelFor(_pool, count, chunk, [&](size_t begin, size_t end) {
+                CommandBuffer& buffer = *_buffers[begin / chunk];
+                func(buffer, begin, end);
+                buffer.Finish();
+            });
+        }
+
+        // replay the commands of all buffers in the order of their keys,
+        // merging the sorted buffers in a single pass. Equal keys from
+        // different buffers are replayed in the order of the buffers.
+        void Submit()
+        {
+            _stats = {0, 0, 0};
+            _heads.assign(_buffers.size(), 0);
+            for(auto& buffer : _buffers)
+            {
+                buffer->Finish();
+                _stats.bytes += buffer->GetBytes();
+            }
+
+            for(;;)
+            {
+                // the buffer with the smallest next key
+                int next = -1;
+                uint64_t key = 0;
+                for(size_t i = 0; i < _buffers.size(); i++)
+                {
+                    const std::vector<_command_entry_t>& entries = _buffers[i]->GetEntries();
+                    if(_heads[i] < entries.size() && (next < 0 || entries[_heads[i]].key < key))
+                    {
+                        next = i;
+                        key = entries[_heads[i]].key;
+                    }
+                }
+                if(next < 0) {
+                    break;
+                }
+
+                // replay the run of that buffer up to the next key of another
+                CommandBuffer& buffer = *_buffers[next];
+                const std::vector<_command_entry_t>& entries = buffer.GetEntries();
+                uint64_t limit = UINT64_MAX;
+                for(size_t i = 0; i < _buffers.size(); i++)
+                {
+                    const std::vector<_command_entry_t>& other = _buffers[i]->GetEntries();
+                    if((int)i != next && _heads[i] < other.size()) {
+                        // later buffers replay equal keys after this one
+                        uint64_t bound = other[_heads[i]].key;
+                        if((int)i < next && bound > 0) {
+                            bound--;
+                        }
+                        limit = std::min(limit, bound);
+                    }
+                }
+                size_t& head = _heads[next];
+                do
+                {
+                    const _command_header_t* command = buffer.GetCommand(entries[head]);
+                    execute(command);
+                    _stats.commands++;
+                    _stats.draws += command->type == COMMAND_DRAW;
+                    head++;
+                } while(head < entries.size() && entries[head].key <= limit);
+            }
+        }
+
+        CommandBuffer& GetBuffer(size_t index)
+        {
+            return *_buffers[index];
+        }
+
+        size_t GetBufferCount()
+        {
+            return _buffers.size();
+        }
+
+        // of the last `Submit'
+        const _command_stats_t& GetStats()
+        {
+            return _stats;
+        }
+    };
+
+} // namespace Commands
@@ -0,0 +1,644 @@
+//
+// Block Compression Library
+//
+// CPU encoder and decoder for the BC1 (DXT1) and BC3 (DXT5) texture
+// formats, which store every 4x4 block of pixels in 8 or 16 bytes
+// instead of 64. Rows of blocks are split on a thread pool, and the
+// bounds and palette search of a block are vectorized with SSE2.
+//
+// The decoder is used to measure the quality of the encoder, as the
+// PSNR of a round trip.
+//
+
+#pragma once
+
+// CUSTOM
+#include "mipmaps.hpp"
+#include "threads.hpp"
+
+// STANDARD
+#include <algorithm>
+#include <limits.h>
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define COMPRESSION_SSE
+#endif
+
+
+namespace Compression
+{
+    typedef enum {
+        COMPRESSION_BC1, // RGB, 8 bytes per block, alpha is dropped
+        COMPRESSION_BC3  // RGBA, 16 bytes per block
+    } _compression_format_t;
+
+    typedef enum {
+        COMPRESSION_FAST,   // endpoints from the bounding box of the colors
+        COMPRESSION_NORMAL, // endpoints along the principal axis of the colors
+        COMPRESSION_HIGH    // principal axis, refined by least squares
+    } _compression_quality_t;
+
+    // a compressed mipmap level, ready for `glCompressedTexImage2D'
+    typedef struct {
+        int width;
+        int height;
+        std::vector<unsigned char> data;
+    } Level;
+
+    inline size_t getBlockSize(_compression_format_t format)
+    {
+        return (format == COMPRESSION_BC1) ? 8 : 16;
+    }
+
+    inline size_t getCompressedSize(int width, int height, _compression_format_t format)
+    {
+        return (size_t)((width + 3) / 4) * ((height + 3) / 4) * getBlockSize(format);
+    }
+
+    // rows of blocks encoded per task on the thread pool
+    const size_t COMPRESSION_ROWS_PER_TASK = 4;
+
+
+    // --- COLORS --- //
+
+    inline uint16_t packRGB565(const float* rgb)
+    {
+        int r = (int)(std::min(std::max(rgb[0], 0.0f), 255.0f) * 31.0f / 255.0f + 0.5f);
+        int g = (int)(std::min(std::max(rgb[1], 0.0f), 255.0f) * 63.0f / 255.0f + 0.5f);
+        int b = (int)(std::min(std::max(rgb[2], 0.0f), 255.0f) * 31.0f / 255.0f + 0.5f);
+        return (uint16_t)((r << 11) | (g << 5) | b);
+    }
+
+    inline void unpackRGB565(uint16_t color, unsigned char* rgba)
+    {
+        int r = (color >> 11) & 31;
+        int g = (color >> 5) & 63;
+        int b = color & 31;
+        rgba[0] = (unsigned char)((r << 3) | (r >> 2));
+        rgba[1] = (unsigned char)((g << 2) | (g >> 4));
+        rgba[2] = (unsigned char)((b << 3) | (b >> 2));
+        rgba[3] = 255;
+    }
+
+    // the four colors of a BC1 block in four color mode
+    inline void getPalette(uint16_t c0, uint16_t c1, unsigned char palette[4][4])
+    {
+        unpackRGB565(c0, palette[0]);
+        unpackRGB565(c1, palette[1]);
+        for(int c = 0; c < 4; c++)
+        {
+            palette[2][c] = (unsigned char)((2 * palette[0][c] + palette[1][c]) / 3);
+            palette[3][c] = (unsigned char)((palette[0][c] + 2 * palette[1][c]) / 3);
+        }
+    }
+
+    // the eight values of a BC3 alpha block with a0 > a1
+    inline void getAlphaPalette(int a0, int a1, int palette[8])
+    {
+        palette[0] = a0;
+        palette[1] = a1;
+        if(a0 > a1)
+        {
+            for(int i = 1; i < 7; i++) {
+                palette[i + 1] = ((7 - i) * a0 + i * a1) / 7;
+            }
+        }
+        else
+        {
+            for(int i = 1; i < 5; i++) {
+                palette[i + 1] = ((5 - i) * a0 + i * a1) / 5;
+            }
+            palette[6] = 0;
+            palette[7] = 255;
+        }
+    }
+
+
+    // --- ENCODER --- //
+
+    // bounds of the 16 RGBA pixels of a block
+    inline void getBounds(const unsigned char* block, unsigned char* low, unsigned char* high)
+    {
+#ifdef COMPRESSION_SSE
+        __m128i r0 = _mm_loadu_si128((const __m128i*)block);
+        __m128i r1 = _mm_loadu_si128((const __m128i*)(block + 16));
+        __m128i r2 = _mm_loadu_si128((const __m128i*)(block + 32));
+        __m128i r3 = _mm_loadu_si128((const __m128i*)(block + 48));
+        __m128i mn = _mm_min_epu8(_mm_min_epu8(r0, r1), _mm_min_epu8(r2, r3));
+        __m128i mx = _mm_max_epu8(_mm_max_epu8(r0, r1), _mm_max_epu8(r2, r3));
+
+        // reduce the four pixels of a row to one
+        mn = _mm_min_epu8(mn, _mm_shuffle_epi32(mn, _MM_SHUFFLE(1, 0, 3, 2)));
+        mx = _mm_max_epu8(mx, _mm_shuffle_epi32(mx, _MM_SHUFFLE(1, 0, 3, 2)));
+        mn = _mm_min_epu8(mn, _mm_shuffle_epi32(mn, _MM_SHUFFLE(2, 3, 0, 1)));
+        mx = _mm_max_epu8(mx, _mm_shuffle_epi32(mx, _MM_SHUFFLE(2, 3, 0, 1)));
+
+        uint32_t l = _mm_cvtsi128_si32(mn);
+        uint32_t h = _mm_cvtsi128_si32(mx);
+        memcpy(low, &l, 4);
+        memcpy(high, &h, 4);
+#else
+        memcpy(low, block, 4);
+        memcpy(high, block, 4);
+        for(int i = 1; i < 16; i++)
+        {
+            for(int c = 0; c < 4; c++)
+            {
+                low[c] = std::min(low[c], block[i * 4 + c]);
+                high[c] = std::max(high[c], block[i * 4 + c]);
+            }
+        }
+#endif
+    }
+
+    // choose the nearest palette color for every pixel, by squared RGB
+    // distance. Returns the total squared error.
+    inline int findColorIndices(const unsigned char* block, const unsigned char palette[4][4],
+                                int indices[16])
+    {
+#ifdef COMPRESSION_SSE
+        const __m128i mask = _mm_set1_epi32(0x00ffffff);
+        const __m128i zero = _mm_setzero_si128();
+        __m128i colors[4];
+        for(int i = 0; i < 4; i++)
+        {
+            uint32_t color;
+            memcpy(&color, palette[i], 4);
+            colors[i] = _mm_unpacklo_epi8(_mm_and_si128(_mm_set1_epi32(color), mask), zero);
+        }
+
+        __m128i total = zero;
+        for(int p = 0; p < 16; p += 4)
+        {
+            __m128i pixels = _mm_and_si128(_mm_loadu_si128((const __m128i*)(block + p * 4)), mask);
+            __m128i lo = _mm_unpacklo_epi8(pixels, zero);
+            __m128i hi = _mm_unpackhi_epi8(pixels, zero);
+
+            __m128i best = _mm_set1_epi32(INT_MAX);
+            __m128i best_index = zero;
+            for(int i = 0; i < 4; i++)
+            {
+                __m128i dl = _mm_sub_epi16(lo, colors[i]);
+                __m128i dh = _mm_sub_epi16(hi, colors[i]);
+                dl = _mm_madd_epi16(dl, dl);
+                dh = _mm_madd_epi16(dh, dh);
+
+                // add the (r, g) and (b, a) halves of each pixel
+                __m128 fl = _mm_castsi128_ps(dl);
+                __m128 fh = _mm_castsi128_ps(dh);
+                __m128i distance = _mm_add_epi32(
+                    _mm_castps_si128(_mm_shuffle_ps(fl, fh, _MM_SHUFFLE(2, 0, 2, 0))),
+                    _mm_castps_si128(_mm_shuffle_ps(fl, fh, _MM_SHUFFLE(3, 1, 3, 1))));
+
+                __m128i less = _mm_cmplt_epi32(distance, best);
+                best = _mm_or_si128(_mm_and_si128(less, distance), _mm_andnot_si128(less, best));
+                best_index = _mm_or_si128(_mm_and_si128(less, _mm_set1_epi32(i)),
+                                          _mm_andnot_si128(less, best_index));
+            }
+            _mm_storeu_si128((__m128i*)&indices[p], best_index);
+            total = _mm_add_epi32(total, best);
+        }
+        int sums[4];
+        _mm_storeu_si128((__m128i*)sums, total);
+        return sums[0] + sums[1] + sums[2] + sums[3];
+#else
+        int total = 0;
+        for(int p = 0; p < 16; p++)
+        {
+            int best = INT_MAX;
+            for(int i = 0; i < 4; i++)
+            {
+                int distance = 0;
+                for(int c = 0; c < 3; c++)
+                {
+                    int d = block[p * 4 + c] - palette[i][c];
+                    distance += d * d;
+                }
+                if(distance < best)
+                {
+                    best = distance;
+                    indices[p] = i;
+                }
+            }
+            total += best;
+        }
+        return total;
+#endif
+    }
+
+    // endpoints along the principal axis of the colors
+    inline void getPrincipalEndpoints(const unsigned char* block, float* start, float* end)
+    {
+        float mean[3] = {0.0f, 0.0f, 0.0f};
+        for(int p = 0; p < 16; p++) {
+            for(int c = 0; c < 3; c++) {
+                mean[c] += block[p * 4 + c];
+            }
+        }
+        for(int c = 0; c < 3; c++) {
+            mean[c] /= 16.0f;
+        }
+
+        // covariance: rr, rg, rb, gg, gb, bb
+        float cov[6] = {0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f};
+        for(int p = 0; p < 16; p++)
+        {
+            float r = block[p * 4 + 0] - mean[0];
+            float g = block[p * 4 + 1] - mean[1];
+            float b = block[p * 4 + 2] - mean[2];
+            cov[0] += r * r;
+            cov[1] += r * g;
+            cov[2] += r * b;
+            cov[3] += g * g;
+            cov[4] += g * b;
+            cov[5] += b * b;
+        }
+
+        // power iteration, from the diagonal of the bounding box
+        unsigned char low[4], high[4];
+        getBounds(block, low, high);
+        float axis[3] = {(float)(high[0] - low[0]), (float)(high[1] - low[1]),
+                         (float)(high[2] - low[2])};
+        for(int i = 0; i < 4; i++)
+        {
+            float x = cov[0] * axis[0] + cov[1] * axis[1] + cov[2] * axis[2];
+            float y = cov[1] * axis[0] + cov[3] * axis[1] + cov[4] * axis[2];
+            float z = cov[2] * axis[0] + cov[4] * axis[1] + cov[5] * axis[2];
+            float length = std::max(std::max(fabsf(x), fabsf(y)), fabsf(z));
+            if(length < 1e-6f) {
+                break;
+            }
+            axis[0] = x / length;
+            axis[1] = y / length;
+            axis[2] = z / length;
+        }
+
+        // the extreme projections on the axis
+        float low_t = 1e30f, high_t = -1e30f;
+        for(int p = 0; p < 16; p++)
+        {
+            float t = (block[p * 4 + 0] - mean[0]) * axis[0] +
+                      (block[p * 4 + 1] - mean[1]) * axis[1] +
+                      (block[p * 4 + 2] - mean[2]) * axis[2];
+            low_t = std::min(low_t, t);
+            high_t = std::max(high_t, t);
+        }
+        float norm = axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2];
+        if(norm < 1e-12f) {
+            norm = 1.0f;
+        }
+        // inset like the bounding box, as the extremes are rarely hit
+        float inset = (high_t - low_t) / 16.0f;
+        for(int c = 0; c < 3; c++)
+        {
+            start[c] = mean[c] + axis[c] * (high_t - inset) / norm;
+            end[c] = mean[c] + axis[c] * (low_t + inset) / norm;
+        }
+    }
+
+    // the endpoints that fit the colors best for the given indices, by
+    // least squares. Returns false if they cannot be solved for.
+    inline bool refineEndpoints(const unsigned char* block, const int indices[16],
+                                float* start, float* end)
+    {
+        static const float weights[4] = {1.0f, 0.0f, 2.0f / 3.0f, 1.0f / 3.0f};
+
+        float aa = 0.0f, ab = 0.0f, bb = 0.0f;
+        float ax[3] = {0.0f, 0.0f, 0.0f};
+        float bx[3] = {0.0f, 0.0f, 0.0f};
+        for(int p = 0; p < 16; p++)
+        {
+            float a = weights[indices[p]];
+            float b = 1.0f - a;
+            aa += a * a;
+            ab += a * b;
+            bb += b * b;
+            for(int c = 0; c < 3; c++)
+            {
+                ax[c] += a * block[p * 4 + c];
+                bx[c] += b * block[p * 4 + c];
+            }
+        }
+
+        float det = aa * bb - ab * ab;
+        if(fabsf(det) < 1e-6f) {
+            return false;
+        }
+        for(int c = 0; c < 3; c++)
+        {
+            start[c] = (ax[c] * bb - bx[c] * ab) / det;
+            end[c] = (bx[c] * aa - ax[c] * ab) / det;
+        }
+        return true;
+    }
+
+    // quantize the endpoints and choose the indices. Returns the error.
+    inline int fitColorBlock(const unsigned char* block, const float* start, const float* end,
+                             uint16_t& c0, uint16_t& c1, int indices[16])
+    {
+        c0 = packRGB565(start);
+        c1 = packRGB565(end);
+        unsigned char palette[4][4];
+        getPalette(c0, c1, palette);
+        return findColorIndices(block, palette, indices);
+    }
+
+    // encode the colors of 16 RGBA pixels into an 8 byte BC1 block,
+    // always in four color mode
+    inline void encodeColorBlock(const unsigned char* block, _compression_quality_t quality,
+                                 unsigned char* out)
+    {
+        float start[3], end[3];
+        if(quality == COMPRESSION_FAST)
+        {
+            // the bounding box, inset to reduce the error at its corners
+            unsigned char low[4], high[4];
+            getBounds(block, low, high);
+            for(int c = 0; c < 3; c++)
+            {
+                float inset = (high[c] - low[c]) / 16.0f;
+                start[c] = high[c] - inset;
+                end[c] = low[c] + inset;
+            }
+        }
+        else {
+            getPrincipalEndpoints(block, start, end);
+        }
+
+        uint16_t c0, c1;
+        int indices[16];
+        int error = fitColorBlock(block, start, end, c0, c1, indices);
+
+        if(quality == COMPRESSION_HIGH)
+        {
+            for(int i = 0; i < 2 && error > 0; i++)
+            {
+                uint16_t r0, r1;
+                int refined[16];
+                if(!refineEndpoints(block, indices, start, end)) {
+                    break;
+                }
+                int refined_error = fitColorBlock(block, start, end, r0, r1, refined);
+                if(refined_error >= error) {
+                    break;
+                }
+                error = refined_error;
+                c0 = r0;
+                c1 = r1;
+                memcpy(indices, refined, sizeof(refined));
+            }
+        }
+
+        // four color mode needs c0 > c1, and swapping the endpoints
+        // swaps indices 0 and 1, and 2 and 3
+        int flip = 0;
+        if(c0 < c1)
+        {
+            std::swap(c0, c1);
+            flip = 1;
+        }
+        uint32_t bits = 0;
+        if(c0 != c1) {
+            for(int p = 0; p < 16; p++) {
+                bits |= (uint32_t)(indices[p] ^ flip) << (2 * p);
+            }
+        }
+
+        out[0] = c0 & 0xff;
+        out[1] = c0 >> 8;
+        out[2] = c1 & 0xff;
+        out[3] = c1 >> 8;
+        for(int i = 0; i < 4; i++) {
+            out[4 + i] = (bits >> (8 * i)) & 0xff;
+        }
+    }
+
+    // encode the alpha of 16 RGBA pixels into an 8 byte BC3 alpha block
+    inline void encodeAlphaBlock(const unsigned char* block, unsigned char* out)
+    {
+        int a0 = 0, a1 = 255;
+        for(int p = 0; p < 16; p++)
+        {
+            a0 = std::max(a0, (int)block[p * 4 + 3]);
+            a1 = std::min(a1, (int)block[p * 4 + 3]);
+        }
+
+        uint64_t bits = 0;
+        if(a0 > a1)
+        {
+            int palette[8];
+            getAlphaPalette(a0, a1, palette);
+            for(int p = 0; p < 16; p++)
+            {
+                int alpha = block[p * 4 + 3];
+                int best = INT_MAX;
+                uint64_t index = 0;
+                for(int i = 0; i < 8; i++)
+                {
+                    int d = abs(alpha - palette[i]);
+                    if(d < best)
+                    {
+                        best = d;
+                        index = i;
+                    }
+                }
+                bits |= index << (3 * p);
+            }
+        }
+
+        out[0] = (unsigned char)a0;
+        out[1] = (unsigned char)a1;
+        for(int i = 0; i < 6; i++) {
+            out[2 + i] = (bits >> (8 * i)) & 0xff;
+        }
+    }
+
+    // copy the 4x4 block at (bx, by) of an RGBA8 image, repeating the
+    // last row and column for images that are not a multiple of 4
+    inline void fetchBlock(const unsigned char* pixels, int width, int height,
+                           int bx, int by, unsigned char* block)
+    {
+        for(int y = 0; y < 4; y++)
+        {
+            int sy = std::min(by * 4 + y, height - 1);
+            const unsigned char* row = pixels + (size_t)sy * width * 4;
+            if(bx * 4 + 4 <= width) {
+                memcpy(block + y * 16, row + bx * 16, 16);
+                continue;
+            }
+            for(int x = 0; x < 4; x++)
+            {
+                int sx = std::min(bx * 4 + x, width - 1);
+                memcpy(block + y * 16 + x * 4, row + sx * 4, 4);
+            }
+        }
+    }
+
+    // compress an RGBA8 image, with rows of blocks split on `pool' if
+    // there is one
+    void compressImage(const unsigned char* pixels, int width, int height,
+                       _compression_format_t format, _compression_quality_t quality,
+                       std::vector<unsigned char>& out, Threads::ThreadPool* pool = NULL)
+    {
+        int blocks_x = (width + 3) / 4;
+        int blocks_y = (height + 3) / 4;
+        size_t block_size = getBlockSize(format);
+        out.resize(getCompressedSize(width, height, format));
+
+        auto func = [&](size_t begin, size_t end) {
+            unsigned char block[64];
+            for(size_t by = begin; by < end; by++)
+            {
+                unsigned char* dst = &out[by * blocks_x * block_size];
+                for(int bx = 0; bx < blocks_x; bx++)
+                {
+                    fetchBlock(pixels, width, height, bx, by, block);
+                    if(format == COMPRESSION_BC3)
+                    {
+                        encodeAlphaBlock(block, dst);
+                        dst += 8;
+                    }
+                    encodeColorBlock(block, quality, dst);
+                    dst += 8;
+                }
+            }
+        };
+
+        if(pool == NULL) {
+            func((size_t)0, (size_t)blocks_y);
+        }
+        else {
+            Threads::parallelFor(*pool, blocks_y, COMPRESSION_ROWS_PER_TASK, func);
+        }
+    }
+
+    // compress every level of a chain from `Mipmaps::generateMipmaps'
+    // in the RGBA8 or SRGB8_ALPHA8 format
+    std::vector<Level> compressMipmaps(const std::vector<Mipmaps::Level>& levels,
+                                       _compression_format_t format,
+                                       _compression_quality_t quality,
+                                       Threads::ThreadPool* pool = NULL)
+    {
+        std::vector<Level> compressed(levels.size());
+        for(size_t i = 0; i < levels.size(); i++)
+        {
+            compressed[i].width = levels[i].width;
+            compressed[i].height = levels[i].height;
+            compressImage(&levels[i].data[0], levels[i].width, levels[i].height,
+                          format, quality, compressed[i].data, pool);
+        }
+        return compressed;
+    }
+
+
+    // --- DECODER --- //
+
+    // BC3 color blocks are always in four color mode
+    inline void decodeColorBlock(const unsigned char* in, unsigned char* block,
+                                 bool four_color = false)
+    {
+        uint16_t c0 = in[0] | (in[1] << 8);
+        uint16_t c1 = in[2] | (in[3] << 8);
+        uint32_t bits = in[4] | (in[5] << 8) | (in[6] << 16) | ((uint32_t)in[7] << 24);
+
+        unsigned char palette[4][4];
+        getPalette(c0, c1, palette);
+        if(c0 <= c1 && !four_color)
+        {
+            // three color mode, with transparent black
+            for(int c = 0; c < 4; c++) {
+                palette[2][c] = (unsigned char)((palette[0][c] + palette[1][c]) / 2);
+            }
+            memset(palette[3], 0, 4);
+        }
+
+        for(int p = 0; p < 16; p++) {
+            memcpy(block + p * 4, palette[(bits >> (2 * p)) & 3], 4);
+        }
+    }
+
+    inline void decodeAlphaBlock(const unsigned char* in, unsigned char* block)
+    {
+        int palette[8];
+        getAlphaPalette(in[0], in[1], palette);
+        uint64_t bits = 0;
+        for(int i = 0; i < 6; i++) {
+            bits |= (uint64_t)in[2 + i] << (8 * i);
+        }
+        for(int p = 0; p < 16; p++) {
+            block[p * 4 + 3] = (unsigned char)palette[(bits >> (3 * p)) & 7];
+        }
+    }
+
+    // decompress to an RGBA8 image of `width' by `height' pixels
+    void decompressImage(const unsigned char* data, int width, int height,
+                         _compression_format_t format, std::vector<unsigned char>& out,
+                         Threads::ThreadPool* pool = NULL)
+    {
+        int blocks_x = (width + 3) / 4;
+        int blocks_y = (height + 3) / 4;
+        size_t block_size = getBlockSize(format);
+        out.resize((size_t)width * height * 4);
+
+        auto func = [&](size_t begin, size_t end) {
+            unsigned char block[64];
+            for(size_t by = begin; by < end; by++)
+            {
+                for(int bx = 0; bx < blocks_x; bx++)
+                {
+                    const unsigned char* src = data + (by * blocks_x + bx) * block_size;
+                    if(format == COMPRESSION_BC3)
+                    {
+                        decodeColorBlock(src + 8, block, true);
+                        decodeAlphaBlock(src, block);
+                    }
+                    else {
+                        decodeColorBlock(src, block);
+                    }
+
+                    for(int y = 0; y < 4 && (int)by * 4 + y < height; y++)
+                    {
+                        int count = std::min(4, width - bx * 4);
+                        memcpy(&out[((by * 4 + y) * (size_t)width + bx * 4) * 4],
+                               block + y * 16, count * 4);
+                    }
+                }
+            }
+        };
+
+        if(pool == NULL) {
+            func((size_t)0, (size_t)blocks_y);
+        }
+        else {
+            Threads::parallelFor(*pool, blocks_y, COMPRESSION_ROWS_PER_TASK, func);
+        }
+    }
+
+    // peak signal to noise ratio in dB between two RGBA8 images, over
+    // the first `channels' channels. Infinite if they are equal.
+    double computePSNR(const unsigned char* a, const unsigned char* b,
+                       int width, int height, int channels = 4)
+    {
+        double sum = 0.0;
+        size_t count = (size_t)width * height;
+        for(size_t i = 0; i < count; i++)
+        {
+            for(int c = 0; c < channels; c++)
+            {
+                double d = (double)a[i * 4 + c] - b[i * 4 + c];
+                sum += d * d;
+            }
+        }
+        double mse = sum / ((double)count * channels);
+        if(mse == 0.0) {
+            return INFINITY;
+        }
+        return 10.0 * log10(255.0 * 255.0 / mse);
+    }
+
+} // namespace Compression
@@ -1,9 +1,22 @@
+// counts heap allocations, to check that frames do not allocate
+#define MEMORY_COUNT_ALLOCATIONS
+#include "memory.hpp"
+
 #include "windows.hpp"
 #include "shaders.hpp"
+#include "buffers.hpp"
+#include "profiler.hpp"
 #include "fileIO.hpp"
 #include "system.hpp"
 
 
+// matches the inputs of the vertex shader
+struct Vertex {
+    glm::vec2 vertexPos;
+    glm::vec3 vertexCol;
+};
+typedef Buffers::VertexLayout<Vertex, &Vertex::vertexPos, &Vertex::vertexCol> VertexLayout;
+
 void key_callback(GLFWwindow* win, int key, int scancode, int action, int mode)
 {
     if(action == GLFW_PRESS && key == GLFW_KEY_ESCAPE)
@@ -20,36 +33,47 @@ int main()
     Shaders::ShaderWrapper shader("shader1", Shaders::SHADERS_VF);
     shader.Activate();
 
-    GLuint VBO, VAO;
-    GLfloat vertexData[] = {
-        // vertexPos   vertexCol
-        -1.0f, -1.0f,  1.0f, 0.0f, 0.0f,
-        -1.0f, 1.0f,   0.0f, 1.0f, 0.0f,
-        1.0f, 1.0f,    0.0f, 0.0f, 1.0f
+    Vertex vertexData[] = {
+        // vertexPos         vertexCol
+        {{-1.0f, -1.0f},  {1.0f, 0.0f, 0.0f}},
+        {{-1.0f, 1.0f},   {0.0f, 1.0f, 0.0f}},
+        {{1.0f, 1.0f},    {0.0f, 0.0f, 1.0f}}
     };
-    glGenVertexArrays(1, &VAO);
-    glGenBuffers(1, &VBO);
-    glBindVertexArray(VAO);
-    glBindBuffer(GL_ARRAY_BUFFER, VBO);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(vertexData), vertexData, GL_STATIC_DRAW);
-    // (GLuint index, GLint size, GLenum type, GLboolean normalized,
-    //  GLsizei stride, const GLvoid * pointer);
-    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 5*sizeof(GLfloat),
-                          (GLvoid*)0);
-    glEnableVertexAttribArray(0);
-
-    // texture coordinate
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 5*sizeof(GLfloat),
-                          (GLvoid*)(2*sizeof(GLfloat)));
-    glEnableVertexAttribArray(1);
+    Buffers::Mesh<VertexLayout> mesh(vertexData, 3);
+
+    // timings are written to profile.json and trace.json at exit
+    Profiling::Profiler profiler;
+    Profiling::_scope_id_t scope_frame = profiler.GetScope("Frame");
+    Profiling::_scope_id_t scope_clear = profiler.GetScope("ClearWindow");
+    Profiling::_scope_id_t scope_draw = profiler.GetScope("Draw");
+    Profiling::_scope_id_t scope_swap = profiler.GetScope("SwapBuffers");
+    Memory::AllocationCheck allocations;
 
     while(!glfwWindowShouldClose(window.GetWindow()))
     {
+        profiler.BeginFrame();
+        profiler.Begin(scope_frame);
+
+        profiler.Begin(scope_clear);
         window.ClearWindow();
-        glDrawArrays(GL_TRIANGLES, 0, 3);
+        profiler.End(scope_clear);
+
+        profiler.Begin(scope_draw);
+        mesh.Draw();
+        profiler.End(scope_draw);
+
+        profiler.Begin(scope_swap);
         window.SwapBuffers();
+        profiler.End(scope_swap);
+
+        profiler.End(scope_frame);
+        allocations.EndFrame();
         window.WaitEvents();
     }
+    std::cout << "frames with heap allocations after the warmup: "
+              << allocations.GetAllocatingFrames() << std::endl;
+    profiler.WriteJSON("profile.json");
+    profiler.WriteChromeTrace("trace.json");
     window.CloseWindow();
 
     return 0;
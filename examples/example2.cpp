@@ -1,16 +1,33 @@
+// counts heap allocations, to check that frames do not allocate
+#define MEMORY_COUNT_ALLOCATIONS
+#include "memory.hpp"
+
 #include "windows.hpp"
+#include "renderLoop.hpp"
 #include "shaders.hpp"
+#include "buffers.hpp"
+#include "profiler.hpp"
+#include "watcher.hpp"
 #include "fileIO.hpp"
 #include "system.hpp"
 
-bool wait = false;
-GLfloat timer;
+// the simulation time, stopped while paused
+double timer = 0.0;
+Windows::RenderLoop* render_loop = NULL;
+
+// matches the inputs of the vertex shader
+struct Vertex {
+    glm::vec2 vertexPos;
+    glm::vec3 vertexCol;
+};
+typedef Buffers::VertexLayout<Vertex, &Vertex::vertexPos, &Vertex::vertexCol> VertexLayout;
 
 void key_callback(GLFWwindow* win, int key, int scancode, int action, int mode)
 {
-    if(wait)
+    // any key resumes
+    if(render_loop->IsPaused())
     {
-        wait = false;
+        render_loop->SetPaused(false);
         return;
     }
     if(action == GLFW_PRESS)
@@ -27,8 +44,7 @@ void key_callback(GLFWwindow* win, int key, int scancode, int action, int mode)
         switch(key)
         {
         case GLFW_KEY_SPACE:
-            wait = true;
-            glfwSetTime(timer);
+            render_loop->SetPaused(true);
             break;
         }
     }
@@ -41,46 +57,85 @@ int main()
 
     Shaders::ShaderWrapper shader("shader2", Shaders::SHADERS_VF);
     shader.Activate();
+    Shaders::_uniform_handle_t xytime = shader.GetUniformHandle("xytime");
+
+    // saving a file in shader2/ reloads the program
+    Watchers::ShaderWatcher watcher;
+    watcher.Watch(shader);
 
-    GLuint VBO, VAO;
-    GLfloat vertexData[] = {
-        // vertexPos   vertexCol
-        -0.5f, -0.5f,  1.0f, 0.0f, 0.0f,
-        -0.5f, 0.5f,   0.0f, 1.0f, 0.0f,
-        0.5f, 0.5f,    0.0f, 0.0f, 1.0f
+    Vertex vertexData[] = {
+        // vertexPos         vertexCol
+        {{-0.5f, -0.5f},  {1.0f, 0.0f, 0.0f}},
+        {{-0.5f, 0.5f},   {0.0f, 1.0f, 0.0f}},
+        {{0.5f, 0.5f},    {0.0f, 0.0f, 1.0f}}
     };
-    glGenVertexArrays(1, &VAO);
-    glGenBuffers(1, &VBO);
-    glBindVertexArray(VAO);
-    glBindBuffer(GL_ARRAY_BUFFER, VBO);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(vertexData), vertexData, GL_STATIC_DRAW);
-    // (GLuint index, GLint size, GLenum type, GLboolean normalized,
-    //  GLsizei stride, const GLvoid * pointer);
-    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 5*sizeof(GLfloat),
-                          (GLvoid*)0);
-    glEnableVertexAttribArray(0);
-
-    // texture coordinate
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 5*sizeof(GLfloat),
-                          (GLvoid*)(2*sizeof(GLfloat)));
-    glEnableVertexAttribArray(1);
-
-    while(!glfwWindowShouldClose(window.GetWindow()))
-    {
-        if(wait)
-        {
-            window.WaitEvents();
-        }
-        else
-        {
-            window.PollEvents();
+    Buffers::Mesh<VertexLayout> mesh(vertexData, 3);
+
+    // timings are written to profile.json and trace.json at exit
+    Profiling::Profiler profiler;
+    Profiling::_scope_id_t scope_frame = profiler.GetScope("Frame");
+    Profiling::_scope_id_t scope_clear = profiler.GetScope("ClearWindow");
+    Profiling::_scope_id_t scope_draw = profiler.GetScope("Draw");
+    Profiling::_scope_id_t scope_swap = profiler.GetScope("SwapBuffers");
+    Memory::AllocationCheck allocations;
+
+    // 60 updates and at most 60 frames per second, and nothing is
+    // rendered while paused, until an event arrives
+    Windows::RenderLoop loop(window, 60.0);
+    loop.SetFrameRateCap(60.0);
+    loop.SetIdleMode(true);
+    render_loop = &loop;
+
+    // a saved shader is reloaded also while paused: the watcher requests
+    // a frame, and wakes up the loop
+    watcher.SetChangeCallback([&]() {
+        loop.RequestRedraw();
+    });
+
+    auto update = [&](double dt) {
+        timer += dt;
+    };
+
+    auto render = [&](double alpha) {
+        if(watcher.Update() > 0 || watcher.IsReloading()) {
+            loop.RequestRedraw();
         }
+
+        profiler.BeginFrame();
+        profiler.Begin(scope_frame);
+
+        profiler.Begin(scope_clear);
         window.ClearWindow();
-        timer = glfwGetTime();
-        shader.SetUniform("xytime", glm::vec2(cos(timer), sin(timer)));
-        glDrawArrays(GL_TRIANGLES, 0, 3);
+        profiler.End(scope_clear);
+
+        // interpolate between the last two updates
+        profiler.Begin(scope_draw);
+        float time = timer + (loop.IsPaused() ? 0.0 : alpha * loop.GetTimestep());
+        shader.SetUniform(xytime, glm::vec2(cos(time), sin(time)));
+        mesh.Draw();
+        profiler.End(scope_draw);
+    };
+
+    loop.SetPresentFunction([&]() {
+        profiler.Begin(scope_swap);
         window.SwapBuffers();
-    }
+        profiler.End(scope_swap);
+
+        profiler.End(scope_frame);
+        allocations.EndFrame();
+    });
+
+    loop.Run(update, render);
+    watcher.SetChangeCallback(NULL);
+    std::cout << "frames with heap allocations after the warmup: "
+              << allocations.GetAllocatingFrames() << std::endl;
+    profiler.WriteJSON("profile.json");
+    profiler.WriteChromeTrace("trace.json");
+
+    // GL calls of the last frame, and how many were redundant
+    const States::_state_counters_t& calls = States::getState().GetFrameCounters();
+    std::cout << "state changes per frame: " << States::getTotal(calls.issued)
+              << " issued, " << States::getTotal(calls.elided) << " elided" << std::endl;
     window.CloseWindow();
 
     return 0;
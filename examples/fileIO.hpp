@@ -9,10 +9,18 @@
 
 // STANDARD
 #include <string>
+#include <string_view>
 #include <fstream>
 #include <iostream>
+#include <stdint.h>
+#include <stdio.h>
+#include <sys/stat.h>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
 
 // CUSTOM
+#include "memory.hpp"
 #include "system.hpp"
 
 
@@ -24,28 +32,96 @@ namespace FileIO
         return file.substr(file.find_last_of(".") + 1);
     }
 
+    // read a whole file into `content' with a single allocation and
+    // a single read, returning false if it could not be opened
+    bool readFile(const char* path, std::string& content)
+    {
+        std::ifstream fileStream(path, std::ios::in | std::ios::binary);
+        if(!fileStream.is_open()) {
+            return false;
+        }
+
+        fileStream.seekg(0, std::ios::end);
+        std::streamoff size = fileStream.tellg();
+        fileStream.seekg(0, std::ios::beg);
+
+        content.resize(size > 0 ? size : 0);
+        if(size > 0 && !fileStream.read(&content[0], size)) {
+            content.clear();
+            return false;
+        }
+        return true;
+    }
+
     // auxillary function to read from a (shader) file
     std::string readFileContents(const char* path)
     {
         std::string content;
-        std::ifstream fileStream(path, std::ios::in);
+        if(!readFile(path, content))
+        {
+            std::cerr << "Could not read file '"
+                      << path << "'." << std::endl;
+        }
+        return content;
+    }
 
-        if(!fileStream.is_open())
+    // same, but into `arena', so reading does not allocate. Returns an
+    // empty string if the file could not be read.
+    const char* readFileContents(const char* path, Memory::FrameArena& arena)
+    {
+        FILE* file = fopen(path, "rb");
+        long size = -1;
+        if(file != NULL && fseek(file, 0, SEEK_END) == 0) {
+            size = ftell(file);
+        }
+        char* content = (size >= 0) ? arena.Allocate<char>(size + 1) : NULL;
+        if(content == NULL || fseek(file, 0, SEEK_SET) != 0 ||
+           fread(content, 1, size, file) != (size_t)size)
         {
             std::cerr << "Could not read file '"
                       << path << "'." << std::endl;
+            if(file != NULL) {
+                fclose(file);
+            }
             return "";
         }
+        fclose(file);
+        content[size] = '\0';
+        return content;
+    }
 
-        std::string line = "";
-        while(!fileStream.eof())
-        {
-            std::getline(fileStream, line);
-            content.append(line + "\n");
+    // modification time and size of a file, to tell whether it changed
+    typedef struct {
+        int64_t seconds;
+        int64_t nanoseconds;
+        int64_t size;
+    } _file_stamp_t;
+
+    inline bool operator==(const _file_stamp_t& a, const _file_stamp_t& b)
+    {
+        return a.seconds == b.seconds && a.nanoseconds == b.nanoseconds
+            && a.size == b.size;
+    }
+
+    // returns false if the file does not exist
+    bool getFileStamp(const char* path, _file_stamp_t& stamp)
+    {
+        struct stat info;
+        if(stat(path, &info) != 0) {
+            return false;
         }
+        stamp.seconds = info.st_mtime;
+        stamp.size = info.st_size;
 
-        fileStream.close();
-        return content;
+        // editors may save twice within a second
+#if defined(__linux__)
+        stamp.nanoseconds = info.st_mtim.tv_nsec;
+#elif defined(__APPLE__)
+        stamp.nanoseconds = info.st_mtimespec.tv_nsec;
+#else
+        stamp.nanoseconds = 0;
+#endif
+        return true;
     }
 
     // intended functionality to retrieve platform-dependent
@@ -92,4 +168,227 @@ namespace FileIO
         return getPlatformFilePath(path) + getPlatformSeparator();
     }
 
+    // same, but into `arena'
+    char* getPlatformPath(const char* path, Memory::FrameArena& arena)
+    {
+        char sep = getPlatformSeparator();
+        char* filepath = arena.Format("%s%c", path, sep);
+        for(char* ptr = filepath; ptr != NULL && *ptr != '\0'; ptr++)
+        {
+            if(*ptr == '|') {
+                *ptr = sep;
+            }
+        }
+        return filepath;
+    }
+
+    // directory part of a file path, including the final separator
+    std::string getDirectory(const std::string& file)
+    {
+        size_t sep = file.find_last_of("/\\");
+        return (sep == std::string::npos) ? "" : file.substr(0, sep + 1);
+    }
+
+
+
+    // --- FILE CACHE --- //
+
+    // contents of the files read during a run, keyed by path. A file is
+    // only read again when its modification time or size changed, so
+    // each file is read once per run unless it is edited.
+    // Files are read in full rather than memory-mapped, as editors may
+    // truncate a file in place while it is mapped.
+    class FileCache {
+    private:
+        typedef struct {
+            _file_stamp_t stamp;
+            std::string contents;
+        } _entry_t;
+
+        std::unordered_map<std::string, _entry_t> _files;
+        size_t _reads = 0;
+
+    public:
+        // the view is valid until the same file is requested again after
+        // it changed on disk. Returns false if the file could not be read.
+        bool Get(const std::string& path, std::string_view& contents)
+        {
+            _file_stamp_t stamp;
+            if(!getFileStamp(path.c_str(), stamp))
+            {
+                std::cerr << "Could not read file '"
+                          << path << "'." << std::endl;
+                _files.erase(path);
+                return false;
+            }
+
+            auto it = _files.find(path);
+            if(it == _files.end() || !(it->second.stamp == stamp))
+            {
+                _entry_t& entry = _files[path];
+                if(!readFile(path.c_str(), entry.contents))
+                {
+                    std::cerr << "Could not read file '"
+                              << path << "'." << std::endl;
+                    _files.erase(path);
+                    return false;
+                }
+                entry.stamp = stamp;
+                _reads++;
+                it = _files.find(path);
+            }
+
+            contents = it->second.contents;
+            return true;
+        }
+
+        // number of times a file was actually read from disk
+        size_t GetReads() const
+        {
+            return _reads;
+        }
+
+        void Clear()
+        {
+            _files.clear();
+        }
+    };
+
+
+
+    // --- SHADER PREPROCESSOR --- //
+
+    // expands `#include "file"' directives in shader sources, since
+    // GLSL has none. Included paths are relative to the including file
+    // and use '|' as separator, as in `getPlatformFilePath'.
+    // Every file is included at most once per source, so shared
+    // includes need no include guards, and cycles are harmless.
+    // `#line' directives keep compiler errors pointing at the right
+    // line, with the index of the file in `GetFiles' as source number.
+    class Preprocessor {
+    private:
+        FileCache _cache;
+        std::vector<std::string> _files;
+        std::unordered_set<std::string> _included;
+        std::string _out;   // kept, so its capacity is reused
+
+        // `#include "name"' on a line, with `name' returned. The
+        // directive must end in whitespace or the quote, so that e.g.
+        // `#includes' is left alone.
+        static bool parseInclude(std::string_view line, std::string_view& name)
+        {
+            size_t pos = line.find_first_not_of(" \t");
+            if(pos == std::string_view::npos || line.compare(pos, 8, "#include") != 0) {
+                return false;
+            }
+            pos += 8;
+            if(pos >= line.size() ||
+               (line[pos] != ' ' && line[pos] != '\t' && line[pos] != '"')) {
+                return false;
+            }
+            pos = line.find_first_not_of(" \t", pos);
+            if(pos == std::string_view::npos || line[pos] != '"') {
+                return false;
+            }
+            size_t close = line.find('"', pos + 1);
+            if(close == std::string_view::npos) {
+                return false;
+            }
+            name = line.substr(pos + 1, close - pos - 1);
+            return true;
+        }
+
+        static bool isPragmaOnce(std::string_view line)
+        {
+            size_t pos = line.find_first_not_of(" \t");
+            return pos != std::string_view::npos
+                && line.compare(pos, 12, "#pragma once") == 0;
+        }
+
+        void process(const std::string& path, std::string& out)
+        {
+            std::string_view source;
+            if(!_included.insert(path).second || !_cache.Get(path, source)) {
+                return;
+            }
+
+            int index = _files.size();
+            _files.push_back(path);
+            std::string directory = getDirectory(path);
+
+            size_t line_number = 1;
+            for(size_t begin = 0; begin < source.size(); line_number++)
+            {
+                size_t end = source.find('\n', begin);
+                if(end == std::string_view::npos) {
+                    end = source.size();
+                }
+                std::string_view line = source.substr(begin, end - begin);
+                begin = end + 1;
+
+                std::string_view name;
+                if(parseInclude(line, name))
+                {
+                    std::string included = directory + getPlatformFilePath(
+                        std::string(name).c_str());
+                    if(_included.count(included) == 0)
+                    {
+                        out += "#line 1 " + std::to_string(_files.size()) + "\n";
+                        process(included, out);
+                        // `#line n' numbers the line after it, so n is
+                        // the line after the include
+                        out += "#line " + std::to_string(line_number + 1) + " "
+                            + std::to_string(index) + "\n";
+                    }
+                    else {
+                        out += "\n";
+                    }
+                    continue;
+                }
+
+                if(!isPragmaOnce(line)) {
+                    out.append(line.data(), line.size());
+                }
+                out += '\n';
+            }
+        }
+
+    public:
+        // the expanded source of the file at `path'
+        std::string Process(const char* path)
+        {
+            _files.clear();
+            _included.clear();
+
+            std::string out;
+            process(path, out);
+            return out;
+        }
+
+        // same, but the source is returned in `arena', e.g. to keep it
+        // only until it is compiled
+        const char* Process(const char* path, Memory::FrameArena& arena)
+        {
+            _files.clear();
+            _included.clear();
+
+            _out.clear();
+            process(path, _out);
+            const char* source = arena.Copy(_out.c_str());
+            return source ? source : "";
+        }
+
+        // files the last processed source was made of, in source
+        // number order, e.g. to watch them for changes
+        const std::vector<std::string>& GetFiles() const
+        {
+            return _files;
+        }
+
+        FileCache& GetCache()
+        {
+            return _cache;
+        }
+    };
+
 } // namespace FileIO
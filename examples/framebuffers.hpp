@@ -0,0 +1,352 @@
+//
+// Framebuffer Library
+//
+// Framebuffer objects with texture attachments for render-to-texture,
+// and a ping-pong pair for iterative simulations such as the Game of
+// Life, where every pass reads the previous result.
+//
+// Once created, no GL objects are created or destroyed while rendering:
+// resizing re-specifies the storage of the existing textures, and only
+// when they have to grow.
+//
+
+#pragma once
+
+// GLEW
+#ifndef GLEW_STATIC
+#define GLEW_STATIC
+#endif
+#include <GL/glew.h>
+
+// CUSTOM
+#include "state.hpp"
+
+// STANDARD
+#include <algorithm>
+#include <iostream>
+#include <vector>
+
+
+namespace Framebuffers
+{
+    typedef enum {
+        ATTACHMENT_RGBA8,
+        ATTACHMENT_RGBA32F,
+        ATTACHMENT_R8,
+        ATTACHMENT_DEPTH24,
+        ATTACHMENT_DEPTH24_STENCIL8
+    } _attachment_format_t;
+
+    typedef struct {
+        GLenum internal_format;
+        GLenum format;
+        GLenum type;
+    } _texture_format_t;
+
+    _texture_format_t getTextureFormat(_attachment_format_t format)
+    {
+        switch(format) {
+        case ATTACHMENT_RGBA32F:
+            return {GL_RGBA32F, GL_RGBA, GL_FLOAT};
+        case ATTACHMENT_R8:
+            return {GL_R8, GL_RED, GL_UNSIGNED_BYTE};
+        case ATTACHMENT_DEPTH24:
+            return {GL_DEPTH_COMPONENT24, GL_DEPTH_COMPONENT, GL_UNSIGNED_INT};
+        case ATTACHMENT_DEPTH24_STENCIL8:
+            return {GL_DEPTH24_STENCIL8, GL_DEPTH_STENCIL, GL_UNSIGNED_INT_24_8};
+        case ATTACHMENT_RGBA8:
+        default:
+            return {GL_RGBA8, GL_RGBA, GL_UNSIGNED_BYTE};
+        }
+    }
+
+    inline bool isDepthFormat(_attachment_format_t format)
+    {
+        return format == ATTACHMENT_DEPTH24 || format == ATTACHMENT_DEPTH24_STENCIL8;
+    }
+
+    // color attachments every implementation supports
+    const int MAX_COLOR_ATTACHMENTS = 8;
+
+    // which attachments `Framebuffer::Invalidate' discards
+    typedef enum {
+        INVALIDATE_COLOR = 1,
+        INVALIDATE_DEPTH = 2,
+        INVALIDATE_ALL = 3
+    } _invalidate_t;
+
+
+    class Framebuffer
+    {
+    private:
+        typedef struct {
+            GLuint texture;
+            _attachment_format_t format;
+        } _attachment_t;
+
+        GLuint _fbo;
+        int _width;
+        int _height;
+
+        // size of the texture storage, at least the size in use
+        int _storage_width;
+        int _storage_height;
+
+        std::vector<_attachment_t> _colors;
+        std::vector<GLenum> _draw_buffers;
+        _attachment_t _depth;
+
+        void allocate(const _attachment_t& attachment)
+        {
+            _texture_format_t f = getTextureFormat(attachment.format);
+            States::bindTexture(GL_TEXTURE_2D, attachment.texture);
+            glTexImage2D(GL_TEXTURE_2D, 0, f.internal_format,
+                         _storage_width, _storage_height, 0,
+                         f.format, f.type, NULL);
+        }
+
+        void attach(GLenum point, _attachment_t& attachment, GLint filter, GLint wrap)
+        {
+            glGenTextures(1, &attachment.texture);
+            States::bindTexture(GL_TEXTURE_2D, attachment.texture);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, filter);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, filter);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, wrap);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, wrap);
+            allocate(attachment);
+            States::bindTexture(GL_TEXTURE_2D, 0);
+
+            glBindFramebuffer(GL_FRAMEBUFFER, _fbo);
+            glFramebufferTexture2D(GL_FRAMEBUFFER, point, GL_TEXTURE_2D,
+                                   attachment.texture, 0);
+            glBindFramebuffer(GL_FRAMEBUFFER, States::getState().GetDefaultFramebuffer());
+        }
+
+    public:
+        Framebuffer(int width, int height)
+            : _width(width), _height(height),
+              _storage_width(width), _storage_height(height)
+        {
+            glGenFramebuffers(1, &_fbo);
+            _depth.texture = 0;
+        }
+
+        ~Framebuffer()
+        {
+            for(size_t i = 0; i < _colors.size(); i++) {
+                States::getState().DeleteTextures(1, &_colors[i].texture);
+            }
+            if(_depth.texture) {
+                States::getState().DeleteTextures(1, &_depth.texture);
+            }
+            glDeleteFramebuffers(1, &_fbo);
+        }
+
+        Framebuffer(const Framebuffer&) = delete;
+        Framebuffer& operator=(const Framebuffer&) = delete;
+
+        // add a color texture at GL_COLOR_ATTACHMENT0 + (returned index).
+        // GL_REPEAT wrapping matches the toroidal board of the Game of Life.
+        int AddColorTexture(_attachment_format_t format,
+                            GLint filter = GL_NEAREST, GLint wrap = GL_REPEAT)
+        {
+            if(isDepthFormat(format) || _colors.size() == MAX_COLOR_ATTACHMENTS)
+            {
+                std::cerr << "Framebuffer::AddColorTexture: "
+                          << "depth format, or too many color attachments" << std::endl;
+                return -1;
+            }
+
+            _attachment_t attachment;
+            attachment.format = format;
+            int index = _colors.size();
+            attach(GL_COLOR_ATTACHMENT0 + index, attachment, filter, wrap);
+
+            _colors.push_back(attachment);
+            _draw_buffers.push_back(GL_COLOR_ATTACHMENT0 + index);
+            return index;
+        }
+
+        void SetDepthTexture(_attachment_format_t format)
+        {
+            if(!isDepthFormat(format) || _depth.texture != 0)
+            {
+                std::cerr << "Framebuffer::SetDepthTexture: "
+                          << "invalid format, or depth already attached" << std::endl;
+                return;
+            }
+
+            _depth.format = format;
+            GLenum point = (format == ATTACHMENT_DEPTH24_STENCIL8)
+                ? GL_DEPTH_STENCIL_ATTACHMENT : GL_DEPTH_ATTACHMENT;
+            attach(point, _depth, GL_NEAREST, GL_CLAMP_TO_EDGE);
+        }
+
+        // should be called once after all attachments are added
+        bool CheckStatus()
+        {
+            glBindFramebuffer(GL_FRAMEBUFFER, _fbo);
+            GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+            glBindFramebuffer(GL_FRAMEBUFFER, States::getState().GetDefaultFramebuffer());
+
+            if(status != GL_FRAMEBUFFER_COMPLETE)
+            {
+                std::cerr << "Framebuffer is not complete (0x" << std::hex
+                          << status << std::dec << ")" << std::endl;
+                return false;
+            }
+            return true;
+        }
+
+        // render into this framebuffer, with the viewport covering the
+        // part of the storage in use
+        void Bind()
+        {
+            glBindFramebuffer(GL_FRAMEBUFFER, _fbo);
+            if(!_draw_buffers.empty()) {
+                glDrawBuffers(_draw_buffers.size(), &_draw_buffers[0]);
+            }
+            glViewport(0, 0, _width, _height);
+        }
+
+        // change the size in use. The storage is only re-specified when
+        // it has to grow; the textures and the framebuffer object stay.
+        void Resize(int width, int height)
+        {
+            _width = width;
+            _height = height;
+            if(width <= _storage_width && height <= _storage_height) {
+                return;
+            }
+
+            _storage_width = std::max(width, _storage_width);
+            _storage_height = std::max(height, _storage_height);
+            for(size_t i = 0; i < _colors.size(); i++) {
+                allocate(_colors[i]);
+            }
+            if(_depth.texture) {
+                allocate(_depth);
+            }
+            States::bindTexture(GL_TEXTURE_2D, 0);
+        }
+
+        // tell the driver that the contents of some attachments are no
+        // longer needed, e.g. depth after the last draw of a pass, or
+        // color right before it is overwritten completely. This avoids
+        // preserving the data, which is costly on tiled GPUs.
+        // The framebuffer is bound afterwards.
+        void Invalidate(_invalidate_t which)
+        {
+            GLenum attachments[MAX_COLOR_ATTACHMENTS + 1];
+            GLsizei count = 0;
+            if(which & INVALIDATE_COLOR)
+            {
+                for(size_t i = 0; i < _draw_buffers.size(); i++) {
+                    attachments[count++] = _draw_buffers[i];
+                }
+            }
+            if((which & INVALIDATE_DEPTH) && _depth.texture)
+            {
+                attachments[count++] = (_depth.format == ATTACHMENT_DEPTH24_STENCIL8)
+                    ? GL_DEPTH_STENCIL_ATTACHMENT : GL_DEPTH_ATTACHMENT;
+            }
+
+            glBindFramebuffer(GL_FRAMEBUFFER, _fbo);
+            if(count > 0 && GLEW_ARB_invalidate_subdata) {
+                glInvalidateFramebuffer(GL_FRAMEBUFFER, count, attachments);
+            }
+        }
+
+        GLuint GetColorTexture(int index = 0)
+        {
+            return _colors[index].texture;
+        }
+
+        GLuint GetDepthTexture()
+        {
+            return _depth.texture;
+        }
+
+        GLuint GetFramebuffer()
+        {
+            return _fbo;
+        }
+
+        int GetWidth()
+        {
+            return _width;
+        }
+
+        int GetHeight()
+        {
+            return _height;
+        }
+
+        // texture coordinates of the top right corner of the part in
+        // use, as the storage may be larger after shrinking. Wrapping
+        // then applies to the whole storage, not the part in use.
+        float GetTexCoordScaleX()
+        {
+            return (float)_width / _storage_width;
+        }
+
+        float GetTexCoordScaleY()
+        {
+            return (float)_height / _storage_height;
+        }
+    };
+
+
+    // two framebuffers with the same attachments. Each pass reads the
+    // front texture and renders into the back buffer, then `Swap'.
+    class PingPong
+    {
+    private:
+        Framebuffer _buffers[2];
+        int _front = 0;
+
+    public:
+        PingPong(int width, int height, _attachment_format_t format,
+                 GLint filter = GL_NEAREST, GLint wrap = GL_REPEAT)
+            : _buffers{Framebuffer(width, height), Framebuffer(width, height)}
+        {
+            for(int i = 0; i < 2; i++)
+            {
+                _buffers[i].AddColorTexture(format, filter, wrap);
+                _buffers[i].CheckStatus();
+            }
+        }
+
+        // bind the back buffer for a pass that overwrites all of it, so
+        // its old contents are invalidated. Returns the texture to read.
+        GLuint BeginPass()
+        {
+            Framebuffer& back = _buffers[1 - _front];
+            back.Invalidate(INVALIDATE_COLOR);
+            back.Bind();
+            return _buffers[_front].GetColorTexture();
+        }
+
+        void Swap()
+        {
+            _front = 1 - _front;
+        }
+
+        Framebuffer& Front()
+        {
+            return _buffers[_front];
+        }
+
+        Framebuffer& Back()
+        {
+            return _buffers[1 - _front];
+        }
+
+        void Resize(int width, int height)
+        {
+            _buffers[0].Resize(width, height);
+            _buffers[1].Resize(width, height);
+        }
+    };
+
+} // namespace Framebuffers
@@ -0,0 +1,199 @@
+//
+// Image Library
+//
+// CPU-side images and decoders for simple uncompressed
+// file formats (binary PPM/PGM and TGA).
+//
+
+#pragma once
+
+// CUSTOM
+#include "fileIO.hpp"
+
+// STANDARD
+#include <string>
+#include <string.h>
+#include <stdio.h>
+#include <iostream>
+#include <vector>
+
+
+namespace Images
+{
+    // 8 bits per channel, rows are stored bottom to top
+    // as expected by `glTexImage2D'
+    typedef struct {
+        int width;
+        int height;
+        int channels; // 1 (grey), 3 (RGB) or 4 (RGBA)
+        std::vector<unsigned char> pixels;
+    } Image;
+
+    // signature of an image decoder, returns false on failure.
+    // Decoders may be called from any thread.
+    typedef bool (*_image_decoder_func)(const char* path, Image& image);
+
+    inline size_t getRowSize(const Image& image)
+    {
+        return (size_t)image.width * image.channels;
+    }
+
+    void flipRows(Image& image)
+    {
+        size_t row = getRowSize(image);
+        std::vector<unsigned char> tmp(row);
+        for(int y = 0; y < image.height / 2; y++)
+        {
+            unsigned char* top = &image.pixels[y * row];
+            unsigned char* bottom = &image.pixels[(image.height - 1 - y) * row];
+            memcpy(&tmp[0], top, row);
+            memcpy(top, bottom, row);
+            memcpy(bottom, &tmp[0], row);
+        }
+    }
+
+
+    // --- DECODERS --- //
+
+    // skip whitespace and comments in a PPM header
+    bool readPPMValue(FILE* file, int& value)
+    {
+        int c = fgetc(file);
+        while(c == '#' || c == ' ' || c == '\t' || c == '\n' || c == '\r')
+        {
+            if(c == '#') {
+                while(c != '\n' && c != EOF) c = fgetc(file);
+            }
+            c = fgetc(file);
+        }
+        ungetc(c, file);
+        return fscanf(file, "%d", &value) == 1;
+    }
+
+    // binary PPM (P6) and PGM (P5) with a maximum value of 255
+    bool decodePPM(const char* path, Image& image)
+    {
+        FILE* file = fopen(path, "rb");
+        if(file == NULL) {
+            return false;
+        }
+
+        char magic[3] = {};
+        int maxval = 0;
+        bool ok = fread(magic, 1, 2, file) == 2 &&
+                  (strcmp(magic, "P6") == 0 || strcmp(magic, "P5") == 0) &&
+                  readPPMValue(file, image.width) &&
+                  readPPMValue(file, image.height) &&
+                  readPPMValue(file, maxval) && maxval == 255 &&
+                  image.width > 0 && image.height > 0;
+
+        if(ok)
+        {
+            fgetc(file); // single whitespace before the pixel data
+            image.channels = (magic[1] == '6') ? 3 : 1;
+            image.pixels.resize(getRowSize(image) * image.height);
+            ok = fread(&image.pixels[0], 1, image.pixels.size(), file)
+                 == image.pixels.size();
+        }
+        fclose(file);
+
+        if(ok) {
+            flipRows(image); // stored top to bottom
+        }
+        return ok;
+    }
+
+    // uncompressed (types 2, 3) and run-length encoded (types 10, 11)
+    // TGA images with 8, 24 or 32 bits per pixel
+    bool decodeTGA(const char* path, Image& image)
+    {
+        FILE* file = fopen(path, "rb");
+        if(file == NULL) {
+            return false;
+        }
+
+        unsigned char header[18];
+        if(fread(header, 1, 18, file) != 18) {
+            fclose(file);
+            return false;
+        }
+
+        int type = header[2];
+        int bits = header[16];
+        bool rle = (type == 10 || type == 11);
+        image.width = header[12] | (header[13] << 8);
+        image.height = header[14] | (header[15] << 8);
+        image.channels = bits / 8;
+
+        bool ok = (type == 2 || type == 3 || rle) && header[1] == 0 &&
+                  (bits == 8 || bits == 24 || bits == 32) &&
+                  image.width > 0 && image.height > 0;
+        if(ok) {
+            ok = fseek(file, header[0], SEEK_CUR) == 0; // image id
+        }
+
+        if(ok)
+        {
+            size_t bpp = image.channels;
+            image.pixels.resize(getRowSize(image) * image.height);
+            unsigned char* out = &image.pixels[0];
+            unsigned char* end = out + image.pixels.size();
+
+            while(ok && out < end)
+            {
+                if(!rle) {
+                    ok = fread(out, 1, end - out, file) == (size_t)(end - out);
+                    break;
+                }
+
+                int packet = fgetc(file);
+                size_t count = (packet & 0x7f) + 1;
+                ok = packet != EOF && out + count * bpp <= end;
+                if(!ok) break;
+
+                if(packet & 0x80)
+                {
+                    ok = fread(out, 1, bpp, file) == bpp;
+                    for(size_t i = 1; ok && i < count; i++) {
+                        memcpy(out + i * bpp, out, bpp);
+                    }
+                }
+                else {
+                    ok = fread(out, 1, count * bpp, file) == count * bpp;
+                }
+                out += count * bpp;
+            }
+
+            // BGR(A) -> RGB(A)
+            for(size_t i = 0; ok && bpp >= 3 && i < image.pixels.size(); i += bpp)
+            {
+                unsigned char tmp = image.pixels[i];
+                image.pixels[i] = image.pixels[i + 2];
+                image.pixels[i + 2] = tmp;
+            }
+        }
+        fclose(file);
+
+        // bit 5 of the descriptor marks a top-left origin
+        if(ok && (header[17] & 0x20)) {
+            flipRows(image);
+        }
+        return ok;
+    }
+
+    // pick a decoder from the file extension
+    bool decodeImage(const char* path, Image& image)
+    {
+        std::string ext = FileIO::getFileExtension(path);
+        if(ext == "ppm" || ext == "pgm") {
+            return decodePPM(path, image);
+        }
+        if(ext == "tga") {
+            return decodeTGA(path, image);
+        }
+
+        std::cerr << "No decoder for image '" << path << "'" << std::endl;
+        return false;
+    }
+
+} // namespace Images
@@ -0,0 +1,290 @@
+//
+// Game of Life
+//
+// CPU engine for Conway's Game of Life on a toroidal board,
+// the same wrapping as a GL_REPEAT texture. Cells are packed
+// one bit each, so a 64 bit word (or an AVX2 register of four
+// words) is updated at once with bit-sliced adders, and rows
+// are split into bands on a thread pool.
+//
+
+#pragma once
+
+// CUSTOM
+#include "threads.hpp"
+
+// STANDARD
+#include <algorithm>
+#include <iostream>
+#include <stdint.h>
+#include <vector>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define LIFE_AVX2
+#endif
+
+
+namespace Life
+{
+    const size_t CELLS_PER_WORD = 64;
+
+    // rows per task on the thread pool
+    const size_t LIFE_ROWS_PER_BAND = 64;
+
+    // next state of 64 cells, given the words of the rows above,
+    // at and below them, and the words on either side of each
+    inline uint64_t stepWord(uint64_t a_prev, uint64_t a, uint64_t a_next,
+                             uint64_t c_prev, uint64_t c, uint64_t c_next,
+                             uint64_t b_prev, uint64_t b, uint64_t b_next)
+    {
+        // neighbours to the left (x - 1) and right (x + 1) of each cell
+        uint64_t al = (a << 1) | (a_prev >> 63), ar = (a >> 1) | (a_next << 63);
+        uint64_t cl = (c << 1) | (c_prev >> 63), cr = (c >> 1) | (c_next << 63);
+        uint64_t bl = (b << 1) | (b_prev >> 63), br = (b >> 1) | (b_next << 63);
+
+        // add the 8 neighbours: full adders for the rows above and
+        // below, a half adder for the current row
+        uint64_t s1 = al ^ a ^ ar, c1 = (al & a) | (ar & (al ^ a));
+        uint64_t s2 = bl ^ b ^ br, c2 = (bl & b) | (br & (bl ^ b));
+        uint64_t s3 = cl ^ cr,     c3 = cl & cr;
+
+        uint64_t ones = s1 ^ s2 ^ s3, c4 = (s1 & s2) | (s3 & (s1 ^ s2));
+        uint64_t t = c1 ^ c2 ^ c3,    c5 = (c1 & c2) | (c3 & (c1 ^ c2));
+        uint64_t twos = t ^ c4,       c6 = t & c4;
+        uint64_t fours_or_more = c5 | c6;
+
+        // alive with 3 neighbours, or with 2 if alive already
+        return twos & ~fours_or_more & (ones | c);
+    }
+
+#ifdef LIFE_AVX2
+    // `stepWord' for four consecutive words
+    inline __m256i stepWords(const uint64_t* above, const uint64_t* row,
+                             const uint64_t* below)
+    {
+        #define LIFE_LOAD(p) _mm256_loadu_si256((const __m256i*)(p))
+        #define LIFE_LEFT(p)  _mm256_or_si256(_mm256_slli_epi64(LIFE_LOAD(p), 1), \
+                                              _mm256_srli_epi64(LIFE_LOAD((p) - 1), 63))
+        #define LIFE_RIGHT(p) _mm256_or_si256(_mm256_srli_epi64(LIFE_LOAD(p), 1), \
+                                              _mm256_slli_epi64(LIFE_LOAD((p) + 1), 63))
+
+        __m256i a = LIFE_LOAD(above), al = LIFE_LEFT(above), ar = LIFE_RIGHT(above);
+        __m256i c = LIFE_LOAD(row),   cl = LIFE_LEFT(row),   cr = LIFE_RIGHT(row);
+        __m256i b = LIFE_LOAD(below), bl = LIFE_LEFT(below), br = LIFE_RIGHT(below);
+
+        #undef LIFE_RIGHT
+        #undef LIFE_LEFT
+        #undef LIFE_LOAD
+
+        __m256i x1 = _mm256_xor_si256(al, a);
+        __m256i s1 = _mm256_xor_si256(x1, ar);
+        __m256i c1 = _mm256_or_si256(_mm256_and_si256(al, a), _mm256_and_si256(ar, x1));
+        __m256i x2 = _mm256_xor_si256(bl, b);
+        __m256i s2 = _mm256_xor_si256(x2, br);
+        __m256i c2 = _mm256_or_si256(_mm256_and_si256(bl, b), _mm256_and_si256(br, x2));
+        __m256i s3 = _mm256_xor_si256(cl, cr);
+        __m256i c3 = _mm256_and_si256(cl, cr);
+
+        __m256i x4 = _mm256_xor_si256(s1, s2);
+        __m256i ones = _mm256_xor_si256(x4, s3);
+        __m256i c4 = _mm256_or_si256(_mm256_and_si256(s1, s2), _mm256_and_si256(s3, x4));
+        __m256i x5 = _mm256_xor_si256(c1, c2);
+        __m256i t = _mm256_xor_si256(x5, c3);
+        __m256i c5 = _mm256_or_si256(_mm256_and_si256(c1, c2), _mm256_and_si256(c3, x5));
+        __m256i twos = _mm256_xor_si256(t, c4);
+        __m256i c6 = _mm256_and_si256(t, c4);
+
+        __m256i result = _mm256_andnot_si256(_mm256_or_si256(c5, c6), twos);
+        return _mm256_and_si256(result, _mm256_or_si256(ones, c));
+    }
+#endif
+
+
+    // rows are stored with one extra word on either side, holding a
+    // copy of the word at the other end of the row, so every word has
+    // both neighbours in memory and wrapping needs no special case
+    class Board
+    {
+    private:
+        size_t _width;
+        size_t _height;
+        size_t _words;  // words per row, without the two extra ones
+        size_t _stride;
+
+        std::vector<uint64_t> _cells;
+        std::vector<uint64_t> _next;
+
+        uint64_t* row(std::vector<uint64_t>& cells, size_t y)
+        {
+            return &cells[y * _stride + 1];
+        }
+
+        void wrapRow(uint64_t* r)
+        {
+            r[-1] = r[_words - 1];
+            r[_words] = r[0];
+        }
+
+        void stepRows(size_t begin, size_t end)
+        {
+            for(size_t y = begin; y < end; y++)
+            {
+                const uint64_t* a = row(_cells, (y + 1) % _height);
+                const uint64_t* c = row(_cells, y);
+                const uint64_t* b = row(_cells, (y + _height - 1) % _height);
+                uint64_t* out = row(_next, y);
+                size_t i = 0;
+
+#ifdef LIFE_AVX2
+                for(; i + 4 <= _words; i += 4) {
+                    _mm256_storeu_si256((__m256i*)(out + i),
+                                        stepWords(a + i, c + i, b + i));
+                }
+#endif
+                for(; i < _words; i++)
+                {
+                    out[i] = stepWord(a[i - 1], a[i], a[i + 1],
+                                      c[i - 1], c[i], c[i + 1],
+                                      b[i - 1], b[i], b[i + 1]);
+                }
+                wrapRow(out);
+            }
+        }
+
+    public:
+        // the width is rounded up to a multiple of 64 cells
+        Board(size_t width, size_t height)
+        {
+            _words = (width + CELLS_PER_WORD - 1) / CELLS_PER_WORD;
+            _width = _words * CELLS_PER_WORD;
+            _height = height;
+            _stride = _words + 2;
+
+            if(_width != width)
+            {
+                std::cerr << "Life::Board: width rounded up to "
+                          << _width << " cells" << std::endl;
+            }
+
+            _cells.assign(_stride * _height, 0);
+            _next.assign(_stride * _height, 0);
+        }
+
+        size_t GetWidth() const { return _width; }
+        size_t GetHeight() const { return _height; }
+
+        bool Get(size_t x, size_t y) const
+        {
+            return (_cells[y * _stride + 1 + x / 64] >> (x % 64)) & 1;
+        }
+
+        void Set(size_t x, size_t y, bool alive)
+        {
+            uint64_t* r = row(_cells, y);
+            uint64_t bit = (uint64_t)1 << (x % 64);
+            r[x / 64] = alive ? (r[x / 64] | bit) : (r[x / 64] & ~bit);
+            wrapRow(r);
+        }
+
+        void Clear()
+        {
+            std::fill(_cells.begin(), _cells.end(), 0);
+        }
+
+        // fill with random cells, each alive with probability
+        // `density', using a simple xorshift generator per row
+        void Randomize(uint64_t seed, double density = 0.5,
+                       Threads::ThreadPool* pool = NULL)
+        {
+            uint64_t threshold = (uint64_t)(density * 65536.0);
+            auto fill = [&](size_t begin, size_t end) {
+                for(size_t y = begin; y < end; y++)
+                {
+                    uint64_t state = seed ^ ((y + 1) * 0x9E3779B97F4A7C15ull);
+                    uint64_t* r = row(_cells, y);
+                    for(size_t i = 0; i < _words; i++)
+                    {
+                        uint64_t word = 0;
+                        for(int bit = 0; bit < 64; bit++)
+                        {
+                            state ^= state << 13;
+                            state ^= state >> 7;
+                            state ^= state << 17;
+                            word |= (uint64_t)((state & 0xffff) < threshold) << bit;
+                        }
+                        r[i] = word;
+                    }
+                    wrapRow(r);
+                }
+            };
+
+            if(pool == NULL) {
+                fill(0, _height);
+            }
+            else {
+                Threads::parallelFor(*pool, _height, LIFE_ROWS_PER_BAND, fill);
+            }
+        }
+
+        // advance `generations' steps, with bands of rows on `pool'
+        // if there is one
+        void Step(Threads::ThreadPool* pool = NULL, int generations = 1)
+        {
+            for(int g = 0; g < generations; g++)
+            {
+                if(pool == NULL) {
+                    stepRows(0, _height);
+                }
+                else {
+                    Threads::parallelFor(*pool, _height, LIFE_ROWS_PER_BAND,
+                                         [this](size_t begin, size_t end) {
+                        stepRows(begin, end);
+                    });
+                }
+                _cells.swap(_next);
+            }
+        }
+
+        size_t CountAlive() const
+        {
+            size_t count = 0;
+            for(size_t y = 0; y < _height; y++) {
+                for(size_t i = 0; i < _words; i++) {
+                    count += __builtin_popcountll(_cells[y * _stride + 1 + i]);
+                }
+            }
+            return count;
+        }
+
+        // write the region [x0, x0 + width) x [y0, y0 + height) as one
+        // byte per cell (0 or 255), ready for a GL_R8 texture. Row y0
+        // comes first, i.e. the bottom row of the texture.
+        void ExportR8(unsigned char* out, size_t x0, size_t y0,
+                      size_t width, size_t height) const
+        {
+            for(size_t y = 0; y < height; y++)
+            {
+                const uint64_t* r = &_cells[((y0 + y) % _height) * _stride + 1];
+                unsigned char* dst = out + y * width;
+                for(size_t x = 0; x < width; x++)
+                {
+                    size_t cx = (x0 + x) % _width;
+                    dst[x] = ((r[cx / 64] >> (cx % 64)) & 1) ? 255 : 0;
+                }
+            }
+        }
+
+        // the packed words of row `y', bit i of word w is cell 64w + i
+        const uint64_t* GetRow(size_t y) const
+        {
+            return &_cells[y * _stride + 1];
+        }
+
+        size_t GetWordsPerRow() const
+        {
+            return _words;
+        }
+    };
+
+} // namespace Life
@@ -0,0 +1,536 @@
+//
+// Memory Library
+//
+// A frame arena for memory that is only needed until the end of the
+// frame, a pool for objects of one type, and counting of heap
+// allocations to check that a rendering loop does not allocate.
+//
+// Counting replaces the global `operator new' and `operator delete',
+// which may only happen once per program: define
+// MEMORY_COUNT_ALLOCATIONS before including this file in the file that
+// has `main'. Without it, the counters stay at zero. Allocations with
+// `malloc', e.g. by GLFW or the driver, are never counted.
+//
+
+#pragma once
+
+// STANDARD
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <iostream>
+#include <new>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <utility>
+
+#if defined(MEMORY_COUNT_ALLOCATIONS) && defined(_WIN32)
+#include <malloc.h>
+#endif
+
+
+namespace Memory
+{
+    // --- ALLOCATION COUNTING --- //
+
+    typedef struct {
+        std::atomic<long> allocations;
+        std::atomic<long> frees;
+        std::atomic<long> bytes;    // allocated in total, not in use
+    } _allocation_counters_t;
+
+    // called for every counted allocation, e.g. to set a breakpoint on
+    typedef void (*_allocation_hook_t)(size_t size);
+
+    inline _allocation_counters_t& getAllocationCounters()
+    {
+        static _allocation_counters_t counters = {{0}, {0}, {0}};
+        return counters;
+    }
+
+    inline std::atomic<_allocation_hook_t>& getAllocationHook()
+    {
+        static std::atomic<_allocation_hook_t> hook(nullptr);
+        return hook;
+    }
+
+    // NULL to remove the hook
+    inline void setAllocationHook(_allocation_hook_t hook)
+    {
+        getAllocationHook() = hook;
+    }
+
+    inline void countAllocation(size_t size)
+    {
+        _allocation_counters_t& counters = getAllocationCounters();
+        counters.allocations.fetch_add(1, std::memory_order_relaxed);
+        counters.bytes.fetch_add(size, std::memory_order_relaxed);
+        _allocation_hook_t hook = getAllocationHook();
+        if(hook) {
+            hook(size);
+        }
+    }
+
+    inline void countFree()
+    {
+        getAllocationCounters().frees.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    inline long getAllocations()
+    {
+        return getAllocationCounters().allocations.load(std::memory_order_relaxed);
+    }
+
+    // reports frames that allocate after the first `warmup' frames,
+    // during which containers may still be growing to their final size
+    class AllocationCheck
+    {
+    private:
+        long _warmup;
+        long _frames = 0;
+        long _allocating_frames = 0;
+        long _allocations = 0;
+        long _last;
+
+    public:
+        AllocationCheck(long warmup = 60)
+            : _warmup(warmup), _last(getAllocations())
+        {
+        }
+
+        // should be called once per frame, at the same point every frame
+        void EndFrame()
+        {
+            long now = getAllocations();
+            long allocations = now - _last;
+            _last = now;
+            if(++_frames <= _warmup || allocations == 0) {
+                return;
+            }
+            if(_allocating_frames++ == 0)
+            {
+                std::cerr << "AllocationCheck: frame " << _frames << " made "
+                          << allocations << " heap allocations" << std::endl;
+            }
+            _allocations += allocations;
+        }
+
+        // frames after the warmup that allocated, should be 0
+        long GetAllocatingFrames()
+        {
+            return _allocating_frames;
+        }
+
+        long GetAllocations()
+        {
+            return _allocations;
+        }
+    };
+
+
+    // --- FRAME ARENA --- //
+
+    // bump allocator for memory that lives until `Reset', usually at the
+    // end of the frame. Destructors of objects in the arena are never
+    // called. When a frame needs more than the capacity, the extra
+    // memory comes from the heap, and the next `Reset' grows the arena
+    // to what the frame needed, so a steady state does not allocate.
+    class FrameArena
+    {
+    private:
+        typedef struct _block_t {
+            struct _block_t* next;
+            size_t size;
+        } _block_t;
+
+        unsigned char* _memory;
+        size_t _capacity;
+        size_t _used = 0;
+        _block_t* _overflow = NULL;   // blocks of this frame beyond the arena
+        size_t _overflow_used = 0;    // in the first overflow block
+        size_t _needed = 0;           // by this frame, in total
+        size_t _high_water = 0;
+
+        static size_t align(size_t offset, size_t alignment)
+        {
+            return (offset + alignment - 1) & ~(alignment - 1);
+        }
+
+        void* allocateOverflow(size_t size, size_t alignment)
+        {
+            size_t header = align(sizeof(_block_t), alignment);
+            if(_overflow != NULL)
+            {
+                size_t offset = align(_overflow_used, alignment);
+                if(offset + size <= _overflow->size)
+                {
+                    _overflow_used = offset + size;
+                    return (unsigned char*)_overflow + offset;
+                }
+            }
+            size_t block_size = std::max(header + size, _capacity);
+            _block_t* block = (_block_t*)malloc(block_size);
+            if(block == NULL) {
+                return NULL;
+            }
+            block->next = _overflow;
+            block->size = block_size;
+            _overflow = block;
+            _overflow_used = header + size;
+            return (unsigned char*)block + header;
+        }
+
+        void freeOverflow()
+        {
+            while(_overflow != NULL)
+            {
+                _block_t* next = _overflow->next;
+                free(_overflow);
+                _overflow = next;
+            }
+            _overflow_used = 0;
+        }
+
+    public:
+        FrameArena(size_t capacity = 1 << 20)
+            : _capacity(capacity)
+        {
+            _memory = (unsigned char*)malloc(_capacity);
+        }
+
+        ~FrameArena()
+        {
+            freeOverflow();
+            free(_memory);
+        }
+
+        FrameArena(const FrameArena&) = delete;
+        FrameArena& operator=(const FrameArena&) = delete;
+
+        // `alignment' must be a power of two
+        void* Allocate(size_t size, size_t alignment = alignof(std::max_align_t))
+        {
+            size_t offset = align(_used, alignment);
+            _needed += offset - _used + size;
+            if(offset + size <= _capacity && _memory != NULL)
+            {
+                _used = offset + size;
+                return _memory + offset;
+            }
+            return allocateOverflow(size, alignment);
+        }
+
+        // uninitialized memory for `count' objects of type `T'
+        template<typename T>
+        T* Allocate(size_t count)
+        {
+            return (T*)Allocate(count * sizeof(T), alignof(T));
+        }
+
+        // a copy of `str'
+        char* Copy(const char* str)
+        {
+            size_t length = strlen(str);
+            char* copy = Allocate<char>(length + 1);
+            if(copy) {
+                memcpy(copy, str, length + 1);
+            }
+            return copy;
+        }
+
+        // the concatenation of `a' and `b', e.g. a directory and a file
+        char* Concat(const char* a, const char* b)
+        {
+            size_t length_a = strlen(a);
+            size_t length_b = strlen(b);
+            char* str = Allocate<char>(length_a + length_b + 1);
+            if(str)
+            {
+                memcpy(str, a, length_a);
+                memcpy(str + length_a, b, length_b + 1);
+            }
+            return str;
+        }
+
+        // printf into the arena
+        char* Format(const char* format, ...)
+        {
+            va_list args;
+            va_start(args, format);
+            va_list copy;
+            va_copy(copy, args);
+            int length = vsnprintf(NULL, 0, format, copy);
+            va_end(copy);
+
+            char* str = (length >= 0) ? Allocate<char>(length + 1) : NULL;
+            if(str) {
+                vsnprintf(str, length + 1, format, args);
+            }
+            va_end(args);
+            return str;
+        }
+
+        // free everything allocated since the last reset
+        void Reset()
+        {
+            if(_overflow != NULL)
+            {
+                freeOverflow();
+                free(_memory);
+                _capacity = align(_needed + _needed / 2, 4096);
+                _memory = (unsigned char*)malloc(_capacity);
+            }
+            _high_water = std::max(_high_water, _needed);
+            _used = 0;
+            _needed = 0;
+        }
+
+        size_t GetCapacity()
+        {
+            return _capacity;
+        }
+
+        // the most any frame needed
+        size_t GetHighWater()
+        {
+            return std::max(_high_water, _needed);
+        }
+    };
+
+    // the arena of the rendering thread, reset by `BaseWindow::SwapBuffers'
+    inline FrameArena& getFrameArena()
+    {
+        static FrameArena arena;
+        return arena;
+    }
+
+
+    // --- POOLS --- //
+
+    // objects of type `T', allocated in chunks of `chunk' objects and
+    // reused through a free list. Chunks are only freed with the pool.
+    template<typename T>
+    class Pool
+    {
+    private:
+        union _slot_t {
+            _slot_t* next;
+            alignas(T) unsigned char object[sizeof(T)];
+        };
+
+        typedef struct _chunk_t {
+            struct _chunk_t* next;
+            _slot_t* slots;
+        } _chunk_t;
+
+        size_t _chunk;
+        _chunk_t* _chunks = NULL;
+        _slot_t* _free = NULL;
+        size_t _count = 0;
+
+        bool grow()
+        {
+            _chunk_t* chunk = (_chunk_t*)malloc(sizeof(_chunk_t));
+            _slot_t* slots = (_slot_t*)malloc(_chunk * sizeof(_slot_t));
+            if(chunk == NULL || slots == NULL)
+            {
+                free(chunk);
+                free(slots);
+                return false;
+            }
+            chunk->next = _chunks;
+            chunk->slots = slots;
+            _chunks = chunk;
+            for(size_t i = _chunk; i-- > 0; )
+            {
+                slots[i].next = _free;
+                _free = &slots[i];
+            }
+            return true;
+        }
+
+    public:
+        Pool(size_t chunk = 64)
+            : _chunk(chunk > 0 ? chunk : 1)
+        {
+        }
+
+        // objects still in the pool are not destroyed
+        ~Pool()
+        {
+            if(_count > 0) {
+                std::cerr << "Pool: " << _count << " objects were not deleted" << std::endl;
+            }
+            while(_chunks != NULL)
+            {
+                _chunk_t* next = _chunks->next;
+                free(_chunks->slots);
+                free(_chunks);
+                _chunks = next;
+            }
+        }
+
+        Pool(const Pool&) = delete;
+        Pool& operator=(const Pool&) = delete;
+
+        template<typename... Args>
+        T* New(Args&&... args)
+        {
+            if(_free == NULL && !grow()) {
+                return NULL;
+            }
+            _slot_t* slot = _free;
+            _free = slot->next;
+            _count++;
+            return new (slot->object) T(std::forward<Args>(args)...);
+        }
+
+        void Delete(T* object)
+        {
+            if(object == NULL) {
+                return;
+            }
+            object->~T();
+            _slot_t* slot = (_slot_t*)object;
+            slot->next = _free;
+            _free = slot;
+            _count--;
+        }
+
+        // objects in use
+        size_t GetCount()
+        {
+            return _count;
+        }
+    };
+
+} // namespace Memory
+
+
+#ifdef MEMORY_COUNT_ALLOCATIONS
+
+void* operator new(size_t size)
+{
+    Memory::countAllocation(size);
+    void* ptr = malloc(size > 0 ? size : 1);
+    if(ptr == NULL) {
+        throw std::bad_alloc();
+    }
+    return ptr;
+}
+
+void* operator new[](size_t size)
+{
+    return operator new(size);
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept
+{
+    Memory::countAllocation(size);
+    return malloc(size > 0 ? size : 1);
+}
+
+void* operator new[](size_t size, const std::nothrow_t&) noexcept
+{
+    return operator new(size, std::nothrow);
+}
+
+void operator delete(void* ptr) noexcept
+{
+    if(ptr) {
+        Memory::countFree();
+    }
+    free(ptr);
+}
+
+void operator delete[](void* ptr) noexcept
+{
+    operator delete(ptr);
+}
+
+void operator delete(void* ptr, size_t) noexcept
+{
+    operator delete(ptr);
+}
+
+void operator delete[](void* ptr, size_t) noexcept
+{
+    operator delete(ptr);
+}
+
+// the forms for types aligned beyond `alignof(std::max_align_t)',
+// which `malloc' does not guarantee
+
+void* operator new(size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept
+{
+    Memory::countAllocation(size);
+    size = size > 0 ? size : 1;
+#if defined(_WIN32)
+    return _aligned_malloc(size, (size_t)alignment);
+#else
+    void* ptr = NULL;
+    size_t align = std::max((size_t)alignment, sizeof(void*));
+    return (posix_memalign(&ptr, align, size) == 0) ? ptr : NULL;
+#endif
+}
+
+void* operator new(size_t size, std::align_val_t alignment)
+{
+    void* ptr = operator new(size, alignment, std::nothrow);
+    if(ptr == NULL) {
+        throw std::bad_alloc();
+    }
+    return ptr;
+}
+
+void* operator new[](size_t size, std::align_val_t alignment)
+{
+    return operator new(size, alignment);
+}
+
+void* operator new[](size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept
+{
+    return operator new(size, alignment, std::nothrow);
+}
+
+void operator delete(void* ptr, std::align_val_t) noexcept
+{
+    if(ptr) {
+        Memory::countFree();
+    }
+#if defined(_WIN32)
+    _aligned_free(ptr);
+#else
+    free(ptr);
+#endif
+}
+
+void operator delete[](void* ptr, std::align_val_t alignment) noexcept
+{
+    operator delete(ptr, alignment);
+}
+
+void operator delete(void* ptr, size_t, std::align_val_t alignment) noexcept
+{
+    operator delete(ptr, alignment);
+}
+
+void operator delete[](void* ptr, size_t, std::align_val_t alignment) noexcept
+{
+    operator delete(ptr, alignment);
+}
+
+void operator delete(void* ptr, std::align_val_t alignment, const std::nothrow_t&) noexcept
+{
+    operator delete(ptr, alignment);
+}
+
+void operator delete[](void* ptr, std::align_val_t alignment, const std::nothrow_t&) noexcept
+{
+    operator delete(ptr, alignment);
+}
+
+#endif // MEMORY_COUNT_ALLOCATIONS
@@ -0,0 +1,548 @@
+//
+// Mipmap Library
+//
+// CPU generation of mipmap chains for RGBA8, sRGB and float
+// images, with box and windowed-sinc (Kaiser, Lanczos) filters.
+// Filtering is done in linear space on RGBA floats, vectorized
+// with SSE/AVX2 and split into rows on a thread pool.
+//
+
+#pragma once
+
+// CUSTOM
+#include "threads.hpp"
+
+// STANDARD
+#include <algorithm>
+#include <math.h>
+#include <string.h>
+#include <vector>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define MIPMAPS_AVX2
+#endif
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define MIPMAPS_SSE
+#endif
+
+
+namespace Mipmaps
+{
+    typedef enum {
+        MIPMAP_RGBA8,        // 8 bits per channel, linear
+        MIPMAP_SRGB8_ALPHA8, // 8 bits per channel, sRGB encoded colors
+        MIPMAP_RGBA32F       // 32 bit float per channel
+    } _mipmap_format_t;
+
+    typedef enum {
+        MIPMAP_FILTER_BOX,     // average of 2x2 pixels, same as most drivers
+        MIPMAP_FILTER_KAISER,  // Kaiser-windowed sinc, radius 3
+        MIPMAP_FILTER_LANCZOS  // Lanczos-windowed sinc, radius 3
+    } _mipmap_filter_t;
+
+    // a single level of the chain, in the same format as the input.
+    // Rows are tightly packed and can be passed to `glTexImage2D'.
+    typedef struct {
+        int width;
+        int height;
+        std::vector<unsigned char> data;
+    } Level;
+
+    inline size_t getPixelSize(_mipmap_format_t format)
+    {
+        return (format == MIPMAP_RGBA32F) ? 4 * sizeof(float) : 4;
+    }
+
+    // number of levels in a full chain down to 1x1
+    inline int getLevelCount(int width, int height)
+    {
+        int levels = 1;
+        for(int size = std::max(width, height); size > 1; size /= 2) {
+            levels++;
+        }
+        return levels;
+    }
+
+    // rows processed per task on the thread pool
+    const size_t MIPMAP_ROWS_PER_TASK = 16;
+
+    // run `func(begin, end)' over rows, on the pool if there is one
+    template<typename Func>
+    void forRows(Threads::ThreadPool* pool, size_t rows, Func func)
+    {
+        if(pool == NULL) {
+            func((size_t)0, rows);
+        }
+        else {
+            Threads::parallelFor(*pool, rows, MIPMAP_ROWS_PER_TASK, func);
+        }
+    }
+
+
+    // --- COLOR CONVERSION --- //
+
+    // lookup tables between 8 bit sRGB and linear floats
+    class SRGBTables
+    {
+    private:
+        // indexed by a linear value quantized to 16 bits
+        static const int ENCODE_SIZE = 65536;
+
+        float _decode[256];
+        unsigned char _encode[ENCODE_SIZE];
+
+        SRGBTables()
+        {
+            for(int i = 0; i < 256; i++)
+            {
+                float c = i / 255.0f;
+                _decode[i] = (c <= 0.04045f) ? c / 12.92f
+                                             : powf((c + 0.055f) / 1.055f, 2.4f);
+            }
+            for(int i = 0; i < ENCODE_SIZE; i++)
+            {
+                float l = i / (float)(ENCODE_SIZE - 1);
+                float c = (l <= 0.0031308f) ? l * 12.92f
+                                            : 1.055f * powf(l, 1.0f / 2.4f) - 0.055f;
+                _encode[i] = (unsigned char)(c * 255.0f + 0.5f);
+            }
+        }
+
+    public:
+        static const SRGBTables& Get()
+        {
+            static SRGBTables tables;
+            return tables;
+        }
+
+        float Decode(unsigned char c) const
+        {
+            return _decode[c];
+        }
+
+        unsigned char Encode(float l) const
+        {
+            l = std::min(std::max(l, 0.0f), 1.0f);
+            return _encode[(int)(l * (ENCODE_SIZE - 1) + 0.5f)];
+        }
+    };
+
+    inline unsigned char encodeUnorm8(float f)
+    {
+        f = std::min(std::max(f, 0.0f), 1.0f);
+        return (unsigned char)(f * 255.0f + 0.5f);
+    }
+
+    // RGBA floats used while filtering, 4 floats per pixel
+    typedef struct {
+        int width;
+        int height;
+        std::vector<float> pixels;
+    } _float_image_t;
+
+    void convertToFloat(const void* src, int width, int height,
+                        _mipmap_format_t format, _float_image_t& out,
+                        Threads::ThreadPool* pool)
+    {
+        out.width = width;
+        out.height = height;
+        out.pixels.resize((size_t)width * height * 4);
+
+        const size_t row = (size_t)width * 4;
+        const SRGBTables& srgb = SRGBTables::Get();
+
+        forRows(pool, height, [&](size_t begin, size_t end) {
+            for(size_t y = begin; y < end; y++)
+            {
+                float* dst = &out.pixels[y * row];
+                if(format == MIPMAP_RGBA32F)
+                {
+                    memcpy(dst, (const float*)src + y * row, row * sizeof(float));
+                    continue;
+                }
+
+                const unsigned char* s = (const unsigned char*)src + y * row;
+                for(size_t i = 0; i < row; i += 4)
+                {
+                    if(format == MIPMAP_SRGB8_ALPHA8)
+                    {
+                        dst[i + 0] = srgb.Decode(s[i + 0]);
+                        dst[i + 1] = srgb.Decode(s[i + 1]);
+                        dst[i + 2] = srgb.Decode(s[i + 2]);
+                    }
+                    else
+                    {
+                        dst[i + 0] = s[i + 0] * (1.0f / 255.0f);
+                        dst[i + 1] = s[i + 1] * (1.0f / 255.0f);
+                        dst[i + 2] = s[i + 2] * (1.0f / 255.0f);
+                    }
+                    dst[i + 3] = s[i + 3] * (1.0f / 255.0f); // alpha is linear
+                }
+            }
+        });
+    }
+
+    void convertFromFloat(const _float_image_t& in, _mipmap_format_t format,
+                          Level& out, Threads::ThreadPool* pool)
+    {
+        out.width = in.width;
+        out.height = in.height;
+        out.data.resize((size_t)in.width * in.height * getPixelSize(format));
+
+        const size_t row = (size_t)in.width * 4;
+        const SRGBTables& srgb = SRGBTables::Get();
+
+        forRows(pool, in.height, [&](size_t begin, size_t end) {
+            for(size_t y = begin; y < end; y++)
+            {
+                const float* src = &in.pixels[y * row];
+                if(format == MIPMAP_RGBA32F)
+                {
+                    memcpy(&out.data[y * row * sizeof(float)], src,
+                           row * sizeof(float));
+                    continue;
+                }
+
+                unsigned char* d = &out.data[y * row];
+                for(size_t i = 0; i < row; i += 4)
+                {
+                    if(format == MIPMAP_SRGB8_ALPHA8)
+                    {
+                        d[i + 0] = srgb.Encode(src[i + 0]);
+                        d[i + 1] = srgb.Encode(src[i + 1]);
+                        d[i + 2] = srgb.Encode(src[i + 2]);
+                    }
+                    else
+                    {
+                        d[i + 0] = encodeUnorm8(src[i + 0]);
+                        d[i + 1] = encodeUnorm8(src[i + 1]);
+                        d[i + 2] = encodeUnorm8(src[i + 2]);
+                    }
+                    d[i + 3] = encodeUnorm8(src[i + 3]);
+                }
+            }
+        });
+    }
+
+
+    // --- FILTER KERNELS --- //
+
+    const float MIPMAP_SINC_RADIUS = 3.0f;
+    const float MIPMAP_KAISER_ALPHA = 4.0f;
+
+    inline float sinc(float x)
+    {
+        if(fabsf(x) < 1e-6f) {
+            return 1.0f;
+        }
+        x *= (float)M_PI;
+        return sinf(x) / x;
+    }
+
+    // modified Bessel function of the first kind, order 0
+    inline float besselI0(float x)
+    {
+        float sum = 1.0f;
+        float term = 1.0f;
+        for(int k = 1; k < 20; k++)
+        {
+            term *= (x * 0.5f / k) * (x * 0.5f / k);
+            sum += term;
+        }
+        return sum;
+    }
+
+    // radius of the filter in destination pixels
+    inline float getFilterRadius(_mipmap_filter_t filter)
+    {
+        return (filter == MIPMAP_FILTER_BOX) ? 0.5f : MIPMAP_SINC_RADIUS;
+    }
+
+    // filter weight at distance `x', measured in destination pixels
+    float getFilterWeight(_mipmap_filter_t filter, float x)
+    {
+        float r = MIPMAP_SINC_RADIUS;
+        x = fabsf(x);
+
+        switch(filter) {
+        case MIPMAP_FILTER_BOX:
+            return (x < 0.5f) ? 1.0f : (x == 0.5f) ? 0.5f : 0.0f;
+        case MIPMAP_FILTER_KAISER:
+            if(x >= r) return 0.0f;
+            return sinc(x) * besselI0(MIPMAP_KAISER_ALPHA * sqrtf(1.0f - (x * x) / (r * r)))
+                           / besselI0(MIPMAP_KAISER_ALPHA);
+        case MIPMAP_FILTER_LANCZOS:
+            if(x >= r) return 0.0f;
+            return sinc(x) * sinc(x / r);
+        default:
+            return 0.0f;
+        }
+    }
+
+    // source pixels and weights contributing to each destination pixel
+    // along one axis. Every destination pixel has the same number of
+    // taps; indices are clamped to the edge and weights sum to one.
+    typedef struct {
+        int taps;
+        std::vector<int> index;
+        std::vector<float> weight;
+    } _filter_taps_t;
+
+    void computeTaps(_mipmap_filter_t filter, int in_size, int out_size,
+                     _filter_taps_t& taps)
+    {
+        float scale = (float)in_size / out_size;
+        float support = getFilterRadius(filter) * scale;
+        taps.taps = (int)ceilf(support * 2.0f) + 1;
+        taps.index.resize((size_t)out_size * taps.taps);
+        taps.weight.resize((size_t)out_size * taps.taps);
+
+        for(int o = 0; o < out_size; o++)
+        {
+            float center = (o + 0.5f) * scale;
+            int first = (int)floorf(center - support);
+            float sum = 0.0f;
+
+            for(int k = 0; k < taps.taps; k++)
+            {
+                int i = first + k;
+                float w = getFilterWeight(filter, (i + 0.5f - center) / scale);
+                taps.index[o * taps.taps + k] = std::min(std::max(i, 0), in_size - 1);
+                taps.weight[o * taps.taps + k] = w;
+                sum += w;
+            }
+            for(int k = 0; k < taps.taps; k++) {
+                taps.weight[o * taps.taps + k] /= sum;
+            }
+        }
+    }
+
+
+    // --- SIMD KERNELS --- //
+
+    // filter rows [begin, end) of `in' horizontally into `out'
+    void filterRowsHorizontal(const _float_image_t& in, _float_image_t& out,
+                              const _filter_taps_t& taps,
+                              size_t begin, size_t end)
+    {
+        const int n = taps.taps;
+        for(size_t y = begin; y < end; y++)
+        {
+            const float* src = &in.pixels[y * in.width * 4];
+            float* dst = &out.pixels[y * out.width * 4];
+            int x = 0;
+
+#ifdef MIPMAPS_AVX2
+            // two destination pixels per register, one in each lane
+            for(; x + 1 < out.width; x += 2)
+            {
+                const int* i0 = &taps.index[x * n];
+                const int* i1 = i0 + n;
+                const float* w0 = &taps.weight[x * n];
+                const float* w1 = w0 + n;
+
+                __m256 acc = _mm256_setzero_ps();
+                for(int k = 0; k < n; k++)
+                {
+                    __m256 p = _mm256_insertf128_ps(
+                        _mm256_castps128_ps256(_mm_loadu_ps(src + i0[k] * 4)),
+                        _mm_loadu_ps(src + i1[k] * 4), 1);
+                    __m256 w = _mm256_insertf128_ps(
+                        _mm256_castps128_ps256(_mm_set1_ps(w0[k])),
+                        _mm_set1_ps(w1[k]), 1);
+                    acc = _mm256_add_ps(acc, _mm256_mul_ps(p, w));
+                }
+                _mm256_storeu_ps(dst + x * 4, acc);
+            }
+#endif
+            for(; x < out.width; x++)
+            {
+                const int* idx = &taps.index[x * n];
+                const float* w = &taps.weight[x * n];
+#ifdef MIPMAPS_SSE
+                __m128 acc = _mm_setzero_ps();
+                for(int k = 0; k < n; k++) {
+                    acc = _mm_add_ps(acc, _mm_mul_ps(_mm_loadu_ps(src + idx[k] * 4),
+                                                     _mm_set1_ps(w[k])));
+                }
+                _mm_storeu_ps(dst + x * 4, acc);
+#else
+                float acc[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+                for(int k = 0; k < n; k++) {
+                    for(int c = 0; c < 4; c++) {
+                        acc[c] += src[idx[k] * 4 + c] * w[k];
+                    }
+                }
+                memcpy(dst + x * 4, acc, sizeof(acc));
+#endif
+            }
+        }
+    }
+
+    // filter rows [begin, end) of `out' vertically from `in'
+    void filterRowsVertical(const _float_image_t& in, _float_image_t& out,
+                            const _filter_taps_t& taps,
+                            size_t begin, size_t end)
+    {
+        const int n = taps.taps;
+        const size_t row = (size_t)out.width * 4;
+
+        for(size_t y = begin; y < end; y++)
+        {
+            const int* idx = &taps.index[y * n];
+            const float* w = &taps.weight[y * n];
+            float* dst = &out.pixels[y * row];
+            size_t i = 0;
+
+#ifdef MIPMAPS_AVX2
+            for(; i + 8 <= row; i += 8)
+            {
+                __m256 acc = _mm256_setzero_ps();
+                for(int k = 0; k < n; k++) {
+                    acc = _mm256_add_ps(acc, _mm256_mul_ps(
+                        _mm256_loadu_ps(&in.pixels[idx[k] * row + i]),
+                        _mm256_set1_ps(w[k])));
+                }
+                _mm256_storeu_ps(dst + i, acc);
+            }
+#endif
+#ifdef MIPMAPS_SSE
+            for(; i + 4 <= row; i += 4)
+            {
+                __m128 acc = _mm_setzero_ps();
+                for(int k = 0; k < n; k++) {
+                    acc = _mm_add_ps(acc, _mm_mul_ps(
+                        _mm_loadu_ps(&in.pixels[idx[k] * row + i]),
+                        _mm_set1_ps(w[k])));
+                }
+                _mm_storeu_ps(dst + i, acc);
+            }
+#endif
+            for(; i < row; i++)
+            {
+                float acc = 0.0f;
+                for(int k = 0; k < n; k++) {
+                    acc += in.pixels[idx[k] * row + i] * w[k];
+                }
+                dst[i] = acc;
+            }
+        }
+    }
+
+    // 2x2 average for even dimensions, rows [begin, end) of `out'
+    void boxRows2x2(const _float_image_t& in, _float_image_t& out,
+                    size_t begin, size_t end)
+    {
+        const size_t in_row = (size_t)in.width * 4;
+        const size_t out_row = (size_t)out.width * 4;
+
+        for(size_t y = begin; y < end; y++)
+        {
+            const float* r0 = &in.pixels[2 * y * in_row];
+            const float* r1 = r0 + in_row;
+            float* dst = &out.pixels[y * out_row];
+            int x = 0;
+
+#ifdef MIPMAPS_AVX2
+            const __m256 quarter8 = _mm256_set1_ps(0.25f);
+            for(; x + 1 < out.width; x += 2)
+            {
+                // source pixels 0,1 and 2,3 of both rows
+                __m256 a = _mm256_add_ps(_mm256_loadu_ps(r0 + x * 8),
+                                         _mm256_loadu_ps(r1 + x * 8));
+                __m256 b = _mm256_add_ps(_mm256_loadu_ps(r0 + x * 8 + 8),
+                                         _mm256_loadu_ps(r1 + x * 8 + 8));
+                // (0,2) + (1,3)
+                __m256 even = _mm256_permute2f128_ps(a, b, 0x20);
+                __m256 odd = _mm256_permute2f128_ps(a, b, 0x31);
+                _mm256_storeu_ps(dst + x * 4,
+                                 _mm256_mul_ps(_mm256_add_ps(even, odd), quarter8));
+            }
+#endif
+            for(; x < out.width; x++)
+            {
+#ifdef MIPMAPS_SSE
+                __m128 sum = _mm_add_ps(
+                    _mm_add_ps(_mm_loadu_ps(r0 + x * 8), _mm_loadu_ps(r0 + x * 8 + 4)),
+                    _mm_add_ps(_mm_loadu_ps(r1 + x * 8), _mm_loadu_ps(r1 + x * 8 + 4)));
+                _mm_storeu_ps(dst + x * 4, _mm_mul_ps(sum, _mm_set1_ps(0.25f)));
+#else
+                for(int c = 0; c < 4; c++) {
+                    dst[x * 4 + c] = 0.25f * (r0[x * 8 + c] + r0[x * 8 + 4 + c] +
+                                              r1[x * 8 + c] + r1[x * 8 + 4 + c]);
+                }
+#endif
+            }
+        }
+    }
+
+    // compute the next level of `in' into `out'
+    void downsample(const _float_image_t& in, _float_image_t& out,
+                    _mipmap_filter_t filter, _float_image_t& tmp,
+                    Threads::ThreadPool* pool)
+    {
+        out.width = std::max(in.width / 2, 1);
+        out.height = std::max(in.height / 2, 1);
+        out.pixels.resize((size_t)out.width * out.height * 4);
+
+        if(filter == MIPMAP_FILTER_BOX &&
+           in.width == out.width * 2 && in.height == out.height * 2)
+        {
+            forRows(pool, out.height, [&](size_t begin, size_t end) {
+                boxRows2x2(in, out, begin, end);
+            });
+            return;
+        }
+
+        // separable: all source rows horizontally, then columns
+        _filter_taps_t htaps, vtaps;
+        computeTaps(filter, in.width, out.width, htaps);
+        computeTaps(filter, in.height, out.height, vtaps);
+
+        tmp.width = out.width;
+        tmp.height = in.height;
+        tmp.pixels.resize((size_t)tmp.width * tmp.height * 4);
+
+        forRows(pool, in.height, [&](size_t begin, size_t end) {
+            filterRowsHorizontal(in, tmp, htaps, begin, end);
+        });
+        forRows(pool, out.height, [&](size_t begin, size_t end) {
+            filterRowsVertical(tmp, out, vtaps, begin, end);
+        });
+    }
+
+
+    // --- MIPMAP CHAIN --- //
+
+    // generate the full chain for `pixels' (RGBA, rows tightly packed),
+    // level 0 included. Each level is filtered from the float version
+    // of the previous one, so no precision is lost between levels.
+    // `pool' may be NULL to run on the calling thread.
+    std::vector<Level> generateMipmaps(const void* pixels, int width, int height,
+                                       _mipmap_format_t format,
+                                       _mipmap_filter_t filter,
+                                       Threads::ThreadPool* pool = NULL)
+    {
+        std::vector<Level> levels(getLevelCount(width, height));
+
+        levels[0].width = width;
+        levels[0].height = height;
+        levels[0].data.assign((const unsigned char*)pixels,
+                              (const unsigned char*)pixels +
+                              (size_t)width * height * getPixelSize(format));
+
+        _float_image_t current, next, tmp;
+        convertToFloat(pixels, width, height, format, current, pool);
+
+        for(size_t i = 1; i < levels.size(); i++)
+        {
+            downsample(current, next, filter, tmp, pool);
+            convertFromFloat(next, format, levels[i], pool);
+            std::swap(current, next);
+        }
+        return levels;
+    }
+
+} // namespace Mipmaps
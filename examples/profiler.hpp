@@ -0,0 +1,440 @@
+//
+// Profiler
+//
+// Timing of named scopes in the rendering loop, both on the CPU and
+// on the GPU. GPU time is measured with timestamp queries, which are
+// read back a few frames later so that the CPU never waits for them.
+//
+// The last samples of every scope are kept in a ring buffer, and
+// summarized as percentiles when written as JSON. A Chrome trace
+// (chrome://tracing, or ui.perfetto.dev) shows the individual scopes
+// of the last frames, with the GPU on a track of its own.
+//
+
+#pragma once
+
+// GLEW
+#ifndef GLEW_STATIC
+#define GLEW_STATIC
+#endif
+#include <GL/glew.h>
+
+// STANDARD
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+
+namespace Profiling
+{
+    // frames between issuing timestamp queries and reading them back
+    const int PROFILER_FRAME_LATENCY = 3;
+
+    // samples kept per scope, for the percentiles
+    const size_t PROFILER_HISTORY = 1024;
+
+    // events kept for the Chrome trace
+    const size_t PROFILER_TRACE_EVENTS = 1 << 16;
+
+    typedef int _scope_id_t;
+
+    inline int64_t getCPUTime()
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+
+    // the last `PROFILER_HISTORY' durations of something, in nanoseconds
+    class Histogram
+    {
+    private:
+        std::vector<int64_t> _samples;
+        size_t _next = 0;
+        size_t _total = 0;
+
+    public:
+        Histogram()
+        {
+            _samples.reserve(PROFILER_HISTORY);
+        }
+
+        void Add(int64_t ns)
+        {
+            if(_samples.size() < PROFILER_HISTORY) {
+                _samples.push_back(ns);
+            }
+            else {
+                _samples[_next] = ns;
+            }
+            _next = (_next + 1) % PROFILER_HISTORY;
+            _total++;
+        }
+
+        // total number of samples added, also those no longer kept
+        size_t GetTotal() const
+        {
+            return _total;
+        }
+
+        bool IsEmpty() const
+        {
+            return _samples.empty();
+        }
+
+        // percentiles of the kept samples, `p' in [0, 1]
+        double Percentile(double p) const
+        {
+            if(_samples.empty()) {
+                return 0.0;
+            }
+            std::vector<int64_t> sorted(_samples);
+            size_t k = std::min(sorted.size() - 1, (size_t)(p * sorted.size()));
+            std::nth_element(sorted.begin(), sorted.begin() + k, sorted.end());
+            return sorted[k];
+        }
+
+        double Mean() const
+        {
+            if(_samples.empty()) {
+                return 0.0;
+            }
+            double sum = 0.0;
+            for(int64_t sample : _samples) {
+                sum += sample;
+            }
+            return sum / _samples.size();
+        }
+
+        int64_t Max() const
+        {
+            return _samples.empty() ? 0 : *std::max_element(_samples.begin(), _samples.end());
+        }
+    };
+
+
+    class Profiler
+    {
+    private:
+        typedef struct {
+            std::string name;
+            Histogram cpu;
+            Histogram gpu;
+        } _scope_t;
+
+        // a scope between `Begin' and `End'
+        typedef struct {
+            _scope_id_t scope;
+            int64_t cpu_begin;
+            size_t query_begin;
+        } _open_scope_t;
+
+        // a scope whose timestamp queries are still in flight
+        typedef struct {
+            _scope_id_t scope;
+            size_t query_begin;
+            size_t query_end;
+        } _gpu_sample_t;
+
+        typedef struct {
+            std::vector<GLuint> queries;
+            size_t used;
+            std::vector<_gpu_sample_t> samples;
+        } _frame_t;
+
+        typedef struct {
+            _scope_id_t scope;
+            bool gpu;
+            int64_t begin; // nanoseconds on the CPU clock
+            int64_t duration;
+        } _trace_event_t;
+
+        std::vector<_scope_t> _scopes;
+        std::vector<_open_scope_t> _open;
+
+        bool _gpu;
+        _frame_t _frames[PROFILER_FRAME_LATENCY + 1];
+        int _frame = 0;
+        size_t _dropped = 0;
+
+        // GPU timestamp minus CPU time, to put both on one timeline
+        int64_t _gpu_offset = 0;
+        int64_t _start;
+
+        std::vector<_trace_event_t> _trace;
+        size_t _trace_next = 0;
+
+        void addTraceEvent(_scope_id_t scope, bool gpu, int64_t begin, int64_t duration)
+        {
+            _trace_event_t event = {scope, gpu, begin, duration};
+            if(_trace.size() < PROFILER_TRACE_EVENTS) {
+                _trace.push_back(event);
+            }
+            else {
+                _trace[_trace_next] = event;
+            }
+            _trace_next = (_trace_next + 1) % PROFILER_TRACE_EVENTS;
+        }
+
+        size_t issueTimestamp()
+        {
+            _frame_t& frame = _frames[_frame];
+            if(frame.used == frame.queries.size())
+            {
+                GLuint query;
+                glGenQueries(1, &query);
+                frame.queries.push_back(query);
+            }
+            glQueryCounter(frame.queries[frame.used], GL_TIMESTAMP);
+            return frame.used++;
+        }
+
+        // read back the queries of a frame issued `PROFILER_FRAME_LATENCY'
+        // frames ago. Results that are still not available are dropped
+        // rather than waited for.
+        void collect(_frame_t& frame)
+        {
+            for(const _gpu_sample_t& sample : frame.samples)
+            {
+                GLuint end = frame.queries[sample.query_end];
+                GLint available = GL_FALSE;
+                glGetQueryObjectiv(end, GL_QUERY_RESULT_AVAILABLE, &available);
+                if(!available) {
+                    _dropped++;
+                    continue;
+                }
+
+                GLint64 begin_time = 0, end_time = 0;
+                glGetQueryObjecti64v(frame.queries[sample.query_begin],
+                                     GL_QUERY_RESULT, &begin_time);
+                glGetQueryObjecti64v(end, GL_QUERY_RESULT, &end_time);
+
+                _scopes[sample.scope].gpu.Add(end_time - begin_time);
+                addTraceEvent(sample.scope, true, begin_time - _gpu_offset,
+                              end_time - begin_time);
+            }
+            frame.samples.clear();
+            frame.used = 0;
+        }
+
+        void writeStats(std::ostream& out, const Histogram& histogram)
+        {
+            out << "{\"mean_ms\": " << histogram.Mean() * 1e-6
+                << ", \"p50_ms\": " << histogram.Percentile(0.50) * 1e-6
+                << ", \"p95_ms\": " << histogram.Percentile(0.95) * 1e-6
+                << ", \"p99_ms\": " << histogram.Percentile(0.99) * 1e-6
+                << ", \"max_ms\": " << histogram.Max() * 1e-6 << "}";
+        }
+
+        static std::string escape(const std::string& str)
+        {
+            std::string escaped;
+            for(char c : str)
+            {
+                if(c == '"' || c == '\\') {
+                    escaped += '\\';
+                }
+                escaped += c;
+            }
+            return escaped;
+        }
+
+    public:
+        // GPU timing needs a current context with timer queries (core
+        // since OpenGL 3.3, also in Mesa's software rasterizers). With
+        // `gpu' false, no GL calls are made at all.
+        Profiler(bool gpu = true)
+        {
+            _gpu = gpu && (GLEW_ARB_timer_query || GLEW_VERSION_3_3);
+            _start = getCPUTime();
+            _trace.reserve(PROFILER_TRACE_EVENTS);
+            for(_frame_t& frame : _frames) {
+                frame.used = 0;
+            }
+
+            if(_gpu)
+            {
+                GLint64 gpu_time = 0;
+                glGetInteger64v(GL_TIMESTAMP, &gpu_time);
+                _gpu_offset = gpu_time - getCPUTime();
+            }
+        }
+
+        ~Profiler()
+        {
+            for(_frame_t& frame : _frames)
+            {
+                if(!frame.queries.empty()) {
+                    glDeleteQueries(frame.queries.size(), &frame.queries[0]);
+                }
+            }
+        }
+
+        Profiler(const Profiler&) = delete;
+        Profiler& operator=(const Profiler&) = delete;
+
+        // register a scope, done once outside of the rendering loop
+        _scope_id_t GetScope(const char* name)
+        {
+            for(size_t i = 0; i < _scopes.size(); i++) {
+                if(_scopes[i].name == name) {
+                    return i;
+                }
+            }
+            _scopes.push_back(_scope_t());
+            _scopes.back().name = name;
+            return _scopes.size() - 1;
+        }
+
+        // should be called at the start of every frame, outside of
+        // any scope
+        void BeginFrame()
+        {
+            if(!_open.empty()) {
+                std::cerr << "Profiler::BeginFrame: scope '"
+                          << _scopes[_open.back().scope].name
+                          << "' is still open" << std::endl;
+                _open.clear();
+            }
+            if(_gpu)
+            {
+                _frame = (_frame + 1) % (PROFILER_FRAME_LATENCY + 1);
+                collect(_frames[_frame]);
+            }
+        }
+
+        // scopes may be nested, but must be ended in reverse order
+        void Begin(_scope_id_t scope)
+        {
+            _open_scope_t open;
+            open.scope = scope;
+            open.query_begin = _gpu ? issueTimestamp() : 0;
+            open.cpu_begin = getCPUTime();
+            _open.push_back(open);
+        }
+
+        void End(_scope_id_t scope)
+        {
+            int64_t cpu_end = getCPUTime();
+            if(_open.empty() || _open.back().scope != scope)
+            {
+                std::cerr << "Profiler::End: scope '" << _scopes[scope].name
+                          << "' was not the last one begun" << std::endl;
+                return;
+            }
+            _open_scope_t open = _open.back();
+            _open.pop_back();
+
+            _scopes[scope].cpu.Add(cpu_end - open.cpu_begin);
+            addTraceEvent(scope, false, open.cpu_begin, cpu_end - open.cpu_begin);
+
+            if(_gpu)
+            {
+                _gpu_sample_t sample = {scope, open.query_begin, issueTimestamp()};
+                _frames[_frame].samples.push_back(sample);
+            }
+        }
+
+        // samples whose GPU results were not available in time
+        size_t GetDroppedSamples()
+        {
+            return _dropped;
+        }
+
+        const Histogram& GetCPUHistogram(_scope_id_t scope)
+        {
+            return _scopes[scope].cpu;
+        }
+
+        const Histogram& GetGPUHistogram(_scope_id_t scope)
+        {
+            return _scopes[scope].gpu;
+        }
+
+        // percentiles of all scopes in milliseconds
+        bool WriteJSON(const char* path)
+        {
+            std::ofstream out(path);
+            if(!out.is_open())
+            {
+                std::cerr << "Could not write file '" << path << "'." << std::endl;
+                return false;
+            }
+
+            out << "{\n  \"scopes\": [";
+            for(size_t i = 0; i < _scopes.size(); i++)
+            {
+                out << (i ? "," : "") << "\n    {\"name\": \"" << escape(_scopes[i].name)
+                    << "\", \"count\": " << _scopes[i].cpu.GetTotal()
+                    << ",\n     \"cpu\": ";
+                writeStats(out, _scopes[i].cpu);
+                if(!_scopes[i].gpu.IsEmpty())
+                {
+                    out << ",\n     \"gpu\": ";
+                    writeStats(out, _scopes[i].gpu);
+                }
+                out << "}";
+            }
+            out << "\n  ],\n  \"dropped_gpu_samples\": " << _dropped << "\n}\n";
+            return true;
+        }
+
+        // the last `PROFILER_TRACE_EVENTS' scopes in the Chrome trace
+        // event format, with the CPU as thread 1 and the GPU as thread 2
+        bool WriteChromeTrace(const char* path)
+        {
+            std::ofstream out(path);
+            if(!out.is_open())
+            {
+                std::cerr << "Could not write file '" << path << "'." << std::endl;
+                return false;
+            }
+
+            out << "{\"traceEvents\": [\n"
+                << "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": 1,"
+                << " \"args\": {\"name\": \"CPU\"}},\n"
+                << "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": 2,"
+                << " \"args\": {\"name\": \"GPU\"}}";
+
+            out << std::fixed;
+            for(const _trace_event_t& event : _trace)
+            {
+                out << ",\n{\"name\": \"" << escape(_scopes[event.scope].name)
+                    << "\", \"ph\": \"X\", \"pid\": 1, \"tid\": " << (event.gpu ? 2 : 1)
+                    << ", \"ts\": " << (event.begin - _start) * 1e-3
+                    << ", \"dur\": " << event.duration * 1e-3 << "}";
+            }
+            out << "\n]}\n";
+            return true;
+        }
+    };
+
+
+    // begins a scope on construction and ends it on destruction
+    class Scope
+    {
+    private:
+        Profiler& _profiler;
+        _scope_id_t _scope;
+
+    public:
+        Scope(Profiler& profiler, _scope_id_t scope)
+            : _profiler(profiler), _scope(scope)
+        {
+            _profiler.Begin(scope);
+        }
+
+        ~Scope()
+        {
+            _profiler.End(_scope);
+        }
+
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+    };
+
+} // namespace Profiling
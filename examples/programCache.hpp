@@ -0,0 +1,260 @@
+//
+// Program Cache
+//
+// Stores linked shader programs on disk with `glGetProgramBinary',
+// and loads them with `glProgramBinary' on the next run instead of
+// compiling and linking the sources again.
+//
+// Programs are keyed by a hash of their sources together with the
+// vendor, renderer and version strings of the driver, so a driver
+// update or an edited shader simply misses the cache. A binary the
+// driver rejects anyway is deleted, and the program is compiled.
+//
+
+#pragma once
+
+// GLEW
+#ifndef GLEW_STATIC
+#define GLEW_STATIC
+#endif
+#include <GL/glew.h>
+
+// STANDARD
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <stdint.h>
+#include <string>
+#include <string.h>
+#include <vector>
+
+#if defined(_WIN32)
+#include <direct.h>
+#include <process.h>
+#else
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+
+namespace ProgramCache
+{
+    // header of a cache file, followed by `length' bytes of binary
+    typedef struct {
+        char magic[4];
+        uint32_t version;
+        uint64_t key;
+        uint32_t format;
+        uint32_t length;
+    } _cache_header_t;
+
+    const char CACHE_MAGIC[4] = {'T', 'P', 'P', 'B'};
+    const uint32_t CACHE_VERSION = 1;
+
+    // FNV-1a, 64 bit. Pass the previous result as `hash' to
+    // continue hashing more data.
+    inline uint64_t hashBytes(const void* data, size_t size,
+                              uint64_t hash = 14695981039346656037ull)
+    {
+        const unsigned char* bytes = (const unsigned char*)data;
+        for(size_t i = 0; i < size; i++)
+        {
+            hash ^= bytes[i];
+            hash *= 1099511628211ull;
+        }
+        return hash;
+    }
+
+    inline uint64_t hashString(const std::string& str, uint64_t hash)
+    {
+        // include the terminator, so "ab" + "c" differs from "a" + "bc"
+        return hashBytes(str.c_str(), str.size() + 1, hash);
+    }
+
+    // the directory cache files are written to. An empty string
+    // disables the cache.
+    std::string& getDirectory()
+    {
+        static std::string directory = "programCache";
+        return directory;
+    }
+
+    void setDirectory(const char* directory)
+    {
+        getDirectory() = directory;
+    }
+
+    // whether the current context can retrieve program binaries at all.
+    // Some drivers expose the extension but no binary formats.
+    bool isSupported()
+    {
+        if(getDirectory().empty() || !GLEW_ARB_get_program_binary) {
+            return false;
+        }
+        GLint formats = 0;
+        glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+        return formats > 0;
+    }
+
+    // hash of the strings identifying the driver, as the start of
+    // every key. Queried once, as it does not change with the context.
+    uint64_t getDriverKey()
+    {
+        static uint64_t key = 0;
+        if(key == 0)
+        {
+            GLenum names[] = {GL_VENDOR, GL_RENDERER, GL_VERSION,
+                              GL_SHADING_LANGUAGE_VERSION};
+            key = hashBytes(&CACHE_VERSION, sizeof(CACHE_VERSION));
+            for(GLenum name : names)
+            {
+                const char* str = (const char*)glGetString(name);
+                key = hashString(str ? str : "", key);
+            }
+        }
+        return key;
+    }
+
+    std::string getCacheFile(uint64_t key)
+    {
+        char name[32];
+        snprintf(name, sizeof(name), "%016llx.bin", (unsigned long long)key);
+
+        std::string path = getDirectory();
+        if(path.back() != '/' && path.back() != '\\') {
+            path += '/';
+        }
+        return path + name;
+    }
+
+    void createDirectory()
+    {
+#if defined(_WIN32)
+        _mkdir(getDirectory().c_str());
+#else
+        mkdir(getDirectory().c_str(), 0755);
+#endif
+    }
+
+    // should be called on a program before linking it, if it is
+    // going to be stored afterwards
+    void prepareProgram(GLuint program)
+    {
+        if(isSupported()) {
+            glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+        }
+    }
+
+    // return a linked program from the cache, or 0 if there is none
+    // for `key' or the driver does not accept it
+    GLuint loadProgram(uint64_t key)
+    {
+        if(!isSupported()) {
+            return 0;
+        }
+
+        std::string file = getCacheFile(key);
+        std::ifstream stream(file.c_str(), std::ios::in | std::ios::binary | std::ios::ate);
+        if(!stream.is_open()) {
+            return 0;
+        }
+        std::streamoff size = stream.tellg();
+        stream.seekg(0);
+
+        // the length is only trusted if it is exactly what follows the
+        // header, so a truncated or corrupt file is a miss
+        _cache_header_t header;
+        std::vector<char> binary;
+        if(size >= (std::streamoff)sizeof(header) && stream.read((char*)&header, sizeof(header)))
+        {
+            if(memcmp(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC)) == 0 &&
+               header.version == CACHE_VERSION && header.key == key &&
+               header.length > 0 &&
+               (std::streamoff)header.length == size - (std::streamoff)sizeof(header))
+            {
+                binary.resize(header.length);
+                if(!stream.read(binary.data(), binary.size())) {
+                    binary.clear();
+                }
+            }
+        }
+        stream.close();
+
+        GLuint program = 0;
+        GLint result = GL_FALSE;
+        if(!binary.empty())
+        {
+            program = glCreateProgram();
+            glProgramBinary(program, header.format, binary.data(), binary.size());
+            glGetProgramiv(program, GL_LINK_STATUS, &result);
+        }
+
+        if(!result)
+        {
+            std::cout << "Discarding stale program binary '" << file << "'" << std::endl;
+            if(program) {
+                glDeleteProgram(program);
+            }
+            std::remove(file.c_str());
+            return 0;
+        }
+
+        std::cout << "Loaded program binary '" << file << "'" << std::endl;
+        return program;
+    }
+
+    // write a linked program to the cache. Written to a temporary file
+    // first, so concurrent runs never read a partial binary.
+    void storeProgram(uint64_t key, GLuint program)
+    {
+        if(!isSupported()) {
+            return;
+        }
+
+        GLint length = 0;
+        glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+        if(length <= 0) {
+            return;
+        }
+
+        _cache_header_t header;
+        memcpy(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC));
+        header.version = CACHE_VERSION;
+        header.key = key;
+
+        std::vector<char> binary(length);
+        GLenum format = 0;
+        glGetProgramBinary(program, length, &length, &format, binary.data());
+        header.format = format;
+        header.length = length;
+
+        createDirectory();
+        std::string file = getCacheFile(key);
+        // one per process, so that processes storing the same program
+        // at the same time do not write to each other's file
+#if defined(_WIN32)
+        std::string temporary = file + "." + std::to_string(_getpid()) + ".tmp";
+#else
+        std::string temporary = file + "." + std::to_string(getpid()) + ".tmp";
+#endif
+
+        std::ofstream stream(temporary.c_str(), std::ios::out | std::ios::binary);
+        if(!stream.is_open())
+        {
+            std::cerr << "Could not write program binary '"
+                      << temporary << "'." << std::endl;
+            return;
+        }
+        stream.write((const char*)&header, sizeof(header));
+        stream.write(binary.data(), length);
+        stream.close();
+
+        if(std::rename(temporary.c_str(), file.c_str()) != 0)
+        {
+            // rename does not replace an existing file on Windows
+            std::remove(file.c_str());
+            std::rename(temporary.c_str(), file.c_str());
+        }
+    }
+
+} // namespace ProgramCache
@@ -0,0 +1,599 @@
+//
+// Software Rasterizer
+//
+// Renders the same interleaved vertex data as the examples
+// without an OpenGL context. Triangles are binned into screen
+// tiles, and the tiles are rasterized in parallel with edge
+// functions evaluated for 8 (AVX2) or 4 (SSE2) pixels at once.
+//
+// Coverage uses 4 bit sub-pixel fixed point and the top-left
+// fill rule, so results are exact and do not depend on the
+// number of threads. There is no clipping against the near plane;
+// triangles with a vertex behind the camera or far outside the
+// viewport are dropped. Depth testing and blending are not done,
+// as the examples do not use them.
+//
+
+#pragma once
+
+// CUSTOM
+#include "threads.hpp"
+
+// STANDARD
+#include <algorithm>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <vector>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define RASTERIZER_AVX2
+#elif defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define RASTERIZER_SSE2
+#endif
+
+
+namespace Rasterizer
+{
+    const int TILE_SIZE = 64;
+    const int SUBPIXEL_BITS = 4;
+    const int SUBPIXEL_SCALE = 1 << SUBPIXEL_BITS;
+
+    // triangles reaching further than this outside the viewport are
+    // dropped, which keeps the edge functions within 32 bits
+    const float GUARD_BAND = 4096.0f;
+
+    // number of floats passed from the vertex to the fragment stage
+    const int MAX_VARYINGS = 4;
+
+
+    // --- PROGRAMS --- //
+
+    // output of the vertex stage, like `gl_Position' and `out' variables
+    typedef struct {
+        float position[4];
+        float varyings[MAX_VARYINGS];
+    } _vertex_out_t;
+
+    // called for every vertex, with `attributes' pointing at its data
+    typedef void (*_vertex_shader_func)(const float* attributes,
+                                        const void* uniforms,
+                                        _vertex_out_t& out);
+
+    // the fragment stage writes the interpolated varyings as RGBA,
+    // which is what the fragment shaders of the examples do. With
+    // 3 varyings alpha is 1.
+    typedef struct {
+        _vertex_shader_func vertex;
+        const void* uniforms;
+        int varyings;
+    } Program;
+
+    // shader1/vertex.shd
+    void shader1Vertex(const float* attributes, const void* uniforms,
+                       _vertex_out_t& out)
+    {
+        (void)uniforms;
+        out.position[0] = attributes[0];
+        out.position[1] = attributes[1];
+        out.position[2] = 0.0f;
+        out.position[3] = 1.0f;
+        out.varyings[0] = attributes[2];
+        out.varyings[1] = attributes[3];
+        out.varyings[2] = attributes[4];
+    }
+
+    typedef struct {
+        float xytime[2];
+    } _shader2_uniforms_t;
+
+    // shader2/vertex.shd
+    void shader2Vertex(const float* attributes, const void* uniforms,
+                       _vertex_out_t& out)
+    {
+        const float* xytime = ((const _shader2_uniforms_t*)uniforms)->xytime;
+        float xtime = (xytime[0] + 1.0f) * 0.5f;
+        float ytime = (xytime[1] + 1.0f) * 0.5f;
+
+        for(int c = 0; c < 3; c++)
+        {
+            // mix(vertexCol, 1.0f - vertexCol, xtime) * ytime
+            float col = attributes[2 + c];
+            out.varyings[c] = (col * (1.0f - xtime) + (1.0f - col) * xtime) * ytime;
+        }
+        out.position[0] = attributes[0] + xytime[0] * 0.5f;
+        out.position[1] = attributes[1] + xytime[1] * 0.4f;
+        out.position[2] = 0.0f;
+        out.position[3] = 1.0f;
+    }
+
+
+    // --- FRAMEBUFFER --- //
+
+    // RGBA8 color buffer, row 0 is the bottom row like in OpenGL
+    class Framebuffer
+    {
+    private:
+        int _width;
+        int _height;
+        std::vector<uint32_t> _pixels;
+
+    public:
+        Framebuffer(int width, int height)
+            : _width(width), _height(height), _pixels((size_t)width * height, 0)
+        {
+        }
+
+        int GetWidth() const { return _width; }
+        int GetHeight() const { return _height; }
+        uint32_t* GetPixels() { return &_pixels[0]; }
+
+        uint32_t GetPixel(int x, int y) const
+        {
+            return _pixels[(size_t)y * _width + x];
+        }
+
+        void Clear(float r, float g, float b, float a)
+        {
+            uint32_t color = (uint32_t)(r * 255.0f + 0.5f) |
+                             ((uint32_t)(g * 255.0f + 0.5f) << 8) |
+                             ((uint32_t)(b * 255.0f + 0.5f) << 16) |
+                             ((uint32_t)(a * 255.0f + 0.5f) << 24);
+            std::fill(_pixels.begin(), _pixels.end(), color);
+        }
+
+        // write as binary PPM, top row first
+        bool WritePPM(const char* path) const
+        {
+            FILE* file = fopen(path, "wb");
+            if(file == NULL) {
+                return false;
+            }
+            fprintf(file, "P6\n%d %d\n255\n", _width, _height);
+
+            std::vector<unsigned char> row((size_t)_width * 3);
+            for(int y = _height - 1; y >= 0; y--)
+            {
+                for(int x = 0; x < _width; x++)
+                {
+                    uint32_t p = GetPixel(x, y);
+                    row[x * 3 + 0] = p & 0xff;
+                    row[x * 3 + 1] = (p >> 8) & 0xff;
+                    row[x * 3 + 2] = (p >> 16) & 0xff;
+                }
+                fwrite(&row[0], 1, row.size(), file);
+            }
+            fclose(file);
+            return true;
+        }
+    };
+
+
+    // --- TRIANGLE SETUP --- //
+
+    typedef struct {
+        // pixel bounding box, clipped to the viewport
+        int min_x, min_y, max_x, max_y;
+
+        // edge i: E(P) = dx * (P.y - y0) - dy * (P.x - x0) - bias,
+        // in sub-pixels, covered where all three are >= 0
+        int64_t x0[3], y0[3], dx[3], dy[3], bias[3];
+
+        // planes of varying/w and 1/w: value = v + a*(x-px) + b*(y-py)
+        float px, py;
+        float v[MAX_VARYINGS + 1];
+        float a[MAX_VARYINGS + 1];
+        float b[MAX_VARYINGS + 1];
+    } _triangle_t;
+
+    typedef struct {
+        float x, y;   // window coordinates in pixels
+        float inv_w;
+        float varyings[MAX_VARYINGS];
+        bool valid;
+    } _screen_vertex_t;
+
+    // set up a triangle, returns false if it covers no pixels
+    bool setupTriangle(const _screen_vertex_t* v[3], int varyings,
+                       int width, int height, _triangle_t& tri)
+    {
+        int64_t X[3], Y[3];
+        for(int i = 0; i < 3; i++)
+        {
+            X[i] = (int64_t)lroundf(v[i]->x * SUBPIXEL_SCALE);
+            Y[i] = (int64_t)lroundf(v[i]->y * SUBPIXEL_SCALE);
+        }
+
+        int64_t area = (X[1] - X[0]) * (Y[2] - Y[0]) - (X[2] - X[0]) * (Y[1] - Y[0]);
+        if(area == 0) {
+            return false;
+        }
+        if(area < 0)
+        {
+            // no face culling, so make every triangle counter-clockwise
+            std::swap(X[1], X[2]);
+            std::swap(Y[1], Y[2]);
+            std::swap(v[1], v[2]);
+        }
+
+        int64_t min_x = std::min(X[0], std::min(X[1], X[2]));
+        int64_t min_y = std::min(Y[0], std::min(Y[1], Y[2]));
+        int64_t max_x = std::max(X[0], std::max(X[1], X[2]));
+        int64_t max_y = std::max(Y[0], std::max(Y[1], Y[2]));
+
+        // pixels whose centers may be covered
+        tri.min_x = std::max((int)((min_x - SUBPIXEL_SCALE / 2) >> SUBPIXEL_BITS), 0);
+        tri.min_y = std::max((int)((min_y - SUBPIXEL_SCALE / 2) >> SUBPIXEL_BITS), 0);
+        tri.max_x = std::min((int)((max_x - SUBPIXEL_SCALE / 2) >> SUBPIXEL_BITS) + 1, width - 1);
+        tri.max_y = std::min((int)((max_y - SUBPIXEL_SCALE / 2) >> SUBPIXEL_BITS) + 1, height - 1);
+        if(tri.min_x > tri.max_x || tri.min_y > tri.max_y) {
+            return false;
+        }
+
+        for(int i = 0; i < 3; i++)
+        {
+            int j = (i + 1) % 3;
+            tri.x0[i] = X[i];
+            tri.y0[i] = Y[i];
+            tri.dx[i] = X[j] - X[i];
+            tri.dy[i] = Y[j] - Y[i];
+
+            // top-left rule: pixel centers exactly on an edge belong to
+            // the triangle only for left edges and horizontal top edges
+            bool top_left = tri.dy[i] < 0 || (tri.dy[i] == 0 && tri.dx[i] < 0);
+            tri.bias[i] = top_left ? 0 : 1;
+        }
+
+        // interpolation planes from the snapped positions
+        float x0 = X[0] / (float)SUBPIXEL_SCALE, y0 = Y[0] / (float)SUBPIXEL_SCALE;
+        float x1 = X[1] / (float)SUBPIXEL_SCALE, y1 = Y[1] / (float)SUBPIXEL_SCALE;
+        float x2 = X[2] / (float)SUBPIXEL_SCALE, y2 = Y[2] / (float)SUBPIXEL_SCALE;
+        float det = (x1 - x0) * (y2 - y0) - (x2 - x0) * (y1 - y0);
+
+        tri.px = x0;
+        tri.py = y0;
+        for(int k = 0; k <= varyings; k++)
+        {
+            // the last plane is 1/w itself
+            float f0 = (k < varyings) ? v[0]->varyings[k] * v[0]->inv_w : v[0]->inv_w;
+            float f1 = (k < varyings) ? v[1]->varyings[k] * v[1]->inv_w : v[1]->inv_w;
+            float f2 = (k < varyings) ? v[2]->varyings[k] * v[2]->inv_w : v[2]->inv_w;
+
+            tri.v[k] = f0;
+            tri.a[k] = ((f1 - f0) * (y2 - y0) - (f2 - f0) * (y1 - y0)) / det;
+            tri.b[k] = ((f2 - f0) * (x1 - x0) - (f1 - f0) * (x2 - x0)) / det;
+        }
+        return true;
+    }
+
+
+    // --- TILE RASTERIZATION --- //
+
+    // edge function value at the center of pixel (x, y), clamped to
+    // 31 bits. A clamped value is too large to change sign within a
+    // tile row, so coverage stays exact.
+    inline int32_t edgeAt(const _triangle_t& tri, int i, int x, int y)
+    {
+        int64_t px = ((int64_t)x << SUBPIXEL_BITS) + SUBPIXEL_SCALE / 2;
+        int64_t py = ((int64_t)y << SUBPIXEL_BITS) + SUBPIXEL_SCALE / 2;
+        int64_t e = tri.dx[i] * (py - tri.y0[i]) - tri.dy[i] * (px - tri.x0[i])
+                    - tri.bias[i];
+        const int64_t limit = (int64_t)1 << 30;
+        return (int32_t)std::min(std::max(e, -limit), limit);
+    }
+
+    inline uint32_t packColor(const float c[4])
+    {
+        uint32_t p = 0;
+        for(int k = 0; k < 4; k++)
+        {
+            float f = std::min(std::max(c[k], 0.0f), 1.0f);
+            p |= (uint32_t)(int)(f * 255.0f + 0.5f) << (8 * k);
+        }
+        return p;
+    }
+
+    // shade one covered pixel
+    inline uint32_t shadePixel(const _triangle_t& tri, int varyings, int x, int y)
+    {
+        float dx = (float)x + 0.5f - tri.px;
+        float dy = (float)y + 0.5f - tri.py;
+        float w = 1.0f / (tri.v[varyings] + (tri.a[varyings] * dx + tri.b[varyings] * dy));
+
+        float c[4] = {0.0f, 0.0f, 0.0f, 1.0f};
+        for(int k = 0; k < varyings && k < 4; k++) {
+            c[k] = (tri.v[k] + (tri.a[k] * dx + tri.b[k] * dy)) * w;
+        }
+        return packColor(c);
+    }
+
+#if defined(RASTERIZER_AVX2)
+    const int RASTER_LANES = 8;
+    typedef __m256i _ivec_t;
+    typedef __m256 _fvec_t;
+
+    inline _ivec_t iset1(int32_t x) { return _mm256_set1_epi32(x); }
+    inline _ivec_t iadd(_ivec_t a, _ivec_t b) { return _mm256_add_epi32(a, b); }
+    inline _ivec_t ior(_ivec_t a, _ivec_t b) { return _mm256_or_si256(a, b); }
+    inline _ivec_t imul_lanes(int32_t step) { return _mm256_setr_epi32(0, step, 2 * step, 3 * step, 4 * step, 5 * step, 6 * step, 7 * step); }
+    inline int signmask(_ivec_t a) { return _mm256_movemask_ps(_mm256_castsi256_ps(a)); }
+    inline _fvec_t fset1(float x) { return _mm256_set1_ps(x); }
+    inline _fvec_t flanes() { return _mm256_setr_ps(0, 1, 2, 3, 4, 5, 6, 7); }
+    inline _fvec_t fadd(_fvec_t a, _fvec_t b) { return _mm256_add_ps(a, b); }
+    inline _fvec_t fsub(_fvec_t a, _fvec_t b) { return _mm256_sub_ps(a, b); }
+    inline _fvec_t fmul(_fvec_t a, _fvec_t b) { return _mm256_mul_ps(a, b); }
+    inline _fvec_t fdiv(_fvec_t a, _fvec_t b) { return _mm256_div_ps(a, b); }
+    inline _fvec_t fclamp01(_fvec_t a) { return _mm256_min_ps(_mm256_max_ps(a, _mm256_setzero_ps()), _mm256_set1_ps(1.0f)); }
+    inline _ivec_t toByte(_fvec_t a) { return _mm256_cvttps_epi32(_mm256_add_ps(_mm256_mul_ps(fclamp01(a), _mm256_set1_ps(255.0f)), _mm256_set1_ps(0.5f))); }
+    inline _ivec_t ishl(_ivec_t a, int n) { return _mm256_slli_epi32(a, n); }
+
+    // write the lanes whose sign bit in `edges' is clear
+    inline void storeCovered(uint32_t* dst, _ivec_t color, _ivec_t edges, int count)
+    {
+        if(count == RASTER_LANES)
+        {
+            // the mask store writes lanes with the sign bit *set*
+            __m256i mask = _mm256_xor_si256(edges, _mm256_set1_epi32(-1));
+            _mm256_maskstore_epi32((int*)dst, mask, color);
+            return;
+        }
+        alignas(32) uint32_t c[8];
+        alignas(32) int32_t e[8];
+        _mm256_store_si256((__m256i*)c, color);
+        _mm256_store_si256((__m256i*)e, edges);
+        for(int i = 0; i < count; i++) {
+            if(e[i] >= 0) dst[i] = c[i];
+        }
+    }
+#elif defined(RASTERIZER_SSE2)
+    const int RASTER_LANES = 4;
+    typedef __m128i _ivec_t;
+    typedef __m128 _fvec_t;
+
+    inline _ivec_t iset1(int32_t x) { return _mm_set1_epi32(x); }
+    inline _ivec_t iadd(_ivec_t a, _ivec_t b) { return _mm_add_epi32(a, b); }
+    inline _ivec_t ior(_ivec_t a, _ivec_t b) { return _mm_or_si128(a, b); }
+    inline _ivec_t imul_lanes(int32_t step) { return _mm_setr_epi32(0, step, 2 * step, 3 * step); }
+    inline int signmask(_ivec_t a) { return _mm_movemask_ps(_mm_castsi128_ps(a)); }
+    inline _fvec_t fset1(float x) { return _mm_set1_ps(x); }
+    inline _fvec_t flanes() { return _mm_setr_ps(0, 1, 2, 3); }
+    inline _fvec_t fadd(_fvec_t a, _fvec_t b) { return _mm_add_ps(a, b); }
+    inline _fvec_t fsub(_fvec_t a, _fvec_t b) { return _mm_sub_ps(a, b); }
+    inline _fvec_t fmul(_fvec_t a, _fvec_t b) { return _mm_mul_ps(a, b); }
+    inline _fvec_t fdiv(_fvec_t a, _fvec_t b) { return _mm_div_ps(a, b); }
+    inline _fvec_t fclamp01(_fvec_t a) { return _mm_min_ps(_mm_max_ps(a, _mm_setzero_ps()), _mm_set1_ps(1.0f)); }
+    inline _ivec_t toByte(_fvec_t a) { return _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(fclamp01(a), _mm_set1_ps(255.0f)), _mm_set1_ps(0.5f))); }
+    inline _ivec_t ishl(_ivec_t a, int n) { return _mm_slli_epi32(a, n); }
+
+    inline void storeCovered(uint32_t* dst, _ivec_t color, _ivec_t edges, int count)
+    {
+        __m128i outside = _mm_srai_epi32(edges, 31);
+        if(count == RASTER_LANES)
+        {
+            __m128i old = _mm_loadu_si128((const __m128i*)dst);
+            __m128i merged = _mm_or_si128(_mm_and_si128(outside, old),
+                                          _mm_andnot_si128(outside, color));
+            _mm_storeu_si128((__m128i*)dst, merged);
+            return;
+        }
+        alignas(16) uint32_t c[4];
+        alignas(16) int32_t e[4];
+        _mm_store_si128((__m128i*)c, color);
+        _mm_store_si128((__m128i*)e, edges);
+        for(int i = 0; i < count; i++) {
+            if(e[i] >= 0) dst[i] = c[i];
+        }
+    }
+#endif
+
+    // rasterize the part of `tri' inside the tile [x0,x1] x [y0,y1]
+    void rasterizeInTile(const _triangle_t& tri, int varyings, Framebuffer& fb,
+                         int x0, int y0, int x1, int y1)
+    {
+        int min_x = std::max(tri.min_x, x0);
+        int min_y = std::max(tri.min_y, y0);
+        int max_x = std::min(tri.max_x, x1);
+        int max_y = std::min(tri.max_y, y1);
+        if(min_x > max_x || min_y > max_y) {
+            return;
+        }
+
+        // change of the edge functions per pixel step in x
+        int32_t step[3];
+        for(int i = 0; i < 3; i++) {
+            step[i] = (int32_t)(-tri.dy[i] * SUBPIXEL_SCALE);
+        }
+
+        for(int y = min_y; y <= max_y; y++)
+        {
+            uint32_t* row = fb.GetPixels() + (size_t)y * fb.GetWidth();
+            int32_t e0 = edgeAt(tri, 0, min_x, y);
+            int32_t e1 = edgeAt(tri, 1, min_x, y);
+            int32_t e2 = edgeAt(tri, 2, min_x, y);
+            int x = min_x;
+
+#if defined(RASTERIZER_AVX2) || defined(RASTERIZER_SSE2)
+            _ivec_t ve0 = iadd(iset1(e0), imul_lanes(step[0]));
+            _ivec_t ve1 = iadd(iset1(e1), imul_lanes(step[1]));
+            _ivec_t ve2 = iadd(iset1(e2), imul_lanes(step[2]));
+            _ivec_t vs0 = iset1(step[0] * RASTER_LANES);
+            _ivec_t vs1 = iset1(step[1] * RASTER_LANES);
+            _ivec_t vs2 = iset1(step[2] * RASTER_LANES);
+
+            const _fvec_t lanes = flanes();
+            const _fvec_t fdy = fset1((float)y + 0.5f - tri.py);
+
+            for(; x <= max_x; x += RASTER_LANES)
+            {
+                _ivec_t edges = ior(ve0, ior(ve1, ve2));
+                int count = std::min(RASTER_LANES, max_x - x + 1);
+                int outside = signmask(edges);
+
+                if(outside != (1 << RASTER_LANES) - 1)
+                {
+                    // same order of operations as `shadePixel'
+                    _fvec_t fdx = fsub(fadd(fadd(fset1((float)x), lanes),
+                                            fset1(0.5f)), fset1(tri.px));
+                    _fvec_t w = fadd(fset1(tri.v[varyings]),
+                                     fadd(fmul(fset1(tri.a[varyings]), fdx),
+                                          fmul(fset1(tri.b[varyings]), fdy)));
+                    w = fdiv(fset1(1.0f), w);
+
+                    _ivec_t color = iset1(0);
+                    _ivec_t alpha = ishl(iset1(255), 24);
+                    for(int k = 0; k < varyings && k < 4; k++)
+                    {
+                        _fvec_t c = fadd(fset1(tri.v[k]),
+                                         fadd(fmul(fset1(tri.a[k]), fdx),
+                                              fmul(fset1(tri.b[k]), fdy)));
+                        _ivec_t byte = toByte(fmul(c, w));
+                        if(k == 3) {
+                            alpha = ishl(byte, 24);
+                        }
+                        else {
+                            color = ior(color, ishl(byte, 8 * k));
+                        }
+                    }
+                    color = ior(color, alpha);
+                    storeCovered(row + x, color, edges, count);
+                }
+
+                ve0 = iadd(ve0, vs0);
+                ve1 = iadd(ve1, vs1);
+                ve2 = iadd(ve2, vs2);
+            }
+#else
+            for(; x <= max_x; x++)
+            {
+                if((e0 | e1 | e2) >= 0) {
+                    row[x] = shadePixel(tri, varyings, x, y);
+                }
+                e0 += step[0];
+                e1 += step[1];
+                e2 += step[2];
+            }
+#endif
+        }
+    }
+
+
+    // --- RENDERER --- //
+
+    class Renderer
+    {
+    private:
+        Threads::ThreadPool* _pool;
+
+        // kept between draws to avoid reallocating every frame
+        std::vector<_screen_vertex_t> _vertices;
+        std::vector<_triangle_t> _triangles;
+        std::vector<char> _triangle_valid;
+        std::vector<std::vector<int> > _bins;
+
+        template<typename Func>
+        void forRange(size_t count, size_t chunk, Func func)
+        {
+            if(_pool == NULL) {
+                func((size_t)0, count);
+            }
+            else {
+                Threads::parallelFor(*_pool, count, chunk, func);
+            }
+        }
+
+    public:
+        // `pool' may be NULL to render on the calling thread
+        Renderer(Threads::ThreadPool* pool = NULL)
+            : _pool(pool)
+        {
+        }
+
+        // equivalent of glDrawArrays(GL_TRIANGLES, first, count) with the
+        // attributes of vertex i at `vertices + i * stride' (in floats)
+        void DrawArrays(Framebuffer& fb, const Program& program,
+                        const float* vertices, int stride, int first, int count)
+        {
+            const int width = fb.GetWidth();
+            const int height = fb.GetHeight();
+            const int varyings = std::min(program.varyings, MAX_VARYINGS);
+            const int triangles = count / 3;
+
+            // vertex stage and viewport transform
+            _vertices.resize(count);
+            forRange(count, 1024, [&](size_t begin, size_t end) {
+                for(size_t i = begin; i < end; i++)
+                {
+                    _vertex_out_t out = {};
+                    program.vertex(vertices + (size_t)(first + i) * stride,
+                                   program.uniforms, out);
+
+                    _screen_vertex_t& v = _vertices[i];
+                    float w = out.position[3];
+                    v.inv_w = 1.0f / w;
+                    v.x = (out.position[0] * v.inv_w + 1.0f) * 0.5f * width;
+                    v.y = (out.position[1] * v.inv_w + 1.0f) * 0.5f * height;
+                    v.valid = w > 0.0f &&
+                              v.x > -GUARD_BAND && v.x < width + GUARD_BAND &&
+                              v.y > -GUARD_BAND && v.y < height + GUARD_BAND;
+                    for(int k = 0; k < MAX_VARYINGS; k++) {
+                        v.varyings[k] = out.varyings[k];
+                    }
+                }
+            });
+
+            // triangle setup
+            _triangles.resize(triangles);
+            _triangle_valid.resize(triangles);
+            forRange(triangles, 256, [&](size_t begin, size_t end) {
+                for(size_t t = begin; t < end; t++)
+                {
+                    const _screen_vertex_t* v[3] = {
+                        &_vertices[t * 3], &_vertices[t * 3 + 1], &_vertices[t * 3 + 2]
+                    };
+                    _triangle_valid[t] = v[0]->valid && v[1]->valid && v[2]->valid &&
+                        setupTriangle(v, varyings, width, height, _triangles[t]);
+                }
+            });
+
+            // binning, in submission order so each tile draws in order
+            const int tiles_x = (width + TILE_SIZE - 1) / TILE_SIZE;
+            const int tiles_y = (height + TILE_SIZE - 1) / TILE_SIZE;
+            _bins.resize(tiles_x * tiles_y);
+            for(size_t i = 0; i < _bins.size(); i++) {
+                _bins[i].clear();
+            }
+
+            for(int t = 0; t < triangles; t++)
+            {
+                if(!_triangle_valid[t]) {
+                    continue;
+                }
+                const _triangle_t& tri = _triangles[t];
+                for(int ty = tri.min_y / TILE_SIZE; ty <= tri.max_y / TILE_SIZE; ty++) {
+                    for(int tx = tri.min_x / TILE_SIZE; tx <= tri.max_x / TILE_SIZE; tx++) {
+                        _bins[ty * tiles_x + tx].push_back(t);
+                    }
+                }
+            }
+
+            // every tile is owned by a single thread
+            forRange(_bins.size(), 1, [&](size_t begin, size_t end) {
+                for(size_t b = begin; b < end; b++)
+                {
+                    int x0 = (b % tiles_x) * TILE_SIZE;
+                    int y0 = (b / tiles_x) * TILE_SIZE;
+                    int x1 = std::min(x0 + TILE_SIZE, width) - 1;
+                    int y1 = std::min(y0 + TILE_SIZE, height) - 1;
+
+                    for(size_t i = 0; i < _bins[b].size(); i++) {
+                        rasterizeInTile(_triangles[_bins[b][i]], varyings, fb,
+                                        x0, y0, x1, y1);
+                    }
+                }
+            });
+        }
+    };
+
+} // namespace Rasterizer
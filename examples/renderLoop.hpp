@@ -0,0 +1,196 @@
+//
+// Render Loop
+//
+// Drives the rendering loop of a window: the simulation is updated
+// with a fixed timestep, independent of the frame rate, and every
+// frame is rendered with the fraction of a timestep since the last
+// update, to interpolate between the last two states.
+//
+// Between frames the thread sleeps in `WaitEventsTimeout' until
+// the next frame is due, instead of spinning. In idle mode a frame is
+// only rendered when something may have changed: an update was made,
+// the window received an event, e.g. input, a resize or a part of it
+// to redraw, or a redraw was requested. Otherwise the thread sleeps
+// until the next update is due, or until an event arrives if paused.
+//
+
+#pragma once
+
+// CUSTOM
+#include "windows.hpp"
+
+// STANDARD
+#include <atomic>
+#include <functional>
+
+
+namespace Windows
+{
+    // at most this much time is simulated per frame, e.g. after the
+    // window was dragged, so the simulation never falls further behind
+    const double RENDER_LOOP_MAX_FRAME_TIME = 0.25;
+
+    class RenderLoop
+    {
+    private:
+        BaseWindow& _window;
+        std::function<void()> _present;
+
+        double _timestep;
+        double _frame_time = 0.0;  // 0 means no frame rate cap
+        bool _idle_mode = false;
+        bool _paused = false;
+        std::atomic<bool> _redraw;
+
+        double _accumulator = 0.0;
+        double _previous = 0.0;
+        unsigned long _events = 0;  // of the window, at the last frame
+        long _frames = 0;
+        long _updates = 0;
+        long _skipped = 0;
+
+        // sleep until `deadline', still handling events meanwhile
+        void waitUntil(double deadline)
+        {
+            for(double now = _window.GetTime(); now < deadline; now = _window.GetTime()) {
+                _window.WaitEventsTimeout(deadline - now);
+            }
+        }
+
+    public:
+        // `updates_per_second' fixes the timestep of the simulation
+        RenderLoop(BaseWindow& window, double updates_per_second = 60.0)
+            : _window(window), _timestep(1.0 / updates_per_second), _redraw(true)
+        {
+            _present = [this]() {
+                _window.SwapBuffers();
+            };
+        }
+
+        // replace how a rendered frame is shown, by default by swapping
+        // the buffers of the window, e.g. to time the swap
+        void SetPresentFunction(std::function<void()> present)
+        {
+            _present = present;
+        }
+
+        // the highest number of frames rendered per second, or 0 for no
+        // cap. With vsync, the swap interval caps the frame rate too.
+        void SetFrameRateCap(double frames_per_second)
+        {
+            _frame_time = (frames_per_second > 0.0) ? 1.0 / frames_per_second : 0.0;
+        }
+
+        // in idle mode, frames are only rendered after an update, an
+        // event or `RequestRedraw', and otherwise the loop blocks
+        void SetIdleMode(bool idle)
+        {
+            _idle_mode = idle;
+        }
+
+        // while paused, no updates are made, and time does not pass
+        // for the simulation
+        void SetPaused(bool paused)
+        {
+            _paused = paused;
+            _redraw = true;
+        }
+
+        bool IsPaused()
+        {
+            return _paused;
+        }
+
+        // render the next frame even if idle, e.g. after input changed
+        // what is shown. May be called from any callback, or from another
+        // thread, which should then wake up the loop, e.g. with
+        // `glfwPostEmptyEvent', as empty events alone render nothing.
+        void RequestRedraw()
+        {
+            _redraw = true;
+        }
+
+        double GetTimestep()
+        {
+            return _timestep;
+        }
+
+        long GetFrameCount()
+        {
+            return _frames;
+        }
+
+        long GetUpdateCount()
+        {
+            return _updates;
+        }
+
+        // times idle mode found nothing to render and waited instead
+        long GetSkippedCount()
+        {
+            return _skipped;
+        }
+
+        // run until the window should close. `update' is called with
+        // the timestep zero or more times per frame, and `render' once
+        // per frame with the fraction of a timestep in [0, 1) that has
+        // passed since the last update. The frame is presented afterwards.
+        void Run(std::function<void(double)> update,
+                 std::function<void(double)> render)
+        {
+            _previous = _window.GetTime();
+            _events = _window.GetEventCount();
+            while(_window.IsRunning())
+            {
+                _window.PollEvents();
+
+                double frame_start = _window.GetTime();
+                double elapsed = frame_start - _previous;
+                _previous = frame_start;
+                if(elapsed > RENDER_LOOP_MAX_FRAME_TIME) {
+                    elapsed = RENDER_LOOP_MAX_FRAME_TIME;
+                }
+
+                bool updated = false;
+                if(!_paused)
+                {
+                    _accumulator += elapsed;
+                    while(_accumulator >= _timestep)
+                    {
+                        update(_timestep);
+                        _accumulator -= _timestep;
+                        _updates++;
+                        updated = true;
+                    }
+                }
+
+                unsigned long events = _window.GetEventCount();
+                bool changed = updated || _redraw || events != _events;
+                _events = events;
+                if(_idle_mode && !changed)
+                {
+                    // block until an event, or the next update is due
+                    _skipped++;
+                    if(_paused) {
+                        _window.WaitEvents();
+                    }
+                    else {
+                        _window.WaitEventsTimeout(_timestep - _accumulator);
+                    }
+                    continue;
+                }
+
+                // `render' may request the next frame already
+                _redraw = false;
+                render(_accumulator / _timestep);
+                _present();
+                _frames++;
+
+                if(_frame_time > 0.0) {
+                    waitUntil(frame_start + _frame_time);
+                }
+            }
+        }
+    };
+
+} // namespace Windows
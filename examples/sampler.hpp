@@ -0,0 +1,579 @@
+//
+// Sampler Library
+//
+// CPU implementation of OpenGL texture sampling: nearest, bilinear
+// and trilinear filtering, the repeat/clamp/mirror wrap modes, and
+// level-of-detail selection from texture coordinate derivatives.
+//
+// `sample' is a plain reference implementation of the rules in the
+// OpenGL specification (section 8.14), and can be used to check GPU
+// results on machines without a GPU. `sampleMany' computes the same
+// results, bit for bit, for 4 (SSE4.1) or 8 (AVX2) coordinates at
+// once: both evaluate the weighted sums in the same order, and
+// contracting them into fused multiply-adds is disabled, as that
+// would round differently in the two paths. test_sampler.cpp checks
+// this.
+//
+
+#pragma once
+
+// CUSTOM
+#include "mipmaps.hpp"
+
+// STANDARD
+#include <algorithm>
+#include <math.h>
+#include <vector>
+
+// compilers may contract `a * b + c' into fused multiply-adds, which
+// round once instead of twice, so not for this file
+#if defined(__clang__)
+#pragma STDC FP_CONTRACT OFF
+#elif defined(__GNUC__)
+#pragma GCC push_options
+#pragma GCC optimize("fp-contract=off")
+#endif
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define SAMPLER_AVX2
+#elif defined(__SSE4_1__)
+#include <smmintrin.h>
+#define SAMPLER_SSE41
+#endif
+
+
+namespace Sampler
+{
+    // --- SAMPLER STATE --- //
+
+    // texel filters, GL_NEAREST and GL_LINEAR
+    typedef enum {
+        SAMPLER_NEAREST,
+        SAMPLER_LINEAR
+    } _filter_t;
+
+    // how mipmap levels are selected when minifying, i.e. the
+    // second half of GL_<filter>_MIPMAP_<mode>
+    typedef enum {
+        SAMPLER_MIPMAP_NONE,    // always level 0
+        SAMPLER_MIPMAP_NEAREST, // closest level
+        SAMPLER_MIPMAP_LINEAR   // blend between the two closest levels
+    } _mipmap_mode_t;
+
+    typedef enum {
+        SAMPLER_REPEAT,          // GL_REPEAT
+        SAMPLER_CLAMP_TO_EDGE,   // GL_CLAMP_TO_EDGE
+        SAMPLER_MIRRORED_REPEAT, // GL_MIRRORED_REPEAT
+        SAMPLER_CLAMP_TO_BORDER  // GL_CLAMP_TO_BORDER
+    } _wrap_t;
+
+    typedef struct {
+        _filter_t mag_filter;
+        _filter_t min_filter;
+        _mipmap_mode_t mipmap;
+        _wrap_t wrap_s;
+        _wrap_t wrap_t;
+        float border[4];
+    } SamplerState;
+
+    // the OpenGL defaults, apart from the minifying filter which is
+    // GL_LINEAR instead of GL_NEAREST_MIPMAP_LINEAR
+    inline SamplerState getDefaultState()
+    {
+        SamplerState state = {
+            SAMPLER_LINEAR, SAMPLER_LINEAR, SAMPLER_MIPMAP_NONE,
+            SAMPLER_REPEAT, SAMPLER_REPEAT, {0.0f, 0.0f, 0.0f, 0.0f}
+        };
+        return state;
+    }
+
+
+    // --- TEXTURES --- //
+
+    // mipmapped RGBA float texture, all levels in a single buffer.
+    // 8 bit and sRGB levels are converted to linear floats, the same
+    // way the GPU decodes them before filtering.
+    class Texture
+    {
+    private:
+        std::vector<float> _texels;
+        std::vector<int> _width;
+        std::vector<int> _height;
+        std::vector<int> _offset; // first texel of each level
+
+    public:
+        Texture(const std::vector<Mipmaps::Level>& levels,
+                Mipmaps::_mipmap_format_t format)
+        {
+            size_t total = 0;
+            for(size_t i = 0; i < levels.size(); i++)
+            {
+                _width.push_back(levels[i].width);
+                _height.push_back(levels[i].height);
+                _offset.push_back(total);
+                total += (size_t)levels[i].width * levels[i].height;
+            }
+
+            _texels.resize(total * 4);
+            Mipmaps::_float_image_t level;
+            for(size_t i = 0; i < levels.size(); i++)
+            {
+                Mipmaps::convertToFloat(&levels[i].data[0], levels[i].width,
+                                        levels[i].height, format, level, NULL);
+                std::copy(level.pixels.begin(), level.pixels.end(),
+                          _texels.begin() + (size_t)_offset[i] * 4);
+            }
+        }
+
+        int GetLevels() const
+        {
+            return _width.size();
+        }
+
+        int GetWidth(int level) const
+        {
+            return _width[level];
+        }
+
+        int GetHeight(int level) const
+        {
+            return _height[level];
+        }
+
+        const float* GetTexel(int level, int x, int y) const
+        {
+            return &_texels[((size_t)_offset[level] + (size_t)y * _width[level] + x) * 4];
+        }
+
+        // raw access for the vectorized sampler
+        const float* GetTexels() const { return &_texels[0]; }
+        const int* GetWidths() const { return &_width[0]; }
+        const int* GetHeights() const { return &_height[0]; }
+        const int* GetOffsets() const { return &_offset[0]; }
+    };
+
+
+    // --- LEVEL OF DETAIL --- //
+
+    // lambda = log2(rho), where rho is the larger of the lengths of the
+    // screen-space derivatives of the texel coordinates (equation 8.7,
+    // without the optional bias and clamping)
+    float computeLod(const Texture& texture, float dudx, float dvdx,
+                     float dudy, float dvdy)
+    {
+        float w = texture.GetWidth(0);
+        float h = texture.GetHeight(0);
+        float x = sqrtf((dudx * w) * (dudx * w) + (dvdx * h) * (dvdx * h));
+        float y = sqrtf((dudy * w) * (dudy * w) + (dvdy * h) * (dvdy * h));
+        return log2f(std::max(x, y));
+    }
+
+
+    // --- REFERENCE SAMPLER --- //
+
+    // apply a wrap mode to an integer texel coordinate.
+    // Returns false if the texel is outside the texture (border).
+    bool wrapCoordinate(_wrap_t wrap, int size, int& i)
+    {
+        switch(wrap) {
+        case SAMPLER_REPEAT:
+            i = ((i % size) + size) % size;
+            return true;
+        case SAMPLER_MIRRORED_REPEAT:
+        {
+            int m = ((i % (2 * size)) + 2 * size) % (2 * size);
+            i = (m < size) ? m : 2 * size - 1 - m;
+            return true;
+        }
+        case SAMPLER_CLAMP_TO_BORDER:
+            if(i < 0 || i >= size) {
+                return false;
+            }
+            return true;
+        case SAMPLER_CLAMP_TO_EDGE:
+        default:
+            i = std::min(std::max(i, 0), size - 1);
+            return true;
+        }
+    }
+
+    void fetchTexel(const Texture& texture, const SamplerState& state,
+                    int level, int x, int y, float out[4])
+    {
+        bool inside = wrapCoordinate(state.wrap_s, texture.GetWidth(level), x);
+        inside = wrapCoordinate(state.wrap_t, texture.GetHeight(level), y) && inside;
+
+        const float* texel = inside ? texture.GetTexel(level, x, y) : state.border;
+        for(int c = 0; c < 4; c++) {
+            out[c] = texel[c];
+        }
+    }
+
+    void sampleLevel(const Texture& texture, const SamplerState& state,
+                     _filter_t filter, int level, float u, float v, float out[4])
+    {
+        float x = u * texture.GetWidth(level);
+        float y = v * texture.GetHeight(level);
+
+        if(filter == SAMPLER_NEAREST)
+        {
+            fetchTexel(texture, state, level, (int)floorf(x), (int)floorf(y), out);
+            return;
+        }
+
+        x -= 0.5f;
+        y -= 0.5f;
+        int i0 = (int)floorf(x);
+        int j0 = (int)floorf(y);
+        float a = x - i0;
+        float b = y - j0;
+
+        float t00[4], t10[4], t01[4], t11[4];
+        fetchTexel(texture, state, level, i0, j0, t00);
+        fetchTexel(texture, state, level, i0 + 1, j0, t10);
+        fetchTexel(texture, state, level, i0, j0 + 1, t01);
+        fetchTexel(texture, state, level, i0 + 1, j0 + 1, t11);
+
+        for(int c = 0; c < 4; c++) {
+            out[c] = (1 - a) * (1 - b) * t00[c] + a * (1 - b) * t10[c] +
+                     (1 - a) * b * t01[c] + a * b * t11[c];
+        }
+    }
+
+    // sample `texture' at (u, v) with level of detail `lod'
+    void sample(const Texture& texture, const SamplerState& state,
+                float u, float v, float lod, float out[4])
+    {
+        int q = texture.GetLevels() - 1;
+
+        // magnification, or minification without mipmaps
+        if(lod <= 0.0f || state.mipmap == SAMPLER_MIPMAP_NONE)
+        {
+            _filter_t filter = (lod <= 0.0f) ? state.mag_filter : state.min_filter;
+            sampleLevel(texture, state, filter, 0, u, v, out);
+            return;
+        }
+
+        lod = std::min(lod, (float)q);
+
+        if(state.mipmap == SAMPLER_MIPMAP_NEAREST)
+        {
+            int level = (lod <= 0.5f) ? 0 : (int)ceilf(lod + 0.5f) - 1;
+            sampleLevel(texture, state, state.min_filter, std::min(level, q), u, v, out);
+            return;
+        }
+
+        int level = (int)floorf(lod);
+        float t = lod - level;
+        sampleLevel(texture, state, state.min_filter, level, u, v, out);
+        if(t > 0.0f)
+        {
+            float next[4];
+            sampleLevel(texture, state, state.min_filter, level + 1, u, v, next);
+            for(int c = 0; c < 4; c++) {
+                out[c] = (1 - t) * out[c] + t * next[c];
+            }
+        }
+    }
+
+
+    // --- VECTORIZED SAMPLER --- //
+
+#if defined(SAMPLER_AVX2)
+    // 8 lanes with AVX2 and hardware gathers
+    struct _lanes_t
+    {
+        static const int N = 8;
+        typedef __m256 f;
+        typedef __m256i i;
+
+        static f set1(float x) { return _mm256_set1_ps(x); }
+        static f load(const float* p) { return _mm256_loadu_ps(p); }
+        static f add(f a, f b) { return _mm256_add_ps(a, b); }
+        static f sub(f a, f b) { return _mm256_sub_ps(a, b); }
+        static f mul(f a, f b) { return _mm256_mul_ps(a, b); }
+        static f div(f a, f b) { return _mm256_div_ps(a, b); }
+        static f min(f a, f b) { return _mm256_min_ps(a, b); }
+        static f max(f a, f b) { return _mm256_max_ps(a, b); }
+        static f floor(f a) { return _mm256_floor_ps(a); }
+        static f ceil(f a) { return _mm256_ceil_ps(a); }
+        static f lt(f a, f b) { return _mm256_cmp_ps(a, b, _CMP_LT_OQ); }
+        static f le(f a, f b) { return _mm256_cmp_ps(a, b, _CMP_LE_OQ); }
+        static f ge(f a, f b) { return _mm256_cmp_ps(a, b, _CMP_GE_OQ); }
+        static f andf(f a, f b) { return _mm256_and_ps(a, b); }
+        static f select(f mask, f a, f b) { return _mm256_blendv_ps(b, a, mask); }
+        static bool any(f mask) { return _mm256_movemask_ps(mask) != 0; }
+
+        static i toInt(f a) { return _mm256_cvttps_epi32(a); }
+        static f toFloat(i a) { return _mm256_cvtepi32_ps(a); }
+        static i iadd(i a, i b) { return _mm256_add_epi32(a, b); }
+        static i imul(i a, i b) { return _mm256_mullo_epi32(a, b); }
+        static i iset1(int x) { return _mm256_set1_epi32(x); }
+        static i igather(const int* base, i idx) { return _mm256_i32gather_epi32(base, idx, 4); }
+        static f gather(const float* base, i idx) { return _mm256_i32gather_ps(base, idx, 4); }
+
+        static void storeRGBA(float* out, f r, f g, f b, f a)
+        {
+            __m128 lo[4] = {_mm256_castps256_ps128(r), _mm256_castps256_ps128(g),
+                            _mm256_castps256_ps128(b), _mm256_castps256_ps128(a)};
+            __m128 hi[4] = {_mm256_extractf128_ps(r, 1), _mm256_extractf128_ps(g, 1),
+                            _mm256_extractf128_ps(b, 1), _mm256_extractf128_ps(a, 1)};
+            _MM_TRANSPOSE4_PS(lo[0], lo[1], lo[2], lo[3]);
+            _MM_TRANSPOSE4_PS(hi[0], hi[1], hi[2], hi[3]);
+            for(int k = 0; k < 4; k++)
+            {
+                _mm_storeu_ps(out + k * 4, lo[k]);
+                _mm_storeu_ps(out + 16 + k * 4, hi[k]);
+            }
+        }
+    };
+#elif defined(SAMPLER_SSE41)
+    // 4 lanes with SSE4.1, texels are gathered one lane at a time
+    struct _lanes_t
+    {
+        static const int N = 4;
+        typedef __m128 f;
+        typedef __m128i i;
+
+        static f set1(float x) { return _mm_set1_ps(x); }
+        static f load(const float* p) { return _mm_loadu_ps(p); }
+        static f add(f a, f b) { return _mm_add_ps(a, b); }
+        static f sub(f a, f b) { return _mm_sub_ps(a, b); }
+        static f mul(f a, f b) { return _mm_mul_ps(a, b); }
+        static f div(f a, f b) { return _mm_div_ps(a, b); }
+        static f min(f a, f b) { return _mm_min_ps(a, b); }
+        static f max(f a, f b) { return _mm_max_ps(a, b); }
+        static f floor(f a) { return _mm_floor_ps(a); }
+        static f ceil(f a) { return _mm_ceil_ps(a); }
+        static f lt(f a, f b) { return _mm_cmplt_ps(a, b); }
+        static f le(f a, f b) { return _mm_cmple_ps(a, b); }
+        static f ge(f a, f b) { return _mm_cmpge_ps(a, b); }
+        static f andf(f a, f b) { return _mm_and_ps(a, b); }
+        static f select(f mask, f a, f b) { return _mm_blendv_ps(b, a, mask); }
+        static bool any(f mask) { return _mm_movemask_ps(mask) != 0; }
+
+        static i toInt(f a) { return _mm_cvttps_epi32(a); }
+        static f toFloat(i a) { return _mm_cvtepi32_ps(a); }
+        static i iadd(i a, i b) { return _mm_add_epi32(a, b); }
+        static i imul(i a, i b) { return _mm_mullo_epi32(a, b); }
+        static i iset1(int x) { return _mm_set1_epi32(x); }
+
+        static i igather(const int* base, i idx)
+        {
+            alignas(16) int k[4];
+            _mm_store_si128((__m128i*)k, idx);
+            return _mm_setr_epi32(base[k[0]], base[k[1]], base[k[2]], base[k[3]]);
+        }
+        static f gather(const float* base, i idx)
+        {
+            alignas(16) int k[4];
+            _mm_store_si128((__m128i*)k, idx);
+            return _mm_setr_ps(base[k[0]], base[k[1]], base[k[2]], base[k[3]]);
+        }
+
+        static void storeRGBA(float* out, f r, f g, f b, f a)
+        {
+            _MM_TRANSPOSE4_PS(r, g, b, a);
+            _mm_storeu_ps(out, r);
+            _mm_storeu_ps(out + 4, g);
+            _mm_storeu_ps(out + 8, b);
+            _mm_storeu_ps(out + 12, a);
+        }
+    };
+#endif
+
+#if defined(SAMPLER_AVX2) || defined(SAMPLER_SSE41)
+    typedef _lanes_t L;
+
+    // wrap integer-valued texel coordinates `x' for a level of `size'
+    // texels. `inside' is cleared for lanes outside a border texture.
+    inline L::f wrapLanes(_wrap_t wrap, L::f x, L::f size, L::f& inside)
+    {
+        switch(wrap) {
+        case SAMPLER_REPEAT:
+            return L::sub(x, L::mul(size, L::floor(L::div(x, size))));
+        case SAMPLER_MIRRORED_REPEAT:
+        {
+            L::f twice = L::add(size, size);
+            L::f m = L::sub(x, L::mul(twice, L::floor(L::div(x, twice))));
+            L::f mirrored = L::sub(L::sub(twice, L::set1(1.0f)), m);
+            return L::select(L::lt(m, size), m, mirrored);
+        }
+        case SAMPLER_CLAMP_TO_BORDER:
+            inside = L::andf(inside, L::andf(L::ge(x, L::set1(0.0f)), L::lt(x, size)));
+            // clamped as well, so the fetch stays inside
+            [[fallthrough]];
+        case SAMPLER_CLAMP_TO_EDGE:
+        default:
+            return L::min(L::max(x, L::set1(0.0f)), L::sub(size, L::set1(1.0f)));
+        }
+    }
+
+    // fetch the texels at (x, y) of each lane's level
+    inline void fetchLanes(const Texture& texture, const SamplerState& state,
+                           L::i offset, L::f width, L::f height,
+                           L::f x, L::f y, L::f out[4])
+    {
+        L::f inside = L::lt(L::set1(0.0f), L::set1(1.0f)); // all set
+        x = wrapLanes(state.wrap_s, x, width, inside);
+        y = wrapLanes(state.wrap_t, y, height, inside);
+
+        L::i texel = L::iadd(offset, L::iadd(L::imul(L::toInt(y), L::toInt(width)),
+                                             L::toInt(x)));
+        L::i index = L::iadd(texel, texel);
+        index = L::iadd(index, index); // 4 floats per texel
+
+        const float* texels = texture.GetTexels();
+        for(int c = 0; c < 4; c++)
+        {
+            out[c] = L::gather(texels, L::iadd(index, L::iset1(c)));
+            if(state.wrap_s == SAMPLER_CLAMP_TO_BORDER ||
+               state.wrap_t == SAMPLER_CLAMP_TO_BORDER)
+            {
+                out[c] = L::select(inside, out[c], L::set1(state.border[c]));
+            }
+        }
+    }
+
+    // sample one level per lane. Nearest filtering is bilinear
+    // filtering with zero weights, so lanes may mix both filters.
+    inline void sampleLevelLanes(const Texture& texture, const SamplerState& state,
+                                 L::f linear, L::i level, L::f u, L::f v,
+                                 L::f out[4])
+    {
+        L::i offset = L::igather(texture.GetOffsets(), level);
+        L::f width = L::toFloat(L::igather(texture.GetWidths(), level));
+        L::f height = L::toFloat(L::igather(texture.GetHeights(), level));
+
+        L::f half = L::select(linear, L::set1(0.5f), L::set1(0.0f));
+        L::f x = L::sub(L::mul(u, width), half);
+        L::f y = L::sub(L::mul(v, height), half);
+        L::f x0 = L::floor(x);
+        L::f y0 = L::floor(y);
+        L::f a = L::select(linear, L::sub(x, x0), L::set1(0.0f));
+        L::f b = L::select(linear, L::sub(y, y0), L::set1(0.0f));
+
+        L::f one = L::set1(1.0f);
+        L::f x1 = L::add(x0, one);
+        L::f y1 = L::add(y0, one);
+
+        L::f t00[4], t10[4], t01[4], t11[4];
+        fetchLanes(texture, state, offset, width, height, x0, y0, t00);
+        if(!L::any(linear))
+        {
+            for(int c = 0; c < 4; c++) out[c] = t00[c];
+            return;
+        }
+        fetchLanes(texture, state, offset, width, height, x1, y0, t10);
+        fetchLanes(texture, state, offset, width, height, x0, y1, t01);
+        fetchLanes(texture, state, offset, width, height, x1, y1, t11);
+
+        // summed in the order of `sampleLevel', and nearest lanes keep
+        // their texel as it is
+        L::f ia = L::sub(one, a);
+        L::f ib = L::sub(one, b);
+        L::f w00 = L::mul(ia, ib);
+        L::f w10 = L::mul(a, ib);
+        L::f w01 = L::mul(ia, b);
+        L::f w11 = L::mul(a, b);
+        for(int c = 0; c < 4; c++)
+        {
+            L::f sum = L::add(L::mul(w00, t00[c]), L::mul(w10, t10[c]));
+            sum = L::add(sum, L::mul(w01, t01[c]));
+            sum = L::add(sum, L::mul(w11, t11[c]));
+            out[c] = L::select(linear, sum, t00[c]);
+        }
+    }
+
+    // `sample' for L::N lanes at once
+    inline void sampleLanes(const Texture& texture, const SamplerState& state,
+                            const float* u, const float* v, const float* lod,
+                            float* out)
+    {
+        L::f zero = L::set1(0.0f);
+        L::f one = L::set1(1.0f);
+        L::f q = L::set1((float)(texture.GetLevels() - 1));
+        L::f lambda = L::load(lod);
+
+        L::f minify = L::lt(zero, lambda);
+        L::f mag_linear = L::set1(state.mag_filter == SAMPLER_LINEAR ? 1.0f : 0.0f);
+        L::f min_linear = L::set1(state.min_filter == SAMPLER_LINEAR ? 1.0f : 0.0f);
+        L::f linear = L::lt(zero, L::select(minify, min_linear, mag_linear));
+
+        L::f level = zero;
+        L::f t = zero;
+        if(state.mipmap != SAMPLER_MIPMAP_NONE)
+        {
+            lambda = L::min(lambda, q);
+            if(state.mipmap == SAMPLER_MIPMAP_NEAREST)
+            {
+                L::f nearest = L::sub(L::ceil(L::add(lambda, L::set1(0.5f))), one);
+                level = L::select(L::le(lambda, L::set1(0.5f)), zero, nearest);
+            }
+            else
+            {
+                level = L::max(L::floor(lambda), zero);
+                t = L::sub(lambda, level);
+            }
+            level = L::select(minify, L::min(level, q), zero);
+            t = L::select(minify, t, zero);
+        }
+
+        L::f result[4];
+        sampleLevelLanes(texture, state, linear, L::toInt(level),
+                         L::load(u), L::load(v), result);
+
+        L::f blend = L::lt(zero, t);
+        if(L::any(blend))
+        {
+            L::f next[4];
+            L::f next_level = L::select(blend, L::add(level, one), level);
+            sampleLevelLanes(texture, state, linear, L::toInt(next_level),
+                             L::load(u), L::load(v), next);
+            L::f it = L::sub(one, t);
+            for(int c = 0; c < 4; c++)
+            {
+                L::f lerp = L::add(L::mul(it, result[c]), L::mul(t, next[c]));
+                result[c] = L::select(blend, lerp, result[c]);
+            }
+        }
+
+        L::storeRGBA(out, result[0], result[1], result[2], result[3]);
+    }
+#endif
+
+    // number of coordinates sampled at once by `sampleMany'
+    inline int getLaneCount()
+    {
+#if defined(SAMPLER_AVX2) || defined(SAMPLER_SSE41)
+        return L::N;
+#else
+        return 1;
+#endif
+    }
+
+    // sample `count' coordinates, writing RGBA floats to `out'.
+    // Bit for bit the results of calling `sample' for each coordinate.
+    void sampleMany(const Texture& texture, const SamplerState& state, size_t count,
+                    const float* u, const float* v, const float* lod, float* out)
+    {
+        size_t i = 0;
+#if defined(SAMPLER_AVX2) || defined(SAMPLER_SSE41)
+        for(; i + L::N <= count; i += L::N) {
+            sampleLanes(texture, state, u + i, v + i, lod + i, out + i * 4);
+        }
+#endif
+        for(; i < count; i++) {
+            sample(texture, state, u[i], v[i], lod[i], out + i * 4);
+        }
+    }
+
+} // namespace Sampler
+
+// back to the setting of the command line, for the files including this
+#if defined(__clang__)
+#pragma STDC FP_CONTRACT DEFAULT
+#elif defined(__GNUC__)
+#pragma GCC pop_options
+#endif
@@ -0,0 +1,51 @@
+// Sampling of a virtual texture, see `Textures::VirtualTexture'.
+// Include it in a fragment shader, e.g.
+//     #include "../shaderVirtual/virtualTexture.glsl"
+// and call `vtSample' instead of `texture'. The feedback pass draws
+// `vtFeedback' into a small RGBA8 framebuffer cleared to (0, 0, 0, 1).
+
+uniform sampler2D vtPageTable;
+uniform sampler2D vtPhysical;
+uniform vec2 vtTiles;          // tiles at level 0
+uniform float vtLevels;
+uniform float vtTileSize;      // pixels per tile, without the border
+uniform float vtBorder;
+uniform float vtSlotsPerRow;   // of the physical texture
+uniform float vtFeedbackBias;  // log2 of how much smaller the feedback buffer is
+
+// the mipmap level a lookup at `uv' needs
+float vtLevel(vec2 uv, float bias)
+{
+    vec2 texel = uv * vtTiles * vtTileSize;
+    vec2 dx = dFdx(texel);
+    vec2 dy = dFdy(texel);
+    float level = 0.5 * log2(max(dot(dx, dx), dot(dy, dy))) + bias;
+    return clamp(floor(level), 0.0, vtLevels - 1.0);
+}
+
+vec4 vtSample(vec2 uv)
+{
+    uv = fract(uv);
+    float level = vtLevel(uv, 0.0);
+    vec2 tiles = vtTiles / exp2(level);
+    vec4 entry = texelFetch(vtPageTable, ivec2(uv * tiles), int(level)) * 255.0;
+    if(entry.a < 0.5) {
+        return vec4(0.0); // not even the coarsest level is loaded
+    }
+
+    // the entry may be for a coarser tile than the one wanted
+    vec2 inTile = fract(uv * vtTiles / exp2(entry.b));
+    float stride = vtTileSize + 2.0 * vtBorder;
+    vec2 texel = entry.rg * stride + vtBorder + inTile * vtTileSize;
+    return textureLod(vtPhysical, texel / (vtSlotsPerRow * stride), 0.0);
+}
+
+// the tile and level needed at `uv', see `VirtualTextures::decodeFeedback'
+vec4 vtFeedback(vec2 uv)
+{
+    uv = fract(uv);
+    float level = vtLevel(uv, vtFeedbackBias);
+    ivec2 tile = ivec2(uv * vtTiles / exp2(level));
+    return vec4(float(tile.x & 255), float(tile.y & 255),
+                float((tile.x >> 8) | ((tile.y >> 8) << 4)), level) / 255.0;
+}
@@ -3,6 +3,7 @@
 //
 // Functions to read shader files,
 // compile and load them together.
+// Linked programs are kept in the program cache (programCache.hpp).
 // Also contains a wrapper class.
 
 #pragma once
@@ -23,12 +24,18 @@
 
 // CUSTOM
 #include "fileIO.hpp"
+#include "memory.hpp"
+#include "programCache.hpp"
+#include "state.hpp"
 
 // STANDARD
+#include <algorithm>
 #include <string>
 #include <string.h>
+#include <stdint.h>
 #include <fstream>
 #include <iostream>
+#include <memory>
 #include <vector>
 
 
@@ -95,18 +102,292 @@ namespace Shaders
 
 
 
-    // --- SHADER COMPILATION --- //
+    // --- UNIFORM REFLECTION --- //
 
-    // load, compile, and return a shader of the specified `type`
-    GLuint loadShader(GLenum type, const char* path)
+    // handle to an active uniform variable of a shader program.
+    // Retrieved once with `ShaderWrapper::GetUniformHandle' and then
+    // passed to the setters, which skips the name lookup entirely.
+    typedef GLint _uniform_handle_t;
+
+    const _uniform_handle_t UNIFORM_HANDLE_INVALID = -1;
+
+    // an active uniform variable, as reported by the driver after linking
+    typedef struct {
+        GLint location;
+        GLenum type;
+        GLint size;          // number of array elements, 1 if not an array
+        uint32_t hash;
+        uint32_t name_offset;
+    } _uniform_info_t;
+
+    bool isSamplerType(GLenum type)
     {
-        // load shader file
-        std::string shader_str = FileIO::readFileContents(path);
-        const char* shader_src = shader_str.c_str();
+        switch(type) {
+        case GL_SAMPLER_1D:
+        case GL_SAMPLER_2D:
+        case GL_SAMPLER_3D:
+        case GL_SAMPLER_CUBE:
+        case GL_SAMPLER_2D_ARRAY:
+        case GL_SAMPLER_2D_SHADOW:
+        case GL_INT_SAMPLER_2D:
+        case GL_UNSIGNED_INT_SAMPLER_2D:
+            return true;
+        default:
+            return false;
+        }
+    }
+
+    const char* matchGLType(GLenum type)
+    {
+        switch(type) {
+        case GL_BOOL:
+            return "bool";
+        case GL_FLOAT:
+            return "float";
+        case GL_INT:
+            return "int";
+        case GL_UNSIGNED_INT:
+            return "unsigned int";
+        case GL_FLOAT_MAT4:
+            return "mat4";
+        case GL_FLOAT_VEC2:
+            return "vec2";
+        case GL_FLOAT_VEC3:
+            return "vec3";
+        case GL_FLOAT_VEC4:
+            return "vec4";
+        default:
+            return isSamplerType(type) ? "sampler" : "unsupported type";
+        }
+    }
+
+    // GLSL allows booleans to be set with either of the scalar
+    // setters, and samplers are set with `glUniform1i', so also with
+    // `SetUniform(int)'
+    bool isUniformTypeCompatible(GLenum reflected, GLenum expected)
+    {
+        if(reflected == expected) {
+            return true;
+        }
+        switch(expected) {
+        case GL_INT:
+            return reflected == GL_BOOL || isSamplerType(reflected);
+        case GL_UNSIGNED_INT:
+            return reflected == GL_BOOL;
+        case GL_SAMPLER_2D:
+            return isSamplerType(reflected);
+        default:
+            return false;
+        }
+    }
+
+    // FNV-1a, only used for the uniform name table
+    inline uint32_t hashUniformName(const char* name)
+    {
+        uint32_t hash = 2166136261u;
+        for(const char* ptr = name; *ptr != '\0'; ptr++)
+        {
+            hash ^= (unsigned char)*ptr;
+            hash *= 16777619u;
+        }
+        return hash;
+    }
+
+    // table of all active uniforms in a linked program, filled once
+    // with `glGetActiveUniform' and looked up by name through an
+    // open-addressing hash table. Names are packed in a single buffer.
+    class UniformTable {
+    private:
+        std::vector<_uniform_info_t> _uniforms;
+        std::vector<char> _names;
+        std::vector<GLint> _slots; // power of two, -1 marks an empty slot
+
+        void insert(const char* name, GLint location, GLenum type, GLint size)
+        {
+            _uniform_info_t info;
+            info.location = location;
+            info.type = type;
+            info.size = size;
+            info.hash = hashUniformName(name);
+            info.name_offset = _names.size();
+
+            _names.insert(_names.end(), name, name + strlen(name) + 1);
+            _uniforms.push_back(info);
+        }
+
+        void buildSlots()
+        {
+            size_t capacity = 8;
+            while(capacity < _uniforms.size() * 2) {
+                capacity *= 2;
+            }
+            _slots.assign(capacity, -1);
+
+            for(size_t i = 0; i < _uniforms.size(); i++)
+            {
+                size_t slot = _uniforms[i].hash & (capacity - 1);
+                while(_slots[slot] != -1) {
+                    slot = (slot + 1) & (capacity - 1);
+                }
+                _slots[slot] = i;
+            }
+        }
+
+    public:
+        // query all active uniforms of a linked program. Members of
+        // named uniform blocks and built-in variables have no location
+        // and are therefore not part of the table.
+        void Reflect(GLuint program)
+        {
+            _uniforms.clear();
+            _names.clear();
+
+            GLint count = 0;
+            GLint max_length = 0;
+            glGetProgramiv(program, GL_ACTIVE_UNIFORMS, &count);
+            glGetProgramiv(program, GL_ACTIVE_UNIFORM_MAX_LENGTH, &max_length);
+            std::vector<GLchar> name((max_length > 1) ? max_length : 1);
+
+            for(GLint i = 0; i < count; i++)
+            {
+                GLsizei length = 0;
+                GLint size = 0;
+                GLenum type = 0;
+                glGetActiveUniform(program, i, name.size(), &length,
+                                   &size, &type, &name[0]);
+
+                GLint location = glGetUniformLocation(program, &name[0]);
+                if(location == -1) {
+                    continue;
+                }
+
+                // arrays are reported as "name[0]", store them as "name"
+                if(length > 3 && strcmp(&name[length - 3], "[0]") == 0) {
+                    name[length - 3] = '\0';
+                }
+                insert(&name[0], location, type, size);
+            }
+
+            buildSlots();
+        }
+
+        // reflect a new version of the program, e.g. after it was
+        // reloaded. Handles retrieved before stay valid: uniforms that
+        // are gone keep their handle with location -1, which GL ignores.
+        void Update(GLuint program)
+        {
+            UniformTable table;
+            table.Reflect(program);
+
+            std::vector<_uniform_info_t> uniforms;
+            std::vector<char> names;
+            uniforms.swap(_uniforms);
+            names.swap(_names);
+
+            std::vector<bool> kept(table.Size(), false);
+            for(const _uniform_info_t& info : uniforms)
+            {
+                const char* name = &names[info.name_offset];
+                _uniform_handle_t handle = table.Find(name);
+                if(handle == UNIFORM_HANDLE_INVALID) {
+                    insert(name, -1, info.type, info.size);
+                    continue;
+                }
+                const _uniform_info_t* found = table.Get(handle);
+                insert(name, found->location, found->type, found->size);
+                kept[handle] = true;
+            }
+            for(size_t i = 0; i < table.Size(); i++)
+            {
+                if(!kept[i]) {
+                    const _uniform_info_t* info = table.Get(i);
+                    insert(table.GetName(i), info->location, info->type, info->size);
+                }
+            }
+
+            buildSlots();
+        }
+
+        _uniform_handle_t Find(const char* name) const
+        {
+            if(_slots.empty()) {
+                return UNIFORM_HANDLE_INVALID;
+            }
+
+            uint32_t hash = hashUniformName(name);
+            size_t mask = _slots.size() - 1;
+
+            for(size_t slot = hash & mask; _slots[slot] != -1;
+                slot = (slot + 1) & mask)
+            {
+                const _uniform_info_t& info = _uniforms[_slots[slot]];
+                if(info.hash == hash &&
+                   strcmp(&_names[info.name_offset], name) == 0)
+                {
+                    return _slots[slot];
+                }
+            }
+            return UNIFORM_HANDLE_INVALID;
+        }
+
+        const _uniform_info_t* Get(_uniform_handle_t handle) const
+        {
+            if(handle < 0 || handle >= (GLint)_uniforms.size()) {
+                return NULL;
+            }
+            return &_uniforms[handle];
+        }
+
+        const char* GetName(_uniform_handle_t handle) const
+        {
+            return &_names[_uniforms[handle].name_offset];
+        }
+
+        size_t Size() const
+        {
+            return _uniforms.size();
+        }
+    };
+
 
-        // create shader
-        GLuint shader = glCreateShader(type);
 
+    // --- SHADER COMPILATION --- //
+
+    // a shader stage of a program, with the contents of its file. Both
+    // strings are in the frame arena, and only valid until it is reset.
+    typedef struct {
+        GLenum type;
+        const char* path;
+        const char* source;
+    } _shader_source_t;
+
+    // a program whose stages are compiled and linked, but whose status
+    // has not been queried yet, so the driver may still be working on it
+    typedef struct {
+        GLuint program;
+        std::vector<GLuint> shaders; // empty when loaded from the cache
+        uint64_t key;
+        bool linked;                 // set by `finishProgram'
+        std::vector<std::string> files; // including all included files
+    } _pending_program_t;
+
+    // let the driver compile and link on its own threads, if it can.
+    // Should be called once after the context is created.
+    void enableParallelCompile()
+    {
+        // 0xFFFFFFFF lets the driver choose the number of threads
+        if(GLEW_ARB_parallel_shader_compile) {
+            glMaxShaderCompilerThreadsARB(0xFFFFFFFF);
+        }
+        else if(GLEW_KHR_parallel_shader_compile) {
+            glMaxShaderCompilerThreadsKHR(0xFFFFFFFF);
+        }
+    }
+
+    // create and compile a shader of the specified `type`, without
+    // waiting for the compilation to finish
+    GLuint submitShader(GLenum type, const char* source)
+    {
         // Compile vertex shader
         switch (type)
         {
@@ -126,14 +407,21 @@ namespace Shaders
             std::cout << "Error: Unrecognized shader type" << std::endl;
             return 0;
         }
-        glShaderSource(shader, 1, &shader_src, NULL);
+
+        // create shader
+        GLuint shader = glCreateShader(type);
+        glShaderSource(shader, 1, &source, NULL);
         glCompileShader(shader);
+        return shader;
+    }
 
-        // check if compilation was successful
+    // check if compilation was successful, and if not, print the
+    // error message. Waits for the compilation to finish.
+    bool checkCompileStatus(GLuint shader)
+    {
         GLint result = GL_FALSE;
         glGetShaderiv(shader, GL_COMPILE_STATUS, &result);
 
-        // if compilation did not succeed, print the error message
         if(!result)
         {
             int logLength;
@@ -143,40 +431,33 @@ namespace Shaders
 
             std::cout << &shader_err[0] << std::endl;
         }
+        return result;
+    }
 
+    // compile and return a shader of the specified `type`
+    GLuint compileShader(GLenum type, const char* source)
+    {
+        GLuint shader = submitShader(type, source);
+        if(shader) {
+            checkCompileStatus(shader);
+        }
         return shader;
     }
 
-    // create shaders, link them together, return the linked program
-    GLuint loadShadersVGF(const char* path)
+    // load, compile, and return a shader of the specified `type`
+    GLuint loadShader(GLenum type, const char* path)
     {
-        // retrieve file paths
-        std::string shader_dir = FileIO::getPlatformPath(path);
-        std::cout << "Checking VGF shader program '"
-                  << shader_dir << "'" << std::endl;
-
-        std::string vertex (shader_dir + "vertex.shd");
-        std::string geometry (shader_dir + "geometry.shd");
-        std::string fragment (shader_dir + "fragment.shd");
-
-        // retrieve all shaders
-        GLuint shd_vertex = loadShader(GL_VERTEX_SHADER, vertex.c_str());
-        GLuint shd_geometry = loadShader(GL_GEOMETRY_SHADER, geometry.c_str());
-        GLuint shd_fragment = loadShader(GL_FRAGMENT_SHADER, fragment.c_str());
-
-        // link the shaders together
-        std::cout << "linking shader program" << std::endl;
-        GLuint program = glCreateProgram();
-        glAttachShader(program, shd_vertex);
-        glAttachShader(program, shd_geometry);
-        glAttachShader(program, shd_fragment);
-        glLinkProgram(program);
+        // load shader file, only needed until it is compiled
+        const char* source = FileIO::readFileContents(path, Memory::getFrameArena());
+        return compileShader(type, source);
+    }
 
-        // check if linking was successful
+    // check if linking was successful, and if not, print the error message
+    bool checkLinkStatus(GLuint program)
+    {
         GLint result = GL_FALSE;
         glGetProgramiv(program, GL_LINK_STATUS, &result);
 
-        // if linking did not succeed, print the error message
         if(!result)
         {
             int logLength;
@@ -185,56 +466,161 @@ namespace Shaders
             glGetProgramInfoLog(program, logLength, NULL, &programError[0]);
             std::cout << &programError[0] << std::endl;
         }
+        return result;
+    }
 
-        // perform cleanup
-        glDeleteShader(shd_vertex);
-        glDeleteShader(shd_geometry);
-        glDeleteShader(shd_fragment);
+    // shared by all programs, so files included by several shaders
+    // are only read once per run
+    FileIO::Preprocessor& getPreprocessor()
+    {
+        static FileIO::Preprocessor preprocessor;
+        return preprocessor;
+    }
 
-        return program;
+    // key of a program in the program cache: its sources on this driver
+    uint64_t getProgramKey(const std::vector<_shader_source_t>& sources)
+    {
+        uint64_t key = ProgramCache::getDriverKey();
+        for(const _shader_source_t& stage : sources)
+        {
+            key = ProgramCache::hashBytes(&stage.type, sizeof(stage.type), key);
+            // with the terminator, as `ProgramCache::hashString'
+            key = ProgramCache::hashBytes(stage.source, strlen(stage.source) + 1, key);
+        }
+        return key;
     }
 
-    // attach a vertex and a fragment shader, and link them together in a program
-    GLuint loadShadersVF(const char* path)
+    // read and preprocess the files of all stages into the frame arena,
+    // then either load the program from the program cache, or compile
+    // the stages and link them.
+    // No status is queried, so with parallel compilation enabled this
+    // returns before the driver is done.
+    _pending_program_t submitProgram(std::vector<_shader_source_t>& sources)
     {
-        // retrieve file paths
-        std::string shader_dir = FileIO::getPlatformPath(path);
-        std::cout << "Checking VF shader program '"
-                  << shader_dir << "'" << std::endl;
+        _pending_program_t pending;
+        FileIO::Preprocessor& preprocessor = getPreprocessor();
+        Memory::FrameArena& arena = Memory::getFrameArena();
+        for(_shader_source_t& stage : sources)
+        {
+            stage.source = preprocessor.Process(stage.path, arena);
+            for(const std::string& file : preprocessor.GetFiles())
+            {
+                if(std::find(pending.files.begin(), pending.files.end(), file)
+                   == pending.files.end())
+                {
+                    pending.files.push_back(file);
+                }
+            }
+        }
 
-        std::string vertex (shader_dir + "vertex.shd");
-        std::string fragment (shader_dir + "fragment.shd");
+        pending.key = getProgramKey(sources);
+        pending.program = ProgramCache::loadProgram(pending.key);
+        pending.linked = (pending.program != 0);
+        if(pending.program) {
+            return pending;
+        }
 
         // retrieve all shaders
-        GLuint shd_vertex = loadShader(GL_VERTEX_SHADER, vertex.c_str());
-        GLuint shd_fragment = loadShader(GL_FRAGMENT_SHADER, fragment.c_str());
+        for(const _shader_source_t& stage : sources) {
+            pending.shaders.push_back(submitShader(stage.type, stage.source));
+        }
 
         // link the shaders together
         std::cout << "linking shader program" << std::endl;
-        GLuint program = glCreateProgram();
-        glAttachShader(program, shd_vertex);
-        glAttachShader(program, shd_fragment);
-        glLinkProgram(program);
+        pending.program = glCreateProgram();
+        for(GLuint shader : pending.shaders) {
+            glAttachShader(pending.program, shader);
+        }
+        ProgramCache::prepareProgram(pending.program);
+        glLinkProgram(pending.program);
 
-        // check if linking was successful
-        GLint result = GL_FALSE;
-        glGetProgramiv(program, GL_LINK_STATUS, &result);
+        return pending;
+    }
 
-        // if linking did not succeed, print the error message
-        if(!result)
+    // whether `finishProgram' would return without waiting. Without a
+    // parallel compile extension there is no way to tell, and the
+    // program is reported as ready.
+    bool isProgramReady(const _pending_program_t& pending)
+    {
+        if(pending.shaders.empty() ||
+           !(GLEW_ARB_parallel_shader_compile || GLEW_KHR_parallel_shader_compile))
         {
-            int logLength;
-            glGetProgramiv(program, GL_INFO_LOG_LENGTH, &logLength);
-            std::vector<GLchar> programError( (logLength > 1) ? logLength : 1 );
-            glGetProgramInfoLog(program, logLength, NULL, &programError[0]);
-            std::cout << &programError[0] << std::endl;
+            return true;
+        }
+        GLint done = GL_TRUE;
+        glGetProgramiv(pending.program, GL_COMPLETION_STATUS_ARB, &done);
+        return done;
+    }
+
+    // wait for a submitted program, report errors, store it in the
+    // program cache and release its shaders. Returns the program.
+    GLuint finishProgram(_pending_program_t& pending)
+    {
+        if(pending.shaders.empty()) {
+            return pending.program;
+        }
+
+        for(GLuint shader : pending.shaders) {
+            checkCompileStatus(shader);
+        }
+        pending.linked = checkLinkStatus(pending.program);
+        if(pending.linked) {
+            ProgramCache::storeProgram(pending.key, pending.program);
         }
 
         // perform cleanup
-        glDeleteShader(shd_vertex);
-        glDeleteShader(shd_fragment);
+        for(GLuint shader : pending.shaders) {
+            glDeleteShader(shader);
+        }
+        pending.shaders.clear();
 
-        return program;
+        return pending.program;
+    }
+
+    GLuint loadProgram(std::vector<_shader_source_t>& sources)
+    {
+        _pending_program_t pending = submitProgram(sources);
+        return finishProgram(pending);
+    }
+
+    // type of shader, either with or without geometry shader
+    typedef enum {
+        SHADERS_VF,
+        SHADERS_VGF
+    } _shaders_t;
+
+    // the stages of a program in the directory `path', to be passed to
+    // `submitProgram' in the same frame
+    std::vector<_shader_source_t> getProgramSources(const char* path, _shaders_t type)
+    {
+        // retrieve file paths
+        Memory::FrameArena& arena = Memory::getFrameArena();
+        const char* shader_dir = FileIO::getPlatformPath(path, arena);
+        std::cout << "Checking " << (type == SHADERS_VGF ? "VGF" : "VF")
+                  << " shader program '" << shader_dir << "'" << std::endl;
+
+        std::vector<_shader_source_t> sources;
+        sources.reserve(3);
+        sources.push_back({GL_VERTEX_SHADER, arena.Concat(shader_dir, "vertex.shd"), ""});
+        if(type == SHADERS_VGF) {
+            sources.push_back({GL_GEOMETRY_SHADER, arena.Concat(shader_dir, "geometry.shd"), ""});
+        }
+        sources.push_back({GL_FRAGMENT_SHADER, arena.Concat(shader_dir, "fragment.shd"), ""});
+        return sources;
+    }
+
+    // create shaders, link them together, return the linked program
+    GLuint loadShadersVGF(const char* path)
+    {
+        std::vector<_shader_source_t> sources = getProgramSources(path, SHADERS_VGF);
+        return loadProgram(sources);
+    }
+
+    // attach a vertex and a fragment shader, and link them together in a program
+    GLuint loadShadersVF(const char* path)
+    {
+        std::vector<_shader_source_t> sources = getProgramSources(path, SHADERS_VF);
+        return loadProgram(sources);
     }
 
     // get location for a uniform variable for a given shader program
@@ -249,51 +635,228 @@ namespace Shaders
         return result;
     }
 
-    // type of shader, either with or without geometry shader
-    typedef enum {
-        SHADERS_VF,
-        SHADERS_VGF
-    } _shaders_t;
-
     // wrapper class for the functions above
     class ShaderWrapper {
     private:
         GLuint _shader;
+        UniformTable _uniforms;
+
+        _pending_program_t _pending;
+        bool _linked;
+
+        // where the program was loaded from, to reload it
+        std::string _path;
+        _shaders_t _type;
+        std::vector<std::string> _files;
+
+        _pending_program_t _reload;
+        bool _reloading;
+
+        // look up a uniform by name in the reflected table, reporting
+        // it in the usual way if it is not an active uniform
+        _uniform_handle_t findUniform(const char* name, _uniform_t type)
+        {
+            finish();
+            _uniform_handle_t handle = _uniforms.Find(name);
+            if(handle == UNIFORM_HANDLE_INVALID) {
+                checkUniformVariable(-1, name, type);
+            }
+            return handle;
+        }
+
+        // return the reflected uniform if it can be set as `expected'.
+        // Invalid handles have already been reported when retrieved.
+        const _uniform_info_t* checkUniformHandle(_uniform_handle_t handle,
+                                                  GLenum expected)
+        {
+            const _uniform_info_t* info = _uniforms.Get(handle);
+            if(info == NULL) {
+                return NULL;
+            }
+            if(!isUniformTypeCompatible(info->type, expected))
+            {
+                std::cerr << "'" << _uniforms.GetName(handle) << "' of type '"
+                          << matchGLType(info->type) << "' cannot be set as '"
+                          << matchGLType(expected) << "'" << std::endl;
+                return NULL;
+            }
+            return info;
+        }
+
+        // wait for a deferred program and reflect its uniforms, the
+        // first time the program is needed
+        void finish()
+        {
+            if(_linked) {
+                return;
+            }
+            _shader = finishProgram(_pending);
+            _uniforms.Reflect(_shader);
+            _files = _pending.files;
+            _linked = true;
+        }
+
+        void cancelReload()
+        {
+            if(!_reloading) {
+                return;
+            }
+            for(GLuint shader : _reload.shaders) {
+                glDeleteShader(shader);
+            }
+            States::getState().DeleteProgram(_reload.program);
+            _reload.shaders.clear();
+            _reloading = false;
+        }
+
     protected:
     public:
-        ShaderWrapper(const char* path, _shaders_t type)
-        {
-            switch(type) {
-            case SHADERS_VF:
-                _shader = loadShadersVF(path);
-                break;
-            case SHADERS_VGF:
-                _shader = loadShadersVGF(path);
-                break;
-            default:
+        // with `deferred', the program is only submitted to the driver,
+        // and its status is not queried until it is first used. See
+        // also `ShaderBatch'.
+        ShaderWrapper(const char* path, _shaders_t type, bool deferred = false)
+        {
+            _shader = 0;
+            _linked = true;
+            _path = path;
+            _type = type;
+            _reloading = false;
+            if(type != SHADERS_VF && type != SHADERS_VGF)
+            {
                 std::cerr << "ShaderWrapper::ctor(): Unrecognized shader type"
                           << std::endl;
-                break;
+                return;
+            }
+
+            std::vector<_shader_source_t> sources = getProgramSources(path, type);
+            _pending = submitProgram(sources);
+            _shader = _pending.program;
+            _linked = false;
+            if(!deferred) {
+                finish();
             }
         }
         ~ShaderWrapper()
         {
-            glDeleteShader(_shader); // is this needed ?
-            glUseProgram(0);
+            cancelReload();
+            for(GLuint shader : _pending.shaders) {
+                glDeleteShader(shader);
+            }
+            States::getState().DeleteProgram(_shader);
         }
 
         void Activate()
         {
-            glUseProgram(_shader);
+            finish();
+            States::useProgram(_shader);
         }
         void Deactivate()
         {
-            glUseProgram(0);
+            States::useProgram(0);
+        }
+
+        GLuint GetProgram()
+        {
+            finish();
+            return _shader;
+        }
+
+        // whether the program can be used without waiting for the driver
+        bool IsReady()
+        {
+            return _linked || isProgramReady(_pending);
+        }
+
+
+        // --- RELOADING --- //
+
+        // the files the program was built from, including included files
+        const std::vector<std::string>& GetFiles()
+        {
+            finish();
+            return _files;
+        }
+
+        // start building the program again from its files, without
+        // waiting for the driver. A reload already in progress is
+        // replaced. See `UpdateReload'.
+        void Reload()
+        {
+            if(_type != SHADERS_VF && _type != SHADERS_VGF) {
+                return;
+            }
+            finish();
+            cancelReload();
+            std::vector<_shader_source_t> sources = getProgramSources(_path.c_str(), _type);
+            _reload = submitProgram(sources);
+            _reloading = true;
+        }
+
+        bool IsReloading()
+        {
+            return _reloading;
+        }
+
+        // should be called between frames. Once a reload is done, the
+        // new program replaces the old one, also if it is in use, and
+        // true is returned. If it failed, the old program is kept.
+        // Uniform handles stay valid, but values set on the old
+        // program are not carried over.
+        bool UpdateReload()
+        {
+            if(!_reloading || !isProgramReady(_reload)) {
+                return false;
+            }
+            _reloading = false;
+
+            GLuint program = finishProgram(_reload);
+            if(!_reload.linked)
+            {
+                std::cerr << "ShaderWrapper::UpdateReload: keeping the previous "
+                          << "program of '" << _path << "'" << std::endl;
+                States::getState().DeleteProgram(program);
+                return false;
+            }
+
+            if(States::getState().GetProgram() == _shader) {
+                States::useProgram(program);
+            }
+            States::getState().DeleteProgram(_shader);
+
+            _shader = program;
+            _files = _reload.files;
+            _uniforms.Update(_shader);
+            return true;
+        }
+
+
+        // --- UNIFORM HANDLES --- //
+
+        // retrieve a handle for an active uniform variable. Should be
+        // done once, outside of the rendering loop.
+        _uniform_handle_t GetUniformHandle(const char* name)
+        {
+            finish();
+            _uniform_handle_t handle = _uniforms.Find(name);
+            if(handle == UNIFORM_HANDLE_INVALID)
+            {
+                std::cout << "Could not find uniform variable '"
+                          << name << "'" << std::endl;
+            }
+            return handle;
+        }
+
+        // whether `name' is an active uniform, without reporting it if
+        // not, e.g. for uniforms of an included file that may be unused
+        bool HasUniform(const char* name)
+        {
+            finish();
+            return _uniforms.Find(name) != UNIFORM_HANDLE_INVALID;
         }
 
         // the 'number' is an integer between 0 and
         // GL_MAX_TEXTURE_UNITS (probably 16)
-        void SetUniformTexture(const char* name, GLuint number)
+        void SetUniformTexture(_uniform_handle_t handle, GLuint number)
         {
             if(!(number < GL_MAX_TEXTURE_UNITS))
             {
@@ -302,88 +865,158 @@ namespace Shaders
                           << ")" << std::endl;
             }
 
-            GLint location = glGetUniformLocation(_shader, name);
-            glUniform1i(location, number);
+            const _uniform_info_t* info = checkUniformHandle(handle, GL_SAMPLER_2D);
+            if(info) glUniform1i(info->location, number);
+        }
 
-            checkUniformVariable(location, name, UNIFORM_TEXTURE);
+        void SetUniform(_uniform_handle_t handle, const glm::mat4* mat)
+        {
+            const _uniform_info_t* info = checkUniformHandle(handle, GL_FLOAT_MAT4);
+            if(info) glUniformMatrix4fv(info->location, 1, GL_FALSE,
+                                        glm::value_ptr(*mat));
         }
 
-        void SetUniform(const char* name, const glm::mat4* mat)
+        void SetUniform(_uniform_handle_t handle, const glm::vec2 &vec)
+        {
+            const _uniform_info_t* info = checkUniformHandle(handle, GL_FLOAT_VEC2);
+            if(info) glUniform2fv(info->location, 1, glm::value_ptr(vec));
+        }
+
+        void SetUniform(_uniform_handle_t handle, const glm::vec3 &vec)
+        {
+            const _uniform_info_t* info = checkUniformHandle(handle, GL_FLOAT_VEC3);
+            if(info) glUniform3fv(info->location, 1, glm::value_ptr(vec));
+        }
+
+        void SetUniform(_uniform_handle_t handle, bool b)
+        {
+            const _uniform_info_t* info = checkUniformHandle(handle, GL_BOOL);
+            if(info) glUniform1ui(info->location, b);
+        }
+
+        void SetUniform(_uniform_handle_t handle, float f)
+        {
+            const _uniform_info_t* info = checkUniformHandle(handle, GL_FLOAT);
+            if(info) glUniform1f(info->location, f);
+        }
+
+        void SetUniform(_uniform_handle_t handle, int i)
+        {
+            const _uniform_info_t* info = checkUniformHandle(handle, GL_INT);
+            if(info) glUniform1i(info->location, i);
+        }
+
+        void SetUniform(_uniform_handle_t handle, unsigned int i)
         {
-            GLint location = glGetUniformLocation(_shader, name);
-            glUniformMatrix4fv(location, 1, GL_FALSE, glm::value_ptr(*mat));
+            const _uniform_info_t* info = checkUniformHandle(handle, GL_UNSIGNED_INT);
+            if(info) glUniform1ui(info->location, i);
+        }
+
+
+        // --- UNIFORMS BY NAME --- //
+
+        // these look up the name in the reflected uniform table on
+        // every call, prefer handles inside the rendering loop.
+
+        void SetUniformTexture(const char* name, GLuint number)
+        {
+            SetUniformTexture(findUniform(name, UNIFORM_TEXTURE), number);
+        }
 
-            checkUniformVariable(location, name, UNIFORM_MAT4);
+        void SetUniform(const char* name, const glm::mat4* mat)
+        {
+            SetUniform(findUniform(name, UNIFORM_MAT4), mat);
         }
 
         // vector is already allocated
         void SetUniform(const char* name, const glm::vec2* vec)
         {
-            GLint location = glGetUniformLocation(_shader, name);
-            glUniform2fv(location, 1, glm::value_ptr(*vec));
-
-            checkUniformVariable(location, name, UNIFORM_VEC2);
+            SetUniform(findUniform(name, UNIFORM_VEC2), *vec);
         }
 
         // vector can be called by value, i.e. not allocated prior to
         // calling this function
         void SetUniform(const char* name, const glm::vec2 &vec)
         {
-            GLint location = glGetUniformLocation(_shader, name);
-            glUniform2fv(location, 1, glm::value_ptr(vec));
-
-            checkUniformVariable(location, name, UNIFORM_VEC2);
+            SetUniform(findUniform(name, UNIFORM_VEC2), vec);
         }
 
         // vector is already allocated
         void SetUniform(const char* name, const glm::vec3* vec)
         {
-            GLint location = glGetUniformLocation(_shader, name);
-            glUniform3fv(location, 1, glm::value_ptr(*vec));
-
-            checkUniformVariable(location, name, UNIFORM_VEC3);
+            SetUniform(findUniform(name, UNIFORM_VEC3), *vec);
         }
 
         // vector can be called by value, i.e. not allocated prior to
         // calling this function
         void SetUniform(const char* name, const glm::vec3 &vec)
         {
-            GLint location = glGetUniformLocation(_shader, name);
-            glUniform3fv(location, 1, glm::value_ptr(vec));
-
-            checkUniformVariable(location, name, UNIFORM_VEC3);
+            SetUniform(findUniform(name, UNIFORM_VEC3), vec);
         }
 
         void SetUniform(const char* name, bool b)
         {
-            GLint location = glGetUniformLocation(_shader, name);
-            glUniform1ui(location, b);
-
-            checkUniformVariable(location, name, UNIFORM_BOOL);
+            SetUniform(findUniform(name, UNIFORM_BOOL), b);
         }
 
         void SetUniform(const char* name, float f)
         {
-            GLint location = glGetUniformLocation(_shader, name);
-            glUniform1f(location, f);
-
-            checkUniformVariable(location, name, UNIFORM_FLOAT);
+            SetUniform(findUniform(name, UNIFORM_FLOAT), f);
         }
 
         void SetUniform(const char* name, int i)
         {
-            GLint location = glGetUniformLocation(_shader, name);
-            glUniform1i(location, i);
-
-            checkUniformVariable(location, name, UNIFORM_INT);
+            SetUniform(findUniform(name, UNIFORM_INT), i);
         }
 
         void SetUniform(const char* name, unsigned int i)
         {
-            GLint location = glGetUniformLocation(_shader, name);
-            glUniform1ui(location, i);
+            SetUniform(findUniform(name, UNIFORM_UINT), i);
+        }
+    };
+
+
+    // many shader programs loaded together, e.g. behind a loading
+    // screen. Every program is submitted before any status is queried,
+    // so the driver can compile them in parallel, and `CountReady'
+    // reports progress without blocking.
+    class ShaderBatch {
+    private:
+        std::vector<std::unique_ptr<ShaderWrapper>> _shaders;
+
+    public:
+        ShaderBatch()
+        {
+            enableParallelCompile();
+        }
+
+        // the returned wrapper lives as long as the batch
+        ShaderWrapper& Add(const char* path, _shaders_t type)
+        {
+            _shaders.emplace_back(new ShaderWrapper(path, type, true));
+            return *_shaders.back();
+        }
 
-            checkUniformVariable(location, name, UNIFORM_UINT);
+        size_t CountReady()
+        {
+            size_t ready = 0;
+            for(auto& shader : _shaders) {
+                ready += shader->IsReady();
+            }
+            return ready;
+        }
+
+        size_t Size()
+        {
+            return _shaders.size();
+        }
+
+        // wait for all programs, reporting any errors
+        void Finish()
+        {
+            for(auto& shader : _shaders) {
+                shader->GetProgram();
+            }
         }
     };
 }
@@ -0,0 +1,295 @@
+//
+// Sprite Batching
+//
+// Draws many textured quads with few draw calls. Sprites are
+// collected during the frame, sorted by depth, shader and texture,
+// and written to a per-frame instance buffer, and every run of
+// sprites sharing a shader and a texture becomes one instanced draw.
+//
+// Textures are 2D texture arrays, so sprites with different images
+// in different layers of the same array still share a draw call.
+//
+
+#pragma once
+
+// GLEW
+#ifndef GLEW_STATIC
+#define GLEW_STATIC
+#endif
+#include <GL/glew.h>
+
+// GLM
+#include <glm/glm.hpp>
+
+// CUSTOM
+#include "buffers.hpp"
+#include "shaders.hpp"
+#include "state.hpp"
+
+// STANDARD
+#include <iostream>
+#include <stdint.h>
+#include <vector>
+
+
+namespace Sprites
+{
+    // a sprite as read by the vertex shader of shaderSprites/
+    typedef struct {
+        glm::vec4 rect;        // x, y, width, height in pixels
+        glm::vec4 uv;          // u0, v0, u1, v1
+        Buffers::rgba8 color;  // multiplied with the texture
+        GLuint layer;          // layer of the texture array
+    } _sprite_t;
+
+    typedef Buffers::VertexLayout<_sprite_t, &_sprite_t::rect, &_sprite_t::uv,
+                                  &_sprite_t::color, &_sprite_t::layer> SpriteLayout;
+
+    // sprites are drawn in increasing depth, so at most 256 depths
+    const int SPRITE_DEPTHS = 256;
+    const int SPRITE_MAX_SHADERS = 256;
+    const int SPRITE_MAX_TEXTURES = 65536;
+
+    // sort `keys' stably, returning the order in `order', with two
+    // passes of a 16 bit radix sort. `scratch' and `offsets' are only
+    // used while sorting, and can be kept to sort without allocating.
+    inline void radixSort(const std::vector<uint32_t>& keys,
+                          std::vector<uint32_t>& order,
+                          std::vector<uint32_t>& scratch,
+                          std::vector<uint32_t>& offsets)
+    {
+        size_t count = keys.size();
+        order.resize(count);
+        scratch.resize(count);
+        for(size_t i = 0; i < count; i++) {
+            order[i] = i;
+        }
+
+        offsets.resize(1 << 16);
+        for(int shift = 0; shift < 32; shift += 16)
+        {
+            std::fill(offsets.begin(), offsets.end(), 0);
+            for(size_t i = 0; i < count; i++) {
+                offsets[(keys[i] >> shift) & 0xffff]++;
+            }
+            uint32_t sum = 0;
+            for(uint32_t& offset : offsets)
+            {
+                uint32_t n = offset;
+                offset = sum;
+                sum += n;
+            }
+            for(size_t i = 0; i < count; i++)
+            {
+                uint32_t index = order[i];
+                scratch[offsets[(keys[index] >> shift) & 0xffff]++] = index;
+            }
+            order.swap(scratch);
+        }
+    }
+
+
+    class SpriteBatch
+    {
+    private:
+        typedef struct {
+            GLuint texture;
+            int shader;
+            GLint first;      // first instance in the stream
+            GLsizei count;
+        } _draw_t;
+
+        Buffers::VertexStream<SpriteLayout> _stream;
+
+        std::vector<Shaders::ShaderWrapper*> _shaders;
+        std::vector<Shaders::_uniform_handle_t> _viewport_handles;
+        std::vector<GLuint> _textures;
+        size_t _last_texture = 0;
+        int _shader = -1;
+
+        // sprites of the current frame, and their sort keys
+        std::vector<_sprite_t> _sprites;
+        std::vector<uint32_t> _keys;
+        std::vector<uint32_t> _order;
+        std::vector<uint32_t> _scratch;
+        std::vector<uint32_t> _offsets;
+        std::vector<_draw_t> _draws;
+
+        glm::vec2 _viewport;
+        size_t _draw_calls = 0;
+        size_t _drawn = 0;
+
+        int findTexture(GLuint texture)
+        {
+            // sprites tend to come in runs of the same texture
+            if(_last_texture < _textures.size() && _textures[_last_texture] == texture) {
+                return _last_texture;
+            }
+            for(size_t i = 0; i < _textures.size(); i++)
+            {
+                if(_textures[i] == texture) {
+                    _last_texture = i;
+                    return i;
+                }
+            }
+            _textures.push_back(texture);
+            _last_texture = _textures.size() - 1;
+            return _last_texture;
+        }
+
+        bool isSorted()
+        {
+            for(size_t i = 1; i < _keys.size(); i++) {
+                if(_keys[i] < _keys[i - 1]) {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+    public:
+        // `capacity' is the number of sprites that can be drawn per frame
+        SpriteBatch(size_t capacity)
+            : _stream(capacity, true)
+        {
+            _sprites.reserve(capacity);
+            _keys.reserve(capacity);
+            _order.reserve(capacity);
+            _scratch.reserve(capacity);
+            _offsets.resize(1 << 16);
+        }
+
+        // the sprite shader, or one with the same inputs. Sprites added
+        // afterwards are drawn with it.
+        void SetShader(Shaders::ShaderWrapper& shader)
+        {
+            for(size_t i = 0; i < _shaders.size(); i++)
+            {
+                if(_shaders[i] == &shader) {
+                    _shader = i;
+                    return;
+                }
+            }
+            if(_shaders.size() == SPRITE_MAX_SHADERS)
+            {
+                std::cerr << "SpriteBatch::SetShader: too many shaders" << std::endl;
+                return;
+            }
+            _shaders.push_back(&shader);
+            _viewport_handles.push_back(shader.GetUniformHandle("viewportSize"));
+            shader.Activate();
+            shader.SetUniformTexture("sprites", 0);
+            _shader = _shaders.size() - 1;
+        }
+
+        // should be called at the start of a frame, with the size of
+        // the viewport that pixel coordinates refer to
+        void Begin(int width, int height)
+        {
+            _viewport = glm::vec2(width, height);
+            _sprites.clear();
+            _keys.clear();
+            _textures.clear();
+            _draw_calls = 0;
+            _drawn = 0;
+        }
+
+        // add a sprite, with its texture array and a depth in
+        // [0, SPRITE_DEPTHS). Sprites of equal depth are drawn in any
+        // order, so overlapping transparent sprites need distinct depths.
+        void Add(const _sprite_t& sprite, GLuint texture, int depth = 0)
+        {
+            if(_shader < 0 || _sprites.size() == _stream.GetCapacity()) {
+                return;
+            }
+            int texture_index = findTexture(texture);
+            if(texture_index >= SPRITE_MAX_TEXTURES) {
+                return;
+            }
+
+            _sprites.push_back(sprite);
+            _keys.push_back(((uint32_t)(depth & (SPRITE_DEPTHS - 1)) << 24) |
+                            ((uint32_t)_shader << 16) | (uint32_t)texture_index);
+        }
+
+        void Add(glm::vec4 rect, glm::vec4 uv, Buffers::rgba8 color,
+                 GLuint texture, GLuint layer = 0, int depth = 0)
+        {
+            _sprite_t sprite = {rect, uv, color, layer};
+            Add(sprite, texture, depth);
+        }
+
+        // sort the sprites, write them to the instance buffer and draw
+        // them, one instanced draw per run of shader and texture.
+        // Texture unit 0 and the bound program are changed.
+        void End()
+        {
+            size_t count = _sprites.size();
+            if(count == 0) {
+                _stream.EndFrame();
+                return;
+            }
+
+            bool sorted = isSorted();
+            if(!sorted) {
+                radixSort(_keys, _order, _scratch, _offsets);
+            }
+
+            GLint first = 0;
+            _sprite_t* instances = _stream.Allocate(count, first);
+            if(instances == NULL)
+            {
+                std::cerr << "SpriteBatch::End: out of room for " << count << " sprites" << std::endl;
+                _stream.EndFrame();
+                return;
+            }
+            _draws.clear();
+            uint32_t previous = ~0u;
+            for(size_t i = 0; i < count; i++)
+            {
+                uint32_t index = sorted ? i : _order[i];
+                instances[i] = _sprites[index];
+
+                // depth only orders, it does not need a draw of its own
+                uint32_t state = _keys[index] & 0xffffff;
+                if(state != previous)
+                {
+                    _draw_t draw = {_textures[state & 0xffff], (int)(state >> 16),
+                                    first + (GLint)i, 0};
+                    _draws.push_back(draw);
+                    previous = state;
+                }
+                _draws.back().count++;
+            }
+
+            int shader = -1;
+            for(const _draw_t& draw : _draws)
+            {
+                if(draw.shader != shader)
+                {
+                    shader = draw.shader;
+                    _shaders[shader]->Activate();
+                    _shaders[shader]->SetUniform(_viewport_handles[shader], _viewport);
+                }
+                States::bindTexture(0, GL_TEXTURE_2D_ARRAY, draw.texture);
+                _stream.DrawInstanced(GL_TRIANGLE_STRIP, 4, draw.first, draw.count);
+            }
+
+            _draw_calls = _draws.size();
+            _drawn = count;
+            _stream.EndFrame();
+        }
+
+        // draw calls and sprites of the last frame
+        size_t GetDrawCalls()
+        {
+            return _draw_calls;
+        }
+
+        size_t GetSpriteCount()
+        {
+            return _drawn;
+        }
+    };
+
+} // namespace Sprites
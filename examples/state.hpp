@@ -0,0 +1,430 @@
+//
+// GL State Tracking
+//
+// Shadows the GL state that is changed most often - the program,
+// vertex array, buffer and texture bindings, blending and the polygon
+// mode - and skips calls that would not change it. Counts the calls
+// issued and elided per frame.
+//
+// The shadow is only correct if all code changes this state through
+// the functions below, and objects are deleted through them as well,
+// since GL reuses the names of deleted objects. After calling code that
+// does not, use `invalidate'. There is one shadow, for the one context
+// of the examples, and it may only be used from the GL thread.
+//
+
+#pragma once
+
+// GLEW
+#ifndef GLEW_STATIC
+#define GLEW_STATIC
+#endif
+#include <GL/glew.h>
+
+// STANDARD
+#include <string.h>
+
+
+namespace States
+{
+    typedef enum {
+        STATE_PROGRAM,
+        STATE_VERTEX_ARRAY,
+        STATE_BUFFER,
+        STATE_TEXTURE,
+        STATE_ACTIVE_TEXTURE,
+        STATE_BLEND,
+        STATE_POLYGON_MODE,
+        STATE_KINDS
+    } _state_kind_t;
+
+    typedef struct {
+        long issued[STATE_KINDS];
+        long elided[STATE_KINDS];
+    } _state_counters_t;
+
+    inline long getTotal(const long counts[STATE_KINDS])
+    {
+        long total = 0;
+        for(int i = 0; i < STATE_KINDS; i++) {
+            total += counts[i];
+        }
+        return total;
+    }
+
+    // texture units whose bindings are shadowed, higher ones are not
+    const int STATE_TEXTURE_UNITS = 32;
+
+    // a binding that is not known, so the next call is never elided
+    const GLuint STATE_UNKNOWN = 0xffffffff;
+
+    typedef enum {
+        STATE_TARGET_2D,
+        STATE_TARGET_2D_ARRAY,
+        STATE_TARGET_3D,
+        STATE_TARGET_CUBE_MAP,
+        STATE_TEXTURE_TARGETS
+    } _texture_target_t;
+
+    typedef enum {
+        STATE_ARRAY_BUFFER,
+        STATE_ELEMENT_ARRAY_BUFFER,
+        STATE_UNIFORM_BUFFER,
+        STATE_PIXEL_PACK_BUFFER,
+        STATE_PIXEL_UNPACK_BUFFER,
+        STATE_DRAW_INDIRECT_BUFFER,
+        STATE_BUFFER_TARGETS
+    } _buffer_target_t;
+
+    inline int getTextureTarget(GLenum target)
+    {
+        switch(target) {
+        case GL_TEXTURE_2D:       return STATE_TARGET_2D;
+        case GL_TEXTURE_2D_ARRAY: return STATE_TARGET_2D_ARRAY;
+        case GL_TEXTURE_3D:       return STATE_TARGET_3D;
+        case GL_TEXTURE_CUBE_MAP: return STATE_TARGET_CUBE_MAP;
+        default:                  return -1;
+        }
+    }
+
+    inline int getBufferTarget(GLenum target)
+    {
+        switch(target) {
+        case GL_ARRAY_BUFFER:         return STATE_ARRAY_BUFFER;
+        case GL_ELEMENT_ARRAY_BUFFER: return STATE_ELEMENT_ARRAY_BUFFER;
+        case GL_UNIFORM_BUFFER:       return STATE_UNIFORM_BUFFER;
+        case GL_PIXEL_PACK_BUFFER:    return STATE_PIXEL_PACK_BUFFER;
+        case GL_PIXEL_UNPACK_BUFFER:  return STATE_PIXEL_UNPACK_BUFFER;
+        case GL_DRAW_INDIRECT_BUFFER: return STATE_DRAW_INDIRECT_BUFFER;
+        default:                      return -1;
+        }
+    }
+
+    class StateTracker
+    {
+    private:
+        GLuint _program;
+        GLuint _vertex_array;
+        GLuint _buffers[STATE_BUFFER_TARGETS];
+        GLuint _textures[STATE_TEXTURE_UNITS][STATE_TEXTURE_TARGETS];
+        GLuint _active_texture;
+        GLuint _blend;  // 0, 1 or STATE_UNKNOWN
+        GLenum _blend_src;
+        GLenum _blend_dst;
+        GLenum _polygon_mode;
+
+        // not shadowed, the framebuffer that stands for the window
+        GLuint _default_framebuffer = 0;
+
+        _state_counters_t _counters;
+        _state_counters_t _last_frame;
+
+        // whether `value' changes, counting the call either way
+        bool change(GLuint& shadow, GLuint value, _state_kind_t kind)
+        {
+            if(shadow == value) {
+                _counters.elided[kind]++;
+                return false;
+            }
+            shadow = value;
+            _counters.issued[kind]++;
+            return true;
+        }
+
+        void forget(GLuint& shadow, GLuint name)
+        {
+            if(shadow == name) {
+                shadow = STATE_UNKNOWN;
+            }
+        }
+
+    public:
+        StateTracker()
+        {
+            memset(&_counters, 0, sizeof(_counters));
+            memset(&_last_frame, 0, sizeof(_last_frame));
+            Reset();
+        }
+
+        // assume the state of a new context
+        void Reset()
+        {
+            _program = 0;
+            _vertex_array = 0;
+            for(GLuint& buffer : _buffers) {
+                buffer = 0;
+            }
+            for(int unit = 0; unit < STATE_TEXTURE_UNITS; unit++) {
+                for(int target = 0; target < STATE_TEXTURE_TARGETS; target++) {
+                    _textures[unit][target] = 0;
+                }
+            }
+            _active_texture = 0;
+            _blend = 0;
+            _blend_src = GL_ONE;
+            _blend_dst = GL_ZERO;
+            _polygon_mode = GL_FILL;
+        }
+
+        // forget the state, after it was changed behind the tracker
+        void Invalidate()
+        {
+            _program = STATE_UNKNOWN;
+            _vertex_array = STATE_UNKNOWN;
+            for(GLuint& buffer : _buffers) {
+                buffer = STATE_UNKNOWN;
+            }
+            for(int unit = 0; unit < STATE_TEXTURE_UNITS; unit++) {
+                for(int target = 0; target < STATE_TEXTURE_TARGETS; target++) {
+                    _textures[unit][target] = STATE_UNKNOWN;
+                }
+            }
+            _active_texture = STATE_UNKNOWN;
+            _blend = STATE_UNKNOWN;
+            _blend_src = STATE_UNKNOWN;
+            _blend_dst = STATE_UNKNOWN;
+            _polygon_mode = STATE_UNKNOWN;
+        }
+
+        void UseProgram(GLuint program)
+        {
+            if(change(_program, program, STATE_PROGRAM)) {
+                glUseProgram(program);
+            }
+        }
+
+        GLuint GetProgram()
+        {
+            return _program;
+        }
+
+        void BindVertexArray(GLuint vertex_array)
+        {
+            if(change(_vertex_array, vertex_array, STATE_VERTEX_ARRAY))
+            {
+                glBindVertexArray(vertex_array);
+                // the element array binding is part of the vertex array
+                _buffers[STATE_ELEMENT_ARRAY_BUFFER] = STATE_UNKNOWN;
+            }
+        }
+
+        void BindBuffer(GLenum target, GLuint buffer)
+        {
+            int index = getBufferTarget(target);
+            if(index < 0) {
+                _counters.issued[STATE_BUFFER]++;
+                glBindBuffer(target, buffer);
+            }
+            else if(change(_buffers[index], buffer, STATE_BUFFER)) {
+                glBindBuffer(target, buffer);
+            }
+        }
+
+        // binding a range of a buffer also binds the whole buffer
+        void BindBufferRange(GLenum target, GLuint index, GLuint buffer,
+                             GLintptr offset, GLsizeiptr size)
+        {
+            glBindBufferRange(target, index, buffer, offset, size);
+            _counters.issued[STATE_BUFFER]++;
+            int shadow = getBufferTarget(target);
+            if(shadow >= 0) {
+                _buffers[shadow] = buffer;
+            }
+        }
+
+        void BindBufferBase(GLenum target, GLuint index, GLuint buffer)
+        {
+            glBindBufferBase(target, index, buffer);
+            _counters.issued[STATE_BUFFER]++;
+            int shadow = getBufferTarget(target);
+            if(shadow >= 0) {
+                _buffers[shadow] = buffer;
+            }
+        }
+
+        void ActiveTexture(GLuint unit)
+        {
+            if(change(_active_texture, unit, STATE_ACTIVE_TEXTURE)) {
+                glActiveTexture(GL_TEXTURE0 + unit);
+            }
+        }
+
+        // bind to texture unit `unit', making it the active unit only
+        // if the binding changes
+        void BindTexture(GLuint unit, GLenum target, GLuint texture)
+        {
+            int index = getTextureTarget(target);
+            if(unit >= (GLuint)STATE_TEXTURE_UNITS || index < 0)
+            {
+                ActiveTexture(unit);
+                _counters.issued[STATE_TEXTURE]++;
+                glBindTexture(target, texture);
+                return;
+            }
+            if(change(_textures[unit][index], texture, STATE_TEXTURE))
+            {
+                ActiveTexture(unit);
+                glBindTexture(target, texture);
+            }
+        }
+
+        // bind to the active texture unit, e.g. to upload to a texture
+        void BindTexture(GLenum target, GLuint texture)
+        {
+            if(_active_texture == STATE_UNKNOWN) {
+                ActiveTexture(0);
+            }
+            BindTexture(_active_texture, target, texture);
+        }
+
+        void SetBlend(bool enabled)
+        {
+            if(change(_blend, enabled ? 1 : 0, STATE_BLEND))
+            {
+                if(enabled) {
+                    glEnable(GL_BLEND);
+                }
+                else {
+                    glDisable(GL_BLEND);
+                }
+            }
+        }
+
+        void BlendFunc(GLenum src, GLenum dst)
+        {
+            if(_blend_src == src && _blend_dst == dst) {
+                _counters.elided[STATE_BLEND]++;
+                return;
+            }
+            _blend_src = src;
+            _blend_dst = dst;
+            _counters.issued[STATE_BLEND]++;
+            glBlendFunc(src, dst);
+        }
+
+        // for both faces, as only those are allowed by core profiles
+        void PolygonMode(GLenum mode)
+        {
+            if(change(_polygon_mode, mode, STATE_POLYGON_MODE)) {
+                glPolygonMode(GL_FRONT_AND_BACK, mode);
+            }
+        }
+
+        GLenum GetPolygonMode()
+        {
+            return _polygon_mode;
+        }
+
+        // framebuffer object to render to instead of the default
+        // framebuffer, e.g. by a window without a surface
+        void SetDefaultFramebuffer(GLuint framebuffer)
+        {
+            _default_framebuffer = framebuffer;
+        }
+
+        // to bind after rendering to a texture, instead of 0
+        GLuint GetDefaultFramebuffer()
+        {
+            return _default_framebuffer;
+        }
+
+        // --- DELETION --- //
+
+        void DeleteProgram(GLuint program)
+        {
+            forget(_program, program);
+            glDeleteProgram(program);
+        }
+
+        void DeleteVertexArrays(GLsizei count, const GLuint* vertex_arrays)
+        {
+            for(GLsizei i = 0; i < count; i++)
+            {
+                if(vertex_arrays[i] != 0 && _vertex_array == vertex_arrays[i])
+                {
+                    // deleting the bound vertex array binds 0
+                    _vertex_array = 0;
+                    _buffers[STATE_ELEMENT_ARRAY_BUFFER] = STATE_UNKNOWN;
+                }
+            }
+            glDeleteVertexArrays(count, vertex_arrays);
+        }
+
+        void DeleteBuffers(GLsizei count, const GLuint* buffers)
+        {
+            for(GLsizei i = 0; i < count; i++) {
+                for(GLuint& buffer : _buffers) {
+                    forget(buffer, buffers[i]);
+                }
+            }
+            glDeleteBuffers(count, buffers);
+        }
+
+        void DeleteTextures(GLsizei count, const GLuint* textures)
+        {
+            for(GLsizei i = 0; i < count; i++) {
+                for(int unit = 0; unit < STATE_TEXTURE_UNITS; unit++) {
+                    for(int target = 0; target < STATE_TEXTURE_TARGETS; target++) {
+                        forget(_textures[unit][target], textures[i]);
+                    }
+                }
+            }
+            glDeleteTextures(count, textures);
+        }
+
+        // --- COUNTERS --- //
+
+        // should be called once per frame, e.g. by `SwapBuffers'
+        void EndFrame()
+        {
+            _last_frame = _counters;
+            memset(&_counters, 0, sizeof(_counters));
+        }
+
+        // calls issued and elided during the last frame
+        const _state_counters_t& GetFrameCounters()
+        {
+            return _last_frame;
+        }
+    };
+
+    inline StateTracker& getState()
+    {
+        static StateTracker state;
+        return state;
+    }
+
+
+    // --- SHORTHANDS --- //
+
+    inline void useProgram(GLuint program)
+    {
+        getState().UseProgram(program);
+    }
+
+    inline void bindVertexArray(GLuint vertex_array)
+    {
+        getState().BindVertexArray(vertex_array);
+    }
+
+    inline void bindBuffer(GLenum target, GLuint buffer)
+    {
+        getState().BindBuffer(target, buffer);
+    }
+
+    inline void bindTexture(GLuint unit, GLenum target, GLuint texture)
+    {
+        getState().BindTexture(unit, target, texture);
+    }
+
+    inline void bindTexture(GLenum target, GLuint texture)
+    {
+        getState().BindTexture(target, texture);
+    }
+
+    inline void invalidate()
+    {
+        getState().Invalidate();
+    }
+
+} // namespace States
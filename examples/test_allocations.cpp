@@ -0,0 +1,142 @@
+// Checks that the frames of example1 and example2 do not allocate on
+// the heap once warmed up: both are rendered headless for a number of
+// frames, example2's through the render loop in idle mode and with the
+// shader watcher. Exits with 1 if a frame after the warmup allocated.
+// Usage: test_allocations [frames]
+
+#define MEMORY_COUNT_ALLOCATIONS
+#include "memory.hpp"
+
+#include "windows.hpp"
+#include "renderLoop.hpp"
+#include "shaders.hpp"
+#include "buffers.hpp"
+#include "profiler.hpp"
+#include "watcher.hpp"
+
+#include <cstdlib>
+
+const long WARMUP = 60;
+
+struct Vertex {
+    glm::vec2 vertexPos;
+    glm::vec3 vertexCol;
+};
+typedef Buffers::VertexLayout<Vertex, &Vertex::vertexPos, &Vertex::vertexCol> VertexLayout;
+
+// example1: clear, draw and swap
+long checkExample1(Windows::HeadlessWindow& window, long frames)
+{
+    Shaders::ShaderWrapper shader("shader1", Shaders::SHADERS_VF);
+    shader.Activate();
+
+    Vertex vertexData[] = {
+        {{-1.0f, -1.0f},  {1.0f, 0.0f, 0.0f}},
+        {{-1.0f, 1.0f},   {0.0f, 1.0f, 0.0f}},
+        {{1.0f, 1.0f},    {0.0f, 0.0f, 1.0f}}
+    };
+    Buffers::Mesh<VertexLayout> mesh(vertexData, 3);
+
+    Profiling::Profiler profiler;
+    Profiling::_scope_id_t scope_frame = profiler.GetScope("Frame");
+    Profiling::_scope_id_t scope_draw = profiler.GetScope("Draw");
+    Memory::AllocationCheck allocations(WARMUP);
+
+    for(long frame = 0; frame < WARMUP + frames; frame++)
+    {
+        profiler.BeginFrame();
+        profiler.Begin(scope_frame);
+        window.ClearWindow();
+
+        profiler.Begin(scope_draw);
+        mesh.Draw();
+        profiler.End(scope_draw);
+
+        window.SwapBuffers();
+        profiler.End(scope_frame);
+        allocations.EndFrame();
+        window.PollEvents();
+    }
+    return allocations.GetAllocatingFrames();
+}
+
+// example2: a render loop with updates, interpolation and reloading
+long checkExample2(Windows::HeadlessWindow& window, long frames)
+{
+    Shaders::ShaderWrapper shader("shader2", Shaders::SHADERS_VF);
+    shader.Activate();
+    Shaders::_uniform_handle_t xytime = shader.GetUniformHandle("xytime");
+
+    Watchers::ShaderWatcher watcher;
+    watcher.Watch(shader);
+
+    Vertex vertexData[] = {
+        {{-0.5f, -0.5f},  {1.0f, 0.0f, 0.0f}},
+        {{-0.5f, 0.5f},   {0.0f, 1.0f, 0.0f}},
+        {{0.5f, 0.5f},    {0.0f, 0.0f, 1.0f}}
+    };
+    Buffers::Mesh<VertexLayout> mesh(vertexData, 3);
+
+    Profiling::Profiler profiler;
+    Profiling::_scope_id_t scope_frame = profiler.GetScope("Frame");
+    Profiling::_scope_id_t scope_draw = profiler.GetScope("Draw");
+    Profiling::_scope_id_t scope_swap = profiler.GetScope("SwapBuffers");
+    Memory::AllocationCheck allocations(WARMUP);
+
+    // more updates than frames, so that every frame is rendered
+    double timer = 0.0;
+    Windows::RenderLoop loop(window, 1000.0);
+    loop.SetIdleMode(true);
+
+    auto update = [&](double dt) {
+        timer += dt;
+    };
+
+    auto render = [&](double alpha) {
+        if(watcher.Update() > 0 || watcher.IsReloading()) {
+            loop.RequestRedraw();
+        }
+
+        profiler.BeginFrame();
+        profiler.Begin(scope_frame);
+        window.ClearWindow();
+
+        profiler.Begin(scope_draw);
+        float time = timer + alpha * loop.GetTimestep();
+        shader.SetUniform(xytime, glm::vec2(cos(time), sin(time)));
+        mesh.Draw();
+        profiler.End(scope_draw);
+    };
+
+    loop.SetPresentFunction([&]() {
+        profiler.Begin(scope_swap);
+        window.SwapBuffers();
+        profiler.End(scope_swap);
+
+        profiler.End(scope_frame);
+        allocations.EndFrame();
+    });
+
+    loop.Run(update, render);
+    return allocations.GetAllocatingFrames();
+}
+
+int main(int argc, char** argv)
+{
+    long frames = (argc > 1) ? atol(argv[1]) : 600;
+
+    Windows::HeadlessWindow window("Allocation test", 400, Windows::ASPECT_RATIO_4_3);
+    // the render loop of example2 stops after its frames
+    window.SetFrameLimit(2 * (WARMUP + frames));
+
+    long example1 = checkExample1(window, frames);
+    std::cout << "example1: " << example1 << " of " << frames
+              << " frames allocated after the warmup" << std::endl;
+    long example2 = checkExample2(window, frames);
+    std::cout << "example2: " << example2 << " of " << frames
+              << " frames allocated after the warmup" << std::endl;
+
+    window.CloseWindow();
+
+    return (example1 == 0 && example2 == 0) ? 0 : 1;
+}
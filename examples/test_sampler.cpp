@@ -0,0 +1,93 @@
+// Checks that the vectorized sampler returns the same bits as the
+// reference sampler, for every filter, mipmap and wrap mode, so that
+// either can stand in for the other when checking GPU results.
+// Exits with 1 on any difference.
+
+#include "sampler.hpp"
+
+#include <iostream>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+const int SIZE = 64;
+const size_t SAMPLES = 1 << 14;
+
+int main()
+{
+    std::vector<unsigned char> rgba8((size_t)SIZE * SIZE * 4);
+    srand(1);
+    for(size_t i = 0; i < rgba8.size(); i++) {
+        rgba8[i] = rand() % 256;
+    }
+    Sampler::Texture texture(
+        Mipmaps::generateMipmaps(&rgba8[0], SIZE, SIZE, Mipmaps::MIPMAP_RGBA8,
+                                 Mipmaps::MIPMAP_FILTER_BOX),
+        Mipmaps::MIPMAP_RGBA8);
+
+    // outside [0,1] for the wrap modes, and both magnified and minified
+    std::vector<float> u(SAMPLES), v(SAMPLES), lod(SAMPLES);
+    for(size_t i = 0; i < SAMPLES; i++)
+    {
+        u[i] = rand() / (float)RAND_MAX * 3.0f - 1.0f;
+        v[i] = rand() / (float)RAND_MAX * 3.0f - 1.0f;
+        lod[i] = rand() / (float)RAND_MAX * 9.0f - 2.0f;
+    }
+
+    Sampler::_filter_t filters[] = {Sampler::SAMPLER_NEAREST, Sampler::SAMPLER_LINEAR};
+    Sampler::_mipmap_mode_t mipmaps[] = {Sampler::SAMPLER_MIPMAP_NONE,
+                                         Sampler::SAMPLER_MIPMAP_NEAREST,
+                                         Sampler::SAMPLER_MIPMAP_LINEAR};
+    Sampler::_wrap_t wraps[] = {Sampler::SAMPLER_REPEAT, Sampler::SAMPLER_MIRRORED_REPEAT,
+                                Sampler::SAMPLER_CLAMP_TO_EDGE,
+                                Sampler::SAMPLER_CLAMP_TO_BORDER};
+
+    std::cout << Sampler::getLaneCount() << " lanes" << std::endl;
+
+    std::vector<float> reference(SAMPLES * 4), vectorized(SAMPLES * 4);
+    long failures = 0;
+    int cases = 0;
+    for(Sampler::_filter_t mag : filters)
+    for(Sampler::_filter_t min : filters)
+    for(Sampler::_mipmap_mode_t mipmap : mipmaps)
+    for(Sampler::_wrap_t wrap : wraps)
+    {
+        Sampler::SamplerState state = Sampler::getDefaultState();
+        state.mag_filter = mag;
+        state.min_filter = min;
+        state.mipmap = mipmap;
+        state.wrap_s = wrap;
+        state.wrap_t = wraps[(wrap + 1) % 4];
+        state.border[0] = 0.25f;
+        state.border[3] = 1.0f;
+
+        for(size_t i = 0; i < SAMPLES; i++) {
+            Sampler::sample(texture, state, u[i], v[i], lod[i], &reference[i * 4]);
+        }
+        Sampler::sampleMany(texture, state, SAMPLES, &u[0], &v[0], &lod[0], &vectorized[0]);
+
+        long differences = 0;
+        size_t first = 0;
+        for(size_t i = 0; i < SAMPLES; i++)
+        {
+            if(memcmp(&reference[i * 4], &vectorized[i * 4], 4 * sizeof(float)) != 0 &&
+               differences++ == 0)
+            {
+                first = i;
+            }
+        }
+        if(differences > 0)
+        {
+            std::cerr << "mag " << mag << ", min " << min << ", mipmap " << mipmap
+                      << ", wrap " << wrap << ": " << differences << " samples differ, "
+                      << "first at (" << u[first] << ", " << v[first] << ") lod "
+                      << lod[first] << ": " << reference[first * 4] << " instead of "
+                      << vectorized[first * 4] << std::endl;
+            failures++;
+        }
+        cases++;
+    }
+
+    std::cout << cases - failures << " of " << cases << " sampler states match" << std::endl;
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,771 @@
+//
+// Texture Library
+//
+// Asynchronous texture loading. Images are decoded on a pool of
+// worker threads and uploaded through pixel buffer objects, so the
+// rendering loop never waits for the disk, the decoder or the driver.
+//
+
+#pragma once
+
+// GLEW
+#ifndef GLEW_STATIC
+#define GLEW_STATIC
+#endif
+#include <GL/glew.h>
+
+// GLM
+#include <glm/glm.hpp>
+
+// CUSTOM
+#include "atlas.hpp"
+#include "compression.hpp"
+#include "images.hpp"
+#include "mipmaps.hpp"
+#include "state.hpp"
+#include "threads.hpp"
+#include "virtualTexture.hpp"
+
+// STANDARD
+#include <atomic>
+#include <deque>
+#include <iostream>
+#include <math.h>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string.h>
+#include <thread>
+#include <vector>
+
+
+namespace Textures
+{
+    // handle to a texture owned by a `TextureLoader'. It can be used
+    // right away, but only refers to a GL texture once uploaded.
+    typedef int _texture_handle_t;
+
+    const _texture_handle_t TEXTURE_HANDLE_INVALID = -1;
+
+    typedef enum {
+        TEXTURE_DECODING,  // queued or being decoded on a worker thread
+        TEXTURE_UPLOADING, // copied to a staging buffer, transfer in flight
+        TEXTURE_READY,
+        TEXTURE_FAILED
+    } _texture_state_t;
+
+    // number of staging buffers, i.e. uploads that may be in flight
+    const int TEXTURE_STAGING_BUFFERS = 4;
+
+    // default number of bytes copied into staging buffers per frame
+    const size_t TEXTURE_UPLOAD_BUDGET = 16 * 1024 * 1024;
+
+    GLenum getPixelFormat(int channels)
+    {
+        switch(channels) {
+        case 1:
+            return GL_RED;
+        case 3:
+            return GL_RGB;
+        case 4:
+            return GL_RGBA;
+        default:
+            std::cerr << "Unsupported number of channels ("
+                      << channels << ")" << std::endl;
+            return GL_RGBA;
+        }
+    }
+
+    GLenum getInternalFormat(int channels)
+    {
+        switch(channels) {
+        case 1:
+            return GL_R8;
+        case 3:
+            return GL_RGB8;
+        default:
+            return GL_RGBA8;
+        }
+    }
+
+
+    GLenum getInternalFormat(Mipmaps::_mipmap_format_t format)
+    {
+        switch(format) {
+        case Mipmaps::MIPMAP_SRGB8_ALPHA8:
+            return GL_SRGB8_ALPHA8;
+        case Mipmaps::MIPMAP_RGBA32F:
+            return GL_RGBA32F;
+        default:
+            return GL_RGBA8;
+        }
+    }
+
+    // upload a chain from `Mipmaps::generateMipmaps' to the texture
+    // currently bound to GL_TEXTURE_2D
+    void uploadMipmaps(const std::vector<Mipmaps::Level>& levels,
+                       Mipmaps::_mipmap_format_t format)
+    {
+        GLenum type = (format == Mipmaps::MIPMAP_RGBA32F) ? GL_FLOAT
+                                                          : GL_UNSIGNED_BYTE;
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, levels.size() - 1);
+
+        for(size_t i = 0; i < levels.size(); i++)
+        {
+            glTexImage2D(GL_TEXTURE_2D, i, getInternalFormat(format),
+                         levels[i].width, levels[i].height, 0, GL_RGBA, type,
+                         &levels[i].data[0]);
+        }
+    }
+
+
+    GLenum getInternalFormat(Compression::_compression_format_t format, bool srgb)
+    {
+        if(format == Compression::COMPRESSION_BC1) {
+            return srgb ? GL_COMPRESSED_SRGB_S3TC_DXT1_EXT : GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+        }
+        return srgb ? GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT : GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+    }
+
+    // upload a chain from `Compression::compressMipmaps' to the texture
+    // currently bound to GL_TEXTURE_2D. Needs EXT_texture_compression_s3tc.
+    void uploadCompressedMipmaps(const std::vector<Compression::Level>& levels,
+                                 Compression::_compression_format_t format,
+                                 bool srgb = false)
+    {
+        if(!GLEW_EXT_texture_compression_s3tc) {
+            std::cerr << "S3TC texture compression is not supported" << std::endl;
+            return;
+        }
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, levels.size() - 1);
+
+        for(size_t i = 0; i < levels.size(); i++)
+        {
+            glCompressedTexImage2D(GL_TEXTURE_2D, i, getInternalFormat(format, srgb),
+                                   levels[i].width, levels[i].height, 0,
+                                   levels[i].data.size(), &levels[i].data[0]);
+        }
+    }
+
+    class TextureLoader
+    {
+    private:
+        typedef struct {
+            std::string path;
+            GLuint texture;
+            _texture_state_t state;
+            bool mipmaps;
+        } _texture_entry_t;
+
+        typedef struct {
+            GLuint buffer;
+            size_t capacity;
+            GLsync fence;
+            _texture_handle_t handle;
+        } _staging_buffer_t;
+
+        typedef struct {
+            _texture_handle_t handle;
+            bool ok;
+            Images::Image image;
+        } _decoded_image_t;
+
+        // only accessed from the GL thread
+        std::vector<_texture_entry_t> _textures;
+        _staging_buffer_t _staging[TEXTURE_STAGING_BUFFERS];
+        size_t _upload_budget;
+        size_t _pending = 0;
+
+        // filled by the workers
+        std::deque<_decoded_image_t> _decoded;
+        std::mutex _mutex;
+        std::atomic<bool> _stop;
+
+        Images::_image_decoder_func _decoder;
+
+        // declared last so the workers are joined before anything
+        // they touch is destroyed
+        Threads::ThreadPool _pool;
+
+        void decode(_texture_handle_t handle, std::string path)
+        {
+            _decoded_image_t result;
+            result.handle = handle;
+            result.ok = !_stop && _decoder(path.c_str(), result.image);
+
+            std::lock_guard<std::mutex> lock(_mutex);
+            _decoded.push_back(std::move(result));
+        }
+
+        // move finished transfers out of the staging buffers
+        void retireUploads()
+        {
+            for(int i = 0; i < TEXTURE_STAGING_BUFFERS; i++)
+            {
+                _staging_buffer_t& staging = _staging[i];
+                if(staging.fence == 0) {
+                    continue;
+                }
+
+                GLenum status = glClientWaitSync(staging.fence, 0, 0);
+                if(status != GL_ALREADY_SIGNALED &&
+                   status != GL_CONDITION_SATISFIED)
+                {
+                    continue;
+                }
+
+                glDeleteSync(staging.fence);
+                staging.fence = 0;
+                _textures[staging.handle].state = TEXTURE_READY;
+                staging.handle = TEXTURE_HANDLE_INVALID;
+                _pending--;
+            }
+        }
+
+        _staging_buffer_t* getFreeStaging()
+        {
+            for(int i = 0; i < TEXTURE_STAGING_BUFFERS; i++) {
+                if(_staging[i].handle == TEXTURE_HANDLE_INVALID) {
+                    return &_staging[i];
+                }
+            }
+            return NULL;
+        }
+
+        // copy into a staging buffer and start the transfer, which
+        // completes asynchronously once the fence is signaled
+        void startUpload(_staging_buffer_t& staging, _decoded_image_t& decoded)
+        {
+            _texture_entry_t& entry = _textures[decoded.handle];
+            Images::Image& image = decoded.image;
+            size_t size = image.pixels.size();
+
+            States::bindBuffer(GL_PIXEL_UNPACK_BUFFER, staging.buffer);
+            if(staging.capacity < size)
+            {
+                glBufferData(GL_PIXEL_UNPACK_BUFFER, size, NULL, GL_STREAM_DRAW);
+                staging.capacity = size;
+            }
+
+            // the previous transfer from this buffer has completed
+            void* ptr = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, size,
+                                         GL_MAP_WRITE_BIT |
+                                         GL_MAP_INVALIDATE_BUFFER_BIT |
+                                         GL_MAP_UNSYNCHRONIZED_BIT);
+            memcpy(ptr, &image.pixels[0], size);
+            glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+
+            glGenTextures(1, &entry.texture);
+            States::bindTexture(GL_TEXTURE_2D, entry.texture);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER,
+                            entry.mipmaps ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+            if(image.channels == 1)
+            {
+                // sample grey images as grey, not red
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_G, GL_RED);
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_B, GL_RED);
+            }
+
+            glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+            glTexImage2D(GL_TEXTURE_2D, 0, getInternalFormat(image.channels),
+                         image.width, image.height, 0,
+                         getPixelFormat(image.channels), GL_UNSIGNED_BYTE,
+                         (const GLvoid*)0);
+            if(entry.mipmaps) {
+                glGenerateMipmap(GL_TEXTURE_2D);
+            }
+
+            States::bindTexture(GL_TEXTURE_2D, 0);
+            States::bindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+            staging.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+            staging.handle = decoded.handle;
+            entry.state = TEXTURE_UPLOADING;
+        }
+
+    public:
+        // 0 threads means one per hardware thread. `upload_budget' limits
+        // the bytes copied per call to `Update', though at least one
+        // image is always started.
+        TextureLoader(unsigned threads = 0,
+                      size_t upload_budget = TEXTURE_UPLOAD_BUDGET,
+                      Images::_image_decoder_func decoder = Images::decodeImage)
+            : _upload_budget(upload_budget), _stop(false),
+              _decoder(decoder), _pool(threads)
+        {
+            for(int i = 0; i < TEXTURE_STAGING_BUFFERS; i++)
+            {
+                glGenBuffers(1, &_staging[i].buffer);
+                _staging[i].capacity = 0;
+                _staging[i].fence = 0;
+                _staging[i].handle = TEXTURE_HANDLE_INVALID;
+            }
+        }
+
+        ~TextureLoader()
+        {
+            // skip decoding whatever is still queued
+            _stop = true;
+            _pool.Wait();
+
+            for(int i = 0; i < TEXTURE_STAGING_BUFFERS; i++)
+            {
+                if(_staging[i].fence) glDeleteSync(_staging[i].fence);
+                States::getState().DeleteBuffers(1, &_staging[i].buffer);
+            }
+            for(size_t i = 0; i < _textures.size(); i++) {
+                if(_textures[i].texture) States::getState().DeleteTextures(1, &_textures[i].texture);
+            }
+        }
+
+        // queue an image for loading and return its handle immediately
+        _texture_handle_t Load(const char* path, bool mipmaps = true)
+        {
+            _texture_entry_t entry;
+            entry.path = path;
+            entry.texture = 0;
+            entry.state = TEXTURE_DECODING;
+            entry.mipmaps = mipmaps;
+
+            _texture_handle_t handle = _textures.size();
+            _textures.push_back(entry);
+            _pending++;
+
+            std::string file = path;
+            _pool.Submit([this, handle, file]() { decode(handle, file); });
+            return handle;
+        }
+
+        // advance loading, should be called once per frame from the
+        // GL thread. Never waits for the workers or the GPU.
+        void Update()
+        {
+            retireUploads();
+
+            size_t copied = 0;
+            bool first = true;
+            while(first || copied < _upload_budget)
+            {
+                _staging_buffer_t* staging = getFreeStaging();
+                if(staging == NULL) {
+                    break;
+                }
+
+                _decoded_image_t decoded;
+                {
+                    std::lock_guard<std::mutex> lock(_mutex);
+                    if(_decoded.empty()) {
+                        break;
+                    }
+                    decoded = std::move(_decoded.front());
+                    _decoded.pop_front();
+                }
+
+                if(!decoded.ok)
+                {
+                    std::cerr << "Could not load texture '"
+                              << _textures[decoded.handle].path << "'"
+                              << std::endl;
+                    _textures[decoded.handle].state = TEXTURE_FAILED;
+                    _pending--;
+                    continue;
+                }
+
+                startUpload(*staging, decoded);
+                copied += decoded.image.pixels.size();
+                first = false;
+            }
+        }
+
+        // block until every queued texture is ready or has failed,
+        // e.g. for loading screens
+        void Finish()
+        {
+            while(_pending > 0)
+            {
+                Update();
+                glFlush();
+                std::this_thread::yield();
+            }
+        }
+
+        // number of textures that are not ready yet
+        size_t Pending()
+        {
+            return _pending;
+        }
+
+        _texture_state_t GetState(_texture_handle_t handle)
+        {
+            return _textures[handle].state;
+        }
+
+        bool IsReady(_texture_handle_t handle)
+        {
+            return _textures[handle].state == TEXTURE_READY;
+        }
+
+        // the GL texture, or 0 while it is still loading
+        GLuint GetTexture(_texture_handle_t handle)
+        {
+            if(!IsReady(handle)) {
+                return 0;
+            }
+            return _textures[handle].texture;
+        }
+
+        // bind to texture unit `unit', unbinding it while not ready
+        void Bind(_texture_handle_t handle, GLuint unit)
+        {
+            States::bindTexture(unit, GL_TEXTURE_2D, GetTexture(handle));
+        }
+    };
+
+
+    // the pages of an `Atlases::Atlas' as layers of a 2D texture array,
+    // e.g. for `Sprites::SpriteBatch' with the page of an entry as layer
+    class AtlasTexture
+    {
+    private:
+        Atlases::Atlas& _atlas;
+        GLuint _texture;
+        bool _mipmaps;
+
+    public:
+        // room for all pages the atlas may grow to is allocated now
+        AtlasTexture(Atlases::Atlas& atlas, bool mipmaps = false)
+            : _atlas(atlas), _mipmaps(mipmaps)
+        {
+            int size = atlas.GetSize();
+            int levels = 1;
+            if(mipmaps) {
+                while((size >> levels) > 0) levels++;
+            }
+
+            glGenTextures(1, &_texture);
+            States::bindTexture(GL_TEXTURE_2D_ARRAY, _texture);
+            for(int level = 0; level < levels; level++)
+            {
+                glTexImage3D(GL_TEXTURE_2D_ARRAY, level,
+                             getInternalFormat(atlas.GetChannels()),
+                             size >> level, size >> level, atlas.GetMaxPages(), 0,
+                             getPixelFormat(atlas.GetChannels()), GL_UNSIGNED_BYTE, NULL);
+            }
+            glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, levels - 1);
+            glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER,
+                            mipmaps ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+            glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        }
+
+        ~AtlasTexture()
+        {
+            States::getState().DeleteTextures(1, &_texture);
+        }
+
+        AtlasTexture(const AtlasTexture&) = delete;
+        AtlasTexture& operator=(const AtlasTexture&) = delete;
+
+        // upload the parts of the pages that images were added to since
+        // the last call. Returns the number of pages changed.
+        int Update()
+        {
+            int changed = 0;
+            int size = _atlas.GetSize();
+            States::bindTexture(GL_TEXTURE_2D_ARRAY, _texture);
+            glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+            glPixelStorei(GL_UNPACK_ROW_LENGTH, size);
+            for(int page = 0; page < _atlas.GetPageCount(); page++)
+            {
+                Atlases::_rect_t rect;
+                if(!_atlas.GetDirty(page, rect)) {
+                    continue;
+                }
+                glPixelStorei(GL_UNPACK_SKIP_PIXELS, rect.x);
+                glPixelStorei(GL_UNPACK_SKIP_ROWS, rect.y);
+                glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, rect.x, rect.y, page,
+                                rect.width, rect.height, 1,
+                                getPixelFormat(_atlas.GetChannels()), GL_UNSIGNED_BYTE,
+                                &_atlas.GetPage(page).pixels[0]);
+                changed++;
+            }
+            glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+            glPixelStorei(GL_UNPACK_SKIP_PIXELS, 0);
+            glPixelStorei(GL_UNPACK_SKIP_ROWS, 0);
+
+            if(changed > 0 && _mipmaps) {
+                glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
+            }
+            return changed;
+        }
+
+        GLuint GetTexture()
+        {
+            return _texture;
+        }
+    };
+
+
+    // tiles requested from disk and uploaded per frame at most
+    const size_t VT_REQUESTS_PER_FRAME = 64;
+    const size_t VT_UPLOADS_PER_FRAME = 16;
+
+    // a virtual texture from a file written by `VirtualTextures::writeTileFile',
+    // sampled with shaderVirtual/virtualTexture.glsl. Every frame, the
+    // scene is drawn with `vtFeedback' into a small framebuffer, which is
+    // read back with `ReadFeedback', and `Update' streams in the tiles.
+    class VirtualTexture
+    {
+    private:
+        VirtualTextures::TileFile _file;
+        VirtualTextures::_layout_t _layout;
+        std::unique_ptr<VirtualTextures::Residency> _residency;
+        std::unique_ptr<VirtualTextures::TileStreamer> _streamer;
+        int _slots_per_row;
+
+        GLuint _physical = 0;
+        GLuint _page_table = 0;
+        long _frame = 0;
+
+        // feedback is read back through two buffers, each mapped a
+        // frame after its transfer was started
+        GLuint _feedback_buffers[2] = {0, 0};
+        GLsync _feedback_fences[2] = {0, 0};
+        size_t _feedback_sizes[2] = {0, 0};
+        int _feedback_index = 0;
+
+        std::vector<VirtualTextures::_tile_id_t> _requests;
+        std::vector<VirtualTextures::_loaded_tile_t> _loaded;
+
+        void upload(const VirtualTextures::_loaded_tile_t& tile, int slot)
+        {
+            int stride = _layout.tile_size + 2 * _layout.border;
+            States::bindTexture(GL_TEXTURE_2D, _physical);
+            glTexSubImage2D(GL_TEXTURE_2D, 0, (slot % _slots_per_row) * stride,
+                            (slot / _slots_per_row) * stride, stride, stride,
+                            GL_RGBA, GL_UNSIGNED_BYTE, &tile.pixels[0]);
+        }
+
+        void uploadPageTable()
+        {
+            VirtualTextures::PageTable& table = _residency->GetPageTable();
+            if(!table.Build(_slots_per_row)) {
+                return;
+            }
+            States::bindTexture(GL_TEXTURE_2D, _page_table);
+            for(int level = 0; level < _layout.levels; level++)
+            {
+                glTexSubImage2D(GL_TEXTURE_2D, level, 0, 0,
+                                VirtualTextures::getTilesX(_layout, level),
+                                VirtualTextures::getTilesY(_layout, level),
+                                GL_RGBA, GL_UNSIGNED_BYTE, &table.GetLevel(level)[0]);
+            }
+        }
+
+        // the feedback read back a frame ago, if the transfer is done
+        void processFeedback()
+        {
+            int index = 1 - _feedback_index;
+            if(_feedback_fences[index] == 0) {
+                return;
+            }
+            if(glClientWaitSync(_feedback_fences[index], 0, 0) == GL_TIMEOUT_EXPIRED) {
+                return; // try again next frame, instead of stalling
+            }
+            glDeleteSync(_feedback_fences[index]);
+            _feedback_fences[index] = 0;
+
+            States::bindBuffer(GL_PIXEL_PACK_BUFFER, _feedback_buffers[index]);
+            const uint32_t* pixels = (const uint32_t*)glMapBufferRange(
+                GL_PIXEL_PACK_BUFFER, 0, _feedback_sizes[index] * 4, GL_MAP_READ_BIT);
+            if(pixels != NULL)
+            {
+                _residency->ProcessFeedback(pixels, _feedback_sizes[index], _frame,
+                                            _requests, VT_REQUESTS_PER_FRAME);
+                glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+            }
+            States::bindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+            for(VirtualTextures::_tile_id_t tile : _requests) {
+                _streamer->Request(tile);
+            }
+        }
+
+    public:
+        // the physical texture has `slots_per_row' squared tile slots.
+        // The coarsest level is loaded right away and stays resident, so
+        // the texture is invalid if it does not leave slots to stream to.
+        VirtualTexture(const char* path, int slots_per_row = 16, unsigned threads = 2)
+            : _slots_per_row(std::min(slots_per_row, 256))
+        {
+            if(!_file.Open(path)) {
+                return;
+            }
+            _layout = _file.GetLayout();
+            int slots = _slots_per_row * _slots_per_row;
+            int coarsest = _layout.levels - 1;
+            int pinned = VirtualTextures::getTilesX(_layout, coarsest) *
+                         VirtualTextures::getTilesY(_layout, coarsest);
+            if(pinned >= slots)
+            {
+                std::cerr << "Virtual texture '" << path << "' keeps " << pinned
+                          << " tiles resident, which needs more than " << slots
+                          << " slots" << std::endl;
+                return;
+            }
+            _residency.reset(new VirtualTextures::Residency(_layout, slots));
+            _streamer.reset(new VirtualTextures::TileStreamer(_file, threads));
+
+            int size = _slots_per_row * (_layout.tile_size + 2 * _layout.border);
+            glGenTextures(1, &_physical);
+            States::bindTexture(GL_TEXTURE_2D, _physical);
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, size, size, 0,
+                         GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+            glGenTextures(1, &_page_table);
+            States::bindTexture(GL_TEXTURE_2D, _page_table);
+            for(int level = 0; level < _layout.levels; level++)
+            {
+                glTexImage2D(GL_TEXTURE_2D, level, GL_RGBA8,
+                             VirtualTextures::getTilesX(_layout, level),
+                             VirtualTextures::getTilesY(_layout, level),
+                             0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+            }
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, _layout.levels - 1);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+            glGenBuffers(2, _feedback_buffers);
+
+            VirtualTextures::_loaded_tile_t tile;
+            for(int y = 0; y < VirtualTextures::getTilesY(_layout, coarsest); y++)
+            {
+                for(int x = 0; x < VirtualTextures::getTilesX(_layout, coarsest); x++)
+                {
+                    tile.tile = VirtualTextures::makeTileId(coarsest, x, y);
+                    if(!_file.ReadTile(tile.tile, tile.pixels)) {
+                        continue;
+                    }
+                    int slot = _residency->Insert(tile.tile, _frame, true);
+                    if(slot >= 0) {
+                        upload(tile, slot);
+                    }
+                }
+            }
+            uploadPageTable();
+        }
+
+        ~VirtualTexture()
+        {
+            _streamer.reset();
+            for(int i = 0; i < 2; i++) {
+                if(_feedback_fences[i] != 0) {
+                    glDeleteSync(_feedback_fences[i]);
+                }
+            }
+            States::getState().DeleteBuffers(2, _feedback_buffers);
+            States::getState().DeleteTextures(1, &_page_table);
+            States::getState().DeleteTextures(1, &_physical);
+        }
+
+        VirtualTexture(const VirtualTexture&) = delete;
+        VirtualTexture& operator=(const VirtualTexture&) = delete;
+
+        bool IsValid()
+        {
+            return _residency != NULL;
+        }
+
+        // start reading the feedback drawn to the first color attachment
+        // of `framebuffer'. It is processed a frame later, so that the
+        // transfer has finished by then.
+        void ReadFeedback(GLuint framebuffer, int width, int height)
+        {
+            int index = _feedback_index;
+            if(_feedback_fences[index] != 0) {
+                return; // the last transfer to this buffer was never used
+            }
+            size_t size = (size_t)width * height;
+            States::bindBuffer(GL_PIXEL_PACK_BUFFER, _feedback_buffers[index]);
+            if(size != _feedback_sizes[index])
+            {
+                glBufferData(GL_PIXEL_PACK_BUFFER, size * 4, NULL, GL_STREAM_READ);
+                _feedback_sizes[index] = size;
+            }
+            glBindFramebuffer(GL_READ_FRAMEBUFFER, framebuffer);
+            glReadBuffer(framebuffer == 0 ? GL_BACK : GL_COLOR_ATTACHMENT0);
+            glPixelStorei(GL_PACK_ALIGNMENT, 4);
+            glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+            States::bindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+            _feedback_fences[index] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        }
+
+        // should be called once per frame: requests the tiles in the
+        // last feedback, and uploads those loaded since
+        void Update()
+        {
+            if(!IsValid()) {
+                return;
+            }
+            _frame++;
+            processFeedback();
+            _feedback_index = 1 - _feedback_index;
+
+            _streamer->Poll(_loaded, VT_UPLOADS_PER_FRAME);
+            for(const VirtualTextures::_loaded_tile_t& tile : _loaded)
+            {
+                int slot = tile.ok ? _residency->Insert(tile.tile, _frame) : -1;
+                if(slot < 0) {
+                    _residency->Cancel(tile.tile);
+                    continue;
+                }
+                upload(tile, slot);
+            }
+            uploadPageTable();
+        }
+
+        // bind the page table and physical textures to the texture units
+        // and set the uniforms of shaderVirtual/virtualTexture.glsl that
+        // the active `shader' uses. `feedback_scale' is how many times smaller
+        // the feedback framebuffer is than the one drawn to.
+        template<typename Shader>
+        void Bind(Shader& shader, GLuint page_table_unit, GLuint physical_unit,
+                  float feedback_scale = 1.0f)
+        {
+            States::bindTexture(page_table_unit, GL_TEXTURE_2D, _page_table);
+            States::bindTexture(physical_unit, GL_TEXTURE_2D, _physical);
+
+            // the sampling and the feedback pass use different uniforms
+            auto set = [&shader](const char* name, auto value) {
+                if(shader.HasUniform(name)) {
+                    shader.SetUniform(name, value);
+                }
+            };
+            if(shader.HasUniform("vtPageTable")) {
+                shader.SetUniformTexture("vtPageTable", page_table_unit);
+            }
+            if(shader.HasUniform("vtPhysical")) {
+                shader.SetUniformTexture("vtPhysical", physical_unit);
+            }
+            set("vtTiles", glm::vec2(VirtualTextures::getTilesX(_layout, 0),
+                                     VirtualTextures::getTilesY(_layout, 0)));
+            set("vtLevels", (float)_layout.levels);
+            set("vtTileSize", (float)_layout.tile_size);
+            set("vtBorder", (float)_layout.border);
+            set("vtSlotsPerRow", (float)_slots_per_row);
+            set("vtFeedbackBias", -log2f(feedback_scale));
+        }
+
+        const VirtualTextures::_residency_stats_t& GetStats()
+        {
+            return _residency->GetStats();
+        }
+    };
+
+} // namespace Textures
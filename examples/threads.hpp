@@ -0,0 +1,180 @@
+//
+// Thread Library
+//
+// A fixed-size pool of worker threads, and a parallel loop
+// on top of it for splitting work into chunks of rows.
+//
+
+#pragma once
+
+// STANDARD
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+namespace Threads
+{
+    // number of hardware threads, at least 1
+    inline unsigned getHardwareThreads()
+    {
+        unsigned count = std::thread::hardware_concurrency();
+        return (count > 0) ? count : 1;
+    }
+
+    class ThreadPool
+    {
+    private:
+        std::vector<std::thread> _workers;
+        std::deque<std::function<void()>> _tasks;
+        std::mutex _mutex;
+        std::condition_variable _task_available;
+        std::condition_variable _tasks_done;
+        size_t _active = 0;
+        bool _stop = false;
+
+        void workerLoop()
+        {
+            for(;;)
+            {
+                std::function<void()> task;
+                {
+                    std::unique_lock<std::mutex> lock(_mutex);
+                    _task_available.wait(lock, [this]() {
+                        return _stop || !_tasks.empty();
+                    });
+                    if(_tasks.empty()) {
+                        return; // stopping, and nothing left to do
+                    }
+                    task = std::move(_tasks.front());
+                    _tasks.pop_front();
+                    _active++;
+                }
+
+                task();
+
+                std::lock_guard<std::mutex> lock(_mutex);
+                _active--;
+                if(_active == 0 && _tasks.empty()) {
+                    _tasks_done.notify_all();
+                }
+            }
+        }
+
+    public:
+        // 0 threads means one per hardware thread
+        ThreadPool(unsigned count = 0)
+        {
+            if(count == 0) {
+                count = getHardwareThreads();
+            }
+            for(unsigned i = 0; i < count; i++) {
+                _workers.emplace_back(&ThreadPool::workerLoop, this);
+            }
+        }
+
+        // finishes all queued tasks before joining the workers
+        ~ThreadPool()
+        {
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+                _stop = true;
+            }
+            _task_available.notify_all();
+            for(std::thread& worker : _workers) {
+                worker.join();
+            }
+        }
+
+        void Submit(std::function<void()> task)
+        {
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+                _tasks.push_back(std::move(task));
+            }
+            _task_available.notify_one();
+        }
+
+        // block until every submitted task has finished.
+        // Must not be called from inside a task.
+        void Wait()
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            _tasks_done.wait(lock, [this]() {
+                return _active == 0 && _tasks.empty();
+            });
+        }
+
+        unsigned Size()
+        {
+            return _workers.size();
+        }
+    };
+
+
+    // --- PARALLEL LOOPS --- //
+
+    // call `func(begin, end)' for consecutive chunks of [0, count) on the
+    // pool. The calling thread processes chunks as well, and only waits
+    // for its own chunks, so other tasks on the pool are not affected.
+    template<typename Func>
+    void parallelFor(ThreadPool& pool, size_t count, size_t chunk, Func func)
+    {
+        if(count == 0) {
+            return;
+        }
+        if(chunk == 0) {
+            chunk = 1;
+        }
+        const size_t chunks = (count + chunk - 1) / chunk;
+
+        // shared, since a helper may only get to run after the chunks
+        // are finished and this function has returned
+        struct _state_t {
+            std::atomic<size_t> next;
+            std::mutex mutex;
+            std::condition_variable done;
+            size_t finished;
+        };
+        std::shared_ptr<_state_t> state = std::make_shared<_state_t>();
+        state->next = 0;
+        state->finished = 0;
+
+        // `func' is only called for chunks that exist, which all
+        // complete before this function returns
+        Func* body = &func;
+        auto work = [state, body, chunks, chunk, count]() {
+            size_t finished = 0;
+            for(size_t c = state->next++; c < chunks; c = state->next++)
+            {
+                size_t begin = c * chunk;
+                size_t end = (begin + chunk < count) ? begin + chunk : count;
+                (*body)(begin, end);
+                finished++;
+            }
+            if(finished > 0)
+            {
+                std::lock_guard<std::mutex> lock(state->mutex);
+                state->finished += finished;
+                if(state->finished == chunks) {
+                    state->done.notify_all();
+                }
+            }
+        };
+
+        size_t helpers = (chunks - 1 < pool.Size()) ? chunks - 1 : pool.Size();
+        for(size_t i = 0; i < helpers; i++) {
+            pool.Submit(work);
+        }
+        work();
+
+        std::unique_lock<std::mutex> lock(state->mutex);
+        state->done.wait(lock, [&]() { return state->finished == chunks; });
+    }
+
+} // namespace Threads
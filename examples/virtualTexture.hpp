@@ -0,0 +1,687 @@
+//
+// Virtual Texture Library
+//
+// Textures larger than video memory, split into square tiles on disk
+// of which only those in view are resident. A feedback pass writes
+// the tile and mipmap level every pixel would sample; the needed tiles
+// are loaded on a pool of threads, kept in a fixed number of cache
+// slots with least recently used eviction, and the page table maps
+// every tile to its slot, or to the slot of its nearest resident
+// ancestor while it is not loaded.
+//
+// Everything in this file runs on the CPU only, so the cache can be
+// driven by simulated feedback. The GL side is `Textures::VirtualTexture'.
+//
+
+#pragma once
+
+// CUSTOM
+#include "mipmaps.hpp"
+#include "threads.hpp"
+
+// STANDARD
+#include <algorithm>
+#include <atomic>
+#include <deque>
+#include <iostream>
+#include <mutex>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+
+namespace VirtualTextures
+{
+    // level in the top 4 bits, then 14 bits each of y and x
+    typedef uint32_t _tile_id_t;
+
+    const _tile_id_t VT_TILE_INVALID = 0xffffffff;
+    const int VT_MAX_LEVELS = 16;
+    const int VT_MAX_TILES = 1 << 12; // per side, at level 0, as feedback has 12 bits
+
+    inline _tile_id_t makeTileId(int level, int x, int y)
+    {
+        return ((uint32_t)level << 28) | ((uint32_t)y << 14) | (uint32_t)x;
+    }
+
+    inline int getTileLevel(_tile_id_t tile)
+    {
+        return tile >> 28;
+    }
+
+    inline int getTileX(_tile_id_t tile)
+    {
+        return tile & 0x3fff;
+    }
+
+    inline int getTileY(_tile_id_t tile)
+    {
+        return (tile >> 14) & 0x3fff;
+    }
+
+    // the tile one level coarser that covers `tile'
+    inline _tile_id_t getParent(_tile_id_t tile)
+    {
+        return makeTileId(getTileLevel(tile) + 1, getTileX(tile) / 2, getTileY(tile) / 2);
+    }
+
+    // a feedback pixel as written by `vtFeedback' in shaderVirtual/,
+    // or VT_TILE_INVALID where nothing virtual was drawn
+    inline _tile_id_t decodeFeedback(uint32_t pixel)
+    {
+        unsigned char rgba[4];
+        memcpy(rgba, &pixel, 4);
+        if(rgba[3] == 255) {
+            return VT_TILE_INVALID;
+        }
+        int x = rgba[0] | ((rgba[2] & 0x0f) << 8);
+        int y = rgba[1] | ((rgba[2] >> 4) << 8);
+        return makeTileId(rgba[3], x, y);
+    }
+
+    // the layout of a virtual texture, whose sides are powers of two
+    // and at least one tile long. Level l has (tiles_x >> l) by
+    // (tiles_y >> l) tiles, down to the level whose shorter side is
+    // one tile.
+    typedef struct {
+        int width;
+        int height;
+        int tile_size;  // pixels of the texture per tile
+        int border;     // extra pixels on each side, for filtering
+        int levels;
+    } _layout_t;
+
+    inline int getTilesX(const _layout_t& layout, int level)
+    {
+        return (layout.width / layout.tile_size) >> level;
+    }
+
+    inline int getTilesY(const _layout_t& layout, int level)
+    {
+        return (layout.height / layout.tile_size) >> level;
+    }
+
+    // bytes of a stored RGBA8 tile, including its border
+    inline size_t getTileBytes(const _layout_t& layout)
+    {
+        size_t side = layout.tile_size + 2 * layout.border;
+        return side * side * 4;
+    }
+
+    inline bool isPowerOfTwo(int n)
+    {
+        return n > 0 && (n & (n - 1)) == 0;
+    }
+
+    inline bool makeLayout(int width, int height, int tile_size, int border, _layout_t& layout)
+    {
+        if(!isPowerOfTwo(width) || !isPowerOfTwo(height) || !isPowerOfTwo(tile_size) ||
+           width < tile_size || height < tile_size ||
+           width / tile_size > VT_MAX_TILES || height / tile_size > VT_MAX_TILES)
+        {
+            std::cerr << "Virtual texture of " << width << "x" << height
+                      << " cannot be split in tiles of " << tile_size << std::endl;
+            return false;
+        }
+        layout.width = width;
+        layout.height = height;
+        layout.tile_size = tile_size;
+        layout.border = border;
+        layout.levels = 1;
+        while(getTilesX(layout, layout.levels) > 0 && getTilesY(layout, layout.levels) > 0 &&
+              layout.levels < VT_MAX_LEVELS)
+        {
+            layout.levels++;
+        }
+        return true;
+    }
+
+
+    // --- TILE FILES --- //
+
+    typedef struct {
+        char magic[4]; // "TPVT"
+        uint32_t width;
+        uint32_t height;
+        uint32_t tile_size;
+        uint32_t border;
+    } _tile_file_header_t;
+
+    // offset of `tile' in a tile file. Tiles are stored level by level,
+    // row by row.
+    inline size_t getTileOffset(const _layout_t& layout, _tile_id_t tile)
+    {
+        size_t index = 0;
+        for(int level = 0; level < getTileLevel(tile); level++) {
+            index += (size_t)getTilesX(layout, level) * getTilesY(layout, level);
+        }
+        int level = getTileLevel(tile);
+        index += (size_t)getTileY(tile) * getTilesX(layout, level) + getTileX(tile);
+        return sizeof(_tile_file_header_t) + index * getTileBytes(layout);
+    }
+
+    // split an RGBA8 image and its mipmaps into a tile file
+    bool writeTileFile(const char* path, const unsigned char* pixels, int width, int height,
+                       int tile_size, int border, Threads::ThreadPool* pool = NULL)
+    {
+        _layout_t layout;
+        if(!makeLayout(width, height, tile_size, border, layout)) {
+            return false;
+        }
+        FILE* file = fopen(path, "wb");
+        if(file == NULL) {
+            std::cerr << "Cannot create tile file '" << path << "'" << std::endl;
+            return false;
+        }
+
+        _tile_file_header_t header = {{'T', 'P', 'V', 'T'}, (uint32_t)width, (uint32_t)height,
+                                      (uint32_t)tile_size, (uint32_t)border};
+        bool ok = fwrite(&header, sizeof(header), 1, file) == 1;
+
+        std::vector<Mipmaps::Level> levels = Mipmaps::generateMipmaps(
+            pixels, width, height, Mipmaps::MIPMAP_RGBA8, Mipmaps::MIPMAP_FILTER_BOX, pool);
+
+        int side = tile_size + 2 * border;
+        std::vector<unsigned char> tile(getTileBytes(layout));
+        for(int level = 0; level < layout.levels && ok; level++)
+        {
+            const Mipmaps::Level& image = levels[level];
+            for(int ty = 0; ty < getTilesY(layout, level) && ok; ty++)
+            {
+                for(int tx = 0; tx < getTilesX(layout, level) && ok; tx++)
+                {
+                    // the border repeats the neighbouring tiles, clamped
+                    // at the edges of the texture
+                    for(int y = 0; y < side; y++)
+                    {
+                        int sy = std::min(std::max(ty * tile_size + y - border, 0), image.height - 1);
+                        for(int x = 0; x < side; x++)
+                        {
+                            int sx = std::min(std::max(tx * tile_size + x - border, 0), image.width - 1);
+                            memcpy(&tile[(y * side + x) * 4],
+                                   &image.data[((size_t)sy * image.width + sx) * 4], 4);
+                        }
+                    }
+                    ok = fwrite(&tile[0], tile.size(), 1, file) == 1;
+                }
+            }
+        }
+
+        fclose(file);
+        if(!ok) {
+            std::cerr << "Cannot write tile file '" << path << "'" << std::endl;
+        }
+        return ok;
+    }
+
+    // reads tiles from a file written by `writeTileFile'. `ReadTile'
+    // may be called from any thread.
+    class TileFile
+    {
+    private:
+        FILE* _file = NULL;
+        std::mutex _mutex;
+        _layout_t _layout;
+
+    public:
+        TileFile()
+        {
+            memset(&_layout, 0, sizeof(_layout));
+        }
+
+        ~TileFile()
+        {
+            if(_file != NULL) {
+                fclose(_file);
+            }
+        }
+
+        TileFile(const TileFile&) = delete;
+        TileFile& operator=(const TileFile&) = delete;
+
+        bool Open(const char* path)
+        {
+            _file = fopen(path, "rb");
+            if(_file == NULL) {
+                std::cerr << "Cannot open tile file '" << path << "'" << std::endl;
+                return false;
+            }
+            _tile_file_header_t header;
+            if(fread(&header, sizeof(header), 1, _file) != 1 ||
+               memcmp(header.magic, "TPVT", 4) != 0 ||
+               !makeLayout(header.width, header.height, header.tile_size, header.border, _layout))
+            {
+                std::cerr << "Invalid tile file '" << path << "'" << std::endl;
+                fclose(_file);
+                _file = NULL;
+                return false;
+            }
+            return true;
+        }
+
+        // read the RGBA8 pixels of `tile', including its border
+        bool ReadTile(_tile_id_t tile, std::vector<unsigned char>& pixels)
+        {
+            pixels.resize(getTileBytes(_layout));
+            std::lock_guard<std::mutex> lock(_mutex);
+            return _file != NULL &&
+                fseek(_file, (long)getTileOffset(_layout, tile), SEEK_SET) == 0 &&
+                fread(&pixels[0], pixels.size(), 1, _file) == 1;
+        }
+
+        const _layout_t& GetLayout()
+        {
+            return _layout;
+        }
+    };
+
+
+    // --- PAGE TABLE --- //
+
+    const uint16_t VT_SLOT_NONE = 0xffff;
+
+    // the slot of every resident tile. Tiles that are not resident
+    // resolve to their nearest resident ancestor.
+    class PageTable
+    {
+    private:
+        _layout_t _layout;
+        std::vector<std::vector<uint16_t>> _slots;   // per level
+        std::vector<std::vector<uint32_t>> _entries; // resolved, per level
+        bool _dirty = true;
+
+    public:
+        PageTable(const _layout_t& layout)
+            : _layout(layout), _slots(layout.levels), _entries(layout.levels)
+        {
+            for(int level = 0; level < layout.levels; level++)
+            {
+                size_t count = (size_t)getTilesX(layout, level) * getTilesY(layout, level);
+                _slots[level].assign(count, VT_SLOT_NONE);
+                _entries[level].assign(count, 0);
+            }
+        }
+
+        void Map(_tile_id_t tile, uint16_t slot)
+        {
+            int level = getTileLevel(tile);
+            _slots[level][getTileY(tile) * getTilesX(_layout, level) + getTileX(tile)] = slot;
+            _dirty = true;
+        }
+
+        void Unmap(_tile_id_t tile)
+        {
+            Map(tile, VT_SLOT_NONE);
+        }
+
+        uint16_t Find(_tile_id_t tile)
+        {
+            int level = getTileLevel(tile);
+            return _slots[level][getTileY(tile) * getTilesX(_layout, level) + getTileX(tile)];
+        }
+
+        // resolve every tile to the RGBA8 texel of the page table
+        // texture: slot column, slot row, level of the tile used, 255.
+        // Returns false if nothing changed since the last call.
+        bool Build(int slots_per_row)
+        {
+            if(!_dirty) {
+                return false;
+            }
+            for(int level = _layout.levels - 1; level >= 0; level--)
+            {
+                int tiles_x = getTilesX(_layout, level);
+                int tiles_y = getTilesY(_layout, level);
+                bool coarsest = (level == _layout.levels - 1);
+                for(int y = 0; y < tiles_y; y++)
+                {
+                    for(int x = 0; x < tiles_x; x++)
+                    {
+                        uint16_t slot = _slots[level][y * tiles_x + x];
+                        uint32_t& entry = _entries[level][y * tiles_x + x];
+                        if(slot != VT_SLOT_NONE)
+                        {
+                            entry = (uint32_t)(slot % slots_per_row) |
+                                    ((uint32_t)(slot / slots_per_row) << 8) |
+                                    ((uint32_t)level << 16) | 0xff000000u;
+                        }
+                        else if(coarsest) {
+                            entry = 0; // nothing to fall back to yet
+                        }
+                        else {
+                            int parent_x = std::min(x / 2, getTilesX(_layout, level + 1) - 1);
+                            int parent_y = std::min(y / 2, getTilesY(_layout, level + 1) - 1);
+                            entry = _entries[level + 1][parent_y * getTilesX(_layout, level + 1) + parent_x];
+                        }
+                    }
+                }
+            }
+            _dirty = false;
+            return true;
+        }
+
+        // the texels of `level' after `Build', row by row
+        const std::vector<uint32_t>& GetLevel(int level)
+        {
+            return _entries[level];
+        }
+    };
+
+
+    // --- TILE CACHE --- //
+
+    // a fixed number of slots for tiles, of which the least recently
+    // used one is reused first. Pinned slots are never reused.
+    class TileCache
+    {
+    private:
+        typedef struct {
+            _tile_id_t tile;
+            long last_used;  // frame
+            int prev;
+            int next;
+            bool pinned;
+        } _slot_t;
+
+        std::vector<_slot_t> _slots;
+        std::unordered_map<_tile_id_t, int> _lookup;
+        int _head = -1; // most recently used
+        int _tail = -1; // least recently used
+
+        void unlink(int slot)
+        {
+            _slot_t& s = _slots[slot];
+            if(s.prev >= 0) _slots[s.prev].next = s.next; else _head = s.next;
+            if(s.next >= 0) _slots[s.next].prev = s.prev; else _tail = s.prev;
+            s.prev = s.next = -1;
+        }
+
+        void pushFront(int slot)
+        {
+            _slot_t& s = _slots[slot];
+            s.prev = -1;
+            s.next = _head;
+            if(_head >= 0) _slots[_head].prev = slot;
+            _head = slot;
+            if(_tail < 0) _tail = slot;
+        }
+
+    public:
+        TileCache(int slots)
+            : _slots(slots)
+        {
+            for(int i = slots - 1; i >= 0; i--)
+            {
+                _slots[i].tile = VT_TILE_INVALID;
+                _slots[i].last_used = -1;
+                _slots[i].pinned = false;
+                pushFront(i);
+            }
+            _lookup.reserve(slots);
+        }
+
+        // the slot holding `tile', or -1
+        int Find(_tile_id_t tile)
+        {
+            auto it = _lookup.find(tile);
+            return (it == _lookup.end()) ? -1 : it->second;
+        }
+
+        // mark a slot as used in `frame'
+        void Touch(int slot, long frame)
+        {
+            _slots[slot].last_used = frame;
+            if(!_slots[slot].pinned && _head != slot)
+            {
+                unlink(slot);
+                pushFront(slot);
+            }
+        }
+
+        // a slot for `tile', reusing the least recently used one, whose
+        // tile is returned in `evicted' (VT_TILE_INVALID if it was
+        // empty). Tiles used in `frame' are not evicted, so -1 is
+        // returned when the cache is too small for a frame.
+        int Allocate(_tile_id_t tile, long frame, _tile_id_t& evicted)
+        {
+            int slot = _tail;
+            if(slot < 0 || (_slots[slot].last_used == frame && _slots[slot].tile != VT_TILE_INVALID)) {
+                return -1;
+            }
+            evicted = _slots[slot].tile;
+            if(evicted != VT_TILE_INVALID) {
+                _lookup.erase(evicted);
+            }
+            _slots[slot].tile = tile;
+            _lookup[tile] = slot;
+            Touch(slot, frame);
+            return slot;
+        }
+
+        // keep a slot, e.g. for the coarsest level which every tile
+        // falls back to
+        void Pin(int slot)
+        {
+            if(!_slots[slot].pinned)
+            {
+                unlink(slot);
+                _slots[slot].pinned = true;
+            }
+        }
+
+        _tile_id_t GetTile(int slot)
+        {
+            return _slots[slot].tile;
+        }
+
+        int Size()
+        {
+            return _slots.size();
+        }
+    };
+
+
+    // --- RESIDENCY --- //
+
+    typedef struct {
+        long requested; // tiles returned to be loaded
+        long loaded;
+        long evicted;
+        long rejected;  // not loaded as the cache was full for the frame
+    } _residency_stats_t;
+
+    // decides which tiles to load from the feedback of a frame, and
+    // keeps the page table in sync with the cache
+    class Residency
+    {
+    private:
+        _layout_t _layout;
+        PageTable _table;
+        TileCache _cache;
+        std::vector<_tile_id_t> _needed;
+        std::unordered_map<_tile_id_t, long> _pending; // frame requested
+        _residency_stats_t _stats = {0, 0, 0, 0};
+
+    public:
+        Residency(const _layout_t& layout, int slots)
+            : _layout(layout), _table(layout), _cache(slots)
+        {
+        }
+
+        // the tiles of `count' feedback pixels that are not resident and
+        // not being loaded, coarsest first, at most `max_requests'. The
+        // ancestors of every needed tile are needed as well, so there is
+        // always a close fallback. Resident tiles are marked as used.
+        void ProcessFeedback(const uint32_t* pixels, size_t count, long frame,
+                             std::vector<_tile_id_t>& requests, size_t max_requests)
+        {
+            _needed.clear();
+            _tile_id_t previous = VT_TILE_INVALID;
+            for(size_t i = 0; i < count; i++)
+            {
+                _tile_id_t tile = decodeFeedback(pixels[i]);
+                // neighbouring pixels mostly need the same tile
+                if(tile == previous || tile == VT_TILE_INVALID) {
+                    continue;
+                }
+                previous = tile;
+                int level = getTileLevel(tile);
+                if(level >= _layout.levels || getTileX(tile) >= getTilesX(_layout, level) ||
+                   getTileY(tile) >= getTilesY(_layout, level)) {
+                    continue;
+                }
+                _needed.push_back(tile);
+            }
+            std::sort(_needed.begin(), _needed.end());
+            _needed.erase(std::unique(_needed.begin(), _needed.end()), _needed.end());
+
+            // the ancestors of every tile, up to the coarsest level
+            size_t direct = _needed.size();
+            for(size_t i = 0; i < direct; i++)
+            {
+                for(int level = getTileLevel(_needed[i]) + 1; level < _layout.levels; level++)
+                {
+                    int shift = level - getTileLevel(_needed[i]);
+                    _needed.push_back(makeTileId(level, getTileX(_needed[i]) >> shift,
+                                                 getTileY(_needed[i]) >> shift));
+                }
+            }
+            // coarse levels first, as they are shared by many tiles
+            std::sort(_needed.begin(), _needed.end(), std::greater<_tile_id_t>());
+            _needed.erase(std::unique(_needed.begin(), _needed.end()), _needed.end());
+
+            requests.clear();
+            for(_tile_id_t tile : _needed)
+            {
+                int slot = _cache.Find(tile);
+                if(slot >= 0) {
+                    _cache.Touch(slot, frame);
+                }
+                else if(_pending.count(tile) == 0 && requests.size() < max_requests)
+                {
+                    requests.push_back(tile);
+                    _pending[tile] = frame;
+                    _stats.requested++;
+                }
+            }
+        }
+
+        // place a loaded tile in the cache. Returns its slot, or -1 if
+        // every slot is in use by the current frame.
+        int Insert(_tile_id_t tile, long frame, bool pinned = false)
+        {
+            _pending.erase(tile);
+            _tile_id_t evicted;
+            int slot = _cache.Allocate(tile, frame, evicted);
+            if(slot < 0) {
+                _stats.rejected++;
+                return -1;
+            }
+            if(evicted != VT_TILE_INVALID)
+            {
+                _table.Unmap(evicted);
+                _stats.evicted++;
+            }
+            _table.Map(tile, slot);
+            if(pinned) {
+                _cache.Pin(slot);
+            }
+            _stats.loaded++;
+            return slot;
+        }
+
+        // forget a request that could not be loaded, so it is retried
+        void Cancel(_tile_id_t tile)
+        {
+            _pending.erase(tile);
+        }
+
+        size_t GetPendingCount()
+        {
+            return _pending.size();
+        }
+
+        PageTable& GetPageTable()
+        {
+            return _table;
+        }
+
+        TileCache& GetCache()
+        {
+            return _cache;
+        }
+
+        const _residency_stats_t& GetStats()
+        {
+            return _stats;
+        }
+    };
+
+
+    // --- STREAMING --- //
+
+    typedef struct {
+        _tile_id_t tile;
+        bool ok;
+        std::vector<unsigned char> pixels;
+    } _loaded_tile_t;
+
+    // reads requested tiles from a file on a pool of threads
+    class TileStreamer
+    {
+    private:
+        TileFile& _file;
+        std::deque<_loaded_tile_t> _loaded;
+        std::mutex _mutex;
+        std::atomic<bool> _stop;
+
+        // declared last so the workers are joined before anything
+        // they touch is destroyed
+        Threads::ThreadPool _pool;
+
+    public:
+        TileStreamer(TileFile& file, unsigned threads = 2)
+            : _file(file), _stop(false), _pool(threads)
+        {
+        }
+
+        ~TileStreamer()
+        {
+            _stop = true;
+        }
+
+        void Request(_tile_id_t tile)
+        {
+            _pool.Submit([this, tile]() {
+                _loaded_tile_t result;
+                result.tile = tile;
+                result.ok = !_stop && _file.ReadTile(tile, result.pixels);
+
+                std::lock_guard<std::mutex> lock(_mutex);
+                _loaded.push_back(std::move(result));
+            });
+        }
+
+        // take at most `max_tiles' loaded tiles
+        void Poll(std::vector<_loaded_tile_t>& tiles, size_t max_tiles)
+        {
+            tiles.clear();
+            std::lock_guard<std::mutex> lock(_mutex);
+            while(!_loaded.empty() && tiles.size() < max_tiles)
+            {
+                tiles.push_back(std::move(_loaded.front()));
+                _loaded.pop_front();
+            }
+        }
+
+        // block until every requested tile was read
+        void Wait()
+        {
+            _pool.Wait();
+        }
+    };
+
+} // namespace VirtualTextures
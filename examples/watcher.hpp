@@ -0,0 +1,308 @@
+//
+// Shader Watcher
+//
+// Reloads shader programs while the program is running, whenever one
+// of their files (including included files) is saved.
+//
+// A background thread waits for changes to the directories of the
+// files, with inotify on Linux and by checking modification times
+// elsewhere. The rendering thread calls `Update' between frames,
+// which submits the affected programs again and swaps them in once
+// the driver is done, so neither waiting nor compiling blocks a frame
+// when parallel shader compilation is available.
+//
+
+#pragma once
+
+// CUSTOM
+#include "fileIO.hpp"
+#include "shaders.hpp"
+
+// STANDARD
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if defined(__linux__)
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#define WATCHER_INOTIFY
+#endif
+
+
+namespace Watchers
+{
+    // how often the background thread checks whether to stop, and
+    // how often files are checked without inotify
+    const int WATCHER_INTERVAL_MS = 100;
+
+    // a headless build has no GLFW window to post events to
+#ifdef WINDOW_HEADLESS
+    const bool WATCHER_WAKE_EVENTS = false;
+#else
+    const bool WATCHER_WAKE_EVENTS = true;
+#endif
+
+    class ShaderWatcher
+    {
+    private:
+        typedef struct {
+            Shaders::ShaderWrapper* shader;
+            std::vector<std::string> files;
+        } _watched_t;
+
+        // only used by the rendering thread
+        std::vector<_watched_t> _shaders;
+
+        // shared with the background thread
+        std::mutex _mutex;
+        std::set<std::string> _changed;
+        std::map<std::string, FileIO::_file_stamp_t> _stamps;
+        std::atomic<bool> _running;
+        bool _wake_events;
+        std::function<void()> _on_change;
+        std::thread _thread;
+
+#ifdef WATCHER_INOTIFY
+        int _inotify;
+        std::map<int, std::string> _directories; // watch descriptor to directory
+#endif
+
+        void notifyChanged(const std::string& file)
+        {
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+                _changed.insert(file);
+                if(_on_change) {
+                    _on_change();
+                }
+            }
+            // wake up a rendering thread blocked in `WaitEvents'
+            if(_wake_events) {
+                glfwPostEmptyEvent();
+            }
+        }
+
+        void addDirectory(const std::string& directory)
+        {
+#ifdef WATCHER_INOTIFY
+            std::lock_guard<std::mutex> lock(_mutex);
+            const char* path = directory.empty() ? "." : directory.c_str();
+            int wd = inotify_add_watch(_inotify, path,
+                                       IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE);
+            if(wd < 0)
+            {
+                std::cerr << "ShaderWatcher: cannot watch '" << path << "'" << std::endl;
+                return;
+            }
+            _directories[wd] = directory;
+#else
+            (void)directory;
+#endif
+        }
+
+        void addFile(const std::string& file)
+        {
+            FileIO::_file_stamp_t stamp = {0, 0, 0};
+            FileIO::getFileStamp(file.c_str(), stamp);
+
+            bool new_directory = true;
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+                std::string directory = FileIO::getDirectory(file);
+                for(auto& entry : _stamps) {
+                    if(FileIO::getDirectory(entry.first) == directory) {
+                        new_directory = false;
+                    }
+                }
+                _stamps[file] = stamp;
+            }
+            if(new_directory) {
+                addDirectory(FileIO::getDirectory(file));
+            }
+        }
+
+#ifdef WATCHER_INOTIFY
+        void watchLoop()
+        {
+            // large enough for several events with file names
+            alignas(struct inotify_event) char buffer[4096];
+            pollfd fd = {_inotify, POLLIN, 0};
+
+            while(_running)
+            {
+                if(poll(&fd, 1, WATCHER_INTERVAL_MS) <= 0) {
+                    continue;
+                }
+                ssize_t length = read(_inotify, buffer, sizeof(buffer));
+                for(ssize_t offset = 0; offset < length; )
+                {
+                    const struct inotify_event* event =
+                        (const struct inotify_event*)(buffer + offset);
+                    offset += sizeof(struct inotify_event) + event->len;
+                    if(event->len == 0) {
+                        continue;
+                    }
+
+                    std::string file;
+                    {
+                        std::lock_guard<std::mutex> lock(_mutex);
+                        auto it = _directories.find(event->wd);
+                        if(it == _directories.end()) {
+                            continue;
+                        }
+                        file = it->second + event->name;
+                        if(_stamps.count(file) == 0) {
+                            continue; // not a file of a watched program
+                        }
+                    }
+                    notifyChanged(file);
+                }
+            }
+        }
+#else
+        void watchLoop()
+        {
+            while(_running)
+            {
+                std::this_thread::sleep_for(
+                    std::chrono::milliseconds(WATCHER_INTERVAL_MS));
+
+                std::vector<std::string> changed;
+                {
+                    std::lock_guard<std::mutex> lock(_mutex);
+                    for(auto& entry : _stamps)
+                    {
+                        FileIO::_file_stamp_t stamp;
+                        if(FileIO::getFileStamp(entry.first.c_str(), stamp) &&
+                           !(stamp == entry.second))
+                        {
+                            entry.second = stamp;
+                            changed.push_back(entry.first);
+                        }
+                    }
+                }
+                for(const std::string& file : changed) {
+                    notifyChanged(file);
+                }
+            }
+        }
+#endif
+
+        static bool contains(const std::vector<std::string>& files,
+                             const std::set<std::string>& changed)
+        {
+            for(const std::string& file : files) {
+                if(changed.count(file)) {
+                    return true;
+                }
+            }
+            return false;
+        }
+
+    public:
+        // with `wake_events', a change wakes up the rendering thread
+        // if it is blocked in `glfwWaitEvents'
+        ShaderWatcher(bool wake_events = WATCHER_WAKE_EVENTS)
+            : _running(true), _wake_events(wake_events)
+        {
+#ifdef WATCHER_INOTIFY
+            _inotify = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+            if(_inotify < 0) {
+                std::cerr << "ShaderWatcher: inotify is not available" << std::endl;
+                _running = false;
+                return;
+            }
+#endif
+            _thread = std::thread(&ShaderWatcher::watchLoop, this);
+        }
+
+        ~ShaderWatcher()
+        {
+            _running = false;
+            if(_thread.joinable()) {
+                _thread.join();
+            }
+#ifdef WATCHER_INOTIFY
+            if(_inotify >= 0) {
+                close(_inotify);
+            }
+#endif
+        }
+
+        ShaderWatcher(const ShaderWatcher&) = delete;
+        ShaderWatcher& operator=(const ShaderWatcher&) = delete;
+
+        // called on the background thread when a file changed, before
+        // the rendering thread is woken up, e.g. to request a redraw, so
+        // that `Update' is called also when nothing else happens
+        void SetChangeCallback(std::function<void()> callback)
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _on_change = callback;
+        }
+
+        // reload `shader' whenever one of its files changes. The shader
+        // must outlive the watcher.
+        void Watch(Shaders::ShaderWrapper& shader)
+        {
+            _watched_t watched = {&shader, shader.GetFiles()};
+            for(const std::string& file : watched.files) {
+                addFile(file);
+            }
+            _shaders.push_back(watched);
+        }
+
+        // whether a program is being rebuilt, so `Update' should be
+        // called again soon, even if nothing else happens
+        bool IsReloading()
+        {
+            for(_watched_t& watched : _shaders) {
+                if(watched.shader->IsReloading()) {
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        // should be called by the rendering thread between frames.
+        // Starts reloading the programs with changed files, and swaps in
+        // those that are done. Returns the number of programs swapped.
+        int Update()
+        {
+            std::set<std::string> changed;
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+                changed.swap(_changed);
+            }
+
+            int swapped = 0;
+            for(_watched_t& watched : _shaders)
+            {
+                if(!changed.empty() && contains(watched.files, changed)) {
+                    watched.shader->Reload();
+                }
+                if(watched.shader->UpdateReload())
+                {
+                    swapped++;
+
+                    // an include may have been added or removed
+                    watched.files = watched.shader->GetFiles();
+                    for(const std::string& file : watched.files) {
+                        addFile(file);
+                    }
+                }
+            }
+            return swapped;
+        }
+    };
+
+} // namespace Watchers
@@ -4,6 +4,10 @@
 //
 // Create and manage OpenGL (GLFW) drawing windows.
 //
+// Building with WINDOW_HEADLESS defined adds `HeadlessWindow', which
+// renders offscreen through EGL without a display, and makes it the
+// `DefaultWindow' used by the benchmarks. Link with -lEGL.
+//
 
 #pragma once
 
@@ -16,14 +20,25 @@
 // GLFW
 #include <GLFW/glfw3.h>
 
+// EGL
+#ifdef WINDOW_HEADLESS
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#endif
+
 // GLM
 #include <glm/glm.hpp>
 
 // CUSTOM LIBRARIES
+#include "memory.hpp"
+#include "state.hpp"
 #include "system.hpp"
 
 // STANDARD LIBRARIES
+#include <atomic>
+#include <chrono>
 #include <iostream>
+#include <thread>
 
 // valid openGL function signature for key callback functions
 typedef void (*_key_callback_func)        (GLFWwindow* win,int key,int scancode,
@@ -138,7 +153,7 @@ namespace Windows
         int _width;
         int _height;
 
-        GLFWwindow* _window;
+        GLFWwindow* _window = NULL;
         as_ratio_t _as_ratio;
 
         bool _is_minimized = false;
@@ -147,6 +162,56 @@ namespace Windows
 
         unsigned long _clear_bits = GL_COLOR_BUFFER_BIT;
 
+        unsigned long _events = 0;
+        _key_callback_func _key_callback = NULL;
+
+        static void countEvent(GLFWwindow* window)
+        {
+            BaseWindow* wrapper = (BaseWindow*)glfwGetWindowUserPointer(window);
+            if(wrapper != NULL) {
+                wrapper->_events++;
+            }
+        }
+
+        static void keyEvent(GLFWwindow* window, int key, int scancode, int action, int mode)
+        {
+            countEvent(window);
+            BaseWindow* wrapper = (BaseWindow*)glfwGetWindowUserPointer(window);
+            if(wrapper != NULL && wrapper->_key_callback != NULL) {
+                wrapper->_key_callback(window, key, scancode, action, mode);
+            }
+        }
+
+        // count every event that may change what is shown, including
+        // resizes and parts of the window that need to be redrawn.
+        // Called by the subclasses once the window is created.
+        void registerEventCallbacks()
+        {
+            glfwSetWindowUserPointer(_window, this);
+            glfwSetKeyCallback(_window, keyEvent);
+            glfwSetCharCallback(_window, [](GLFWwindow* window, unsigned int) {
+                countEvent(window);
+            });
+            glfwSetMouseButtonCallback(_window, [](GLFWwindow* window, int, int, int) {
+                countEvent(window);
+            });
+            glfwSetCursorPosCallback(_window, [](GLFWwindow* window, double, double) {
+                countEvent(window);
+            });
+            glfwSetScrollCallback(_window, [](GLFWwindow* window, double, double) {
+                countEvent(window);
+            });
+            glfwSetFramebufferSizeCallback(_window, [](GLFWwindow* window, int, int) {
+                countEvent(window);
+            });
+            glfwSetWindowRefreshCallback(_window, [](GLFWwindow* window) {
+                countEvent(window);
+            });
+            glfwSetWindowFocusCallback(_window, [](GLFWwindow* window, int) {
+                countEvent(window);
+            });
+        }
+
     public:
         // universal destructor, de-allocating the window resources
         virtual ~BaseWindow()
@@ -161,15 +226,20 @@ namespace Windows
             return _window;
         }
 
-        std::string GetTitle()
+        // valid until the title is changed
+        const char* GetTitle()
         {
-            return _title;
+            return _title.c_str();
         }
 
-        void SetTitle(std::string new_title)
+        // reuses the memory of the previous title if it fits, so a
+        // title formatted in the frame arena does not allocate
+        void SetTitle(const char* new_title)
         {
-            _title = new_title;
-            glfwSetWindowTitle(_window, _title.c_str());
+            _title.assign(new_title);
+            if(_window != NULL) {
+                glfwSetWindowTitle(_window, _title.c_str());
+            }
         }
 
         int GetWidth()
@@ -182,26 +252,34 @@ namespace Windows
             return _height;
         }
 
-        bool IsRunning()
+        virtual bool IsRunning()
         {
             return !glfwWindowShouldClose(_window);
         }
 
         // this function does not actually close the window,
         // but marks it as 'ready to close'
-        void CloseWindow()
+        virtual void CloseWindow()
         {
             glfwSetWindowShouldClose(_window, GL_TRUE);
         }
 
+        // seconds since the window was created
+        virtual double GetTime()
+        {
+            return glfwGetTime();
+        }
+
 
         // --- RENDERING METHODS --- //
 
         // Double buffering, should be done at the end of each
         // iteration of the rendering loop
-        void SwapBuffers()
+        virtual void SwapBuffers()
         {
             glfwSwapBuffers(_window);
+            States::getState().EndFrame();
+            Memory::getFrameArena().Reset();
         }
 
         // clear the window to prevent artifacts from the previous
@@ -211,6 +289,14 @@ namespace Windows
             glClear(_clear_bits);
         }
 
+        // render to the window again after rendering to a texture,
+        // restoring the viewport of the window
+        void UseDefaultFramebuffer()
+        {
+            glBindFramebuffer(GL_FRAMEBUFFER, States::getState().GetDefaultFramebuffer());
+            glViewport(0, 0, _width, _height);
+        }
+
         void SetClearColor(GLfloat r, GLfloat g, GLfloat b)
         {
             glClearColor(r, g, b, 1.0f);
@@ -227,14 +313,8 @@ namespace Windows
 
         void SwitchWireframeMode()
         {
-            if(_wireframe) {
-                glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
-            }
-            else {
-                glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
-            }
-
             _wireframe = !_wireframe;
+            States::getState().PolygonMode(_wireframe ? GL_LINE : GL_FILL);
         }
 
 
@@ -243,23 +323,37 @@ namespace Windows
         // this method adds any incoming events to openGL's
         // event queue. Should be called at the start of every
         // iteration of the game loop
-        void PollEvents()
+        virtual void PollEvents()
         {
             glfwPollEvents();
         }
 
         // this method does the same as the above, except
         // here the main thread is blocked until any event is received
-        void WaitEvents()
+        virtual void WaitEvents()
         {
             glfwWaitEvents();
         }
 
+        // same as above, but returns after at most `seconds' even if
+        // no event is received, e.g. to sleep until a frame is due
+        virtual void WaitEventsTimeout(double seconds)
+        {
+            glfwWaitEventsTimeout(seconds);
+        }
+
         // use the provided function as primary key callback function
         // the function *must* not be instantiated.
         void SetKeyCallback(_key_callback_func func)
         {
-            glfwSetKeyCallback(_window, func);
+            _key_callback = func;
+        }
+
+        // events received so far, e.g. to tell whether anything happened
+        // since the last frame. Always 0 for a headless window.
+        unsigned long GetEventCount()
+        {
+            return _events;
         }
 
 
@@ -303,6 +397,7 @@ namespace Windows
             // activating the window within the current thread,
             // should be done from the main thread
             glfwMakeContextCurrent(_window);
+            registerEventCallbacks();
 
             // tell OpenGL the size of the rendering window
             // this information is retrieved from GLFW
@@ -355,6 +450,7 @@ namespace Windows
             // activating the window within the current thread,
             // should be done from the main thread
             glfwMakeContextCurrent(_window);
+            registerEventCallbacks();
 
             // tell OpenGL the size of the rendering window
             // this information is retrieved from GLFW
@@ -369,4 +465,213 @@ namespace Windows
         ~FullscreenWindow() {}
     };
 
+
+#ifdef WINDOW_HEADLESS
+    // seconds `WaitEvents' sleeps on a headless window
+    const double HEADLESS_WAIT_TIME = 0.01;
+
+    // an OpenGL context without a window or display, e.g. on Mesa's
+    // software rasterizer on a build machine. Renders into a
+    // framebuffer object of the size of the window, which is bound
+    // wherever the window's default framebuffer would be.
+    // There are no events, so the window runs until it is closed, also
+    // from another thread, or until `SetFrameLimit' frames were swapped.
+    class HeadlessWindow : public BaseWindow
+    {
+    private:
+        EGLDisplay _display = EGL_NO_DISPLAY;
+        EGLContext _context = EGL_NO_CONTEXT;
+        GLuint _fbo = 0;
+        GLuint _color = 0;
+        GLuint _depth = 0;
+
+        std::atomic<bool> _running{true};
+        long _frames = 0;
+        long _frame_limit = 0;
+        std::chrono::steady_clock::time_point _start;
+
+        // the surfaceless platform of Mesa needs neither a display
+        // server nor a GPU, other platforms may still work without one
+        static EGLDisplay getDisplay()
+        {
+            PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay =
+                (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+            if(getPlatformDisplay != NULL)
+            {
+                EGLDisplay display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA,
+                                                        EGL_DEFAULT_DISPLAY, NULL);
+                if(display != EGL_NO_DISPLAY && eglInitialize(display, NULL, NULL)) {
+                    return display;
+                }
+            }
+            EGLDisplay display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+            if(display != EGL_NO_DISPLAY && eglInitialize(display, NULL, NULL)) {
+                return display;
+            }
+            return EGL_NO_DISPLAY;
+        }
+
+        bool createContext()
+        {
+            _display = getDisplay();
+            if(_display == EGL_NO_DISPLAY || !eglBindAPI(EGL_OPENGL_API))
+            {
+                std::cerr << "Failed to initialize EGL" << std::endl;
+                return false;
+            }
+
+            // a config is only needed by implementations without
+            // EGL_KHR_no_config_context
+            const EGLint config_attribs[] = {
+                EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+                EGL_NONE
+            };
+            EGLConfig config = EGL_NO_CONFIG_KHR;
+            EGLint configs = 0;
+            eglChooseConfig(_display, config_attribs, &config, 1, &configs);
+            if(configs == 0) {
+                config = EGL_NO_CONFIG_KHR;
+            }
+
+            const EGLint context_attribs[] = {
+                EGL_CONTEXT_MAJOR_VERSION, 3,
+                EGL_CONTEXT_MINOR_VERSION, 3,
+                EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+                EGL_NONE
+            };
+            _context = eglCreateContext(_display, config, EGL_NO_CONTEXT, context_attribs);
+            if(_context == EGL_NO_CONTEXT ||
+               !eglMakeCurrent(_display, EGL_NO_SURFACE, EGL_NO_SURFACE, _context))
+            {
+                std::cerr << "Failed to create a surfaceless EGL context" << std::endl;
+                return false;
+            }
+            return true;
+        }
+
+        void createFramebuffer()
+        {
+            glGenRenderbuffers(1, &_color);
+            glBindRenderbuffer(GL_RENDERBUFFER, _color);
+            glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, _width, _height);
+            glGenRenderbuffers(1, &_depth);
+            glBindRenderbuffer(GL_RENDERBUFFER, _depth);
+            glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, _width, _height);
+            glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+            glGenFramebuffers(1, &_fbo);
+            glBindFramebuffer(GL_FRAMEBUFFER, _fbo);
+            glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+                                      GL_RENDERBUFFER, _color);
+            glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT,
+                                      GL_RENDERBUFFER, _depth);
+            if(glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+                std::cerr << "Headless framebuffer is not complete" << std::endl;
+            }
+            States::getState().SetDefaultFramebuffer(_fbo);
+        }
+
+    public:
+        HeadlessWindow(const char* title, int width, as_ratio_t aspect)
+        {
+            _start = std::chrono::steady_clock::now();
+            _width = width;
+            _height = get_aspect_ratio_height(_width, aspect);
+            _title = title;
+            if(!createContext())
+            {
+                _running = false;
+                return;
+            }
+
+            // glewInit also initializes GLX, which fails without a display
+            glewExperimental = GL_TRUE;
+            if(glewContextInit() != GLEW_OK) {
+                std::cout << "Failed to initialize GLEW" << std::endl;
+            }
+
+            createFramebuffer();
+            glViewport(0, 0, _width, _height);
+        }
+
+        ~HeadlessWindow()
+        {
+            if(_context != EGL_NO_CONTEXT)
+            {
+                glDeleteFramebuffers(1, &_fbo);
+                glDeleteRenderbuffers(1, &_color);
+                glDeleteRenderbuffers(1, &_depth);
+                States::getState().SetDefaultFramebuffer(0);
+                eglMakeCurrent(_display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+                eglDestroyContext(_display, _context);
+            }
+            if(_display != EGL_NO_DISPLAY) {
+                eglTerminate(_display);
+            }
+        }
+
+        // stop running after `frames' frames, 0 for no limit
+        void SetFrameLimit(long frames)
+        {
+            _frame_limit = frames;
+        }
+
+        long GetFrames()
+        {
+            return _frames;
+        }
+
+        // the framebuffer object that is rendered to, e.g. to read from
+        GLuint GetFramebuffer()
+        {
+            return _fbo;
+        }
+
+        bool IsRunning() override
+        {
+            return _running && (_frame_limit == 0 || _frames < _frame_limit);
+        }
+
+        void CloseWindow() override
+        {
+            _running = false;
+        }
+
+        double GetTime() override
+        {
+            std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - _start;
+            return elapsed.count();
+        }
+
+        // nothing to present, but the frame ends as for other windows
+        void SwapBuffers() override
+        {
+            _frames++;
+            States::getState().EndFrame();
+            Memory::getFrameArena().Reset();
+        }
+
+        void PollEvents() override
+        {
+        }
+
+        // no event will ever arrive, but another thread may still
+        // request a frame or close the window, so only sleep a little
+        // instead of blocking, or spinning
+        void WaitEvents() override
+        {
+            std::this_thread::sleep_for(std::chrono::duration<double>(HEADLESS_WAIT_TIME));
+        }
+
+        void WaitEventsTimeout(double seconds) override
+        {
+            std::this_thread::sleep_for(std::chrono::duration<double>(seconds));
+        }
+    };
+
+    typedef HeadlessWindow DefaultWindow;
+#else
+    typedef WindowedWindow DefaultWindow;
+#endif // WINDOW_HEADLESS
+
 } // namespace Window